@@ -18,19 +18,138 @@
 // Pendulum Example Application
 // Program Options:
 //   --help                   Print help messages
+//   --command arg            Command (archive, verify or export)
+//   --format arg             Export format (mbox or tar)
+//   --output arg             Export output file (default standard output)
+//   --zstd                   Compress export with zstd.
+//   --update-manifest        Verify adds files not in checksum manifests to them.
 //   -c [ --config ] arg      Config File Name
+//   --accounts arg           Run as daemon archiving every account in multi-account config file
+//   --archive-workers arg    Daemon archive worker threads
 //   -s [ --server ] arg      IMAP Server URL and port
 //   -u [ --user ] arg        Account username
 //   -p [ --password ] arg    User password
 //   -m [ --mailbox ] arg     Mailbox name
 //   -d [ --destination ] arg Destination for archived e-mail
 //   --poll arg               Poll time in minutes
+//   --poll-max arg           Adaptive polling longest interval in minutes
+//   --priority arg           Mailbox priorities (pattern=priority list)
+//   --spares arg             Spare logged in connections kept ready
 //   -r [ --retry ] arg       Server reconnect retry count
+//   --attachments arg        Extract attachments to store folder
+//   --workers arg            Attachment extraction, verify and export worker threads
+//   --maxsize arg            Skip messages larger than size in MB
+//   --since arg              Only archive mail since date (YYYY-MM-DD)
+//   --exclude arg            Excluded sender list (wildcards allowed)
+//   --metrics arg            Export metrics to Prometheus text file
+//   --metrics-interval arg   Metrics export interval in seconds
+//   --trace arg              Write span trace to Chrome trace JSON file
+//   --log-level arg          Log level (debug, info, warning, error)
+//   --progress arg           Progress report interval in seconds
+//   --progress-fd arg        Write progress JSON line events to file descriptor
+//   --connections arg        Daemon connections per account
+//   --bandwidth arg          Bandwidth limit profiles (e.g. Mon-Fri 08:00-18:00=2M)
 //   -u [ --updates ]         Search since last file archived.
 //   -a [ --all ]             Download files for all mailboxes.
+//   --zerocopy               Use zero-copy/arena response parser.
+//   --plan                   Report what archiving would fetch (nothing archived).
+//   --log-json               Log as JSON lines.
 //
 // Note: MIME encoded words in the email subject line are decoded to the best ASCII fit
 // available.
+//
+// Archive policy rules (--maxsize, --since, --exclude) are added to the UID SEARCH for
+// each mailbox where IMAP can express them; any that can't (wildcard sender exclusions)
+// are applied to a bulk envelope/size prefetch so that only bodies of messages that
+// pass are downloaded.
+//
+// If an attachment store is given then after each .eml file is created it is queued to
+// a pool of workers that decode its attachments into the store (content addressed so
+// each distinct attachment is stored once) and write a manifest next to the .eml file.
+//
+// If a metrics file is given, command latency histograms, byte/message counters and
+// queue/arena gauges are written to it in Prometheus text format every interval (for
+// the node exporter textfile collector) and a summary is output on exit.
+//
+// If a trace file is given, server connects, IMAP commands, response parsing, subject
+// decoding and .eml file creation are recorded as spans per thread and written as a
+// Chrome trace JSON file that can be opened in Perfetto (ui.perfetto.dev).
+//
+// Status output is queued to a background logger thread and written in batches;
+// with --log-json each line is a JSON object carrying level, time and fields such
+// as mailbox, uid, bytes and fetch latency.
+//
+// If a progress interval is given, every mailbox is searched (and message sizes
+// fetched) before any are archived so that each pass knows its total messages and
+// bytes; percent complete, smoothed messages/s and MB/s and an ETA for the current
+// mailbox and the pass are then logged every interval. If a progress file descriptor
+// is given (QtPendulum passes one) the same progress is written to it every second as
+// JSON line events ("mailbox", "progress" and "pass_complete").
+//
+// If an accounts file is given the program runs as a daemon archiving every account
+// (section) in it on one shared pool of archive workers. Options outside any section
+// apply to every account and each account is polled at its own interval (scheduled on
+// a timer wheel). Mailboxes are archived in slices handed out round robin across the
+// accounts, at most --connections at a time per account, so one huge account cannot
+// starve the rest. SIGTERM/SIGINT stop it once the slices being archived complete.
+//
+// Each server has an adaptive (AIMD) concurrency controller: in daemon mode the
+// connections the accounts on a server may have at once (up to the sum of their
+// --connections) grow while FETCH latency stays near its baseline and are cut when
+// latency climbs, the server throttles ([THROTTLED], [LIMIT], [UNAVAILABLE], "too
+// many connections" etc.) or a connection is lost. A throttled command is retried
+// after a pacing delay that doubles with each throttle and decays as commands succeed.
+//
+// If bandwidth profiles are given, bytes read from the server by every connection are
+// charged to one token bucket whose rate depends on the day and time (comma separated
+// [days] [HH:MM-HH:MM]=rate rules, first match wins, rate in bytes/s with a K/M/G suffix,
+// unlimited or pause). The measured read rate is exported and logged while limited.
+//
+// The messages found in each mailbox are journaled in its archive folder along with
+// each one committed and .eml files are written under a partial name then renamed;
+// if a run dies part way through a mailbox the next removes any partial files and
+// resumes the journaled plan without searching again or refetching what was archived.
+//
+// If a longest poll interval (--poll-max) is given as well as a poll time, polling is
+// per mailbox: each mailbox's arrival rate is learned (and saved in the destination
+// folder) and busy mailboxes are polled every --poll minutes while quiet ones back off
+// exponentially up to --poll-max. Every mailbox is polled on the first pass. Each poll
+// cycle logs the mailboxes polled, skipped and found empty (wasted SELECT/SEARCH).
+//
+// Mailboxes are archived a slice (250 messages) at a time highest priority first,
+// priorities coming from the first of a list of pattern=priority rules a mailbox name
+// matches (by default INBOX then sent mail first), so a huge low priority mailbox is
+// interleaved with the rest rather than holding them up. While polling, a mailbox of
+// higher priority than a backfill is searched again between slices each poll interval.
+//
+// If spare connections are asked for, that many logged in connections to the server are
+// kept ready in the background (checked with NOOP if idle, replaced before the server's
+// autologout) and a dropped connection is replaced by one instead of a fresh TLS
+// handshake and LOGIN. Connect latency is logged with each connect and exported.
+//
+// With --plan nothing is archived: each mailbox is EXAMINEd (read only), its message
+// count taken from STATUS and the messages an archive would fetch found by the same
+// search and policy, with their sizes from RFC822.SIZE (a spread sample of sizes for
+// mailboxes over 20000 messages). A few messages are fetched whole to measure bandwidth,
+// attachment deduplication and compression; the report gives messages and bytes per
+// mailbox and the estimated archive size and time at the measured round trip.
+//
+// Each .eml file's SHA-256 is appended to a checksum manifest in its mailbox folder as
+// it is committed. The verify command (pendulum verify -d archive) checks every folder
+// under the destination against its manifest on --workers threads (work stealing, files
+// memory mapped) reporting files changed, missing or not in the manifest; if server
+// options are given the UIDs archived for each mailbox are also compared with the
+// server's, messages the archiver skips on purpose (excluded by the archive policy or
+// empty) being reported apart from those missing. It exits with an error if any
+// problem is found. Files not in a manifest are only reported (an archive written
+// before manifests were kept has none) and with --update-manifest they are hashed and
+// added to it, seeding the manifests of an old archive.
+//
+// The export command (pendulum export -d archive -m mailboxes --format mbox|tar [--zstd]
+// [--output file]) streams the .eml files of the given mailbox folders in UID order as
+// one mbox (mboxrd) or tar, zstd compressed if asked (and built with zstd), to a file
+// or standard output (log output then goes to standard error). --workers threads read
+// files ahead while a single writer keeps the output in order.
 // 
 // Dependencies: 
 // 
@@ -51,6 +170,19 @@
 #include <thread>
 #include <chrono>
 #include <stdexcept>
+#include <memory>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+
+//
+// Linux
+//
+
+#include <fcntl.h>
+#include <unistd.h>
 
 //
 // Antik Classes
@@ -70,6 +202,21 @@
 #include "Pendulum_CommandLine.hpp"
 #include "Pendulum_MailBox.hpp"
 #include "Pendulum_File.hpp"
+#include "Pendulum_Attachments.hpp"
+#include "Pendulum_Policy.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Trace.hpp"
+#include "Pendulum_Log.hpp"
+#include "Pendulum_Progress.hpp"
+#include "Pendulum_Daemon.hpp"
+#include "Pendulum_Bandwidth.hpp"
+#include "Pendulum_Journal.hpp"
+#include "Pendulum_PollSchedule.hpp"
+#include "Pendulum_Priority.hpp"
+#include "Pendulum_SparePool.hpp"
+#include "Pendulum_Plan.hpp"
+#include "Pendulum_Verify.hpp"
+#include "Pendulum_Export.hpp"
 
 // =========
 // NAMESPACE
@@ -84,6 +231,8 @@ namespace Pendulum {
     using namespace Pendulum_CommandLine;
     using namespace Pendulum_MailBox;
     using namespace Pendulum_File;
+    using namespace Pendulum_Attachments;
+    using namespace Pendulum_Policy;
 
     using namespace Antik::IMAP;
     using namespace Antik::Util;
@@ -99,13 +248,454 @@ namespace Pendulum {
 
     static void exitWithError(const std::string errMsg) {
 
-        // Display error and exit.
+        // Write final metrics and trace (if enabled), display error and exit.
 
-        std::cerr << errMsg << std::endl;
+        try {
+            Pendulum_Metrics::stopExporter();
+            Pendulum_Trace::stopTracing();
+            Pendulum_Progress::stopReporter();
+        } catch (const std::exception& e) {
+            Pendulum_Log::error(e.what());
+        }
+
+        Pendulum_Log::error(errMsg);
         exit(EXIT_FAILURE);
 
     }
 
+    //
+    // Plan archiving the account given by the options (nothing is archived).
+    //
+
+    static void planAccount(const PendulumOptions& optionData) {
+
+        ServerConnection imapConnection;
+
+        imapConnection.server->setServer(optionData.serverURL);
+        imapConnection.server->setUserAndPassword(optionData.userName, optionData.userPassword);
+        imapConnection.retryCount = optionData.retryCount;
+        imapConnection.bZeroCopy = optionData.bZeroCopy;
+
+        Pendulum_Log::info("Connecting to server [" + imapConnection.server->getServer() + "]");
+
+        serverConnect(imapConnection);
+
+        std::vector<MailBoxDetails> mailBoxList { fetchMailBoxList(imapConnection, optionData.mailBoxList,
+                                                                   optionData.ignoreList, optionData.bAllMailBoxes) };
+
+        Pendulum_Plan::AccountPlan accountPlan { Pendulum_Plan::planAccount(imapConnection, mailBoxList, optionData) };
+
+        Pendulum_Log::info("Archive plan:\n" + Pendulum_Plan::formatPlan(accountPlan, !optionData.attachmentFolder.empty()),
+                           Pendulum_Log::Fields().withCount(accountPlan.archiveMessages).withBytes(accountPlan.archiveBytes));
+
+        Pendulum_Log::info("Disconnecting from server [" + optionData.serverURL + "]");
+
+        imapConnection.server->disconnect();
+
+    }
+
+    //
+    // Verify the archive in the destination folder (and against the server if one is given).
+    //
+
+    static void verifyArchive(const PendulumOptions& optionData) {
+
+        std::size_t workerCount = (optionData.workerCount > 0) ? optionData.workerCount : std::thread::hardware_concurrency();
+
+        Pendulum_Log::info("Verifying archive [" + optionData.destinationFolder + "]",
+                           Pendulum_Log::Fields().withFile(optionData.destinationFolder));
+
+        Pendulum_Verify::VerifyResults results { Pendulum_Verify::verifyArchive(optionData.destinationFolder, workerCount, optionData.bUpdateManifest) };
+
+        if (!optionData.serverURL.empty()) {
+
+            ServerConnection imapConnection;
+
+            imapConnection.server->setServer(optionData.serverURL);
+            imapConnection.server->setUserAndPassword(optionData.userName, optionData.userPassword);
+            imapConnection.retryCount = optionData.retryCount;
+            imapConnection.bZeroCopy = optionData.bZeroCopy;
+
+            Pendulum_Log::info("Connecting to server [" + imapConnection.server->getServer() + "]");
+
+            serverConnect(imapConnection);
+
+            std::vector<MailBoxDetails> mailBoxList { fetchMailBoxList(imapConnection, optionData.mailBoxList,
+                                                                       optionData.ignoreList, optionData.bAllMailBoxes) };
+            ArchivePolicy archivePolicy { createArchivePolicy(optionData.maxSizeMB, optionData.sinceDate, optionData.excludeList) };
+
+            Pendulum_Verify::compareWithServer(imapConnection, mailBoxList, optionData.destinationFolder, archivePolicy,
+                                               buildSearchCriteria(archivePolicy), results);
+
+            Pendulum_Log::info("Disconnecting from server [" + optionData.serverURL + "]");
+
+            imapConnection.server->disconnect();
+
+        }
+
+        Pendulum_Log::info(Pendulum_Verify::formatResults(results), Pendulum_Log::Fields().withCount(results.files).withBytes(results.bytes));
+
+        if (Pendulum_Verify::hasProblems(results)) {
+            throw std::runtime_error("Archive verification failed.");
+        }
+
+    }
+
+    //
+    // Export the archive's mailbox folders given by the options to the output file
+    // (or standard output).
+    //
+
+    static void exportArchive(const PendulumOptions& optionData) {
+
+        std::size_t readerCount = (optionData.workerCount > 0) ? optionData.workerCount : std::thread::hardware_concurrency();
+        Pendulum_Export::Format format { Pendulum_Export::formatFromName(optionData.exportFormat) };
+        std::vector<std::string> mailBoxFolders;
+        std::istringstream mailBoxStream { optionData.mailBoxList };
+
+        for (std::string mailBoxName; std::getline(mailBoxStream, mailBoxName, ',');) {
+            std::string mailBoxFolder { Pendulum_File::mailBoxFolderName(mailBoxName) };
+            if (!mailBoxFolder.empty()) {
+                mailBoxFolders.push_back(mailBoxFolder);
+            }
+        }
+
+        // Export to standard output moves anything else written to it to standard error
+
+        int outputFD { -1 };
+
+        if (optionData.exportFileName.empty() || (optionData.exportFileName == "-")) {
+            outputFD = ::dup(STDOUT_FILENO);
+            if ((outputFD >= 0) && (::dup2(STDERR_FILENO, STDOUT_FILENO) < 0)) {
+                ::close(outputFD);
+                outputFD = -1;
+            }
+        } else {
+            outputFD = ::open(optionData.exportFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }
+
+        if (outputFD < 0) {
+            throw std::runtime_error("Could not open export output: " + std::string(std::strerror(errno)));
+        }
+
+        Pendulum_Export::ExportResults results;
+
+        try {
+            results = Pendulum_Export::exportMailBoxes(optionData.destinationFolder, mailBoxFolders, format,
+                                                       optionData.bZstd, outputFD, readerCount);
+        } catch (...) {
+            ::close(outputFD);
+            throw;
+        }
+
+        if (::close(outputFD) != 0) {
+            throw std::runtime_error("Export output close failed: " + std::string(std::strerror(errno)));
+        }
+
+        Pendulum_Log::info("Exported = " + std::to_string(results.messages)
+                           + ", bytes read = " + std::to_string(results.bytesRead)
+                           + ", bytes written = " + std::to_string(results.bytesWritten)
+                           + ", unreadable = " + std::to_string(results.unreadable)
+                           + ", rejected = " + std::to_string(results.rejected),
+                           Pendulum_Log::Fields().withCount(results.messages).withBytes(results.bytesWritten));
+
+        if (results.unreadable || results.rejected) {
+            throw std::runtime_error("Export incomplete (" + std::to_string(results.unreadable) + " files could not be read, "
+                                     + std::to_string(results.rejected) + " could not be written).");
+        }
+
+    }
+
+    //
+    // Archive the account given by the options; if a poll time is given every poll
+    // interval until killed.
+    //
+
+    static void archiveAccount(const PendulumOptions& optionData) {
+
+        ServerConnection imapConnection;
+        std::vector<MailBoxDetails> mailBoxList;
+
+        // Start progress reporting
+
+        bool bProgress { (optionData.progressInterval > 0) || (optionData.progressFD >= 0) };
+
+        if (bProgress) {
+            if (optionData.progressFD >= 0) {
+                ::signal(SIGPIPE, SIG_IGN);     // Front end exiting must not kill archiving
+            }
+            Pendulum_Progress::startReporter(std::chrono::seconds(optionData.progressInterval), optionData.progressFD);
+        }
+
+        Pendulum_Metrics::Counter& passCount { Pendulum_Metrics::counter("pendulum_passes_total", "Archive passes completed.") };
+        Pendulum_Metrics::Gauge& lastPassTime { Pendulum_Metrics::gauge("pendulum_last_pass_timestamp_seconds", "Unix time last archive pass completed.") };
+        Pendulum_Metrics::Counter& messagesFound { Pendulum_Metrics::counter("pendulum_messages_found_total", "New messages found by mailbox searches.") };
+        Pendulum_Metrics::Gauge& attachmentQueueDepth { Pendulum_Metrics::gauge("pendulum_attachment_queue_depth", "Messages queued for attachment extraction.") };
+
+        // Set mail account user name and password
+
+        imapConnection.server->setServer(optionData.serverURL);
+        imapConnection.server->setUserAndPassword(optionData.userName, optionData.userPassword);
+        
+        // Create archive policy and its server side search criteria
+
+        ArchivePolicy archivePolicy { createArchivePolicy(optionData.maxSizeMB, optionData.sinceDate, optionData.excludeList) };
+        std::string policySearchCriteria { buildSearchCriteria(archivePolicy) };
+
+        // Create attachment extraction stage if requested
+
+        std::unique_ptr<AttachmentExtractor> attachmentExtractor;
+
+        if (!optionData.attachmentFolder.empty()) {
+            std::size_t workerCount = (optionData.workerCount > 0) ? optionData.workerCount : std::thread::hardware_concurrency();
+            attachmentExtractor = std::make_unique<AttachmentExtractor>(optionData.attachmentFolder, workerCount);
+        }
+
+        // Set retry count, response parser and concurrency control (pacing only with one connection)
+        
+        imapConnection.retryCount = optionData.retryCount;
+        imapConnection.bZeroCopy = optionData.bZeroCopy;
+        imapConnection.concurrency = std::make_shared<Pendulum_Concurrency::Controller>(optionData.serverURL, 1);
+
+        // Mailbox priorities
+
+        std::vector<Pendulum_Priority::PriorityRule> priorityRules { Pendulum_Priority::parsePriorities(optionData.priorityList) };
+
+        // Per mailbox poll scheduling (every mailbox each poll unless --poll-max given)
+
+        std::unique_ptr<Pendulum_PollSchedule::PollScheduler> pollScheduler;
+
+        if (optionData.pollTime) {
+            pollScheduler = std::make_unique<Pendulum_PollSchedule::PollScheduler>(optionData.destinationFolder,
+                                                                                    std::chrono::minutes(optionData.pollTime),
+                                                                                    std::chrono::minutes(optionData.pollMaxTime));
+        }
+        
+        do {
+
+            // Connect
+
+            Pendulum_Log::info("Connecting to server [" + imapConnection.server->getServer() + "][" + std::to_string(imapConnection.connectCount) + "]");
+
+            serverConnect(imapConnection);
+
+            // Keep spare connections once logged in (so bad credentials are not retried in the background)
+
+            if ((optionData.spareConnections > 0) && !imapConnection.spares) {
+                imapConnection.spares = std::make_shared<Pendulum_SparePool::SparePool>(optionData.serverURL, optionData.userName,
+                                                                                        optionData.userPassword, optionData.spareConnections);
+            }
+            
+            // Reset reconnect mailbox to none
+            
+            imapConnection.reconnectMailBox = "";
+
+            // Create mailbox list if doesn't exist
+
+            if (mailBoxList.empty()) {
+                mailBoxList = fetchMailBoxList(imapConnection, optionData.mailBoxList, optionData.ignoreList, optionData.bAllMailBoxes);
+            }
+            
+            // Mailboxes due to be polled this pass and their priorities
+
+            std::vector<bool> mailBoxDue(mailBoxList.size(), true);
+            std::vector<int> mailBoxPriority(mailBoxList.size());
+
+            for (std::size_t mailBoxNo = 0; mailBoxNo < mailBoxList.size(); mailBoxNo++) {
+                mailBoxPriority[mailBoxNo] = Pendulum_Priority::mailBoxPriority(priorityRules, mailBoxList[mailBoxNo].name);
+                if (pollScheduler) {
+                    mailBoxDue[mailBoxNo] = pollScheduler->isDue(mailBoxList[mailBoxNo].name);
+                    if (!mailBoxDue[mailBoxNo]) {
+                        pollScheduler->recordSkip();
+                    }
+                }
+            }
+
+            std::vector<MailBoxMessages> mailBoxMessages(mailBoxList.size());
+            std::vector<std::size_t> nextMessage(mailBoxList.size());
+            std::vector<std::chrono::steady_clock::time_point> lastSearch(mailBoxList.size());
+            std::vector<bool> mailBoxQueued(mailBoxList.size());
+            Pendulum_Priority::SliceQueue<std::size_t> sliceQueue;
+
+            // Mailbox archived: finish its journal, record the poll and update its search UID
+
+            auto finishMailBox = [&] (std::size_t mailBoxNo) {
+                MailBoxDetails& mailBoxEntry { mailBoxList[mailBoxNo] };
+                Pendulum_Journal::finishMailBox(mailBoxEntry.path);
+                if (pollScheduler) {
+                    pollScheduler->recordPoll(mailBoxEntry.name, mailBoxMessages[mailBoxNo].messageUID.size());
+                }
+                if (mailBoxMessages[mailBoxNo].highestUID) {
+                    mailBoxEntry.searchUID = mailBoxMessages[mailBoxNo].highestUID; // Update search UID (includes excluded messages)
+                }
+                mailBoxQueued[mailBoxNo] = false;
+            };
+
+            // Search a mailbox and queue any messages found to be archived
+
+            auto searchMailBox = [&] (std::size_t mailBoxNo) {
+                MailBoxDetails& mailBoxEntry { mailBoxList[mailBoxNo] };
+                mailBoxMessages[mailBoxNo] = findArchiveMessages(imapConnection, mailBoxEntry, optionData.destinationFolder,
+                                                                 optionData.bOnlyUpdates, archivePolicy, policySearchCriteria, bProgress);
+                nextMessage[mailBoxNo] = 0;
+                lastSearch[mailBoxNo] = std::chrono::steady_clock::now();
+                std::size_t messageCount { mailBoxMessages[mailBoxNo].messageUID.size() };
+                if (bProgress) {
+                    Pendulum_Progress::addMailBox(mailBoxEntry.name, messageCount, mailBoxMessages[mailBoxNo].bytes);
+                }
+                if (messageCount) {
+                    Pendulum_Log::info("Messages found = " + std::to_string(messageCount),
+                                       Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(messageCount));
+                    messagesFound.add(messageCount);
+                    sliceQueue.push(mailBoxNo, mailBoxPriority[mailBoxNo]);
+                    mailBoxQueued[mailBoxNo] = true;
+                } else {
+                    Pendulum_Log::info("No messages found.", Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(0));
+                    finishMailBox(mailBoxNo);
+                }
+            };
+
+            // Find messages to archive (every mailbox is searched first so that work can be
+            // taken by priority and, when reporting progress, pass totals are known)
+
+            if (bProgress) {
+                Pendulum_Progress::startPass();
+            }
+
+            for (std::size_t mailBoxNo = 0; mailBoxNo < mailBoxList.size(); mailBoxNo++) {
+                if (mailBoxDue[mailBoxNo]) {
+                    searchMailBox(mailBoxNo);
+                }
+            }
+
+            // Archive a slice at a time, highest priority mailbox first. When polling, a
+            // mailbox of higher priority than the work next in line is searched again once
+            // a poll interval has passed since its last search so that its new mail is not
+            // held up by a backfill.
+
+            std::string currentMailBox;
+
+            while (!sliceQueue.empty()) {
+
+                std::size_t mailBoxNo { sliceQueue.pop() };
+                MailBoxDetails& mailBoxEntry { mailBoxList[mailBoxNo] };
+                const std::vector<uint64_t>& messageUID { mailBoxMessages[mailBoxNo].messageUID };
+
+                if (imapConnection.reconnectMailBox != mailBoxEntry.name) {
+                    imapConnection.reconnectMailBox = mailBoxEntry.name;
+                    selectMailBox(imapConnection, mailBoxEntry.name);
+                }
+
+                if (bProgress && (currentMailBox != mailBoxEntry.name)) {
+                    Pendulum_Progress::startMailBox(mailBoxEntry.name);
+                }
+                currentMailBox = mailBoxEntry.name;
+
+                // Create new EML files for slice
+
+                std::size_t sliceEnd { std::min(nextMessage[mailBoxNo] + Pendulum_Priority::kSliceMessages, messageUID.size()) };
+
+                for (; nextMessage[mailBoxNo] < sliceEnd; nextMessage[mailBoxNo]++) {
+                    std::uint64_t uid { messageUID[nextMessage[mailBoxNo]] };
+                    EmailContents emailContents { fetchEmailContents(imapConnection, uid) };
+                    if (emailContents.subject.size() && emailContents.body.size()) {
+                        std::string emlFileName { createEMLFile(emailContents.subject, emailContents.body, uid, mailBoxEntry.path) };
+                        if (attachmentExtractor && !emlFileName.empty()) {
+                            attachmentExtractor->submit(emlFileName);
+                            attachmentQueueDepth.set(attachmentExtractor->queueDepth());
+                        }
+                    } else {
+                        Pendulum_Log::warning("E-mail file not created as subject or contents empty",
+                                              Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withUID(uid));
+                    }
+                    Pendulum_Journal::commitMessage(mailBoxEntry.path, uid);
+                    Pendulum_Progress::messageDone(emailContents.body.size());
+                }
+
+                if (nextMessage[mailBoxNo] < messageUID.size()) {
+                    sliceQueue.push(mailBoxNo, mailBoxPriority[mailBoxNo]);
+                } else {
+                    finishMailBox(mailBoxNo);
+                }
+
+                if (optionData.pollTime && !sliceQueue.empty()) {
+                    auto now = std::chrono::steady_clock::now();
+                    for (std::size_t repollNo = 0; repollNo < mailBoxList.size(); repollNo++) {
+                        if (mailBoxDue[repollNo] && !mailBoxQueued[repollNo] && (mailBoxPriority[repollNo] > sliceQueue.topPriority()) &&
+                            ((now - lastSearch[repollNo]) >= std::chrono::minutes(optionData.pollTime))) {
+                            Pendulum_Log::info("Searching again for new mail during backfill",
+                                               Pendulum_Log::Fields().withMailBox(mailBoxList[repollNo].name));
+                            searchMailBox(repollNo);
+                        }
+                    }
+                }
+
+            }
+
+            // Wait for attachment extraction to complete and report
+
+            if (attachmentExtractor) {
+                attachmentExtractor->wait();
+                attachmentQueueDepth.set(0);
+                const AttachmentStatistics& attachmentStatistics { attachmentExtractor->getStatistics() };
+                Pendulum_Log::info("Attachments found = " + std::to_string(attachmentStatistics.attachments)
+                                   + ", stored = " + std::to_string(attachmentStatistics.stored)
+                                   + ", duplicates = " + std::to_string(attachmentStatistics.duplicates)
+                                   + ", bytes stored = " + std::to_string(attachmentStatistics.bytesStored)
+                                   + ", bytes deduplicated = " + std::to_string(attachmentStatistics.bytesDeduplicated),
+                                   Pendulum_Log::Fields().withCount(attachmentStatistics.attachments).withBytes(attachmentStatistics.bytesStored));
+            }
+
+            // Pass summary
+
+            if (bProgress) {
+                Pendulum_Progress::endPass();
+            }
+
+            // Disconnect from server
+
+            Pendulum_Log::info("Disconnecting from server [" + optionData.serverURL + "]");
+
+            imapConnection.server->disconnect();
+
+            // Report command arena usage (zero-copy parser only)
+
+            if (imapConnection.commandArena) {
+                Pendulum_Arena::ArenaStatistics arenaStatistics { imapConnection.commandArena->getStatistics() };
+                Pendulum_Log::info("Arena commands = " + std::to_string(arenaStatistics.commands)
+                                   + ", allocations = " + std::to_string(arenaStatistics.allocations)
+                                   + ", heap allocations = " + std::to_string(arenaStatistics.upstreamAllocations)
+                                   + ", high water = " + std::to_string(arenaStatistics.highWater)
+                                   + ", capacity = " + std::to_string(arenaStatistics.capacity));
+                Pendulum_Metrics::gauge("pendulum_arena_high_water_bytes", "Command arena high water mark.").set(arenaStatistics.highWater);
+                Pendulum_Metrics::gauge("pendulum_arena_capacity_bytes", "Command arena capacity.").set(arenaStatistics.capacity);
+                Pendulum_Metrics::gauge("pendulum_arena_heap_allocations", "Command arena allocations that overflowed to the heap.").set(arenaStatistics.upstreamAllocations);
+            }
+
+            // Pass complete
+
+            passCount.add();
+            lastPassTime.set(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+            
+            // Increment connection count 
+            
+            imapConnection.connectCount++;
+            
+            // Wait until next poll is due (pollTime == 0 then one pass)
+
+            if (pollScheduler) {
+                pollScheduler->endCycle();
+                std::this_thread::sleep_for(pollScheduler->timeToNextPoll());
+            }
+
+        } while (optionData.pollTime);
+
+        // Stop progress reporting
+
+        Pendulum_Progress::stopReporter();
+
+    }
+
     // ================
     // PUBLIC FUNCTIONS
     // ================
@@ -115,8 +705,6 @@ namespace Pendulum {
         try {
 
             CRedirect logFile{std::cout};
-            ServerConnection imapConnection;
-            std::vector<MailBoxDetails> mailBoxList;
              
             // Setup option data
             
@@ -127,95 +715,62 @@ namespace Pendulum {
 
             if (!optionData.logFileName.empty()) {
                 logFile.change(optionData.logFileName, std::ios_base::out | std::ios_base::app);
-                std::cout << std::string(100, '=') << std::endl;
+                if (!optionData.bLogJSON) {
+                    std::cout << std::string(100, '=') << std::endl;
+                }
             }
 
-            // Set mail account user name and password
-
-            imapConnection.server.setServer(optionData.serverURL);
-            imapConnection.server.setUserAndPassword(optionData.userName, optionData.userPassword);
-            
-            // Set retry count
-            
-            imapConnection.retryCount = optionData.retryCount;
-            
-            do {
-
-                // Connect
-
-                std::cout << "Connecting to server [" << imapConnection.server.getServer() << "][" << imapConnection.connectCount << "]" << std::endl;
-
-                serverConnect(imapConnection);
-                
-                // Reset reconnect mailbox to none
-                
-                imapConnection.reconnectMailBox = "";
+            // Start background logger (destroyed before logFile so queued lines go to the log file)
 
-                // Create mailbox list if doesn't exist
+            Pendulum_Log::Logger logger { optionData.bLogJSON, Pendulum_Log::levelFromName(optionData.logLevel) };
 
-                if (mailBoxList.empty()) {
-                    mailBoxList = fetchMailBoxList(imapConnection, optionData.mailBoxList, optionData.ignoreList, optionData.bAllMailBoxes);
-                }
-                
-                // Process mailboxes
-
-                for (MailBoxDetails& mailBoxEntry : mailBoxList) {
-                    
-                    // Set mailbox to select on reconnect.
-                    
-                    imapConnection.reconnectMailBox = mailBoxEntry.name;
-                            
-                    // Set mailbox archive folder
+            // Start metrics export
 
-                    if (mailBoxEntry.path.empty()) {
-                        mailBoxEntry.path = createMailboxFolder(optionData.destinationFolder, mailBoxEntry.name);
-                    }
-                    
-                     // If only updates specified find highest UID to search from
+            if (!optionData.metricsFileName.empty()) {
+                Pendulum_Metrics::startExporter(optionData.metricsFileName, std::chrono::seconds(optionData.metricsInterval));
+            }
 
-                    if (optionData.bOnlyUpdates && (imapConnection.connectCount==0)) {                       
-                        mailBoxEntry.searchUID = getNewestUID(mailBoxEntry.path);
-                    }
+            // Start span tracing
 
-                    // Get vector of new mail UID(s)
+            if (!optionData.traceFileName.empty()) {
+                Pendulum_Trace::startTracing(optionData.traceFileName);
+            }
 
-                    std::vector<uint64_t> messageUID { fetchMailBoxMessages(imapConnection, mailBoxEntry) };
+            // Start bandwidth shaping (shared by every connection)
 
-                    // If messages found then create new EML files.
+            if (!optionData.bandwidthProfile.empty()) {
+                Pendulum_Bandwidth::startShaping(Pendulum_Bandwidth::parseProfiles(optionData.bandwidthProfile));
+            }
 
-                    if (messageUID.size()) {
-                        std::cout << "Messages found = " << messageUID.size() << std::endl;
-                        for (auto uid : messageUID) {
-                            std::pair<std::string, std::string> emailContents { fetchEmailContents(imapConnection, uid) };
-                            if (emailContents.first.size() && emailContents.second.size()) {
-                                createEMLFile(emailContents, uid, mailBoxEntry.path);
-                            } else {
-                                std::cerr << "E-mail file not created as subject or contents empty" << std::endl;
-                            }
-                            
-                        }
-                        mailBoxEntry.searchUID = messageUID.back(); // Update search UID
-                    } else {
-                        std::cout << "No messages found." << std::endl;
-                    }
+            // Archive accounts (daemon) or the one account given
 
+            if (optionData.command == "verify") {
+                verifyArchive(optionData);
+            } else if (optionData.command == "export") {
+                exportArchive(optionData);
+            } else if (optionData.bPlan) {
+                if (!optionData.accountsFileName.empty()) {
+                    throw std::invalid_argument("Archive plan (--plan) is for a single account only.");
                 }
+                planAccount(optionData);
+            } else if (!optionData.accountsFileName.empty()) {
+                Pendulum_Daemon::runDaemon(optionData);
+            } else {
+                archiveAccount(optionData);
+            }
 
-                // Disconnect from server
+            // Write final metrics and output summary
 
-                std::cout << "Disconnecting from server [" << optionData.serverURL << "]" << std::endl;
+            if (!optionData.metricsFileName.empty()) {
+                Pendulum_Metrics::stopExporter();
+                Pendulum_Log::info("Metrics:\n" + Pendulum_Metrics::formatSummary());
+            }
 
-                imapConnection.server.disconnect();
-                
-                // Increment connection count 
-                
-                imapConnection.connectCount++;
-                
-                // Wait poll interval (pollTime == 0 then one pass)
+            // Complete trace file
 
-                std::this_thread::sleep_for(std::chrono::minutes(optionData.pollTime));
+            Pendulum_Trace::stopTracing();
 
-            } while (optionData.pollTime);
+            Pendulum_Bandwidth::stopShaping();
 
         //
         // Catch any errors
@@ -12,6 +12,12 @@ namespace Pendulum {
     //
 
     constexpr char const *kEMLFileExt{".eml"};
+
+    //
+    // Extension added to an .eml file while it is being written
+    //
+
+    constexpr char const *kPartialFileExt{".part"};
     
     //
     // Main processing functionality (archive e-mail).
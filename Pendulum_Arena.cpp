@@ -0,0 +1,198 @@
+
+//
+// Module: Pendulum_Arena
+//
+// Description: Pendulum per-command monotonic arena used to back the parse results
+// of IMAP command responses. A command's results (SEARCH UIDs, LIST entries, FETCH
+// items) are bump allocated from one buffer and the whole lot released in one go
+// when the next command is sent, instead of being individually new'd and freed.
+// Allocation counts are kept for reporting.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <algorithm>
+
+//
+// Pendulum arena
+//
+
+#include "Pendulum_Arena.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Arena {
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Round up to next power of two.
+    //
+
+    static std::size_t roundUpPowerOfTwo(std::size_t size) {
+
+        std::size_t rounded { 1 };
+
+        while (rounded < size) {
+            rounded <<= 1;
+        }
+
+        return (rounded);
+
+    }
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    void* CommandArena::CountingResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        if (bytesAllocated) {
+            bytesAllocated->fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        return (upstream->allocate(bytes, alignment));
+
+    }
+
+    void CommandArena::CountingResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+        upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool CommandArena::CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return (this == &other);
+    }
+
+    CommandArena::CommandArena(std::size_t initialSize)
+        : buffer(initialSize),
+          upstreamResource { std::pmr::new_delete_resource(), upstreamAllocations, nullptr },
+          monotonicResource { std::make_unique<std::pmr::monotonic_buffer_resource>(buffer.data(), buffer.size(), &upstreamResource) },
+          arenaResource { monotonicResource.get(), allocations, &bytesAllocated } {
+
+        capacity = buffer.size();
+
+    }
+
+    //
+    // Reset arena for next command. If the last command(s) overflowed the buffer
+    // into the heap then grow the buffer so the same workload fits next time.
+    //
+
+    void CommandArena::reset() {
+
+        if (leaseCount > 0) {
+            deferredResets.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::uint64_t commandBytes { bytesAllocated.load(std::memory_order_relaxed) - commandStartBytes };
+        if (commandBytes > highWater.load(std::memory_order_relaxed)) {
+            highWater.store(commandBytes, std::memory_order_relaxed);
+        }
+
+        if (commandBytes > buffer.size()) {
+            monotonicResource.reset();
+            buffer = std::vector<std::byte>(roundUpPowerOfTwo(commandBytes + (commandBytes / 4)));
+            monotonicResource = std::make_unique<std::pmr::monotonic_buffer_resource>(buffer.data(), buffer.size(), &upstreamResource);
+            arenaResource.setUpstream(monotonicResource.get());
+            capacity = buffer.size();
+        } else {
+            monotonicResource->release();
+        }
+
+        commandStartBytes = bytesAllocated.load(std::memory_order_relaxed);
+
+    }
+
+    void CommandArena::release() {
+        leaseCount--;
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    std::shared_ptr<CommandArena> CommandArena::create(std::size_t initialSize) {
+        return (std::shared_ptr<CommandArena>(new CommandArena(initialSize)));
+    }
+
+    ArenaLease CommandArena::acquire() {
+
+        reset();
+
+        leaseCount++;
+        commands.fetch_add(1, std::memory_order_relaxed);
+
+        return (ArenaLease(shared_from_this()));
+
+    }
+
+    ArenaStatistics CommandArena::getStatistics() const {
+
+        ArenaStatistics statistics;
+
+        statistics.commands = commands.load(std::memory_order_relaxed);
+        statistics.allocations = allocations.load(std::memory_order_relaxed);
+        statistics.bytesAllocated = bytesAllocated.load(std::memory_order_relaxed);
+        statistics.upstreamAllocations = upstreamAllocations.load(std::memory_order_relaxed);
+        statistics.deferredResets = deferredResets.load(std::memory_order_relaxed);
+        statistics.highWater = highWater.load(std::memory_order_relaxed);
+        statistics.capacity = capacity.load(std::memory_order_relaxed);
+
+        return (statistics);
+
+    }
+
+    ArenaLease::ArenaLease(std::shared_ptr<CommandArena> arena) : arena { std::move(arena) } {
+    }
+
+    ArenaLease& ArenaLease::operator=(ArenaLease&& other) noexcept {
+
+        if (this != &other) {
+            release();
+            arena = std::move(other.arena);
+        }
+
+        return (*this);
+
+    }
+
+    ArenaLease::~ArenaLease() {
+        release();
+    }
+
+    void ArenaLease::release() {
+
+        if (arena) {
+            arena->release();
+            arena.reset();
+        }
+
+    }
+
+    std::pmr::memory_resource* ArenaLease::resource() const {
+
+        if (arena) {
+            return (&arena->arenaResource);
+        }
+
+        return (std::pmr::get_default_resource());
+
+    }
+
+} // namespace Pendulum_Arena
@@ -0,0 +1,136 @@
+#ifndef PENDULUM_ARENA_HPP
+#define PENDULUM_ARENA_HPP
+
+//
+// C++ STL
+//
+
+#include <memory>
+#include <memory_resource>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Arena {
+
+    //
+    // Initial per-command arena size
+    //
+
+    constexpr std::size_t kInitialArenaSize { 64 * 1024 };
+
+    //
+    // Arena statistics
+    //
+
+    struct ArenaStatistics {
+        std::uint64_t commands { 0 };            // Commands parsed into arena
+        std::uint64_t allocations { 0 };         // Allocations served from arena
+        std::uint64_t bytesAllocated { 0 };      // Bytes allocated from arena
+        std::uint64_t upstreamAllocations { 0 }; // Allocations that went to the heap
+        std::uint64_t deferredResets { 0 };      // Resets skipped as arena still in use
+        std::uint64_t highWater { 0 };           // Largest single command usage (bytes)
+        std::uint64_t capacity { 0 };            // Current arena buffer size (bytes)
+    };
+
+    class CommandArena;
+
+    //
+    // Lease on a command arena; the arena is only reset for the next command once
+    // all leases on it have been released. Parsed responses hold one for as long
+    // as their arena backed data is alive.
+    //
+
+    class ArenaLease {
+    public:
+        ArenaLease() = default;
+        explicit ArenaLease(std::shared_ptr<CommandArena> arena);
+        ArenaLease(ArenaLease&& other) noexcept = default;
+        ArenaLease& operator=(ArenaLease&& other) noexcept;
+        ArenaLease(const ArenaLease&) = delete;
+        ArenaLease& operator=(const ArenaLease&) = delete;
+        ~ArenaLease();
+        std::pmr::memory_resource* resource() const;
+    private:
+        void release();
+        std::shared_ptr<CommandArena> arena;
+    };
+
+    //
+    // Per-command monotonic arena. Each command's parse results are bump allocated
+    // from a single buffer that is reset (not freed) for the following command. If a
+    // command overflows the buffer it is grown to fit on the next reset so that
+    // steady state parsing makes no heap allocations at all.
+    //
+
+    class CommandArena : public std::enable_shared_from_this<CommandArena> {
+    public:
+
+        static std::shared_ptr<CommandArena> create(std::size_t initialSize = kInitialArenaSize);
+
+        CommandArena(const CommandArena&) = delete;
+        CommandArena& operator=(const CommandArena&) = delete;
+
+        //
+        // Reset arena (if not in use) and return a lease on it for the next command.
+        //
+
+        ArenaLease acquire();
+
+        //
+        // Return arena statistics.
+        //
+
+        ArenaStatistics getStatistics() const;
+
+    private:
+
+        friend class ArenaLease;
+
+        //
+        // Memory resource that counts allocations before passing them upstream.
+        //
+
+        class CountingResource : public std::pmr::memory_resource {
+        public:
+            CountingResource(std::pmr::memory_resource* upstream, std::atomic<std::uint64_t>& allocations,
+                             std::atomic<std::uint64_t>* bytesAllocated)
+                : upstream { upstream }, allocations { allocations }, bytesAllocated { bytesAllocated } {}
+            void setUpstream(std::pmr::memory_resource* newUpstream) { upstream = newUpstream; }
+        private:
+            void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+            void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+            std::pmr::memory_resource* upstream;
+            std::atomic<std::uint64_t>& allocations;
+            std::atomic<std::uint64_t>* bytesAllocated;
+        };
+
+        explicit CommandArena(std::size_t initialSize);
+
+        void reset();
+        void release();
+
+        std::vector<std::byte> buffer;                        // Arena buffer
+        std::atomic<std::uint64_t> allocations { 0 };
+        std::atomic<std::uint64_t> bytesAllocated { 0 };
+        std::atomic<std::uint64_t> upstreamAllocations { 0 };
+        std::atomic<std::uint64_t> commands { 0 };
+        std::atomic<std::uint64_t> deferredResets { 0 };
+        std::atomic<std::uint64_t> highWater { 0 };
+        std::atomic<std::uint64_t> capacity { 0 };
+        std::uint64_t commandStartBytes { 0 };                // bytesAllocated at last reset
+        int leaseCount { 0 };                                 // Live leases
+        CountingResource upstreamResource;                    // Heap (counted)
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> monotonicResource;
+        CountingResource arenaResource;                       // Arena (counted)
+
+    };
+
+} // namespace Pendulum_Arena
+#endif /* PENDULUM_ARENA_HPP */
@@ -0,0 +1,1132 @@
+
+//
+// Module: Pendulum_AsyncIMAP
+//
+// Description: Pendulum asynchronous IMAP session engine. Where CIMAP is a blocking
+// client needing a thread per connection, here each event loop thread drives any
+// number of sessions from one epoll set: sockets are non-blocking, the TLS handshake,
+// reads and writes are resumed by OpenSSL's WANT_READ/WANT_WRITE as the socket becomes
+// ready and a response is complete once its tagged status line arrives (literals
+// are skipped by length, so message bodies are never scanned). Completed responses
+// are handed to a continuation in the same form CIMAP::sendCommand() returns them so
+// that the existing response parsers are used unchanged. Connect and command timeouts
+// (no bytes received for kTimeout) are kept on each loop's timer wheel. Each loop
+// caches the last TLS session (ticket) issued by each server and offers it on the next
+// connect to that server so reconnects use an abbreviated handshake; handshake latency
+// and sessions resumed are exported. The archiver itself uses CIMAP, so the engine
+// (and its session cache) is only built into AsyncSessionBenchmark.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// OpenSSL            : Non-blocking TLS.
+// Linux              : Target platform (epoll, eventfd).
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+//
+// Linux
+//
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+//
+// OpenSSL
+//
+
+#include <openssl/err.h>
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_AsyncIMAP.hpp"
+#include "Pendulum_TimerWheel.hpp"
+#include "Pendulum_Metrics.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_AsyncIMAP {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Timeout timer wheel tick and slots
+    //
+
+    constexpr std::chrono::seconds kWheelTick { 1 };
+    constexpr std::size_t kWheelSlots { 256 };
+
+    //
+    // Events taken per epoll_wait and bytes read per socket read
+    //
+
+    constexpr int kMaxEvents { 256 };
+    constexpr std::size_t kReadSize { 64 * 1024 };
+
+    //
+    // Default IMAP ports
+    //
+
+    constexpr char const *kIMAPSPort { "993" };
+    constexpr char const *kIMAPPort { "143" };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Resolved server addresses (sessions mostly share a few servers so each is looked up once)
+    //
+
+    struct ServerAddress {
+        sockaddr_storage address;
+        socklen_t addressLength { 0 };
+    };
+
+    static struct {
+        std::mutex cacheMutex;
+        std::unordered_map<std::string, ServerAddress> addresses;
+    } resolverCache;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Resolve server host/port (cached). Throws on failure.
+    //
+
+    static ServerAddress resolveServer(const std::string& hostName, const std::string& port) {
+
+        std::string serverKey { hostName + ":" + port };
+
+        {
+            std::unique_lock<std::mutex> locker(resolverCache.cacheMutex);
+            auto cached = resolverCache.addresses.find(serverKey);
+            if (cached != resolverCache.addresses.end()) {
+                return (cached->second);
+            }
+        }
+
+        addrinfo hints {};
+        addrinfo *addresses { nullptr };
+
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        int error { ::getaddrinfo(hostName.c_str(), port.c_str(), &hints, &addresses) };
+        if (error != 0) {
+            throw Exception("Could not resolve " + serverKey + ": " + ::gai_strerror(error));
+        }
+
+        ServerAddress serverAddress;
+        std::memcpy(&serverAddress.address, addresses->ai_addr, addresses->ai_addrlen);
+        serverAddress.addressLength = addresses->ai_addrlen;
+        ::freeaddrinfo(addresses);
+
+        std::unique_lock<std::mutex> locker(resolverCache.cacheMutex);
+        resolverCache.addresses[serverKey] = serverAddress;
+
+        return (serverAddress);
+
+    }
+
+    //
+    // Command tag ("A" + 6 digit sequence number as CIMAP).
+    //
+
+    static std::string createTag(std::uint64_t tagNo) {
+        std::string tag { std::to_string(tagNo) };
+        if (tag.size() < 6) {
+            tag.insert(0, 6 - tag.size(), '0');
+        }
+        return ("A" + tag);
+    }
+
+    //
+    // IMAP quoted string.
+    //
+
+    static std::string quoteString(const std::string& value) {
+        std::string quoted { "\"" };
+        for (auto character : value) {
+            if ((character == '"') || (character == '\\')) {
+                quoted += '\\';
+            }
+            quoted += character;
+        }
+        return (quoted + "\"");
+    }
+
+    //
+    // Last (tagged status) line of a response (without CRLF).
+    //
+
+    static std::string taggedLine(const std::string& response) {
+        std::size_t lineEnd { response.size() };
+        if ((lineEnd >= 2) && (response.compare(lineEnd - 2, 2, "\r\n") == 0)) {
+            lineEnd -= 2;
+        }
+        std::size_t lineStart { response.rfind("\r\n", lineEnd ? lineEnd - 1 : 0) };
+        lineStart = (lineStart == std::string::npos) ? 0 : lineStart + 2;
+        return (response.substr(lineStart, lineEnd - lineStart));
+    }
+
+    //
+    // Text of last OpenSSL error.
+    //
+
+    static std::string tlsError() {
+        char errorText[256] { 0 };
+        ::ERR_error_string_n(::ERR_get_error(), errorText, sizeof(errorText));
+        return (errorText);
+    }
+
+    //
+    // Open session gauge
+    //
+
+    static Pendulum_Metrics::Gauge& openSessions() {
+        static Pendulum_Metrics::Gauge& sessions { Pendulum_Metrics::gauge("pendulum_async_sessions", "Asynchronous IMAP sessions open.") };
+        return (sessions);
+    }
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Event loop state (only the posted work queue is shared with other threads)
+    //
+
+    struct EventLoop::LoopState {
+        int epollFd { -1 };
+        int wakeFd { -1 };
+        std::atomic<bool> bStopping { false };
+        std::mutex postMutex;
+        std::vector<std::function<void()>> posted;                          // Work posted to loop
+        std::unordered_map<int, std::shared_ptr<Session>> sessions;         // Open sessions by socket
+        std::atomic<std::size_t> sessionCount { 0 };
+        Pendulum_TimerWheel::TimerWheel timeouts { kWheelTick, kWheelSlots };
+        std::unordered_map<std::uint64_t, std::weak_ptr<Session>> timerSessions; // Timeout timer sessions
+        std::uint64_t nextTimerID { 1 };
+        SSL_CTX *sslContext { nullptr };
+        std::unordered_map<std::string, SSL_SESSION*> tlsSessions;          // Resumable TLS sessions by server
+    };
+
+    //
+    // Loop thread: dispatch socket events, posted work and expired timeouts.
+    //
+
+    void EventLoop::run() {
+
+        epoll_event events[kMaxEvents];
+
+        while (!loopState->bStopping) {
+
+            int timeout { loopState->timeouts.size() ? static_cast<int>(std::chrono::milliseconds(kWheelTick).count()) : -1 };
+            int eventCount { ::epoll_wait(loopState->epollFd, events, kMaxEvents, timeout) };
+
+            if (eventCount < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            for (int eventNo = 0; eventNo < eventCount; eventNo++) {
+                if (events[eventNo].data.fd == loopState->wakeFd) {
+                    std::uint64_t wakeCount;
+                    while (::read(loopState->wakeFd, &wakeCount, sizeof(wakeCount)) > 0) {
+                    }
+                } else {
+                    auto found = loopState->sessions.find(events[eventNo].data.fd);
+                    if (found != loopState->sessions.end()) {
+                        std::shared_ptr<Session> session { found->second };
+                        session->handleEvents(events[eventNo].events);
+                    }
+                }
+            }
+
+            std::vector<std::function<void()>> postedWork;
+            {
+                std::unique_lock<std::mutex> locker(loopState->postMutex);
+                postedWork.swap(loopState->posted);
+            }
+            for (auto& work : postedWork) {
+                work();
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            for (auto timerID : loopState->timeouts.advance(now)) {
+                auto found = loopState->timerSessions.find(timerID);
+                if (found != loopState->timerSessions.end()) {
+                    std::shared_ptr<Session> session { found->second.lock() };
+                    loopState->timerSessions.erase(found);
+                    if (session) {
+                        session->handleTimeout(now);
+                    }
+                }
+            }
+
+        }
+
+        // Close any sessions left
+
+        std::vector<std::shared_ptr<Session>> sessionsLeft;
+        for (auto& session : loopState->sessions) {
+            sessionsLeft.push_back(session.second);
+        }
+        for (auto& session : sessionsLeft) {
+            session->fail("Event loop stopped");
+        }
+
+    }
+
+    void EventLoop::addSession(const std::shared_ptr<Session>& session) {
+
+        epoll_event event {};
+        event.events = session->interest;
+        event.data.fd = session->socketFd;
+
+        if (::epoll_ctl(loopState->epollFd, EPOLL_CTL_ADD, session->socketFd, &event) == -1) {
+            throw Exception("epoll_ctl failed: " + std::string(std::strerror(errno)));
+        }
+
+        loopState->sessions[session->socketFd] = session;
+        loopState->sessionCount++;
+        openSessions().add(1);
+
+    }
+
+    void EventLoop::modifySession(Session& session, std::uint32_t events) {
+        epoll_event event {};
+        event.events = events;
+        event.data.fd = session.socketFd;
+        ::epoll_ctl(loopState->epollFd, EPOLL_CTL_MOD, session.socketFd, &event);
+    }
+
+    void EventLoop::removeSession(Session& session) {
+        ::epoll_ctl(loopState->epollFd, EPOLL_CTL_DEL, session.socketFd, nullptr);
+        if (loopState->sessions.erase(session.socketFd)) {
+            loopState->sessionCount--;
+            openSessions().add(-1);
+        }
+    }
+
+    void EventLoop::scheduleTimeout(Session& session, std::chrono::steady_clock::time_point expiry) {
+        std::uint64_t timerID { loopState->nextTimerID++ };
+        loopState->timerSessions[timerID] = session.shared_from_this();
+        loopState->timeouts.schedule(timerID, expiry);
+    }
+
+    //
+    // Client TLS context (created on first use). The server certificate is not
+    // verified, as with the blocking client, since self-signed IMAP servers are common.
+    //
+
+    SSL_CTX* EventLoop::getTLSContext() {
+
+        if (!loopState->sslContext) {
+            loopState->sslContext = ::SSL_CTX_new(::TLS_client_method());
+            if (!loopState->sslContext) {
+                throw Exception("Could not create TLS context: " + tlsError());
+            }
+            ::SSL_CTX_set_verify(loopState->sslContext, SSL_VERIFY_NONE, nullptr);
+            ::SSL_CTX_set_mode(loopState->sslContext, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+            ::SSL_CTX_set_session_cache_mode(loopState->sslContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+            ::SSL_CTX_sess_set_new_cb(loopState->sslContext, &EventLoop::newTLSSession);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+            // Responses are framed by their tagged line so a server closing without close_notify
+            // loses nothing; left fatal, OpenSSL would stop the session being resumed.
+            ::SSL_CTX_set_options(loopState->sslContext, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+        }
+
+        return (loopState->sslContext);
+
+    }
+
+    //
+    // Cached TLS session for a server (null if none).
+    //
+
+    SSL_SESSION* EventLoop::findTLSSession(const std::string& serverKey) {
+        auto cached = loopState->tlsSessions.find(serverKey);
+        return ((cached != loopState->tlsSessions.end()) ? cached->second : nullptr);
+    }
+
+    void EventLoop::dropTLSSession(const std::string& serverKey) {
+        auto cached = loopState->tlsSessions.find(serverKey);
+        if (cached != loopState->tlsSessions.end()) {
+            ::SSL_SESSION_free(cached->second);
+            loopState->tlsSessions.erase(cached);
+        }
+    }
+
+    //
+    // OpenSSL new session callback (on the loop thread, during a handshake or when a
+    // TLS 1.3 ticket arrives after it): keep the session as its server's latest. Returns
+    // 1 as the cache takes the session's reference.
+    //
+
+    int EventLoop::newTLSSession(SSL *ssl, SSL_SESSION *sslSession) {
+
+        Session *session { static_cast<Session *>(SSL_get_app_data(ssl)) };
+
+        if (!session) {
+            return (0);
+        }
+
+        SSL_SESSION*& cached { session->eventLoop.loopState->tlsSessions[session->hostName + ":" + session->port] };
+        if (cached) {
+            ::SSL_SESSION_free(cached);
+        }
+        cached = sslSession;
+
+        return (1);
+
+    }
+
+    //
+    // Connect on the loop thread. The server address is looked up the first time a
+    // server is connected to (blocking that loop once) and cached after that.
+    //
+
+    void Session::startConnect(ConnectHandler handler) {
+
+        if ((state != State::Idle) && (state != State::Closed)) {
+            handler(std::make_exception_ptr(Exception(getServer() + ": already connected")));
+            return;
+        }
+
+        connectHandler = std::move(handler);
+
+        try {
+
+            ServerAddress serverAddress { resolveServer(hostName, port) };
+
+            socketFd = ::socket(serverAddress.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (socketFd == -1) {
+                throw Exception("socket failed: " + std::string(std::strerror(errno)));
+            }
+
+            int noDelay { 1 };
+            ::setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+            if ((::connect(socketFd, reinterpret_cast<sockaddr *>(&serverAddress.address), serverAddress.addressLength) == -1) &&
+                (errno != EINPROGRESS)) {
+                throw Exception("connect failed: " + std::string(std::strerror(errno)));
+            }
+
+            state = State::Connecting;
+            interest = EPOLLOUT;
+            eventLoop.addSession(shared_from_this());
+            armTimeout();
+
+        } catch (const std::exception& e) {
+            if (socketFd != -1) {
+                ::close(socketFd);
+                socketFd = -1;
+            }
+            state = State::Closed;
+            auto failedHandler = std::move(connectHandler);
+            connectHandler = nullptr;
+            failedHandler(std::current_exception());
+        }
+
+    }
+
+    //
+    // Queue a command (sent when all before it complete).
+    //
+
+    void Session::queueCommand(const std::string& command, ResponseHandler handler, bool bFront) {
+
+        if ((state == State::Closed) && !bFront) {
+            handler("", std::make_exception_ptr(Exception(getServer() + ": not connected")));
+            return;
+        }
+
+        Command queued;
+        queued.tag = createTag(nextTag++);
+        queued.commandLine = queued.tag + " " + command + "\r\n";
+        queued.handler = std::move(handler);
+
+        if (bFront) {
+            commands.push_front(std::move(queued));
+        } else {
+            commands.push_back(std::move(queued));
+        }
+
+        sendNextCommand();
+
+    }
+
+    //
+    // Socket ready.
+    //
+
+    void Session::handleEvents(std::uint32_t events) {
+
+        std::shared_ptr<Session> self { shared_from_this() };
+
+        if (state == State::Connecting) {
+            if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                completeConnect();
+            }
+        } else if (state == State::Handshaking) {
+            doHandshake();
+        } else if (state != State::Closed) {
+            if (writeOutput()) {
+                bool bOpen { readInput() };
+                processInput();
+                if (!bOpen && (state != State::Closed)) {
+                    fail("Server closed connection");
+                }
+            }
+        }
+
+        if (state != State::Closed) {
+            updateInterest();
+        }
+
+    }
+
+    //
+    // Timeout timer expired; fail if nothing received for kTimeout while waiting on
+    // the server, otherwise wait on (to the latest deadline).
+    //
+
+    void Session::handleTimeout(std::chrono::steady_clock::time_point now) {
+
+        bTimerPending = false;
+
+        if ((state == State::Idle) || (state == State::Closed) || ((state == State::Ready) && !bCommandSent)) {
+            return;
+        }
+
+        if (now >= deadline) {
+            fail("Timed out");
+        } else {
+            eventLoop.scheduleTimeout(*this, deadline);
+            bTimerPending = true;
+        }
+
+    }
+
+    //
+    // TCP connect completed (or failed); start TLS handshake or wait for greeting.
+    //
+
+    void Session::completeConnect() {
+
+        int socketError { 0 };
+        socklen_t errorLength { sizeof(socketError) };
+
+        if ((::getsockopt(socketFd, SOL_SOCKET, SO_ERROR, &socketError, &errorLength) == -1) || socketError) {
+            fail("connect failed: " + std::string(std::strerror(socketError ? socketError : errno)));
+            return;
+        }
+
+        if (!bTLS) {
+            state = State::Greeting;
+            return;
+        }
+
+        try {
+            ssl = ::SSL_new(eventLoop.getTLSContext());
+        } catch (const std::exception& e) {
+            fail(e.what());
+            return;
+        }
+
+        if (!ssl) {
+            fail("SSL_new failed: " + tlsError());
+            return;
+        }
+
+        ::SSL_set_fd(ssl, socketFd);
+        ::SSL_set_tlsext_host_name(ssl, hostName.c_str());
+        SSL_set_app_data(ssl, this);
+        ::SSL_set_connect_state(ssl);
+
+        // Offer the server's last session for an abbreviated handshake
+
+        SSL_SESSION *cachedSession { eventLoop.findTLSSession(hostName + ":" + port) };
+        bResumeOffered = (cachedSession && (::SSL_set_session(ssl, cachedSession) == 1));
+
+        state = State::Handshaking;
+        handshakeStart = std::chrono::steady_clock::now();
+        doHandshake();
+
+    }
+
+    //
+    // Continue TLS handshake; returns true once complete.
+    //
+
+    bool Session::doHandshake() {
+
+        static Pendulum_Metrics::Histogram& handshakeLatency { Pendulum_Metrics::histogram("pendulum_tls_handshake_seconds", "TLS handshake latency.") };
+        static Pendulum_Metrics::Counter& handshakes { Pendulum_Metrics::counter("pendulum_tls_handshakes_total", "TLS handshakes completed.") };
+        static Pendulum_Metrics::Counter& sessionsResumed { Pendulum_Metrics::counter("pendulum_tls_sessions_resumed_total", "TLS handshakes that resumed a cached session.") };
+
+        int result { ::SSL_do_handshake(ssl) };
+
+        if (result == 1) {
+            handshakeLatency.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - handshakeStart).count()));
+            handshakes.add();
+            if (::SSL_session_reused(ssl)) {
+                sessionsResumed.add();
+            }
+            state = State::Greeting;
+            bWantWrite = false;
+            armTimeout();
+            if (!readInput()) {
+                fail("Server closed connection");
+                return (false);
+            }
+            processInput();
+            return (true);
+        }
+
+        switch (::SSL_get_error(ssl, result)) {
+            case SSL_ERROR_WANT_READ:
+                bWantWrite = false;
+                break;
+            case SSL_ERROR_WANT_WRITE:
+                bWantWrite = true;
+                break;
+            default:
+                if (bResumeOffered) {
+                    eventLoop.dropTLSSession(hostName + ":" + port);   // Next connect does a full handshake
+                }
+                fail("TLS handshake failed: " + tlsError());
+                break;
+        }
+
+        return (false);
+
+    }
+
+    //
+    // Read all available bytes; returns false if the server closed the connection
+    // (or it failed). Anything received restarts the timeout.
+    //
+
+    bool Session::readInput() {
+
+        static Pendulum_Metrics::Counter& bytesReceived { Pendulum_Metrics::counter("pendulum_imap_received_bytes_total", "IMAP response bytes received.") };
+
+        std::size_t received { 0 };
+        bool bOpen { true };
+
+        while (true) {
+
+            std::size_t used { input.size() };
+            input.resize(used + kReadSize);
+
+            if (ssl) {
+                int count { ::SSL_read(ssl, &input[used], static_cast<int>(kReadSize)) };
+                input.resize(used + std::max(count, 0));
+                if (count > 0) {
+                    received += count;
+                    continue;
+                }
+                int error { ::SSL_get_error(ssl, count) };
+                if (error == SSL_ERROR_WANT_READ) {
+                    bWantWrite = false;
+                } else if (error == SSL_ERROR_WANT_WRITE) {
+                    bWantWrite = true;
+                } else {
+                    bOpen = false;
+                }
+            } else {
+                ssize_t count { ::recv(socketFd, &input[used], kReadSize, 0) };
+                input.resize(used + std::max<ssize_t>(count, 0));
+                if (count > 0) {
+                    received += count;
+                    continue;
+                }
+                if ((count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+                    bOpen = false;
+                }
+            }
+
+            break;
+
+        }
+
+        if (received) {
+            bytesReceived.add(received);
+            armTimeout();
+        }
+
+        return (bOpen);
+
+    }
+
+    //
+    // Write as much pending output as the socket takes; returns false on failure.
+    //
+
+    bool Session::writeOutput() {
+
+        while (outputSent < output.size()) {
+
+            std::size_t remaining { output.size() - outputSent };
+
+            if (ssl) {
+                int count { ::SSL_write(ssl, output.data() + outputSent, static_cast<int>(remaining)) };
+                if (count > 0) {
+                    outputSent += count;
+                    continue;
+                }
+                int error { ::SSL_get_error(ssl, count) };
+                if (error == SSL_ERROR_WANT_WRITE) {
+                    bWantWrite = true;
+                } else if (error == SSL_ERROR_WANT_READ) {
+                    bWantWrite = false;
+                } else {
+                    fail("TLS write failed: " + tlsError());
+                    return (false);
+                }
+            } else {
+                ssize_t count { ::send(socketFd, output.data() + outputSent, remaining, MSG_NOSIGNAL) };
+                if (count > 0) {
+                    outputSent += count;
+                    continue;
+                }
+                if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                    fail("send failed: " + std::string(std::strerror(errno)));
+                    return (false);
+                }
+            }
+
+            break;
+
+        }
+
+        if (outputSent == output.size()) {
+            output.clear();
+            outputSent = 0;
+            if (ssl && bWantWrite && !SSL_want_write(ssl)) {
+                bWantWrite = false;
+            }
+        }
+
+        return (true);
+
+    }
+
+    //
+    // Frame the in flight command's response. Lines are scanned once; a line ending
+    // in a literal ("{n}") has its n bytes skipped and continues after them, and the
+    // response is complete at the line starting with the command's tag.
+    //
+
+    bool Session::responseComplete(std::string& response) {
+
+        const std::string& tag { commands.front().tag };
+
+        while (true) {
+
+            if (literalBytes) {
+                std::uint64_t available { input.size() - scanPosition };
+                if (available < literalBytes) {
+                    literalBytes -= available;
+                    scanPosition = input.size();
+                    return (false);
+                }
+                scanPosition += literalBytes;
+                literalBytes = 0;
+            }
+
+            std::size_t lineEnd { input.find("\r\n", scanPosition) };
+            if (lineEnd == std::string::npos) {
+                if (input.size() > scanPosition + 1) {
+                    scanPosition = input.size() - 1;    // CR may be last byte
+                }
+                return (false);
+            }
+
+            scanPosition = lineEnd + 2;
+
+            if ((lineEnd > lineStart) && (input[lineEnd - 1] == '}')) {
+                std::size_t literalStart { input.rfind('{', lineEnd - 1) };
+                if ((literalStart != std::string::npos) && (literalStart >= lineStart)) {
+                    literalBytes = std::strtoull(&input[literalStart + 1], nullptr, 10);
+                    continue;
+                }
+            }
+
+            if ((input.compare(lineStart, tag.size(), tag) == 0) && (input[lineStart + tag.size()] == ' ')) {
+                response = input.substr(0, scanPosition);
+                input.erase(0, scanPosition);
+                scanPosition = lineStart = 0;
+                return (true);
+            }
+
+            lineStart = scanPosition;
+
+        }
+
+    }
+
+    //
+    // Handle bytes received: the greeting (then LOGIN) or command responses.
+    //
+
+    void Session::processInput() {
+
+        std::shared_ptr<Session> self { shared_from_this() };
+
+        if (state == State::Greeting) {
+
+            std::size_t lineEnd { input.find("\r\n") };
+            if (lineEnd == std::string::npos) {
+                return;
+            }
+
+            std::string greeting { input.substr(0, lineEnd) };
+            input.erase(0, lineEnd + 2);
+
+            if (greeting.compare(0, 5, "* OK ") != 0) {
+                fail("Unexpected greeting: " + greeting);
+                return;
+            }
+
+            state = State::LoggingIn;
+            queueCommand("LOGIN " + quoteString(userName) + " " + quoteString(userPassword),
+                         [this](std::string response, std::exception_ptr error) {
+                if (error) {
+                    return;         // Connect handler already given the error
+                }
+                std::string statusLine { taggedLine(response) };
+                if (statusLine.find(" OK") == std::string::npos) {
+                    fail("LOGIN failed: " + statusLine);
+                    return;
+                }
+                state = State::Ready;
+                ConnectHandler handler { std::move(connectHandler) };
+                connectHandler = nullptr;
+                if (handler) {
+                    handler(nullptr);
+                }
+            }, true);
+
+        }
+
+        while (bCommandSent && (state != State::Closed)) {
+            std::string response;
+            if (!responseComplete(response)) {
+                break;
+            }
+            Command command { std::move(commands.front()) };
+            commands.pop_front();
+            bCommandSent = false;
+            command.handler(command.commandLine + response, nullptr);
+            sendNextCommand();
+        }
+
+    }
+
+    //
+    // Send the next queued command if none in flight.
+    //
+
+    void Session::sendNextCommand() {
+
+        static Pendulum_Metrics::Counter& commandsSent { Pendulum_Metrics::counter("pendulum_async_commands_total", "Asynchronous IMAP commands sent.") };
+
+        if (bCommandSent || commands.empty() || ((state != State::Ready) && (state != State::LoggingIn))) {
+            return;
+        }
+
+        output += commands.front().commandLine;
+        bCommandSent = true;
+        commandsSent.add();
+        armTimeout();
+
+        if (writeOutput()) {
+            updateInterest();
+        }
+
+    }
+
+    //
+    // Watch for readable always and writable while output is pending or TLS needs it.
+    //
+
+    void Session::updateInterest() {
+
+        std::uint32_t events { (state == State::Connecting) ? static_cast<std::uint32_t>(EPOLLOUT) : static_cast<std::uint32_t>(EPOLLIN) };
+
+        if ((state != State::Connecting) && (bWantWrite || (outputSent < output.size()))) {
+            events |= EPOLLOUT;
+        }
+
+        if ((events != interest) && (socketFd != -1)) {
+            interest = events;
+            eventLoop.modifySession(*this, interest);
+        }
+
+    }
+
+    //
+    // Restart timeout (one timer is kept on the wheel and moved on to the latest deadline).
+    //
+
+    void Session::armTimeout() {
+        deadline = std::chrono::steady_clock::now() + kTimeout;
+        if (!bTimerPending) {
+            eventLoop.scheduleTimeout(*this, deadline);
+            bTimerPending = true;
+        }
+    }
+
+    void Session::fail(const std::string& message) {
+        close(std::make_exception_ptr(Exception(getServer() + ": " + message)));
+    }
+
+    //
+    // Close socket and complete everything outstanding (with error if given).
+    //
+
+    void Session::close(std::exception_ptr error) {
+
+        std::shared_ptr<Session> self { shared_from_this() };
+
+        if (state == State::Closed) {
+            return;
+        }
+
+        state = State::Closed;
+
+        if (socketFd != -1) {
+            eventLoop.removeSession(*this);
+            if (ssl) {
+                // OpenSSL stops a session being resumed if its connection is freed without
+                // a shutdown; a clean close sends close_notify, a failed one is just marked.
+                if (!error) {
+                    ::SSL_shutdown(ssl);
+                } else {
+                    ::SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN);
+                }
+                ::SSL_free(ssl);
+                ssl = nullptr;
+            }
+            ::close(socketFd);
+            socketFd = -1;
+        }
+
+        input.clear();
+        output.clear();
+        outputSent = scanPosition = lineStart = 0;
+        literalBytes = 0;
+        bWantWrite = false;
+        interest = 0;
+
+        std::deque<Command> pending;
+        pending.swap(commands);
+        bCommandSent = false;
+
+        if (connectHandler) {
+            ConnectHandler handler { std::move(connectHandler) };
+            connectHandler = nullptr;
+            handler(error ? error : std::make_exception_ptr(Exception(getServer() + ": connection closed")));
+        }
+
+        for (auto& command : pending) {
+            command.handler("", error ? error : std::make_exception_ptr(Exception(getServer() + ": connection closed")));
+        }
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    Session::Session(EventLoop& eventLoop, const std::string& serverURL, const std::string& userName, const std::string& userPassword) :
+            eventLoop { eventLoop }, serverURL { serverURL }, userName { userName }, userPassword { userPassword } {
+
+        // imaps://host:port (TLS) or imap://host:port (plain)
+
+        std::string server { serverURL };
+        std::size_t schemeEnd { server.find("://") };
+
+        if (schemeEnd != std::string::npos) {
+            bTLS = (server.compare(0, schemeEnd, "imap") != 0);
+            server = server.substr(schemeEnd + 3);
+        }
+
+        std::size_t portStart { server.rfind(':') };
+
+        if (portStart != std::string::npos) {
+            hostName = server.substr(0, portStart);
+            port = server.substr(portStart + 1);
+        } else {
+            hostName = server;
+            port = bTLS ? kIMAPSPort : kIMAPPort;
+        }
+
+    }
+
+    Session::~Session() {
+        if (ssl) {
+            ::SSL_free(ssl);
+        }
+        if (socketFd != -1) {
+            ::close(socketFd);
+        }
+    }
+
+    void Session::connect(ConnectHandler handler) {
+        std::shared_ptr<Session> self { shared_from_this() };
+        eventLoop.post([self, handler]() {
+            self->startConnect(handler);
+        });
+    }
+
+    void Session::sendCommand(const std::string& command, ResponseHandler handler) {
+        std::shared_ptr<Session> self { shared_from_this() };
+        eventLoop.post([self, command, handler]() {
+            self->queueCommand(command, handler);
+        });
+    }
+
+    void Session::disconnect() {
+        std::shared_ptr<Session> self { shared_from_this() };
+        eventLoop.post([self]() {
+            if (self->state == State::Ready) {
+                self->queueCommand("LOGOUT", [self](std::string, std::exception_ptr) {
+                    self->close(nullptr);
+                });
+            } else if (self->state != State::Idle) {
+                self->fail("Disconnected");
+            }
+        });
+    }
+
+    Session::State Session::getState() const {
+        return (state);
+    }
+
+    std::string Session::getServer() const {
+        return (serverURL);
+    }
+
+    EventLoop::EventLoop() : loopState { std::make_unique<LoopState>() } {
+
+        loopState->epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+        if (loopState->epollFd == -1) {
+            throw Exception("epoll_create1 failed: " + std::string(std::strerror(errno)));
+        }
+
+        loopState->wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loopState->wakeFd == -1) {
+            ::close(loopState->epollFd);
+            throw Exception("eventfd failed: " + std::string(std::strerror(errno)));
+        }
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = loopState->wakeFd;
+        ::epoll_ctl(loopState->epollFd, EPOLL_CTL_ADD, loopState->wakeFd, &event);
+
+        loopThread = std::thread(&EventLoop::run, this);
+
+    }
+
+    EventLoop::~EventLoop() {
+
+        loopState->bStopping = true;
+        post([]() {
+        });
+
+        if (loopThread.joinable()) {
+            loopThread.join();
+        }
+
+        ::close(loopState->wakeFd);
+        ::close(loopState->epollFd);
+
+        for (auto& tlsSession : loopState->tlsSessions) {
+            ::SSL_SESSION_free(tlsSession.second);
+        }
+
+        if (loopState->sslContext) {
+            ::SSL_CTX_free(loopState->sslContext);
+        }
+
+    }
+
+    void EventLoop::post(std::function<void()> work) {
+
+        {
+            std::unique_lock<std::mutex> locker(loopState->postMutex);
+            loopState->posted.push_back(std::move(work));
+        }
+
+        std::uint64_t wake { 1 };
+        if (::write(loopState->wakeFd, &wake, sizeof(wake)) == -1) {
+            // Counter full; loop is already due to wake
+        }
+
+    }
+
+    std::size_t EventLoop::sessionCount() const {
+        return (loopState->sessionCount);
+    }
+
+    Engine::Engine(std::size_t threadCount) {
+        for (std::size_t loopNo = 0; loopNo < std::max<std::size_t>(threadCount, 1); loopNo++) {
+            eventLoops.push_back(std::make_unique<EventLoop>());
+        }
+    }
+
+    Engine::~Engine() {
+        eventLoops.clear();
+    }
+
+    std::shared_ptr<Session> Engine::createSession(const std::string& serverURL, const std::string& userName,
+                                                   const std::string& userPassword) {
+        EventLoop& eventLoop { *eventLoops[nextLoop++ % eventLoops.size()] };
+        return (std::make_shared<Session>(eventLoop, serverURL, userName, userPassword));
+    }
+
+    std::size_t Engine::sessionCount() const {
+        std::size_t sessions { 0 };
+        for (auto& eventLoop : eventLoops) {
+            sessions += eventLoop->sessionCount();
+        }
+        return (sessions);
+    }
+
+} // namespace Pendulum_AsyncIMAP
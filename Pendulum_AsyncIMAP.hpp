@@ -0,0 +1,248 @@
+#ifndef PENDULUM_ASYNCIMAP_HPP
+#define PENDULUM_ASYNCIMAP_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//
+// OpenSSL
+//
+
+#include <openssl/ssl.h>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_AsyncIMAP {
+
+    //
+    // Connect/command timeout
+    //
+
+    constexpr std::chrono::seconds kTimeout { 60 };
+
+    //
+    // Session failure (connect, TLS, LOGIN, server close or timeout)
+    //
+
+    struct Exception : public std::runtime_error {
+        explicit Exception(const std::string& message) : std::runtime_error("Pendulum_AsyncIMAP Failure: " + message) {
+        }
+    };
+
+    //
+    // Completion handlers. A command response is the raw tagged response in the same
+    // form as CIMAP::sendCommand() returns it (command line then the server's response)
+    // so it can be parsed with CIMAPParse or Pendulum_ResponseParse. Handlers are called
+    // on the session's event loop thread so must not block.
+    //
+
+    using ConnectHandler = std::function<void(std::exception_ptr error)>;
+    using ResponseHandler = std::function<void(std::string response, std::exception_ptr error)>;
+
+    class EventLoop;
+
+    //
+    // IMAP server session (the asynchronous equivalent of a ServerConnection). All of
+    // its socket and TLS state is only touched on its event loop thread; the public
+    // methods may be called from any thread and just queue the work to that loop.
+    // Commands are sent one at a time in the order given.
+    //
+
+    class Session : public std::enable_shared_from_this<Session> {
+    public:
+
+        enum class State {
+            Idle,               // Not connected
+            Connecting,         // TCP connect in progress
+            Handshaking,        // TLS handshake in progress
+            Greeting,           // Waiting for server greeting
+            LoggingIn,          // LOGIN sent
+            Ready,              // Logged in
+            Closed              // Disconnected/failed
+        };
+
+        Session(EventLoop& eventLoop, const std::string& serverURL, const std::string& userName, const std::string& userPassword);
+        ~Session();
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+        //
+        // Connect, TLS handshake (imaps://) and LOGIN.
+        //
+
+        void connect(ConnectHandler handler);
+
+        //
+        // Send a command (untagged; the tag is added).
+        //
+
+        void sendCommand(const std::string& command, ResponseHandler handler);
+
+        //
+        // LOGOUT (once any queued commands complete) and close.
+        //
+
+        void disconnect();
+
+        State getState() const;
+        std::string getServer() const;
+
+    private:
+
+        friend class EventLoop;
+
+        struct Command {
+            std::string tag;                // Command tag
+            std::string commandLine;        // Tagged command line sent
+            ResponseHandler handler;        // Completion handler
+        };
+
+        void startConnect(ConnectHandler handler);
+        void queueCommand(const std::string& command, ResponseHandler handler, bool bFront = false);
+        void handleEvents(std::uint32_t events);
+        void handleTimeout(std::chrono::steady_clock::time_point now);
+        void completeConnect();
+        bool doHandshake();
+        bool readInput();
+        bool writeOutput();
+        bool responseComplete(std::string& response);
+        void processInput();
+        void sendNextCommand();
+        void updateInterest();
+        void armTimeout();
+        void fail(const std::string& message);
+        void close(std::exception_ptr error);
+
+        EventLoop& eventLoop;
+        std::string serverURL;
+        std::string userName;
+        std::string userPassword;
+        std::string hostName;
+        std::string port;
+        bool bTLS { true };
+
+        std::atomic<State> state { State::Idle };
+        int socketFd { -1 };
+        SSL *ssl { nullptr };
+        bool bWantWrite { false };                  // = true TLS needs socket writable
+        std::uint32_t interest { 0 };               // Current epoll events
+
+        ConnectHandler connectHandler;
+        std::deque<Command> commands;               // Queued commands (front = in flight once sent)
+        bool bCommandSent { false };                // = true front command sent
+        std::uint64_t nextTag { 1 };
+
+        std::string output;                         // Bytes to send
+        std::size_t outputSent { 0 };
+        std::string input;                          // Bytes received not yet a complete response
+        std::size_t scanPosition { 0 };             // Response framing: next byte to scan
+        std::size_t lineStart { 0 };                // Start of current (logical) line
+        std::uint64_t literalBytes { 0 };           // Literal bytes still to skip
+
+        std::chrono::steady_clock::time_point handshakeStart; // TLS handshake start
+        bool bResumeOffered { false };              // = true cached TLS session offered
+        std::chrono::steady_clock::time_point deadline; // Connect/command deadline
+        bool bTimerPending { false };               // = true timeout timer on wheel
+
+    };
+
+    //
+    // Event loop: an epoll set of sessions run on one thread. Work for the loop from
+    // other threads is posted through an eventfd; timeouts are kept on a timer wheel.
+    //
+
+    class EventLoop {
+    public:
+
+        EventLoop();
+        ~EventLoop();
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        //
+        // Run work on the loop thread.
+        //
+
+        void post(std::function<void()> work);
+
+        //
+        // Sessions registered (sockets open) on the loop.
+        //
+
+        std::size_t sessionCount() const;
+
+    private:
+
+        friend class Session;
+
+        void run();
+        void addSession(const std::shared_ptr<Session>& session);
+        void modifySession(Session& session, std::uint32_t events);
+        void removeSession(Session& session);
+        void scheduleTimeout(Session& session, std::chrono::steady_clock::time_point expiry);
+        SSL_CTX* getTLSContext();
+        SSL_SESSION* findTLSSession(const std::string& serverKey);
+        void dropTLSSession(const std::string& serverKey);
+        static int newTLSSession(SSL *ssl, SSL_SESSION *sslSession);
+
+        struct LoopState;
+        std::unique_ptr<LoopState> loopState;
+        std::thread loopThread;
+
+    };
+
+    //
+    // Session engine: a small fixed number of event loop threads driving any number
+    // of sessions (assigned to loops round robin). Sessions must not be used once
+    // their engine is destroyed (any still open are failed when it is).
+    //
+
+    class Engine {
+    public:
+
+        explicit Engine(std::size_t threadCount);
+        ~Engine();
+
+        Engine(const Engine&) = delete;
+        Engine& operator=(const Engine&) = delete;
+
+        //
+        // Create a (not yet connected) session.
+        //
+
+        std::shared_ptr<Session> createSession(const std::string& serverURL, const std::string& userName,
+                                               const std::string& userPassword);
+
+        //
+        // Sessions open across all loops.
+        //
+
+        std::size_t sessionCount() const;
+
+    private:
+
+        std::vector<std::unique_ptr<EventLoop>> eventLoops;
+        std::atomic<std::size_t> nextLoop { 0 };
+
+    };
+
+} // namespace Pendulum_AsyncIMAP
+#endif /* PENDULUM_ASYNCIMAP_HPP */
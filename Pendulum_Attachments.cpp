@@ -0,0 +1,757 @@
+
+//
+// Module: Pendulum_Attachments
+//
+// Description: Pendulum attachment extraction. Each archived .eml file is stream
+// parsed for its MIME structure and every attachment found is decoded (base64 or
+// quoted-printable) a line at a time into a content addressed store; the file name
+// in the store being the SHA-256 of the decoded contents so that the same document
+// sent to many people is stored only once. A small manifest (.attachments) written
+// next to the .eml links it to its attachments. Extraction runs on a worker pool
+// with a bounded queue so memory use does not depend on the size of the archive run
+// or of any individual message.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CFile, CPath.
+// OpenSSL            : SHA-256 (EVP).
+// Pendulum           : Pendulum_WorkerPool, Pendulum_MIMEDecode.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+//
+// Antik Classes
+//
+
+#include "CFile.hpp"
+#include "CPath.hpp"
+
+//
+// OpenSSL
+//
+
+#include <openssl/evp.h>
+
+//
+// Pendulum attachments
+//
+
+#include "Pendulum.hpp"
+#include "Pendulum_Attachments.hpp"
+#include "Pendulum_MIMEDecode.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Attachments {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Antik::File;
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Maximum line length read in one go (longer lines are processed in pieces)
+    //
+
+    constexpr std::size_t kMaxLineLength { 64 * 1024 };
+
+    //
+    // Size of decoded data buffered before being written to the store
+    //
+
+    constexpr std::size_t kWriteBufferSize { 64 * 1024 };
+
+    //
+    // Extraction queue length per worker
+    //
+
+    constexpr std::size_t kQueuePerWorker { 4 };
+
+    //
+    // Store temporary file folder and name template (mkstemp, so unique across every
+    // thread and process sharing the store)
+    //
+
+    constexpr char const *kStoreTmpFolder { ".tmp" };
+    constexpr char const *kStoreTmpTemplate { "attachment.XXXXXX" };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Line types when parsing a MIME entity
+    //
+
+    enum class LineType {
+        Content,
+        Boundary,
+        CloseBoundary,
+        EndOfFile
+    };
+
+    struct Terminator {
+        LineType type { LineType::EndOfFile };
+        std::size_t level { 0 };        // Boundary stack level of (close) boundary
+    };
+
+    //
+    // MIME entity headers of interest
+    //
+
+    struct PartHeaders {
+        std::string contentType { "text/plain" };
+        std::string boundary;
+        std::string encoding { "7bit" };
+        std::string disposition;
+        std::string fileName;
+    };
+
+    //
+    // Read message a line at a time with lines over kMaxLineLength returned in pieces.
+    // Line terminators (LF or CRLF) are removed; bLineStart is false for the second
+    // and subsequent pieces of a long line so they are never taken as boundaries.
+    //
+
+    class LineReader {
+    public:
+        explicit LineReader(std::istream& stream) : stream { stream }, buffer(kMaxLineLength) {}
+        bool readLine(std::string& line);
+        bool bLineStart { true };       // = true current line starts a line
+        bool bLineEnded { true };       // = true current line was terminated
+    private:
+        std::istream& stream;
+        std::vector<char> buffer;
+    };
+
+    bool LineReader::readLine(std::string& line) {
+
+        bLineStart = bLineEnded;
+
+        stream.getline(buffer.data(), buffer.size());
+        std::streamsize count { stream.gcount() };
+
+        if (stream.bad()) {
+            return (false);
+        }
+
+        if (stream.fail() && !stream.eof()) { // Buffer full, rest of line to follow
+            stream.clear();
+            line.assign(buffer.data(), count);
+            bLineEnded = false;
+            return (true);
+        }
+
+        if (stream.eof() && (count == 0)) {
+            return (false);
+        }
+
+        line.assign(buffer.data(), stream.eof() ? count : count - 1);
+        if (!line.empty() && (line.back() == '\r')) {
+            line.pop_back();
+        }
+        bLineEnded = true;
+
+        return (true);
+
+    }
+
+    //
+    // Lower case a string.
+    //
+
+    static std::string toLower(std::string value) {
+
+        for (auto& ch : value) {
+            ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        }
+
+        return (value);
+
+    }
+
+    //
+    // Trim leading/trailing whitespace.
+    //
+
+    static std::string trim(const std::string& value) {
+
+        std::size_t start { value.find_first_not_of(" \t") };
+        if (start == std::string::npos) {
+            return ("");
+        }
+
+        return (value.substr(start, value.find_last_not_of(" \t") - start + 1));
+
+    }
+
+    //
+    // Return a parameter value from a structured header value (e.g. boundary
+    // from "multipart/mixed; boundary="xyz""). Quotes are removed.
+    //
+
+    static std::string headerParameter(const std::string& headerValue, const std::string& parameterName) {
+
+        std::size_t position { 0 };
+
+        while ((position = headerValue.find(';', position)) != std::string::npos) {
+            position++;
+            std::size_t equals { headerValue.find('=', position) };
+            if (equals == std::string::npos) {
+                break;
+            }
+            if (toLower(trim(headerValue.substr(position, equals - position))) == parameterName) {
+                std::size_t valueStart { equals + 1 };
+                while ((valueStart < headerValue.size()) && (headerValue[valueStart] == ' ')) {
+                    valueStart++;
+                }
+                if ((valueStart < headerValue.size()) && (headerValue[valueStart] == '\"')) {
+                    std::size_t valueEnd { headerValue.find('\"', valueStart + 1) };
+                    return (headerValue.substr(valueStart + 1, valueEnd - (valueStart + 1)));
+                }
+                return (trim(headerValue.substr(valueStart, headerValue.find(';', valueStart) - valueStart)));
+            }
+        }
+
+        return ("");
+
+    }
+
+    //
+    // Apply a (unfolded) header line to part headers.
+    //
+
+    static void applyHeader(const std::string& header, PartHeaders& partHeaders) {
+
+        std::size_t colon { header.find(':') };
+        if (colon == std::string::npos) {
+            return;
+        }
+
+        std::string name { toLower(trim(header.substr(0, colon))) };
+        std::string value { trim(header.substr(colon + 1)) };
+
+        if (name == "content-type") {
+            partHeaders.contentType = toLower(trim(value.substr(0, value.find(';'))));
+            partHeaders.boundary = headerParameter(value, "boundary");
+            if (partHeaders.fileName.empty()) {
+                partHeaders.fileName = headerParameter(value, "name");
+            }
+        } else if (name == "content-transfer-encoding") {
+            partHeaders.encoding = toLower(value);
+        } else if (name == "content-disposition") {
+            partHeaders.disposition = toLower(trim(value.substr(0, value.find(';'))));
+            std::string fileName { headerParameter(value, "filename") };
+            if (!fileName.empty()) {
+                partHeaders.fileName = fileName;
+            }
+        }
+
+    }
+
+    //
+    // Classify a line against the boundary stack (innermost boundary first).
+    //
+
+    static Terminator classifyLine(const std::string& line, bool bLineStart, const std::vector<std::string>& boundaries) {
+
+        Terminator terminator;
+
+        terminator.type = LineType::Content;
+
+        if (bLineStart && (line.size() > 2) && (line[0] == '-') && (line[1] == '-')) {
+            std::string_view candidate { line };
+            candidate.remove_prefix(2);
+            while (!candidate.empty() && ((candidate.back() == ' ') || (candidate.back() == '\t'))) {
+                candidate.remove_suffix(1);
+            }
+            for (std::size_t level = boundaries.size(); level-- > 0;) {
+                if (candidate == boundaries[level]) {
+                    terminator.type = LineType::Boundary;
+                    terminator.level = level;
+                    break;
+                } else if ((candidate.size() == boundaries[level].size() + 2) &&
+                           (candidate.compare(0, boundaries[level].size(), boundaries[level]) == 0) &&
+                           (candidate.substr(boundaries[level].size()) == "--")) {
+                    terminator.type = LineType::CloseBoundary;
+                    terminator.level = level;
+                    break;
+                }
+            }
+        }
+
+        return (terminator);
+
+    }
+
+    //
+    // Read entity headers up to the blank line that ends them (returned as Content).
+    // Returns the terminator if a boundary or end of file is reached first.
+    //
+
+    static Terminator readHeaders(LineReader& reader, const std::vector<std::string>& boundaries, PartHeaders& partHeaders) {
+
+        std::string line;
+        std::string header;
+        Terminator terminator;
+
+        while (reader.readLine(line)) {
+            terminator = classifyLine(line, reader.bLineStart, boundaries);
+            if ((terminator.type != LineType::Content) || line.empty()) {
+                applyHeader(header, partHeaders);
+                return (terminator);
+            }
+            if (((line[0] == ' ') || (line[0] == '\t')) && !header.empty()) {
+                header += line; // Folded header
+            } else {
+                applyHeader(header, partHeaders);
+                header = line;
+            }
+        }
+
+        applyHeader(header, partHeaders);
+
+        terminator.type = LineType::EndOfFile;
+
+        return (terminator);
+
+    }
+
+    //
+    // Writes decoded attachment data to a temporary file in the store while hashing
+    // it; on finish the file is renamed to its hash (or discarded if already stored).
+    //
+
+    class AttachmentWriter {
+    public:
+
+        explicit AttachmentWriter(const std::string& storeFolder) : storeFolder { storeFolder }, hashContext { EVP_MD_CTX_new() } {
+
+            if (!hashContext || !EVP_DigestInit_ex(hashContext, EVP_sha256(), nullptr)) {
+                throw std::runtime_error("Could not initialise SHA-256.");
+            }
+
+            if (!storeFolder.empty()) {
+                CPath tmpPath { storeFolder };
+                tmpPath.join(kStoreTmpFolder);
+                tmpPath.join(kStoreTmpTemplate);
+                tmpFileName = tmpPath.toString();
+                int tmpFileDescriptor { ::mkstemp(&tmpFileName[0]) };
+                if (tmpFileDescriptor >= 0) {
+                    ::fchmod(tmpFileDescriptor, 0644);  // Stored as readable as before (mkstemp creates 0600)
+                    ::close(tmpFileDescriptor);
+                    tmpFileStream.open(tmpFileName, std::ios::binary | std::ios::trunc);
+                }
+                if (!tmpFileStream.is_open()) {
+                    if (tmpFileDescriptor >= 0) {
+                        std::remove(tmpFileName.c_str());
+                    }
+                    EVP_MD_CTX_free(hashContext);
+                    throw std::runtime_error("Could not create store file [" + tmpFileName + "]");
+                }
+            }
+
+            buffer.reserve(kWriteBufferSize + kMaxLineLength);
+
+        }
+
+        ~AttachmentWriter() {
+            EVP_MD_CTX_free(hashContext);
+            if (tmpFileStream.is_open()) {
+                tmpFileStream.close();
+                std::remove(tmpFileName.c_str());
+            }
+        }
+
+        AttachmentWriter(const AttachmentWriter&) = delete;
+        AttachmentWriter& operator=(const AttachmentWriter&) = delete;
+
+        std::string& getBuffer() {
+            return (buffer);
+        }
+
+        void flush(bool bForce = false) {
+            if ((buffer.size() >= kWriteBufferSize) || (bForce && !buffer.empty())) {
+                EVP_DigestUpdate(hashContext, buffer.data(), buffer.size());
+                if (tmpFileStream.is_open()) {
+                    tmpFileStream.write(buffer.data(), buffer.size());
+                }
+                size += buffer.size();
+                buffer.clear();
+            }
+        }
+
+        void finish(AttachmentDetails& attachment, AttachmentStatistics& statistics) {
+
+            unsigned char digest[EVP_MAX_MD_SIZE];
+            unsigned int digestLength { 0 };
+            std::ostringstream hexHash;
+
+            flush(true);
+            EVP_DigestFinal_ex(hashContext, digest, &digestLength);
+            for (unsigned int index = 0; index < digestLength; index++) {
+                hexHash << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(digest[index]);
+            }
+
+            attachment.hash = hexHash.str();
+            attachment.size = size;
+
+            if (tmpFileStream.is_open()) {
+
+                tmpFileStream.close();
+
+                CPath hashFolder { storeFolder };
+                hashFolder.join(attachment.hash.substr(0, 2));
+                if (!CFile::exists(hashFolder)) {
+                    try {
+                        CFile::createDirectory(hashFolder);
+                    } catch (...) {
+                        if (!CFile::exists(hashFolder)) { // Not created by another worker
+                            throw;
+                        }
+                    }
+                }
+
+                CPath storePath { hashFolder.toString() };
+                storePath.join(attachment.hash);
+                attachment.storePath = attachment.hash.substr(0, 2) + "/" + attachment.hash;
+
+                if (CFile::exists(storePath)) {
+                    std::remove(tmpFileName.c_str());
+                    attachment.bDuplicate = true;
+                    statistics.duplicates++;
+                    statistics.bytesDeduplicated += size;
+                } else {
+                    if (std::rename(tmpFileName.c_str(), storePath.toString().c_str()) != 0) {
+                        std::remove(tmpFileName.c_str());
+                        throw std::runtime_error("Could not store attachment [" + storePath.toString() + "]");
+                    }
+                    statistics.stored++;
+                    statistics.bytesStored += size;
+                }
+
+            }
+
+        }
+
+    private:
+
+        std::string storeFolder;
+        EVP_MD_CTX *hashContext;
+        std::string tmpFileName;
+        std::ofstream tmpFileStream;
+        std::string buffer;
+        std::uint64_t size { 0 };
+
+    };
+
+    //
+    // Is a leaf entity an attachment ? Anything marked as one or with a file name
+    // is, as is any non-text part other than the top level message body.
+    //
+
+    static bool isAttachment(const PartHeaders& partHeaders, bool bTopLevel) {
+
+        if ((partHeaders.disposition == "attachment") || !partHeaders.fileName.empty()) {
+            return (true);
+        }
+
+        return (!bTopLevel && (partHeaders.disposition != "inline") &&
+                (partHeaders.contentType.compare(0, 5, "text/") != 0));
+
+    }
+
+    //
+    // Decode body of a leaf entity into attachment writer until terminated by a boundary or end of file.
+    //
+
+    static Terminator decodeBody(LineReader& reader, const std::vector<std::string>& boundaries,
+                                 const PartHeaders& partHeaders, AttachmentWriter& writer) {
+
+        Pendulum_MIMEDecode::Base64Decoder base64Decoder;
+        bool bBase64 { partHeaders.encoding == "base64" };
+        bool bQuotedPrintable { partHeaders.encoding == "quoted-printable" };
+        bool bPendingNewline { false };
+        std::string line;
+        Terminator terminator;
+
+        terminator.type = LineType::EndOfFile;
+
+        while (reader.readLine(line)) {
+
+            Terminator lineType { classifyLine(line, reader.bLineStart, boundaries) };
+            if (lineType.type != LineType::Content) {
+                terminator = lineType;
+                break;
+            }
+
+            std::string& buffer { writer.getBuffer() };
+
+            if (bBase64) {
+                base64Decoder.decode(line, buffer);
+            } else {
+                // The line break before a boundary belongs to the boundary so
+                // line breaks are only written once the next line is seen.
+                if (bPendingNewline) {
+                    buffer += "\r\n";
+                }
+                if (bQuotedPrintable && reader.bLineEnded && !line.empty() && (line.back() == '=')) {
+                    Pendulum_MIMEDecode::decodeQuotedPrintable(std::string_view(line).substr(0, line.size() - 1), buffer);
+                    bPendingNewline = false; // Soft line break
+                } else {
+                    if (bQuotedPrintable) {
+                        Pendulum_MIMEDecode::decodeQuotedPrintable(line, buffer);
+                    } else {
+                        buffer += line;
+                    }
+                    bPendingNewline = reader.bLineEnded;
+                }
+            }
+
+            writer.flush();
+
+        }
+
+        if (bBase64) {
+            base64Decoder.finish(writer.getBuffer());
+        }
+
+        return (terminator);
+
+    }
+
+    //
+    // Skip body of a leaf entity (or multipart preamble/epilogue) until terminated by a boundary or end of file.
+    //
+
+    static Terminator skipBody(LineReader& reader, const std::vector<std::string>& boundaries) {
+
+        std::string line;
+        Terminator terminator;
+
+        while (reader.readLine(line)) {
+            terminator = classifyLine(line, reader.bLineStart, boundaries);
+            if (terminator.type != LineType::Content) {
+                return (terminator);
+            }
+        }
+
+        terminator.type = LineType::EndOfFile;
+
+        return (terminator);
+
+    }
+
+    //
+    // Process a MIME entity (whose headers have been read) returning the line that terminated it.
+    //
+
+    static Terminator processEntity(LineReader& reader, std::vector<std::string>& boundaries, const PartHeaders& partHeaders,
+                                    bool bTopLevel, const std::string& storeFolder, std::vector<AttachmentDetails>& attachments,
+                                    AttachmentStatistics& statistics) {
+
+        Terminator terminator;
+
+        if ((partHeaders.contentType.compare(0, 10, "multipart/") == 0) && !partHeaders.boundary.empty()) {
+
+            std::size_t level { boundaries.size() };
+            boundaries.push_back(partHeaders.boundary);
+
+            terminator = skipBody(reader, boundaries); // Preamble
+
+            while ((terminator.type == LineType::Boundary) && (terminator.level == level)) {
+                PartHeaders subPartHeaders;
+                terminator = readHeaders(reader, boundaries, subPartHeaders);
+                if (terminator.type == LineType::Content) {
+                    terminator = processEntity(reader, boundaries, subPartHeaders, false, storeFolder, attachments, statistics);
+                }
+            }
+
+            boundaries.pop_back();
+
+            if ((terminator.type == LineType::CloseBoundary) && (terminator.level == level)) {
+                terminator = skipBody(reader, boundaries); // Epilogue
+            }
+
+        } else if (isAttachment(partHeaders, bTopLevel)) {
+
+            AttachmentDetails attachment;
+            AttachmentWriter writer { storeFolder };
+
+            attachment.contentType = partHeaders.contentType;
+            attachment.fileName = Pendulum_MIMEDecode::decodeEncodedWords(partHeaders.fileName);
+            std::replace_if(attachment.fileName.begin(), attachment.fileName.end(),
+                            [] (char ch) { return ((ch == '\t') || (ch == '\r') || (ch == '\n')); }, ' ');
+
+            terminator = decodeBody(reader, boundaries, partHeaders, writer);
+            writer.finish(attachment, statistics);
+
+            statistics.attachments++;
+            attachments.push_back(attachment);
+
+        } else {
+            terminator = skipBody(reader, boundaries);
+        }
+
+        return (terminator);
+
+    }
+
+    //
+    // Write manifest for an .eml file (via a temporary file so it is never seen half written).
+    //
+
+    static void writeManifest(const std::string& emlFileName, const std::vector<AttachmentDetails>& attachments) {
+
+        std::string manifestFileName { emlFileName.substr(0, emlFileName.size() - std::strlen(Pendulum::kEMLFileExt)) + kManifestFileExt };
+        std::string tmpFileName { manifestFileName + ".tmp" };
+
+        {
+            std::ofstream manifestStream { tmpFileName, std::ios::trunc };
+            if (!manifestStream.is_open()) {
+                throw std::runtime_error("Could not create manifest [" + manifestFileName + "]");
+            }
+            for (auto& attachment : attachments) {
+                manifestStream << attachment.hash << '\t' << attachment.size << '\t' << attachment.storePath << '\t'
+                        << attachment.contentType << '\t' << attachment.fileName << '\n';
+            }
+        }
+
+        if (std::rename(tmpFileName.c_str(), manifestFileName.c_str()) != 0) {
+            std::remove(tmpFileName.c_str());
+            throw std::runtime_error("Could not create manifest [" + manifestFileName + "]");
+        }
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    //
+    // Stream parse message extracting its attachments.
+    //
+
+    std::vector<AttachmentDetails> extractAttachments(std::istream& messageStream, const std::string& storeFolder,
+                                                      AttachmentStatistics& statistics) {
+
+        std::vector<AttachmentDetails> attachments;
+        std::vector<std::string> boundaries;
+        LineReader reader { messageStream };
+        PartHeaders messageHeaders;
+
+        if (readHeaders(reader, boundaries, messageHeaders).type == LineType::Content) {
+            processEntity(reader, boundaries, messageHeaders, true, storeFolder, attachments, statistics);
+        }
+
+        statistics.messages++;
+
+        return (attachments);
+
+    }
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Create store folder and its temporary file folder.
+    //
+
+    void AttachmentExtractor::createStore() {
+
+        CPath tmpPath { storeFolder };
+        tmpPath.join(kStoreTmpFolder);
+
+        if (!CFile::exists(storeFolder)) {
+            Pendulum_Log::info("Creating attachment store [" + storeFolder + "]", Pendulum_Log::Fields().withFile(storeFolder));
+            CFile::createDirectory(storeFolder);
+        }
+        if (!CFile::exists(tmpPath)) {
+            CFile::createDirectory(tmpPath);
+        }
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    AttachmentExtractor::AttachmentExtractor(const std::string& storeFolder, std::size_t workerCount) :
+            storeFolder { storeFolder },
+            ownPool { std::make_unique<Pendulum_WorkerPool::WorkerPool>(workerCount, workerCount * kQueuePerWorker) },
+            workerPool { ownPool.get() } {
+        createStore();
+    }
+
+    AttachmentExtractor::AttachmentExtractor(const std::string& storeFolder, Pendulum_WorkerPool::WorkerPool& sharedPool) :
+            storeFolder { storeFolder }, workerPool { &sharedPool } {
+        createStore();
+    }
+
+    void AttachmentExtractor::submit(const std::string& emlFileName) {
+
+        workerPool->submit([this, emlFileName] () {
+            try {
+                std::ifstream emlFileStream { emlFileName, std::ios::binary };
+                if (!emlFileStream.is_open()) {
+                    throw std::runtime_error("Could not open [" + emlFileName + "]");
+                }
+                std::vector<AttachmentDetails> attachments { extractAttachments(emlFileStream, storeFolder, statistics) };
+                if (!attachments.empty()) {
+                    writeManifest(emlFileName, attachments);
+                }
+            } catch (...) {
+                statistics.failures++;
+                throw;
+            }
+        });
+
+    }
+
+    void AttachmentExtractor::wait() {
+        workerPool->waitIdle();
+    }
+
+    const AttachmentStatistics& AttachmentExtractor::getStatistics() const {
+        return (statistics);
+    }
+
+    std::size_t AttachmentExtractor::queueDepth() {
+        return (workerPool->queueDepth());
+    }
+
+} // namespace Pendulum_Attachments
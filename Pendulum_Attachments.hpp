@@ -0,0 +1,118 @@
+#ifndef PENDULUM_ATTACHMENTS_HPP
+#define PENDULUM_ATTACHMENTS_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+//
+// Pendulum worker pool
+//
+
+#include "Pendulum_WorkerPool.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Attachments {
+
+    //
+    // Attachment manifest file extension (one per .eml with attachments)
+    //
+
+    constexpr char const *kManifestFileExt { ".attachments" };
+
+    //
+    // Extracted attachment details
+    //
+
+    struct AttachmentDetails {
+        std::string hash;               // SHA-256 of decoded contents (hex)
+        std::uint64_t size { 0 };       // Decoded size in bytes
+        std::string contentType;        // MIME content type
+        std::string fileName;           // Attachment file name (if given)
+        std::string storePath;          // Path relative to store (empty if not stored)
+        bool bDuplicate { false };      // = true contents already in store
+    };
+
+    //
+    // Extraction statistics
+    //
+
+    struct AttachmentStatistics {
+        std::atomic<std::uint64_t> messages { 0 };          // Messages scanned
+        std::atomic<std::uint64_t> attachments { 0 };       // Attachments found
+        std::atomic<std::uint64_t> stored { 0 };            // Attachments stored
+        std::atomic<std::uint64_t> duplicates { 0 };        // Attachments already in store
+        std::atomic<std::uint64_t> bytesStored { 0 };       // Bytes written to store
+        std::atomic<std::uint64_t> bytesDeduplicated { 0 }; // Bytes not written (duplicates)
+        std::atomic<std::uint64_t> failures { 0 };          // Messages that failed
+    };
+
+    //
+    // Stream parse a message and decode each attachment into the content addressed
+    // store folder (if storeFolder is empty the attachments are only hashed). Memory
+    // use is bounded whatever the size of the message or its parts.
+    //
+
+    std::vector<AttachmentDetails> extractAttachments(std::istream& messageStream, const std::string& storeFolder,
+                                                      AttachmentStatistics& statistics);
+
+    //
+    // Attachment extraction stage run after .eml files are created. Messages are
+    // queued to a worker pool which extracts their attachments to the store and
+    // writes a manifest next to each .eml that has any.
+    //
+
+    class AttachmentExtractor {
+    public:
+
+        AttachmentExtractor(const std::string& storeFolder, std::size_t workerCount);
+
+        //
+        // Extract using a pool shared with other extractors (wait() then waits for all
+        // of the pool's work).
+        //
+
+        AttachmentExtractor(const std::string& storeFolder, Pendulum_WorkerPool::WorkerPool& sharedPool);
+
+        //
+        // Queue .eml file for attachment extraction (blocks if the queue is full).
+        //
+
+        void submit(const std::string& emlFileName);
+
+        //
+        // Wait for all queued extractions to complete.
+        //
+
+        void wait();
+
+        //
+        // Extraction statistics/queue depth.
+        //
+
+        const AttachmentStatistics& getStatistics() const;
+        std::size_t queueDepth();
+
+    private:
+
+        void createStore();
+
+        std::string storeFolder;                                // Content addressed store
+        AttachmentStatistics statistics;                        // Statistics
+        std::unique_ptr<Pendulum_WorkerPool::WorkerPool> ownPool; // Extraction workers (if not shared)
+        Pendulum_WorkerPool::WorkerPool *workerPool { nullptr };  // Pool in use
+
+    };
+
+} // namespace Pendulum_Attachments
+#endif /* PENDULUM_ATTACHMENTS_HPP */
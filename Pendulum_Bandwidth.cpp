@@ -0,0 +1,452 @@
+
+//
+// Module: Pendulum_Bandwidth
+//
+// Description: Pendulum bandwidth shaping. Bytes read from IMAP servers by every
+// connection in the process are charged to one token bucket whose rate comes from
+// a list of time-of-day profiles (so an initial archive can be held to a fraction of
+// the uplink during office hours and run flat out otherwise, or paused altogether).
+// Responses are read whole by the IMAP client so each is charged once received and
+// the connection then sleeps off any deficit before its next command; across many
+// responses that holds the combined read rate to the limit. The measured rate is
+// exported as a gauge and logged while a limit is in force.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <cctype>
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_Bandwidth.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Bandwidth {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Bucket depth in seconds of the current rate
+    //
+
+    constexpr double kBurstSeconds { 1.0 };
+
+    //
+    // How often the profile in force is re-evaluated and a paused read rechecks
+    //
+
+    constexpr std::chrono::seconds kProfileCheckInterval { 1 };
+
+    //
+    // Measured rate window and how often it is logged while limited
+    //
+
+    constexpr std::chrono::seconds kRateWindow { 5 };
+    constexpr std::chrono::seconds kRateLogInterval { 60 };
+
+    //
+    // Day names (index = tm_wday)
+    //
+
+    constexpr char const *kDayNames[] { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Process wide shaper state
+    //
+
+    struct Shaper {
+        std::mutex shaperMutex;
+        bool bActive { false };                             // = true shaping reads
+        std::vector<Profile> profiles;                      // Profiles in priority order
+        int profileNo { -2 };                               // Profile in force (-1 = none matched)
+        std::uint64_t limit { 0 };                          // Its rate (0 = unlimited)
+        bool bPaused { false };                             // = true it pauses transfers
+        std::chrono::steady_clock::time_point lastProfileCheck;
+        double tokens { 0.0 };                              // Bucket tokens (bytes, negative = deficit)
+        std::chrono::steady_clock::time_point lastRefill;
+        std::uint64_t windowBytes { 0 };                    // Bytes in current rate window
+        std::chrono::steady_clock::time_point windowStart;
+        std::uint64_t measuredRate { 0 };                   // Bytes/second over last window
+        std::chrono::steady_clock::time_point lastRateLog;
+    };
+
+    static Shaper shaper;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Trim leading/trailing whitespace.
+    //
+
+    static std::string trim(const std::string& text) {
+        std::size_t first { text.find_first_not_of(" \t") };
+        if (first == std::string::npos) {
+            return ("");
+        }
+        return (text.substr(first, text.find_last_not_of(" \t") - first + 1));
+    }
+
+    //
+    // Day name (first three letters, any case) to tm_wday.
+    //
+
+    static int parseDay(const std::string& dayName) {
+        std::string name;
+        for (auto ch : dayName.substr(0, 3)) {
+            name += static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        }
+        for (int day = 0; day < 7; day++) {
+            if (name == kDayNames[day]) {
+                return (day);
+            }
+        }
+        throw std::invalid_argument("Invalid bandwidth profile day [" + dayName + "].");
+    }
+
+    //
+    // HH:MM to minutes after midnight (24:00 allowed as a window end).
+    //
+
+    static int parseTime(const std::string& time) {
+        std::size_t colon { time.find(':') };
+        try {
+            if (colon != std::string::npos) {
+                int hours { std::stoi(time.substr(0, colon)) };
+                int minutes { std::stoi(time.substr(colon + 1)) };
+                if ((hours >= 0) && (minutes >= 0) && (minutes < 60) && ((hours * 60 + minutes) <= (24 * 60))) {
+                    return (hours * 60 + minutes);
+                }
+            }
+        } catch (const std::logic_error&) {
+        }
+        throw std::invalid_argument("Invalid bandwidth profile time [" + time + "] (use HH:MM).");
+    }
+
+    //
+    // Rate (bytes/second with K/M/G suffix, unlimited or pause) into profile.
+    //
+
+    static void parseRate(const std::string& rate, Profile& profile) {
+
+        if (rate == "unlimited") {
+            return;
+        } else if (rate == "pause") {
+            profile.bPaused = true;
+            return;
+        }
+
+        try {
+            std::size_t rateEnd { 0 };
+            double bytesPerSecond { std::stod(rate, &rateEnd) };
+            std::string suffix { rate.substr(rateEnd) };
+            if (suffix == "K" || suffix == "k") {
+                bytesPerSecond *= 1024;
+            } else if (suffix == "M" || suffix == "m") {
+                bytesPerSecond *= 1024 * 1024;
+            } else if (suffix == "G" || suffix == "g") {
+                bytesPerSecond *= 1024 * 1024 * 1024;
+            } else if (!suffix.empty()) {
+                bytesPerSecond = -1;
+            }
+            if (bytesPerSecond >= 1) {
+                profile.bytesPerSecond = static_cast<std::uint64_t>(bytesPerSecond);
+                return;
+            }
+        } catch (const std::logic_error&) {
+        }
+
+        throw std::invalid_argument("Invalid bandwidth profile rate [" + rate + "] (use bytes/s with K, M or G suffix, unlimited or pause).");
+
+    }
+
+    //
+    // Parse one profile rule.
+    //
+
+    static Profile parseProfile(const std::string& rule) {
+
+        Profile profile;
+        std::size_t equals { rule.find('=') };
+
+        profile.rule = rule;
+
+        parseRate(trim(rule.substr((equals == std::string::npos) ? 0 : equals + 1)), profile);
+
+        if (equals == std::string::npos) {
+            return (profile);
+        }
+
+        std::istringstream whenStream { rule.substr(0, equals) };
+        std::string when;
+
+        while (whenStream >> when) {
+            std::size_t dash { when.find('-') };
+            if (when.find(':') != std::string::npos) {
+                if (dash == std::string::npos) {
+                    throw std::invalid_argument("Invalid bandwidth profile window [" + when + "] (use HH:MM-HH:MM).");
+                }
+                profile.startMinute = parseTime(when.substr(0, dash));
+                profile.endMinute = parseTime(when.substr(dash + 1));
+            } else {
+                int firstDay { parseDay(when.substr(0, dash)) };
+                int lastDay { (dash == std::string::npos) ? firstDay : parseDay(when.substr(dash + 1)) };
+                profile.days = 0;
+                for (int day = firstDay;; day = (day + 1) % 7) {
+                    profile.days |= (1u << day);
+                    if (day == lastDay) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        return (profile);
+
+    }
+
+    //
+    // Rate for logging.
+    //
+
+    static std::string formatRate(std::uint64_t bytesPerSecond) {
+        std::ostringstream rateStream;
+        rateStream << std::fixed << std::setprecision(2) << (static_cast<double>(bytesPerSecond) / (1024.0 * 1024.0)) << " MB/s";
+        return (rateStream.str());
+    }
+
+    //
+    // Index of first profile matching local time now (-1 = none).
+    //
+
+    static int matchProfile(const std::vector<Profile>& profiles) {
+
+        std::time_t now { std::time(nullptr) };
+        std::tm localNow {};
+
+        ::localtime_r(&now, &localNow);
+
+        int minute { localNow.tm_hour * 60 + localNow.tm_min };
+
+        for (std::size_t profileNo = 0; profileNo < profiles.size(); profileNo++) {
+            const Profile& profile { profiles[profileNo] };
+            bool bInWindow { (profile.startMinute < profile.endMinute) ?
+                             ((minute >= profile.startMinute) && (minute < profile.endMinute)) :
+                             ((minute >= profile.startMinute) || (minute < profile.endMinute)) };
+            if ((profile.days & (1u << localNow.tm_wday)) && bInWindow) {
+                return (static_cast<int>(profileNo));
+            }
+        }
+
+        return (-1);
+
+    }
+
+    //
+    // Re-evaluate the profile in force (at most once per check interval). A change
+    // is logged and starts the bucket full. Caller holds the lock.
+    //
+
+    static void selectProfile(std::chrono::steady_clock::time_point now) {
+
+        static Pendulum_Metrics::Gauge& limitGauge { Pendulum_Metrics::gauge("pendulum_bandwidth_limit_bytes_per_second", "Bandwidth limit in force (0 = unlimited, -1 = paused).") };
+
+        if ((shaper.profileNo != -2) && ((now - shaper.lastProfileCheck) < kProfileCheckInterval)) {
+            return;
+        }
+
+        shaper.lastProfileCheck = now;
+
+        int profileNo { matchProfile(shaper.profiles) };
+
+        if (profileNo == shaper.profileNo) {
+            return;
+        }
+
+        shaper.profileNo = profileNo;
+        shaper.limit = (profileNo >= 0) ? shaper.profiles[profileNo].bytesPerSecond : 0;
+        shaper.bPaused = (profileNo >= 0) && shaper.profiles[profileNo].bPaused;
+        shaper.tokens = static_cast<double>(shaper.limit) * kBurstSeconds;
+        shaper.lastRefill = now;
+
+        std::string rule { (profileNo >= 0) ? " (" + shaper.profiles[profileNo].rule + ")" : "" };
+
+        if (shaper.bPaused) {
+            limitGauge.set(-1);
+            Pendulum_Log::info("Bandwidth transfers paused" + rule);
+        } else {
+            limitGauge.set(shaper.limit);
+            Pendulum_Log::info("Bandwidth limit " + (shaper.limit ? formatRate(shaper.limit) : std::string("unlimited")) + rule);
+        }
+
+    }
+
+    //
+    // Add bytes to the measured rate, publishing it each window (and logging it
+    // periodically while limited). Caller holds the lock.
+    //
+
+    static void measureRate(std::chrono::steady_clock::time_point now, std::size_t bytes) {
+
+        static Pendulum_Metrics::Gauge& rateGauge { Pendulum_Metrics::gauge("pendulum_bandwidth_rate_bytes_per_second", "Measured IMAP read rate.") };
+
+        shaper.windowBytes += bytes;
+
+        std::chrono::duration<double> windowTime { now - shaper.windowStart };
+
+        if (windowTime < kRateWindow) {
+            return;
+        }
+
+        shaper.measuredRate = static_cast<std::uint64_t>(shaper.windowBytes / windowTime.count());
+        shaper.windowBytes = 0;
+        shaper.windowStart = now;
+
+        rateGauge.set(shaper.measuredRate);
+
+        if (shaper.limit && ((now - shaper.lastRateLog) >= kRateLogInterval)) {
+            shaper.lastRateLog = now;
+            Pendulum_Log::info("Bandwidth " + formatRate(shaper.measuredRate) + " (limit " + formatRate(shaper.limit) + ")");
+        }
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    std::vector<Profile> parseProfiles(const std::string& profileList) {
+
+        std::vector<Profile> profiles;
+        std::istringstream profileStream { profileList };
+        std::string rule;
+
+        while (std::getline(profileStream, rule, ',')) {
+            rule = trim(rule);
+            if (!rule.empty()) {
+                profiles.push_back(parseProfile(rule));
+            }
+        }
+
+        return (profiles);
+
+    }
+
+    void startShaping(const std::vector<Profile>& profiles) {
+
+        std::unique_lock<std::mutex> locker(shaper.shaperMutex);
+
+        auto now { std::chrono::steady_clock::now() };
+
+        shaper.profiles = profiles;
+        shaper.profileNo = -2;
+        shaper.windowStart = now;
+        shaper.lastRateLog = now;
+        shaper.bActive = !profiles.empty();
+
+        if (shaper.bActive) {
+            selectProfile(now);
+        }
+
+    }
+
+    void stopShaping() {
+        std::unique_lock<std::mutex> locker(shaper.shaperMutex);
+        shaper.bActive = false;
+        shaper.profiles.clear();
+    }
+
+    void throttle(std::size_t bytes) {
+
+        static Pendulum_Metrics::Histogram& delayHistogram { Pendulum_Metrics::histogram("pendulum_bandwidth_delay_seconds", "Time reads were held back by bandwidth shaping.") };
+
+        std::unique_lock<std::mutex> locker(shaper.shaperMutex);
+
+        if (!shaper.bActive) {
+            return;
+        }
+
+        auto now { std::chrono::steady_clock::now() };
+
+        measureRate(now, bytes);
+        selectProfile(now);
+
+        // Paused: wait until the profile in force changes
+
+        while (shaper.bActive && shaper.bPaused) {
+            locker.unlock();
+            std::this_thread::sleep_for(kProfileCheckInterval);
+            locker.lock();
+            now = std::chrono::steady_clock::now();
+            selectProfile(now);
+        }
+
+        if (!shaper.bActive || !shaper.limit) {
+            return;
+        }
+
+        // Refill then charge the bucket; sleep off any deficit
+
+        double limit { static_cast<double>(shaper.limit) };
+
+        shaper.tokens = std::min(limit * kBurstSeconds, shaper.tokens + std::chrono::duration<double>(now - shaper.lastRefill).count() * limit);
+        shaper.lastRefill = now;
+        shaper.tokens -= static_cast<double>(bytes);
+
+        if (shaper.tokens >= 0) {
+            return;
+        }
+
+        std::chrono::microseconds delay { static_cast<std::int64_t>((-shaper.tokens / limit) * 1e6) };
+
+        locker.unlock();
+
+        delayHistogram.record(delay.count());
+        std::this_thread::sleep_for(delay);
+
+    }
+
+    std::uint64_t currentRate() {
+        std::unique_lock<std::mutex> locker(shaper.shaperMutex);
+        return (shaper.measuredRate);
+    }
+
+    std::uint64_t currentLimit() {
+        std::unique_lock<std::mutex> locker(shaper.shaperMutex);
+        return (shaper.bActive ? shaper.limit : 0);
+    }
+
+} // namespace Pendulum_Bandwidth
@@ -0,0 +1,66 @@
+#ifndef PENDULUM_BANDWIDTH_HPP
+#define PENDULUM_BANDWIDTH_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Bandwidth {
+
+    //
+    // Bandwidth profile rule: the rate applied on the given days between the given
+    // times (local time). A window whose end is before its start wraps past midnight.
+    //
+
+    struct Profile {
+        unsigned days { 0x7f };                 // Days active (bit 0 = Sunday)
+        int startMinute { 0 };                  // Window start (minutes after midnight)
+        int endMinute { 24 * 60 };              // Window end (exclusive)
+        std::uint64_t bytesPerSecond { 0 };     // Rate limit (0 = unlimited)
+        bool bPaused { false };                 // = true no transfers in window
+        std::string rule;                       // Rule as given (for logging)
+    };
+
+    //
+    // Parse a comma separated profile list. Each rule is [days] [HH:MM-HH:MM]=rate
+    // or just a rate (applies at all times) where days is a day or day range (for
+    // example Mon-Fri) and rate is bytes/second with an optional K, M or G suffix,
+    // unlimited or pause. The first rule matching the time applies; none matching
+    // is unlimited. For example "Mon-Fri 08:00-18:00=2M,Sat-Sun=pause".
+    //
+
+    std::vector<Profile> parseProfiles(const std::string& profileList);
+
+    //
+    // Start/stop shaping IMAP reads with the given profiles. One token bucket is
+    // shared by every connection in the process.
+    //
+
+    void startShaping(const std::vector<Profile>& profiles);
+    void stopShaping();
+
+    //
+    // Account for bytes read from a server, blocking until they fit within the
+    // current profile's rate (or while it is paused).
+    //
+
+    void throttle(std::size_t bytes);
+
+    //
+    // Measured read rate (bytes/second) and current limit (0 = unlimited).
+    //
+
+    std::uint64_t currentRate();
+    std::uint64_t currentLimit();
+
+} // namespace Pendulum_Bandwidth
+#endif /* PENDULUM_BANDWIDTH_HPP */
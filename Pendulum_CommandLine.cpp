@@ -19,6 +19,7 @@
 //
 
 #include <iostream>
+#include <map>
 
 //
 // Antik Classes
@@ -63,17 +64,129 @@ namespace Pendulum_CommandLine {
     static void addCommonOptions(po::options_description& commonOptions, PendulumOptions& argData) {
 
         commonOptions.add_options()
-                ("server,s", po::value<std::string>(&argData.serverURL)->required(), "IMAP Server URL and port")
-                ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
-                ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
-                ("mailbox,m", po::value<std::string>(&argData.mailBoxList)->required(), "Mailbox name (or mailbox comma separated list)")
-                ("destination,d", po::value<std::string>(&argData.destinationFolder)->required(), "Destination folder for archived e-mail")
+                ("server,s", po::value<std::string>(&argData.serverURL), "IMAP Server URL and port")
+                ("user,u", po::value<std::string>(&argData.userName), "Account username")
+                ("password,p", po::value<std::string>(&argData.userPassword), "User password")
+                ("mailbox,m", po::value<std::string>(&argData.mailBoxList), "Mailbox name (or mailbox comma separated list)")
+                ("destination,d", po::value<std::string>(&argData.destinationFolder), "Destination folder for archived e-mail")
                 ("poll", po::value<int>(&argData.pollTime), "Poll time in minutes")
+                ("poll-max", po::value<int>(&argData.pollMaxTime), "Adaptive polling longest interval in minutes")
+                ("priority", po::value<std::string>(&argData.priorityList), "Mailbox priorities (pattern=priority list)")
+                ("spares", po::value<int>(&argData.spareConnections), "Spare logged in connections kept ready")
                 ("retry,r", po::value<int>(&argData.retryCount), "Server reconnect retry count")
                 ("log,l",po::value<std::string>(&argData.logFileName), "Log file")
                 ("ignore,i",po::value<std::string>(&argData.ignoreList), "Ignore mailbox list")
+                ("attachments",po::value<std::string>(&argData.attachmentFolder), "Extract attachments to store folder")
+                ("workers",po::value<int>(&argData.workerCount), "Attachment extraction, verify and export worker threads")
+                ("maxsize",po::value<int>(&argData.maxSizeMB), "Skip messages larger than size in MB")
+                ("since",po::value<std::string>(&argData.sinceDate), "Only archive mail since date (YYYY-MM-DD)")
+                ("exclude",po::value<std::string>(&argData.excludeList), "Excluded sender list (wildcards allowed)")
+                ("metrics",po::value<std::string>(&argData.metricsFileName), "Export metrics to Prometheus text file")
+                ("metrics-interval",po::value<int>(&argData.metricsInterval), "Metrics export interval in seconds")
+                ("trace",po::value<std::string>(&argData.traceFileName), "Write span trace to Chrome trace JSON file")
+                ("log-level",po::value<std::string>(&argData.logLevel), "Log level (debug, info, warning, error)")
+                ("progress",po::value<int>(&argData.progressInterval), "Progress report interval in seconds")
+                ("progress-fd",po::value<int>(&argData.progressFD), "Write progress JSON line events to file descriptor")
+                ("connections",po::value<int>(&argData.maxConnections), "Daemon connections per account")
+                ("bandwidth",po::value<std::string>(&argData.bandwidthProfile), "Bandwidth limit profiles (e.g. Mon-Fri 08:00-18:00=2M)")
                 ("updates,u", "Search since last file archived.")
-                ("all,a", "Download files for all mailboxes.");
+                ("all,a", "Download files for all mailboxes.")
+                ("zerocopy", "Use zero-copy/arena response parser.")
+                ("plan", "Report what archiving would fetch (nothing archived).")
+                ("log-json", "Log as JSON lines.");
+
+    }
+
+    //
+    // Set flag options. These have no value so are only seen by being present.
+    //
+
+    static void setFlagOptions(const po::variables_map& vm, PendulumOptions& argData) {
+
+        // Search for new e-mails only
+
+        if (vm.count("updates")) {
+            argData.bOnlyUpdates = true;
+        }
+
+        // Download all mailboxes
+
+        if (vm.count("all")) {
+            argData.bAllMailBoxes = true;
+        }
+
+        // Use zero-copy/arena response parser
+
+        if (vm.count("zerocopy")) {
+            argData.bZeroCopy = true;
+        }
+
+        // Log as JSON lines
+
+        if (vm.count("log-json")) {
+            argData.bLogJSON = true;
+        }
+
+        // Plan archive only
+
+        if (vm.count("plan")) {
+            argData.bPlan = true;
+        }
+
+        // Compress export
+
+        if (vm.count("zstd")) {
+            argData.bZstd = true;
+        }
+
+        // Seed checksum manifests when verifying
+
+        if (vm.count("update-manifest")) {
+            argData.bUpdateManifest = true;
+        }
+
+    }
+
+    //
+    // Account options are required for a single account (and for each daemon account).
+    //
+
+    static void checkAccountOptions(const po::variables_map& vm) {
+        for (auto option : { "server", "user", "password", "mailbox", "destination" }) {
+            if (!vm.count(option)) {
+                throw po::required_option(option);
+            }
+        }
+    }
+
+    //
+    // Check the options a command needs; verify needs only the archive unless it is
+    // to be compared with the server and export the archive and its mailboxes.
+    //
+
+    static void checkCommandOptions(const po::variables_map& vm) {
+
+        std::string command { vm.count("command") ? vm["command"].as<std::string>() : "archive" };
+
+        if (command == "verify") {
+            if (!vm.count("destination")) {
+                throw po::required_option("destination");
+            }
+            if (vm.count("server")) {
+                checkAccountOptions(vm);
+            }
+        } else if (command == "export") {
+            for (auto option : { "mailbox", "destination" }) {
+                if (!vm.count(option)) {
+                    throw po::required_option(option);
+                }
+            }
+        } else if (command != "archive") {
+            throw po::error("Unknown command [" + command + "] (archive, verify or export).");
+        } else if (!vm.count("accounts")) {
+            // Account options come from the accounts file when running as a daemon
+            checkAccountOptions(vm);
+        }
 
     }
 
@@ -94,7 +207,14 @@ namespace Pendulum_CommandLine {
         po::options_description commandLine("Program Options");
         commandLine.add_options()
                 ("help", "Print help messages")
-                ("config,c", po::value<std::string>(&optionData.configFileName), "Config File Name");
+                ("command", po::value<std::string>(&optionData.command), "Command (archive, verify or export)")
+                ("format", po::value<std::string>(&optionData.exportFormat), "Export format (mbox or tar)")
+                ("output", po::value<std::string>(&optionData.exportFileName), "Export output file (default standard output)")
+                ("zstd", "Compress export with zstd.")
+                ("update-manifest", "Verify adds files not in checksum manifests to them.")
+                ("config,c", po::value<std::string>(&optionData.configFileName), "Config File Name")
+                ("accounts", po::value<std::string>(&optionData.accountsFileName), "Run as daemon archiving every account in multi-account config file")
+                ("archive-workers", po::value<int>(&optionData.archiveWorkers), "Daemon archive worker threads");
 
         addCommonOptions(commandLine, optionData);
 
@@ -102,13 +222,18 @@ namespace Pendulum_CommandLine {
 
         addCommonOptions(configFile, optionData);
 
+        // Command may be given as the first (positional) argument
+
+        po::positional_options_description commandPosition;
+        commandPosition.add("command", 1);
+
         po::variables_map vm {};
 
         try {
 
             // Process options
 
-            po::store(po::parse_command_line(argc, argv, commandLine), vm);
+            po::store(po::command_line_parser(argc, argv).options(commandLine).positional(commandPosition).run(), vm);
 
             // Display options and exit with success
 
@@ -128,27 +253,97 @@ namespace Pendulum_CommandLine {
                 }
             }
 
-            // Search for new e-mails only
+            setFlagOptions(vm, optionData);
+
+            checkCommandOptions(vm);
+
+            po::notify(vm);
+
+        } catch (po::error& e) {
+            std::cerr << "Pendulum Error: " << e.what() << "\n" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        return(optionData);
+        
+    }
+
+    //
+    // Read the daemon's multi-account config. Each [name] section is an account taking
+    // the same options as a config file; options before the first section apply to
+    // every account unless it sets them itself, and anything else not set comes from
+    // the daemon command line.
+    //
+
+    std::vector<AccountOptions> fetchAccountOptions(const PendulumOptions& daemonOptions) {
 
-            if (vm.count("updates")) {
-                optionData.bOnlyUpdates = true;
+        std::vector<AccountOptions> accounts;
+        std::vector<po::option> sharedOptions;
+        std::vector<std::string> accountNames;
+        std::map<std::string, std::vector<po::option>> accountOptions;
+
+        try {
+
+            if (!CFile::exists(daemonOptions.accountsFileName)) {
+                throw po::error("Specified accounts file does not exist.");
             }
 
-            // Download all mailboxes
+            // Split options into shared and per account (section) ones
 
-            if (vm.count("all")) {
-                optionData.bAllMailBoxes = true;
+            std::ifstream accountsFileStream { daemonOptions.accountsFileName };
+            po::options_description anyOption;
+
+            for (auto& option : po::parse_config_file(accountsFileStream, anyOption, true).options) {
+                std::size_t sectionEnd { option.string_key.find('.') };
+                option.unregistered = false;
+                if (sectionEnd == std::string::npos) {
+                    sharedOptions.push_back(option);
+                } else {
+                    std::string accountName { option.string_key.substr(0, sectionEnd) };
+                    option.string_key = option.string_key.substr(sectionEnd + 1);
+                    if (!accountOptions.count(accountName)) {
+                        accountNames.push_back(accountName);
+                    }
+                    accountOptions[accountName].push_back(option);
+                }
             }
 
-            po::notify(vm);
+            if (accountNames.empty()) {
+                throw po::error("No accounts in accounts file.");
+            }
+
+            // Account's own options are stored first so they win over shared ones
+
+            for (auto& accountName : accountNames) {
+
+                AccountOptions account { accountName, daemonOptions };
+                po::options_description accountFile("Account Options");
+                po::variables_map vm {};
+
+                addCommonOptions(accountFile, account.optionData);
+
+                po::parsed_options ownOptions(&accountFile);
+                po::parsed_options defaultOptions(&accountFile);
+                ownOptions.options = accountOptions[accountName];
+                defaultOptions.options = sharedOptions;
+
+                po::store(ownOptions, vm);
+                po::store(defaultOptions, vm);
+                setFlagOptions(vm, account.optionData);
+                checkAccountOptions(vm);
+                po::notify(vm);
+
+                accounts.push_back(std::move(account));
+
+            }
 
         } catch (po::error& e) {
             std::cerr << "Pendulum Error: " << e.what() << "\n" << std::endl;
             exit(EXIT_FAILURE);
         }
 
-        return(optionData);
-        
+        return (accounts);
+
     }
 
 } // namespace Pendulum_CommandLine
@@ -6,6 +6,7 @@
 //
 
 #include <string>
+#include <vector>
 
 // =========
 // NAMESPACE
@@ -24,16 +25,57 @@ namespace Pendulum_CommandLine {
         std::string mailBoxList;         // Mailbox list
         std::string destinationFolder;   // Destination folder for attachments
         std::string configFileName;      // Configuration file name
+        std::string command { "archive" }; // Command (archive, verify or export)
+        std::string exportFormat { "mbox" }; // Export format (mbox or tar)
+        std::string exportFileName;      // Export output file (empty = standard output)
+        bool bZstd { false };            // = true compress export with zstd
+        bool bUpdateManifest { false };  // = true verify adds files not in manifests to them
         bool bOnlyUpdates { false };     // = true search from UID of last .eml archived
         bool bAllMailBoxes { false };    // = true archive all mailboxes
+        bool bZeroCopy { false };        // = true use zero-copy/arena response parser
+        bool bLogJSON { false };         // = true log as JSON lines
+        bool bPlan { false };            // = true report archive plan only (nothing archived)
         int pollTime { 0 };              // Poll time in minutes
+        int pollMaxTime { 0 };           // Adaptive poll longest interval in minutes (0 = fixed poll time)
         int retryCount { 5 };            // Server reconnect retry count
         std::string logFileName;         // Log file
         std::string ignoreList;          // Mailbox ignore list
+        std::string attachmentFolder;    // Attachment store folder (empty = no extraction)
+        int workerCount { 0 };           // Attachment extraction/verify/export workers (0 = one per CPU)
+        int maxSizeMB { 0 };             // Largest message archived in MB (0 = no limit)
+        std::string sinceDate;           // Only archive mail since date
+        std::string excludeList;         // Excluded sender list
+        std::string metricsFileName;     // Prometheus metrics text file (empty = no export)
+        int metricsInterval { 15 };      // Metrics export interval in seconds
+        std::string traceFileName;       // Chrome trace JSON file (empty = no tracing)
+        std::string logLevel { "info" }; // Log level (debug, info, warning, error)
+        int progressInterval { 0 };      // Progress report interval in seconds (0 = none)
+        int progressFD { -1 };           // Progress event file descriptor (-1 = none)
+        std::string accountsFileName;    // Daemon multi-account config (empty = single account)
+        int archiveWorkers { 8 };        // Daemon archive worker threads
+        int maxConnections { 2 };        // Daemon connections per account
+        std::string bandwidthProfile;    // Bandwidth limit profiles (empty = unlimited)
+        std::string priorityList;        // Mailbox priorities (empty = defaults)
+        int spareConnections { 0 };      // Spare logged in connections kept ready (0 = none)
+    };
+
+    //
+    // An account (section) of a daemon multi-account config.
+    //
+
+    struct AccountOptions {
+        std::string name;                // Section name
+        PendulumOptions optionData;      // Account options
     };
 
     PendulumOptions fetchCommandLineOptions(int argc, char** argv);
 
+    //
+    // Read every account from the multi-account config given to the daemon.
+    //
+
+    std::vector<AccountOptions> fetchAccountOptions(const PendulumOptions& daemonOptions);
+
 } // namespace Pendulum_CommandLine
 #endif /* PENDULUM_COMMANDLINE_HPP */
 
@@ -0,0 +1,259 @@
+
+//
+// Module: Pendulum_Concurrency
+//
+// Description: Pendulum adaptive (AIMD) concurrency control. Each IMAP server has a
+// controller that the connections to it report FETCH latency, throttle responses and
+// reconnects to; the daemon asks it how many connections the server may have and
+// every command waits out its pacing delay before being sent. The aim is to settle
+// at the most parallelism a server sustains without stalling or refusing commands.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_Concurrency.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Concurrency {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Responses up to kLatencySampleBytes are sampled as is. Responses of at least
+    // kBandwidthSampleBytes (where transfer time dominates) measure bandwidth and are
+    // sampled less their transfer time at the best bandwidth seen; those in between
+    // are too noisy for either.
+    //
+
+    constexpr std::size_t kLatencySampleBytes { 16 * 1024 };
+    constexpr std::size_t kBandwidthSampleBytes { 64 * 1024 };
+
+    //
+    // Latency smoothing and how fast the baseline may drift up to a slower server
+    //
+
+    constexpr double kLatencySmoothing { 0.2 };
+    constexpr double kBaselineDrift { 0.005 };
+
+    //
+    // How fast the best bandwidth seen may drift down to a slower server
+    //
+
+    constexpr double kBandwidthDrift { 0.005 };
+
+    //
+    // Latency ratios to baseline: below grow the limit, above cut it (between hold)
+    //
+
+    constexpr double kIncreaseRatio { 1.5 };
+    constexpr double kCongestedRatio { 2.0 };
+
+    //
+    // Multiplicative decrease factors
+    //
+
+    constexpr double kLatencyDecrease { 0.8 };
+    constexpr double kThrottleDecrease { 0.5 };
+    constexpr double kReconnectDecrease { 0.7 };
+
+    //
+    // At most one cut per interval (the effect of a cut takes a while to show)
+    //
+
+    constexpr std::chrono::seconds kDecreaseInterval { 5 };
+
+    //
+    // Pacing delay after a throttle (doubled each time up to the maximum) and the
+    // fraction of it taken off by each success
+    //
+
+    constexpr std::chrono::milliseconds kInitialPaceDelay { 500 };
+    constexpr std::chrono::milliseconds kMaxPaceDelay { 60 * 1000 };
+    constexpr double kPaceDecay { 0.9 };
+
+    //
+    // Throttle response codes/messages
+    //
+
+    constexpr char const *kThrottleCodes[] { "[THROTTLED]", "[LIMIT]", "[UNAVAILABLE]", "[INUSE]", "Too many", "too many", "rate limit", "Rate limit" };
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Cut the limit (at most once per interval). Caller holds the lock.
+    //
+
+    void Controller::decrease(double factor, const std::string& reason) {
+
+        auto now = std::chrono::steady_clock::now();
+
+        if ((now - lastDecrease) < kDecreaseInterval) {
+            return;
+        }
+
+        lastDecrease = now;
+        limit = std::max(1.0, limit * factor);
+
+        Pendulum_Log::warning("Server [" + server + "] " + reason + "; connection limit " + std::to_string(static_cast<int>(limit)));
+
+        limitChanged();
+
+    }
+
+    //
+    // Publish the limit (and log it when the whole number changes). Caller holds the lock.
+    //
+
+    void Controller::limitChanged() {
+
+        int wholeLimit { static_cast<int>(limit) };
+
+        Pendulum_Metrics::gauge("pendulum_concurrency_limit", "Connections allowed to server by the concurrency controller.",
+                                "server=\"" + server + "\"").set(wholeLimit);
+
+        if (wholeLimit > reportedLimit) {
+            Pendulum_Log::info("Server [" + server + "] connection limit raised to " + std::to_string(wholeLimit));
+        }
+
+        reportedLimit = wholeLimit;
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    Controller::Controller(const std::string& server, int maxConnections) :
+            server { server }, maxConnections { std::max(maxConnections, 1) } {
+        limitChanged();
+    }
+
+    void Controller::commandCompleted(std::chrono::microseconds latency, std::size_t responseBytes) {
+
+        std::unique_lock<std::mutex> locker(controllerMutex);
+
+        // Each success eases any pacing
+
+        if (paceDelay.count()) {
+            paceDelay = std::chrono::milliseconds(static_cast<std::int64_t>(paceDelay.count() * kPaceDecay));
+        }
+
+        double sample { static_cast<double>(latency.count()) };
+
+        // Take transfer time out of large responses so message size alone is not congestion
+
+        if (responseBytes > kLatencySampleBytes) {
+            if ((responseBytes < kBandwidthSampleBytes) || (baselineLatency == 0.0)) {
+                return;
+            }
+            double bandwidth { static_cast<double>(responseBytes) / std::max(sample - baselineLatency, 1.0) };
+            if (bandwidth > peakBandwidth) {
+                peakBandwidth = bandwidth;
+            } else {
+                peakBandwidth += (bandwidth - peakBandwidth) * kBandwidthDrift;
+            }
+            sample = std::max(sample - (static_cast<double>(responseBytes) / peakBandwidth), baselineLatency);
+        }
+
+        if ((baselineLatency == 0.0) || (sample < baselineLatency)) {
+            baselineLatency = sample;
+        } else {
+            baselineLatency += (sample - baselineLatency) * kBaselineDrift;
+        }
+
+        smoothedLatency = (smoothedLatency == 0.0) ? sample : smoothedLatency + (sample - smoothedLatency) * kLatencySmoothing;
+
+        if (smoothedLatency > (baselineLatency * kCongestedRatio)) {
+            decrease(kLatencyDecrease, "latency " + std::to_string(static_cast<int>(smoothedLatency / 1000)) + "ms");
+        } else if ((smoothedLatency <= (baselineLatency * kIncreaseRatio)) && (limit < maxConnections)) {
+            limit = std::min(static_cast<double>(maxConnections), limit + (1.0 / limit));
+            if (static_cast<int>(limit) != reportedLimit) {
+                limitChanged();
+            }
+        }
+
+    }
+
+    void Controller::throttled(const std::string& reason) {
+
+        static Pendulum_Metrics::Counter& throttles { Pendulum_Metrics::counter("pendulum_throttle_responses_total", "Commands refused by server throttling.") };
+
+        std::unique_lock<std::mutex> locker(controllerMutex);
+
+        throttles.add();
+
+        paceDelay = std::min(kMaxPaceDelay, std::max(kInitialPaceDelay, paceDelay * 2));
+
+        decrease(kThrottleDecrease, "throttling (" + reason + ")");
+
+    }
+
+    void Controller::reconnected() {
+        std::unique_lock<std::mutex> locker(controllerMutex);
+        decrease(kReconnectDecrease, "reconnect");
+    }
+
+    void Controller::pace() {
+
+        std::chrono::milliseconds delay;
+
+        {
+            std::unique_lock<std::mutex> locker(controllerMutex);
+            delay = paceDelay;
+        }
+
+        if (delay.count()) {
+            std::this_thread::sleep_for(delay);
+        }
+
+    }
+
+    int Controller::connectionLimit() {
+        std::unique_lock<std::mutex> locker(controllerMutex);
+        return (static_cast<int>(limit));
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    bool isThrottleResponse(const std::string& message) {
+
+        for (auto code : kThrottleCodes) {
+            if (message.find(code) != std::string::npos) {
+                return (true);
+            }
+        }
+
+        return (false);
+
+    }
+
+} // namespace Pendulum_Concurrency
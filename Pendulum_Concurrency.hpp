@@ -0,0 +1,101 @@
+#ifndef PENDULUM_CONCURRENCY_HPP
+#define PENDULUM_CONCURRENCY_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Concurrency {
+
+    //
+    // Server refused a command because of rate/connection limits.
+    //
+
+    struct ThrottledException : public std::runtime_error {
+        explicit ThrottledException(const std::string& message) : std::runtime_error("Server throttling: " + message) {
+        }
+    };
+
+    //
+    // AIMD concurrency controller for one IMAP server, shared by every connection to
+    // it. The connection limit grows additively (about one per limit commands) while
+    // FETCH latency stays near its baseline and is cut multiplicatively when latency
+    // climbs well above it, the server throttles a command or a connection has to be
+    // re-established. Throttling also paces commands (a delay that doubles with each
+    // throttle and decays with each success) so that even a single connection backs
+    // off. The limit never goes below one or above the maximum connections allowed.
+    //
+
+    class Controller {
+    public:
+
+        Controller(const std::string& server, int maxConnections);
+
+        Controller(const Controller&) = delete;
+        Controller& operator=(const Controller&) = delete;
+
+        //
+        // FETCH completed; small responses are sampled as is and large ones less their
+        // transfer time at the best bandwidth seen, so latency reflects the server
+        // rather than message size.
+        //
+
+        void commandCompleted(std::chrono::microseconds latency, std::size_t responseBytes);
+
+        //
+        // Server throttled a command / a connection was lost and re-established.
+        //
+
+        void throttled(const std::string& reason);
+        void reconnected();
+
+        //
+        // Wait out any pacing delay before sending a command.
+        //
+
+        void pace();
+
+        //
+        // Connections currently allowed.
+        //
+
+        int connectionLimit();
+
+    private:
+
+        void decrease(double factor, const std::string& reason);
+        void limitChanged();
+
+        std::string server;                                 // Server controlled
+        int maxConnections;                                 // Limit ceiling
+        std::mutex controllerMutex;
+        double limit { 1.0 };                               // Connections allowed (fractional)
+        int reportedLimit { 1 };                            // Limit last logged
+        double baselineLatency { 0.0 };                     // Uncongested latency (us)
+        double smoothedLatency { 0.0 };                     // EWMA latency (us)
+        double peakBandwidth { 0.0 };                       // Best per connection transfer rate (bytes/us)
+        std::chrono::milliseconds paceDelay { 0 };          // Delay before each command
+        std::chrono::steady_clock::time_point lastDecrease; // Time of last cut
+
+    };
+
+    //
+    // Response text carries a throttling code ([THROTTLED], [LIMIT], [UNAVAILABLE],
+    // [INUSE]) or message.
+    //
+
+    bool isThrottleResponse(const std::string& message);
+
+} // namespace Pendulum_Concurrency
+#endif /* PENDULUM_CONCURRENCY_HPP */
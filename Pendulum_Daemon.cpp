@@ -0,0 +1,779 @@
+
+//
+// Module: Pendulum_Daemon
+//
+// Description: Pendulum multi-account daemon. Every account in the accounts file is
+// archived by the one process on a shared pool of archive workers. Work is cut into
+// tasks (fetch an account's mailbox list or archive a slice of one of its mailboxes)
+// that are handed out round robin across the accounts with work, no account having
+// more tasks running than its connection limit, so one huge account cannot starve
+// the rest. An account's mailbox slices are taken highest priority first (see
+// Pendulum_Priority) and, while a backfill of lower priority is under way, an idle
+// mailbox of higher priority is queued again each poll interval so that new mail
+// in it is archived between the backfill's slices. The accounts on one server also share that server's adaptive
+// concurrency limit (see Pendulum_Concurrency). Only the mailboxes due to be polled
+// are archived by a pass (see Pendulum_PollSchedule) and the account's next pass is
+// scheduled for when its next mailbox is due. Each account's next poll is scheduled on a timer wheel when its
+// pass completes; logged in connections are reused by an account's tasks for the
+// rest of the pass. An account given spares keeps that many logged in connections ready
+// (see Pendulum_SparePool) for its tasks to take in place of connecting.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CIMAP.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <csignal>
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_Daemon.hpp"
+#include "Pendulum_MailBox.hpp"
+#include "Pendulum_File.hpp"
+#include "Pendulum_Attachments.hpp"
+#include "Pendulum_Policy.hpp"
+#include "Pendulum_WorkerPool.hpp"
+#include "Pendulum_TimerWheel.hpp"
+#include "Pendulum_Concurrency.hpp"
+#include "Pendulum_Journal.hpp"
+#include "Pendulum_PollSchedule.hpp"
+#include "Pendulum_Priority.hpp"
+#include "Pendulum_SparePool.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Daemon {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Pendulum_CommandLine;
+    using namespace Pendulum_MailBox;
+    using namespace Pendulum_File;
+    using namespace Pendulum_Attachments;
+    using namespace Pendulum_Policy;
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Poll timer wheel tick and slots (one revolution ~68 minutes)
+    //
+
+    constexpr std::chrono::seconds kWheelTick { 1 };
+    constexpr std::size_t kWheelSlots { 4096 };
+
+    //
+    // Attachment extraction queue length per worker
+    //
+
+    constexpr std::size_t kAttachmentQueuePerWorker { 4 };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Archive of one mailbox for a pass (handed from task to task)
+    //
+
+    struct MailBoxWork {
+        std::size_t mailBoxNo { 0 };        // Account mailbox list entry
+        bool bSearched { false };           // = true mailbox searched
+        MailBoxMessages messages;           // Messages found by search
+        std::size_t nextMessage { 0 };      // Next message to archive
+    };
+
+    //
+    // Server shared by one or more accounts and its concurrency controller
+    //
+
+    struct Server {
+        std::shared_ptr<Pendulum_Concurrency::Controller> concurrency; // Adaptive connection limit
+        std::vector<std::size_t> accountNos;                    // Accounts on server
+        int activeTasks { 0 };                                  // Tasks running
+    };
+
+    //
+    // Account being archived. Only the scheduler thread changes an account; its
+    // tasks just read the options, policy and extractor.
+    //
+
+    struct Account {
+        std::string name;                                       // Accounts file section
+        PendulumOptions optionData;                             // Account options
+        ArchivePolicy archivePolicy;                            // Archive policy
+        std::string policySearchCriteria;                       // and its search criteria
+        std::unique_ptr<AttachmentExtractor> attachmentExtractor; // Attachment extraction (if any)
+        std::shared_ptr<Pendulum_SparePool::SparePool> sparePool; // Spare connections (once logged in)
+        Server *server { nullptr };                             // Account's server
+        std::unique_ptr<Pendulum_PollSchedule::PollScheduler> pollScheduler; // Mailbox poll scheduling (if polling)
+        std::vector<Pendulum_Priority::PriorityRule> priorityRules; // Mailbox priorities
+        std::vector<MailBoxDetails> mailBoxList;                // Mailboxes (fetched on first pass)
+        std::vector<int> mailBoxPriority;                       // and their priorities
+        std::vector<bool> mailBoxQueued;                        // = true mailbox work queued or running
+        std::vector<std::chrono::steady_clock::time_point> mailBoxQueueTime; // Time mailbox work last queued
+        Pendulum_Priority::SliceQueue<MailBoxWork> pendingWork; // Mailbox work waiting for a worker
+        std::vector<std::unique_ptr<ServerConnection>> idleConnections; // Logged in, not in use
+        bool bListMailBoxes { false };                          // = true mailbox list to fetch
+        bool bPassActive { false };                             // = true pass in progress
+        bool bReady { false };                                  // = true in ready queue
+        bool bFinished { false };                               // = true no more passes
+        int activeTasks { 0 };                                  // Tasks running
+        int passCount { 0 };                                    // Passes completed
+        std::uint64_t passMessages { 0 };                       // Messages archived this pass
+        std::chrono::steady_clock::time_point passStart;        // Time pass started
+    };
+
+    //
+    // Task run on an archive worker; the same object carries its result back.
+    //
+
+    struct Task {
+        std::size_t accountNo { 0 };                    // Account of task
+        std::unique_ptr<ServerConnection> connection;   // Connection (null = connect first)
+        std::shared_ptr<Pendulum_SparePool::SparePool> sparePool; // Account's spare connections (if any)
+        bool bListMailBoxes { false };                  // = true fetch mailbox list
+        std::vector<MailBoxDetails> mailBoxList;        // Mailbox list fetched
+        MailBoxWork work;                               // Mailbox work (mailbox task)
+        MailBoxDetails mailBoxEntry;                    // and a copy of its mailbox
+        std::uint64_t messagesArchived { 0 };           // Messages archived
+        bool bFailed { false };                         // = true task failed
+    };
+
+    //
+    // Daemon state (owned by the scheduler thread apart from completed tasks)
+    //
+
+    struct DaemonState {
+        std::vector<Account> accounts;                          // Accounts (fixed once started)
+        std::map<std::string, Server> servers;                  // Servers by URL
+        std::deque<std::size_t> readyAccounts;                  // Accounts with work, round robin
+        Pendulum_TimerWheel::TimerWheel pollWheel { kWheelTick, kWheelSlots }; // Next poll of accounts
+        std::size_t workerCount { 0 };                          // Archive workers
+        std::size_t activeTasks { 0 };                          // Tasks running
+        bool bStopping { false };                               // = true stop requested
+        std::mutex completedMutex;
+        std::condition_variable taskCompleted;
+        std::vector<std::unique_ptr<Task>> completedTasks;      // Tasks finished (to be handled)
+        std::unique_ptr<Pendulum_WorkerPool::WorkerPool> attachmentPool; // Shared attachment workers
+        std::unique_ptr<Pendulum_WorkerPool::WorkerPool> archivePool;    // Archive workers (stopped first)
+    };
+
+    //
+    // Set by SIGTERM/SIGINT
+    //
+
+    static volatile std::sig_atomic_t bStopRequested { 0 };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Stop signal handler
+    //
+
+    static void stopHandler(int signal) {
+        (void) signal;
+        bStopRequested = 1;
+    }
+
+    //
+    // Connect and log in to an account's server (taking a spare connection if one is ready).
+    //
+
+    static std::unique_ptr<ServerConnection> connectAccount(const Account& account, const std::shared_ptr<Pendulum_SparePool::SparePool>& sparePool) {
+
+        std::unique_ptr<ServerConnection> imapConnection { std::make_unique<ServerConnection>() };
+
+        imapConnection->server->setServer(account.optionData.serverURL);
+        imapConnection->server->setUserAndPassword(account.optionData.userName, account.optionData.userPassword);
+        imapConnection->retryCount = account.optionData.retryCount;
+        imapConnection->bZeroCopy = account.optionData.bZeroCopy;
+        imapConnection->connectCount = account.passCount;
+        imapConnection->concurrency = account.server->concurrency;
+        imapConnection->spares = sparePool;
+
+        Pendulum_Log::info("Connecting to server [" + imapConnection->server->getServer() + "][" + std::to_string(imapConnection->connectCount) + "]");
+
+        serverConnect(*imapConnection);
+
+        return (imapConnection);
+
+    }
+
+    //
+    // Disconnect a connection; it may already be broken so any error is only logged.
+    //
+
+    static void disconnectAccount(ServerConnection& imapConnection) {
+        try {
+            Pendulum_Log::info("Disconnecting from server [" + imapConnection.server->getServer() + "]");
+            imapConnection.server->disconnect();
+        } catch (const std::exception& e) {
+            Pendulum_Log::warning(e.what());
+        }
+    }
+
+    //
+    // Archive the next slice of a mailbox (searching it first if this is its first slice),
+    // committing each message to the mailbox's journal and finishing it with the last slice.
+    //
+
+    static void archiveMailBoxSlice(const Account& account, Task& task) {
+
+        static Pendulum_Metrics::Counter& messagesFound { Pendulum_Metrics::counter("pendulum_messages_found_total", "New messages found by mailbox searches.") };
+
+        ServerConnection& imapConnection { *task.connection };
+        MailBoxWork& work { task.work };
+
+        if (!work.bSearched) {
+            work.messages = findArchiveMessages(imapConnection, task.mailBoxEntry, account.optionData.destinationFolder,
+                                                account.optionData.bOnlyUpdates, account.archivePolicy, account.policySearchCriteria, false);
+            work.bSearched = true;
+            if (work.messages.messageUID.size()) {
+                Pendulum_Log::info("Messages found = " + std::to_string(work.messages.messageUID.size()),
+                                   Pendulum_Log::Fields().withMailBox(task.mailBoxEntry.name).withCount(work.messages.messageUID.size()));
+                messagesFound.add(work.messages.messageUID.size());
+            } else {
+                Pendulum_Log::info("No messages found.", Pendulum_Log::Fields().withMailBox(task.mailBoxEntry.name).withCount(0));
+            }
+        } else if (imapConnection.reconnectMailBox != task.mailBoxEntry.name) {
+            imapConnection.reconnectMailBox = task.mailBoxEntry.name;
+            selectMailBox(imapConnection, task.mailBoxEntry.name);
+        }
+
+        std::size_t sliceEnd { std::min(work.nextMessage + Pendulum_Priority::kSliceMessages, work.messages.messageUID.size()) };
+
+        for (; (work.nextMessage < sliceEnd) && !bStopRequested; work.nextMessage++) {
+            std::uint64_t uid { work.messages.messageUID[work.nextMessage] };
+            EmailContents emailContents { fetchEmailContents(imapConnection, uid) };
+            if (emailContents.subject.size() && emailContents.body.size()) {
+                std::string emlFileName { createEMLFile(emailContents.subject, emailContents.body, uid, task.mailBoxEntry.path) };
+                if (account.attachmentExtractor && !emlFileName.empty()) {
+                    account.attachmentExtractor->submit(emlFileName);
+                }
+                task.messagesArchived++;
+            } else {
+                Pendulum_Log::warning("E-mail file not created as subject or contents empty",
+                                      Pendulum_Log::Fields().withMailBox(task.mailBoxEntry.name).withUID(uid));
+            }
+            Pendulum_Journal::commitMessage(task.mailBoxEntry.path, uid);
+        }
+
+        if (work.nextMessage == work.messages.messageUID.size()) {
+            Pendulum_Journal::finishMailBox(task.mailBoxEntry.path);
+        }
+
+    }
+
+    //
+    // Run a task on an archive worker. A failure is logged and ends only the task
+    // (its connection is dropped); the other accounts carry on.
+    //
+
+    static void runTask(DaemonState& daemon, std::unique_ptr<Task> task) {
+
+        const Account& account { daemon.accounts[task->accountNo] };
+        Pendulum_Log::AccountScope accountScope { account.name };
+
+        try {
+            if (!task->connection) {
+                task->connection = connectAccount(account, task->sparePool);
+                task->connection->reconnectMailBox = "";
+            }
+            if (task->bListMailBoxes) {
+                task->mailBoxList = fetchMailBoxList(*task->connection, account.optionData.mailBoxList,
+                                                     account.optionData.ignoreList, account.optionData.bAllMailBoxes);
+            } else {
+                archiveMailBoxSlice(account, *task);
+            }
+        } catch (const std::exception& e) {
+            Pendulum_Log::error(e.what(), Pendulum_Log::Fields().withMailBox(task->mailBoxEntry.name));
+            task->bFailed = true;
+            if (task->connection) {
+                disconnectAccount(*task->connection);
+                task->connection.reset();
+            }
+        }
+
+        std::unique_lock<std::mutex> locker(daemon.completedMutex);
+        daemon.completedTasks.push_back(std::move(task));
+        daemon.taskCompleted.notify_one();
+
+    }
+
+    //
+    // Account has work that can be handed out now (within its own and its server's limit).
+    //
+
+    static bool canDispatch(const Account& account) {
+        return ((account.bListMailBoxes || !account.pendingWork.empty()) &&
+                (account.activeTasks < std::max(account.optionData.maxConnections, 1)) &&
+                (account.server->activeTasks < account.server->concurrency->connectionLimit()));
+    }
+
+    //
+    // Add account to the back of the ready queue (if not already queued).
+    //
+
+    static void makeReady(DaemonState& daemon, std::size_t accountNo) {
+        Account& account { daemon.accounts[accountNo] };
+        if (!account.bReady && canDispatch(account)) {
+            account.bReady = true;
+            daemon.readyAccounts.push_back(accountNo);
+        }
+    }
+
+    //
+    // Hand an account's next piece of work (with an idle connection if it has one) to a worker.
+    //
+
+    static void dispatchTask(DaemonState& daemon, std::size_t accountNo) {
+
+        Account& account { daemon.accounts[accountNo] };
+        std::unique_ptr<Task> task { std::make_unique<Task>() };
+
+        task->accountNo = accountNo;
+        task->sparePool = account.sparePool;
+
+        if (!account.idleConnections.empty()) {
+            task->connection = std::move(account.idleConnections.back());
+            task->connection->spares = account.sparePool;
+            account.idleConnections.pop_back();
+        }
+
+        if (account.bListMailBoxes) {
+            task->bListMailBoxes = true;
+            account.bListMailBoxes = false;
+        } else {
+            task->work = account.pendingWork.pop();
+            task->mailBoxEntry = account.mailBoxList[task->work.mailBoxNo];
+        }
+
+        account.activeTasks++;
+        account.server->activeTasks++;
+        daemon.activeTasks++;
+
+        // Pool tasks must be copyable so the task is passed as a raw pointer
+
+        Task *submitted { task.release() };
+        daemon.archivePool->submit([&daemon, submitted]() {
+            runTask(daemon, std::unique_ptr<Task>(submitted));
+        });
+
+    }
+
+    //
+    // Hand out work round robin across ready accounts while there are free workers.
+    // An account still able to take more goes to the back of the queue.
+    //
+
+    static void dispatchTasks(DaemonState& daemon) {
+
+        while ((daemon.activeTasks < daemon.workerCount) && !daemon.readyAccounts.empty()) {
+            std::size_t accountNo { daemon.readyAccounts.front() };
+            daemon.readyAccounts.pop_front();
+            daemon.accounts[accountNo].bReady = false;
+            if (canDispatch(daemon.accounts[accountNo])) {
+                dispatchTask(daemon, accountNo);
+                makeReady(daemon, accountNo);
+            }
+        }
+
+    }
+
+    //
+    // Queue work to archive (search first) one of an account's mailboxes.
+    //
+
+    static void queueMailBox(Account& account, std::size_t mailBoxNo) {
+        MailBoxWork work;
+        work.mailBoxNo = mailBoxNo;
+        account.pendingWork.push(std::move(work), account.mailBoxPriority[mailBoxNo]);
+        account.mailBoxQueued[mailBoxNo] = true;
+        account.mailBoxQueueTime[mailBoxNo] = std::chrono::steady_clock::now();
+    }
+
+    //
+    // Queue work to archive each of an account's mailboxes due to be polled.
+    //
+
+    static void queueMailBoxes(Account& account) {
+        for (std::size_t mailBoxNo = 0; mailBoxNo < account.mailBoxList.size(); mailBoxNo++) {
+            if (account.pollScheduler && !account.pollScheduler->isDue(account.mailBoxList[mailBoxNo].name)) {
+                account.pollScheduler->recordSkip();
+                continue;
+            }
+            queueMailBox(account, mailBoxNo);
+        }
+    }
+
+    //
+    // While a polling account's pass is held up by lower priority work, queue again any
+    // idle mailbox of higher priority that has not been searched for a poll interval.
+    //
+
+    static void requeueHigherPriority(Account& account) {
+
+        if (!account.optionData.pollTime || account.pendingWork.empty()) {
+            return;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        for (std::size_t mailBoxNo = 0; mailBoxNo < account.mailBoxList.size(); mailBoxNo++) {
+            if (!account.mailBoxQueued[mailBoxNo] && (account.mailBoxPriority[mailBoxNo] > account.pendingWork.topPriority()) &&
+                (account.mailBoxQueueTime[mailBoxNo] != std::chrono::steady_clock::time_point()) &&
+                ((now - account.mailBoxQueueTime[mailBoxNo]) >= std::chrono::minutes(account.optionData.pollTime))) {
+                Pendulum_Log::info("Searching again for new mail during backfill",
+                                   Pendulum_Log::Fields().withMailBox(account.mailBoxList[mailBoxNo].name));
+                queueMailBox(account, mailBoxNo);
+            }
+        }
+
+    }
+
+    //
+    // Complete an account's pass; disconnect and schedule its next poll (if it polls).
+    //
+
+    static void endPass(DaemonState& daemon, std::size_t accountNo) {
+
+        static Pendulum_Metrics::Counter& passCount { Pendulum_Metrics::counter("pendulum_passes_total", "Archive passes completed.") };
+        static Pendulum_Metrics::Gauge& lastPassTime { Pendulum_Metrics::gauge("pendulum_last_pass_timestamp_seconds", "Unix time last archive pass completed.") };
+
+        Account& account { daemon.accounts[accountNo] };
+        Pendulum_Log::AccountScope accountScope { account.name };
+
+        for (auto& imapConnection : account.idleConnections) {
+            disconnectAccount(*imapConnection);
+        }
+        account.idleConnections.clear();
+
+        std::chrono::seconds passTime { std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - account.passStart) };
+
+        Pendulum_Log::info("Pass complete, messages archived = " + std::to_string(account.passMessages)
+                           + " in " + std::to_string(passTime.count()) + "s",
+                           Pendulum_Log::Fields().withCount(account.passMessages));
+
+        Pendulum_Metrics::counter("pendulum_account_messages_archived_total", "Messages archived by account.",
+                                  "account=\"" + account.name + "\"").add(account.passMessages);
+        passCount.add();
+        lastPassTime.set(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+        account.bPassActive = false;
+        account.passCount++;
+
+        if (account.pollScheduler && !daemon.bStopping) {
+            account.pollScheduler->endCycle();
+            daemon.pollWheel.schedule(accountNo, std::chrono::steady_clock::now() + account.pollScheduler->timeToNextPoll());
+        } else {
+            account.bFinished = true;
+        }
+
+    }
+
+    //
+    // Start an archive pass of an account.
+    //
+
+    static void startPass(DaemonState& daemon, std::size_t accountNo) {
+
+        Account& account { daemon.accounts[accountNo] };
+
+        account.bPassActive = true;
+        account.passMessages = 0;
+        account.passStart = std::chrono::steady_clock::now();
+
+        Pendulum_Log::info("Starting pass [" + std::to_string(account.passCount) + "]", Pendulum_Log::Fields().withAccount(account.name));
+
+        if (account.mailBoxList.empty()) {
+            account.bListMailBoxes = true;
+        } else {
+            queueMailBoxes(account);
+        }
+
+        // No mailbox due (they were batched into an earlier pass)
+
+        if (!account.bListMailBoxes && account.pendingWork.empty()) {
+            endPass(daemon, accountNo);
+            return;
+        }
+
+        makeReady(daemon, accountNo);
+
+    }
+
+    //
+    // Handle a completed task: keep its connection for the account's next task (unless
+    // its server is at its concurrency limit) and put any of the mailbox left to archive
+    // behind the account's other work of the same priority so those mailboxes get a turn.
+    // Accounts held back by the server's limit are made ready again.
+    //
+
+    static void completeTask(DaemonState& daemon, std::unique_ptr<Task> task) {
+
+        Account& account { daemon.accounts[task->accountNo] };
+
+        account.activeTasks--;
+        account.server->activeTasks--;
+        daemon.activeTasks--;
+        account.passMessages += task->messagesArchived;
+
+        // Keep spare connections once the account has logged in (so bad credentials are
+        // not retried in the background)
+
+        if (task->connection && !account.sparePool && (account.optionData.spareConnections > 0) && !daemon.bStopping) {
+            account.sparePool = std::make_shared<Pendulum_SparePool::SparePool>(account.optionData.serverURL, account.optionData.userName,
+                                                                                account.optionData.userPassword, account.optionData.spareConnections,
+                                                                                account.name);
+        }
+
+        if (task->connection) {
+            if (daemon.bStopping || (account.server->activeTasks >= account.server->concurrency->connectionLimit())) {
+                Pendulum_Log::AccountScope accountScope { account.name };
+                disconnectAccount(*task->connection);
+            } else {
+                account.idleConnections.push_back(std::move(task->connection));
+            }
+        }
+
+        if (task->bListMailBoxes) {
+            if (!task->bFailed) {
+                account.mailBoxList = std::move(task->mailBoxList);
+                account.mailBoxPriority.clear();
+                for (auto& mailBoxEntry : account.mailBoxList) {
+                    account.mailBoxPriority.push_back(Pendulum_Priority::mailBoxPriority(account.priorityRules, mailBoxEntry.name));
+                }
+                account.mailBoxQueued.assign(account.mailBoxList.size(), false);
+                account.mailBoxQueueTime.assign(account.mailBoxList.size(), std::chrono::steady_clock::time_point());
+                queueMailBoxes(account);
+            }
+        } else {
+            MailBoxDetails& mailBoxEntry { account.mailBoxList[task->work.mailBoxNo] };
+            mailBoxEntry.path = task->mailBoxEntry.path;
+            mailBoxEntry.searchUID = task->mailBoxEntry.searchUID;
+            account.mailBoxQueued[task->work.mailBoxNo] = false;
+            if (task->bFailed && account.pollScheduler) {
+                account.pollScheduler->deferPoll(mailBoxEntry.name);
+            } else if (!task->bFailed) {
+                if (task->work.nextMessage < task->work.messages.messageUID.size()) {
+                    if (!daemon.bStopping) {
+                        std::size_t mailBoxNo { task->work.mailBoxNo };
+                        account.mailBoxQueued[mailBoxNo] = true;
+                        account.pendingWork.push(std::move(task->work), account.mailBoxPriority[mailBoxNo]);
+                    }
+                } else {
+                    if (task->work.messages.highestUID) {
+                        mailBoxEntry.searchUID = task->work.messages.highestUID; // Update search UID (includes excluded messages)
+                    }
+                    if (account.pollScheduler) {
+                        account.pollScheduler->recordPoll(mailBoxEntry.name, task->work.messages.messageUID.size());
+                    }
+                }
+            }
+        }
+
+        if (!daemon.bStopping) {
+            requeueHigherPriority(account);
+        }
+
+        if (account.bPassActive && !account.activeTasks && !account.bListMailBoxes && account.pendingWork.empty()) {
+            endPass(daemon, task->accountNo);
+        }
+
+        for (auto accountNo : account.server->accountNos) {
+            makeReady(daemon, accountNo);
+        }
+
+    }
+
+    //
+    // Load accounts from the accounts file with their policies and attachment extractors.
+    //
+
+    static void loadAccounts(DaemonState& daemon, const PendulumOptions& daemonOptions) {
+
+        for (auto& accountOptions : fetchAccountOptions(daemonOptions)) {
+
+            Account account;
+
+            account.name = accountOptions.name;
+            account.optionData = accountOptions.optionData;
+            account.archivePolicy = createArchivePolicy(account.optionData.maxSizeMB, account.optionData.sinceDate, account.optionData.excludeList);
+            account.policySearchCriteria = buildSearchCriteria(account.archivePolicy);
+            account.priorityRules = Pendulum_Priority::parsePriorities(account.optionData.priorityList);
+
+            if (account.optionData.pollTime) {
+                account.pollScheduler = std::make_unique<Pendulum_PollSchedule::PollScheduler>(account.optionData.destinationFolder,
+                                                                                                std::chrono::minutes(account.optionData.pollTime),
+                                                                                                std::chrono::minutes(account.optionData.pollMaxTime));
+            }
+
+            // Attachment extraction shares one pool across accounts
+
+            if (!account.optionData.attachmentFolder.empty()) {
+                if (!daemon.attachmentPool) {
+                    std::size_t workerCount = (daemonOptions.workerCount > 0) ? daemonOptions.workerCount : std::thread::hardware_concurrency();
+                    daemon.attachmentPool = std::make_unique<Pendulum_WorkerPool::WorkerPool>(workerCount, workerCount * kAttachmentQueuePerWorker);
+                }
+                account.attachmentExtractor = std::make_unique<AttachmentExtractor>(account.optionData.attachmentFolder, *daemon.attachmentPool);
+            }
+
+            daemon.accounts.push_back(std::move(account));
+
+        }
+
+        // Accounts on the same server share its concurrency controller (limited to
+        // the sum of their connections)
+
+        std::map<std::string, int> serverConnections;
+
+        for (std::size_t accountNo = 0; accountNo < daemon.accounts.size(); accountNo++) {
+            Account& account { daemon.accounts[accountNo] };
+            daemon.servers[account.optionData.serverURL].accountNos.push_back(accountNo);
+            serverConnections[account.optionData.serverURL] += std::max(account.optionData.maxConnections, 1);
+        }
+
+        for (auto& server : daemon.servers) {
+            server.second.concurrency = std::make_shared<Pendulum_Concurrency::Controller>(server.first, serverConnections[server.first]);
+            for (auto accountNo : server.second.accountNos) {
+                daemon.accounts[accountNo].server = &server.second;
+            }
+        }
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    void runDaemon(const PendulumOptions& daemonOptions) {
+
+        DaemonState daemon;
+
+        loadAccounts(daemon, daemonOptions);
+
+        if ((daemonOptions.progressInterval > 0) || (daemonOptions.progressFD >= 0)) {
+            Pendulum_Log::warning("Progress reporting is not available in daemon mode; ignored.");
+        }
+
+        daemon.workerCount = std::max(daemonOptions.archiveWorkers, 1);
+        daemon.archivePool = std::make_unique<Pendulum_WorkerPool::WorkerPool>(daemon.workerCount, daemon.workerCount);
+
+        ::signal(SIGTERM, stopHandler);
+        ::signal(SIGINT, stopHandler);
+
+        Pendulum_Log::info("Daemon archiving " + std::to_string(daemon.accounts.size()) + " accounts with "
+                           + std::to_string(daemon.workerCount) + " workers.");
+
+        // First pass of every account (in accounts file order)
+
+        for (std::size_t accountNo = 0; accountNo < daemon.accounts.size(); accountNo++) {
+            startPass(daemon, accountNo);
+        }
+
+        // Scheduler loop
+
+        while (true) {
+
+            std::vector<std::unique_ptr<Task>> completedTasks;
+
+            {
+                std::unique_lock<std::mutex> locker(daemon.completedMutex);
+                daemon.taskCompleted.wait_for(locker, kWheelTick, [&daemon]() {
+                    return (!daemon.completedTasks.empty() || bStopRequested);
+                });
+                completedTasks.swap(daemon.completedTasks);
+            }
+
+            if (bStopRequested && !daemon.bStopping) {
+                Pendulum_Log::info("Daemon stopping; waiting for running tasks.");
+                daemon.bStopping = true;
+                daemon.readyAccounts.clear();
+                for (auto& account : daemon.accounts) {
+                    account.bReady = false;
+                    account.bListMailBoxes = false;
+                    account.pendingWork.clear();
+                }
+            }
+
+            for (auto& task : completedTasks) {
+                completeTask(daemon, std::move(task));
+            }
+
+            if (!daemon.bStopping) {
+                for (auto accountNo : daemon.pollWheel.advance(std::chrono::steady_clock::now())) {
+                    startPass(daemon, accountNo);
+                }
+                dispatchTasks(daemon);
+            }
+
+            if (!daemon.activeTasks && (daemon.bStopping ||
+                    std::all_of(daemon.accounts.begin(), daemon.accounts.end(), [](const Account& account) { return (account.bFinished); }))) {
+                break;
+            }
+
+        }
+
+        // Stop workers and disconnect any connections left
+
+        daemon.archivePool.reset();
+
+        for (auto& account : daemon.accounts) {
+            Pendulum_Log::AccountScope accountScope { account.name };
+            for (auto& imapConnection : account.idleConnections) {
+                disconnectAccount(*imapConnection);
+            }
+        }
+
+        // Wait for attachment extraction to complete and report
+
+        if (daemon.attachmentPool) {
+            daemon.attachmentPool->waitIdle();
+            for (auto& account : daemon.accounts) {
+                if (account.attachmentExtractor) {
+                    const AttachmentStatistics& attachmentStatistics { account.attachmentExtractor->getStatistics() };
+                    Pendulum_Log::info("Attachments found = " + std::to_string(attachmentStatistics.attachments)
+                                       + ", stored = " + std::to_string(attachmentStatistics.stored)
+                                       + ", duplicates = " + std::to_string(attachmentStatistics.duplicates),
+                                       Pendulum_Log::Fields().withAccount(account.name).withCount(attachmentStatistics.attachments)
+                                                             .withBytes(attachmentStatistics.bytesStored));
+                }
+            }
+        }
+
+        Pendulum_Log::info("Daemon stopped.");
+
+    }
+
+} // namespace Pendulum_Daemon
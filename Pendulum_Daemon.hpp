@@ -0,0 +1,25 @@
+#ifndef PENDULUM_DAEMON_HPP
+#define PENDULUM_DAEMON_HPP
+
+//
+// Pendulum command line
+//
+
+#include "Pendulum_CommandLine.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Daemon {
+
+    //
+    // Archive every account in the daemon's accounts file, each polled at its own
+    // interval, until stopped (SIGTERM/SIGINT) or until no account has a poll time
+    // and each has been archived once.
+    //
+
+    void runDaemon(const Pendulum_CommandLine::PendulumOptions& daemonOptions);
+
+} // namespace Pendulum_Daemon
+#endif /* PENDULUM_DAEMON_HPP */
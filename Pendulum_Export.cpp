@@ -0,0 +1,682 @@
+
+//
+// Module: Pendulum_Export
+//
+// Description: Pendulum archive export. Streams mailbox folders of an archive to a
+// single mbox (mboxrd) or tar file, optionally zstd compressed, for moving an archive
+// into e-discovery and other tools without handling millions of small files. A pool
+// of reader threads reads the .eml files ahead in UID order (a bounded window of files
+// and bytes) while one writer formats them and writes them out in order, so that the
+// export is limited by disk speed rather than a file at a time open/read latency.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CPath.
+// zstd               : Compression (optional, PENDULUM_ZSTD).
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stdexcept>
+#include <ctime>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+//
+// Linux
+//
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+//
+// zstd
+//
+
+#ifdef PENDULUM_ZSTD
+#include <zstd.h>
+#endif
+
+//
+// Antik Classes
+//
+
+#include "CPath.hpp"
+
+//
+// Pendulum components
+//
+
+#include "Pendulum.hpp"
+#include "Pendulum_Export.hpp"
+#include "Pendulum_File.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Export {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Antik::File;
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Tar block size
+    //
+
+    constexpr std::size_t kTarBlock { 512 };
+
+    //
+    // Largest value of a tar header's 12 byte size and mtime fields in octal (11 digits)
+    //
+
+    constexpr std::uint64_t kTarOctalMax { (1ULL << 33) - 1 };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // File to export (tar entry name is mailbox folder/file name)
+    //
+
+    struct ExportFile {
+        std::string path;
+        std::string entryName;
+    };
+
+    //
+    // File read ahead for the writer
+    //
+
+    struct ReadFile {
+        std::string contents;
+        std::time_t modified { 0 };
+        bool bReady { false };
+        bool bFailed { false };
+    };
+
+    //
+    // Readers reading files ahead of the writer. Files are claimed in order by
+    // whichever reader is free and handed to the writer strictly in order; a reader
+    // waits while kReadAheadFiles files or kReadAheadBytes bytes are waiting (unless
+    // the file it would claim is the one the writer needs next).
+    //
+
+    class ReadAhead {
+    public:
+
+        ReadAhead(const std::vector<ExportFile>& files, std::size_t readerCount) : files { files }, window(kReadAheadFiles) {
+            for (std::size_t readerNo = 0; readerNo < readerCount; readerNo++) {
+                readers.emplace_back(&ReadAhead::run, this);
+            }
+        }
+
+        ~ReadAhead() {
+            {
+                std::unique_lock<std::mutex> locker(readMutex);
+                bStopping = true;
+            }
+            spaceFree.notify_all();
+            for (auto& reader : readers) {
+                reader.join();
+            }
+        }
+
+        //
+        // Next file in order (waits for it to be read).
+        //
+
+        ReadFile next() {
+            std::unique_lock<std::mutex> locker(readMutex);
+            ReadFile& slot { window[nextWrite % kReadAheadFiles] };
+            fileReady.wait(locker, [&slot]() { return (slot.bReady); });
+            ReadFile readFile { std::move(slot) };
+            slot = ReadFile();
+            bytesWaiting -= readFile.contents.size();
+            nextWrite++;
+            spaceFree.notify_all();
+            return (readFile);
+        }
+
+    private:
+
+        void run() {
+
+            std::unique_lock<std::mutex> locker(readMutex);
+
+            while (true) {
+
+                spaceFree.wait(locker, [this]() {
+                    return (bStopping || (nextRead >= files.size()) ||
+                            ((nextRead < nextWrite + kReadAheadFiles) && ((bytesWaiting < kReadAheadBytes) || (nextRead == nextWrite))));
+                });
+                if (bStopping || (nextRead >= files.size())) {
+                    return;
+                }
+
+                std::size_t fileNo { nextRead++ };
+                locker.unlock();
+                ReadFile readFile { readExportFile(files[fileNo].path) };
+                locker.lock();
+
+                bytesWaiting += readFile.contents.size();
+                window[fileNo % kReadAheadFiles] = std::move(readFile);
+                fileReady.notify_all();
+
+            }
+
+        }
+
+        //
+        // Read a file whole.
+        //
+
+        static ReadFile readExportFile(const std::string& filePath) {
+
+            ReadFile readFile;
+            int fileDescriptor { ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC) };
+            struct stat fileStatus {};
+
+            readFile.bReady = true;
+
+            if ((fileDescriptor < 0) || (::fstat(fileDescriptor, &fileStatus) != 0)) {
+                if (fileDescriptor >= 0) {
+                    ::close(fileDescriptor);
+                }
+                readFile.bFailed = true;
+                return (readFile);
+            }
+
+            ::posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+            readFile.modified = fileStatus.st_mtime;
+            readFile.contents.resize(fileStatus.st_size);
+
+            std::size_t bytesRead { 0 };
+            while (bytesRead < readFile.contents.size()) {
+                ssize_t readCount { ::read(fileDescriptor, &readFile.contents[bytesRead], readFile.contents.size() - bytesRead) };
+                if (readCount < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    readFile.bFailed = true;
+                    break;
+                }
+                if (readCount == 0) { // Truncated since fstat
+                    readFile.contents.resize(bytesRead);
+                    break;
+                }
+                bytesRead += readCount;
+            }
+
+            ::close(fileDescriptor);
+
+            return (readFile);
+
+        }
+
+        const std::vector<ExportFile>& files;
+        std::vector<ReadFile> window;               // Files read (indexed by file number modulo kReadAheadFiles)
+        std::mutex readMutex;
+        std::condition_variable fileReady;
+        std::condition_variable spaceFree;
+        std::size_t nextRead { 0 };                 // Next file to claim
+        std::size_t nextWrite { 0 };                // Next file for the writer
+        std::uint64_t bytesWaiting { 0 };           // Bytes read and not yet taken
+        bool bStopping { false };
+        std::vector<std::thread> readers;
+
+    };
+
+    //
+    // Buffered output to a file descriptor, zstd compressed if asked.
+    //
+
+    class Output {
+    public:
+
+        Output(int outputFD, bool bCompress, std::size_t compressWorkers) : outputFD { outputFD } {
+
+            buffer.reserve(kOutputBuffer);
+
+            if (bCompress) {
+#ifdef PENDULUM_ZSTD
+                compressContext = ZSTD_createCCtx();
+                if (!compressContext) {
+                    throw std::runtime_error("Could not create zstd context.");
+                }
+                ZSTD_CCtx_setParameter(compressContext, ZSTD_c_compressionLevel, kZstdLevel);
+                ZSTD_CCtx_setParameter(compressContext, ZSTD_c_nbWorkers, static_cast<int>(compressWorkers)); // Fails if zstd single threaded
+                compressed.resize(ZSTD_CStreamOutSize());
+#else
+                (void) compressWorkers;
+                throw std::invalid_argument("zstd compression not available (built without zstd).");
+#endif
+            }
+
+        }
+
+        ~Output() {
+#ifdef PENDULUM_ZSTD
+            ZSTD_freeCCtx(compressContext);
+#endif
+        }
+
+        Output(const Output&) = delete;
+        Output& operator=(const Output&) = delete;
+
+        void write(std::string_view data) {
+            buffer.append(data);
+            if (buffer.size() >= kOutputBuffer) {
+                flush(false);
+            }
+        }
+
+        void finish() {
+            flush(true);
+        }
+
+        std::uint64_t written() const {
+            return (bytesWritten);
+        }
+
+    private:
+
+        void flush(bool bEnd) {
+
+#ifdef PENDULUM_ZSTD
+            if (compressContext) {
+                ZSTD_inBuffer input { buffer.data(), buffer.size(), 0 };
+                bool bFlushed { false };
+                while (!bFlushed) {
+                    ZSTD_outBuffer output { compressed.data(), compressed.size(), 0 };
+                    std::size_t remaining { ZSTD_compressStream2(compressContext, &output, &input, bEnd ? ZSTD_e_end : ZSTD_e_continue) };
+                    if (ZSTD_isError(remaining)) {
+                        throw std::runtime_error("zstd compression failed: " + std::string(ZSTD_getErrorName(remaining)));
+                    }
+                    writeAll(compressed.data(), output.pos);
+                    bFlushed = bEnd ? (remaining == 0) : (input.pos == input.size);
+                }
+                buffer.clear();
+                return;
+            }
+#else
+            (void) bEnd;
+#endif
+
+            writeAll(buffer.data(), buffer.size());
+            buffer.clear();
+
+        }
+
+        void writeAll(const char *data, std::size_t length) {
+            while (length) {
+                ssize_t writeCount { ::write(outputFD, data, length) };
+                if (writeCount < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error("Export write failed: " + std::string(std::strerror(errno)));
+                }
+                data += writeCount;
+                length -= writeCount;
+                bytesWritten += writeCount;
+            }
+        }
+
+        int outputFD;
+        std::string buffer;
+        std::uint64_t bytesWritten { 0 };
+#ifdef PENDULUM_ZSTD
+        ZSTD_CCtx *compressContext { nullptr };
+        std::vector<char> compressed;
+#endif
+
+    };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // The .eml files of a mailbox folder (not its sub-folders) in UID order.
+    //
+
+    static std::vector<ExportFile> listMailBoxFiles(const std::string& archiveFolder, const std::string& mailBoxFolder) {
+
+        std::vector<std::pair<std::uint64_t, ExportFile>> uidFiles;
+        CPath folderPath { archiveFolder };
+
+        folderPath.join(mailBoxFolder);
+
+        DIR *directory { ::opendir(folderPath.toString().c_str()) };
+        if (!directory) {
+            throw std::invalid_argument("Mailbox folder [" + folderPath.toString() + "] could not be read.");
+        }
+
+        while (struct dirent *entry = ::readdir(directory)) {
+            std::string name { entry->d_name };
+            if ((name.front() == '(') && (name.find(") ") != std::string::npos) &&
+                (name.size() > std::strlen(Pendulum::kEMLFileExt)) &&
+                (name.compare(name.size() - std::strlen(Pendulum::kEMLFileExt), std::string::npos, Pendulum::kEMLFileExt) == 0)) {
+                CPath filePath { folderPath };
+                filePath.join(name);
+                uidFiles.push_back({ std::strtoull(name.c_str() + 1, nullptr, 10), { filePath.toString(), mailBoxFolder + "/" + name } });
+            }
+        }
+
+        ::closedir(directory);
+
+        std::sort(uidFiles.begin(), uidFiles.end(), [](const auto& first, const auto& second) {
+            return (first.first < second.first);
+        });
+
+        std::vector<ExportFile> files;
+        files.reserve(uidFiles.size());
+        for (auto& uidFile : uidFiles) {
+            files.push_back(std::move(uidFile.second));
+        }
+
+        return (files);
+
+    }
+
+    //
+    // Write a message to an mbox (mboxrd): "From " line, CRLF converted to LF, lines
+    // starting >*From escaped with a further > and a blank line after.
+    //
+
+    static void writeMBoxMessage(Output& output, const ReadFile& readFile) {
+
+        std::time_t date { static_cast<std::time_t>(Pendulum_File::messageDate(readFile.contents)) };
+        struct tm dateTime {};
+        char fromLine[64];
+
+        if (date == 0) {
+            date = readFile.modified;
+        }
+        ::gmtime_r(&date, &dateTime);
+        std::strftime(fromLine, sizeof (fromLine), "From MAILER-DAEMON %a %b %e %H:%M:%S %Y\n", &dateTime);
+        output.write(fromLine);
+
+        std::string_view message { readFile.contents };
+        std::size_t lineStart { 0 };
+
+        while (lineStart < message.size()) {
+            std::size_t lineEnd { message.find('\n', lineStart) };
+            if (lineEnd == std::string_view::npos) {
+                lineEnd = message.size();
+            }
+            std::string_view line { message.substr(lineStart, lineEnd - lineStart) };
+            if (!line.empty() && (line.back() == '\r')) {
+                line.remove_suffix(1);
+            }
+            std::size_t quoteEnd { line.find_first_not_of('>') };
+            if ((quoteEnd != std::string_view::npos) && (line.substr(quoteEnd, 5) == "From ")) {
+                output.write(">");
+            }
+            output.write(line);
+            output.write("\n");
+            lineStart = lineEnd + 1;
+        }
+
+        output.write("\n");
+
+    }
+
+    //
+    // Set a tar header octal field (zero padded, NUL terminated). Returns false (the
+    // field not set) if the value has more digits than the field has room for.
+    //
+
+    static bool setOctal(char *field, std::size_t fieldLength, std::uint64_t value) {
+
+        char digits[24] {};
+        std::size_t digitCount { fieldLength - 1 };
+
+        for (std::size_t digitNo = digitCount; digitNo > 0; digitNo--) {
+            digits[digitNo - 1] = static_cast<char>('0' + (value & 7));
+            value >>= 3;
+        }
+
+        if ((value != 0) || (digitCount >= sizeof(digits))) {
+            return (false);
+        }
+
+        std::memcpy(field, digits, digitCount);
+        field[digitCount] = '\0';
+
+        return (true);
+
+    }
+
+    //
+    // Set a tar header numeric field, in octal if it fits and otherwise GNU base-256
+    // (top bit of the first byte set, value big endian in the rest). Returns false if
+    // the value fits neither.
+    //
+
+    static bool setNumeric(char *field, std::size_t fieldLength, std::uint64_t value) {
+
+        if (setOctal(field, fieldLength, value)) {
+            return (true);
+        }
+
+        std::uint64_t remaining { value };
+
+        for (std::size_t byteNo = fieldLength - 1; byteNo > 0; byteNo--) {
+            field[byteNo] = static_cast<char>(remaining & 0xff);
+            remaining >>= 8;
+        }
+        field[0] = static_cast<char>(0x80);
+
+        return (remaining == 0);
+
+    }
+
+    //
+    // Append a tar (ustar) header block to a buffer (false if a field does not fit).
+    //
+
+    static bool appendTarHeader(std::string& buffer, const std::string& name, std::uint64_t size, std::uint64_t modified, char typeFlag) {
+
+        char header[kTarBlock] {};
+
+        name.copy(&header[0], 100);
+        if (!setNumeric(&header[100], 8, 0644) || !setNumeric(&header[108], 8, 0) || !setNumeric(&header[116], 8, 0) ||
+            !setNumeric(&header[124], 12, size) || !setNumeric(&header[136], 12, modified)) {
+            return (false);
+        }
+        header[156] = typeFlag;
+        std::memcpy(&header[257], "ustar", 6);
+        std::memcpy(&header[263], "00", 2);
+
+        // Checksum (at most 512 * 255, six octal digits) taken with its own field as spaces
+
+        std::memset(&header[148], ' ', 8);
+        unsigned int checksum { 0 };
+        for (unsigned char headerByte : header) {
+            checksum += headerByte;
+        }
+        setOctal(&header[148], 7, checksum);
+        header[155] = ' ';
+
+        buffer.append(header, kTarBlock);
+
+        return (true);
+
+    }
+
+    //
+    // pax extended header record ("length keyword=value\n", length including itself).
+    //
+
+    static std::string paxRecord(const std::string& keyword, const std::string& value) {
+
+        std::string record { " " + keyword + "=" + value + "\n" };
+        std::size_t recordLength { record.size() + 1 };
+
+        while (std::to_string(recordLength).size() + record.size() != recordLength) {
+            recordLength = std::to_string(recordLength).size() + record.size();
+        }
+
+        return (std::to_string(recordLength) + record);
+
+    }
+
+    //
+    // Pad a tar entry to a whole block.
+    //
+
+    static void writeTarPadding(Output& output, std::uint64_t size) {
+        static const char kZeroBlock[kTarBlock] {};
+        if (size % kTarBlock) {
+            output.write(std::string_view(kZeroBlock, kTarBlock - (size % kTarBlock)));
+        }
+    }
+
+    //
+    // Write a message to a tar; names too long for a ustar header and sizes or times too
+    // large for its octal fields are given in a pax extended header (the ustar header
+    // then holding large values in base-256 for readers without pax). Returns false
+    // (nothing written) if the entry cannot be represented.
+    //
+
+    static bool writeTarMessage(Output& output, const ExportFile& exportFile, const ReadFile& readFile) {
+
+        std::uint64_t size { readFile.contents.size() };
+        std::uint64_t modified { static_cast<std::uint64_t>(std::max<std::time_t>(readFile.modified, 0)) };
+        std::string records;
+        std::string headers;
+
+        if (exportFile.entryName.size() > 100) {
+            records += paxRecord("path", exportFile.entryName);
+        }
+        if (size > kTarOctalMax) {
+            records += paxRecord("size", std::to_string(size));
+        }
+        if (modified > kTarOctalMax) {
+            records += paxRecord("mtime", std::to_string(modified));
+        }
+
+        if (!records.empty()) {
+            std::string paxName { "PaxHeader/" + exportFile.entryName.substr(exportFile.entryName.size() - std::min<std::size_t>(exportFile.entryName.size(), 90)) };
+            if (!appendTarHeader(headers, paxName, records.size(), modified, 'x')) {
+                return (false);
+            }
+            headers += records;
+            headers.append((kTarBlock - (records.size() % kTarBlock)) % kTarBlock, '\0');
+        }
+
+        if (!appendTarHeader(headers, exportFile.entryName, size, modified, '0')) {
+            return (false);
+        }
+
+        output.write(headers);
+        output.write(readFile.contents);
+        writeTarPadding(output, size);
+
+        return (true);
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    Format formatFromName(const std::string& formatName) {
+
+        if (formatName == "mbox") {
+            return (Format::mbox);
+        } else if (formatName == "tar") {
+            return (Format::tar);
+        }
+
+        throw std::invalid_argument("Unknown export format [" + formatName + "] (mbox or tar).");
+
+    }
+
+    ExportResults exportMailBoxes(const std::string& archiveFolder, const std::vector<std::string>& mailBoxFolders,
+                                  Format format, bool bCompress, int outputFD, std::size_t readerCount) {
+
+        static Pendulum_Metrics::Counter& messagesExported { Pendulum_Metrics::counter("pendulum_export_messages_total", ".eml files exported.") };
+        static Pendulum_Metrics::Counter& bytesExported { Pendulum_Metrics::counter("pendulum_export_bytes_total", "Bytes of .eml files exported.") };
+
+        ExportResults results;
+        std::vector<ExportFile> files;
+
+        for (auto& mailBoxFolder : mailBoxFolders) {
+            std::vector<ExportFile> mailBoxFiles { listMailBoxFiles(archiveFolder, mailBoxFolder) };
+            Pendulum_Log::info("Exporting " + std::to_string(mailBoxFiles.size()) + " messages",
+                               Pendulum_Log::Fields().withMailBox(mailBoxFolder).withCount(mailBoxFiles.size()));
+            std::move(mailBoxFiles.begin(), mailBoxFiles.end(), std::back_inserter(files));
+        }
+
+        Output output { outputFD, bCompress, std::max<std::size_t>(readerCount, 1) };
+        ReadAhead readAhead { files, std::max<std::size_t>(readerCount, 1) };
+
+        for (auto& exportFile : files) {
+
+            ReadFile readFile { readAhead.next() };
+
+            if (readFile.bFailed) {
+                results.unreadable++;
+                Pendulum_Log::error("Could not read [" + exportFile.path + "]", Pendulum_Log::Fields().withFile(exportFile.path));
+                continue;
+            }
+
+            if (format == Format::mbox) {
+                writeMBoxMessage(output, readFile);
+            } else if (!writeTarMessage(output, exportFile, readFile)) {
+                results.rejected++;
+                Pendulum_Log::error("Could not be written as a tar entry [" + exportFile.path + "]", Pendulum_Log::Fields().withFile(exportFile.path));
+                continue;
+            }
+
+            results.messages++;
+            results.bytesRead += readFile.contents.size();
+            messagesExported.add();
+            bytesExported.add(readFile.contents.size());
+
+        }
+
+        // Tar ends with two zero blocks
+
+        if (format == Format::tar) {
+            output.write(std::string(kTarBlock * 2, '\0'));
+        }
+
+        output.finish();
+
+        results.bytesWritten = output.written();
+
+        return (results);
+
+    }
+
+} // namespace Pendulum_Export
@@ -0,0 +1,76 @@
+#ifndef PENDULUM_EXPORT_HPP
+#define PENDULUM_EXPORT_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Export {
+
+    //
+    // Files read ahead of the writer (and the most bytes they may hold between them)
+    //
+
+    constexpr std::size_t kReadAheadFiles { 256 };
+    constexpr std::uint64_t kReadAheadBytes { 256 * 1024 * 1024 };
+
+    //
+    // Output buffered (before any compression) between writes
+    //
+
+    constexpr std::size_t kOutputBuffer { 1024 * 1024 };
+
+    //
+    // zstd compression level
+    //
+
+    constexpr int kZstdLevel { 3 };
+
+    //
+    // Export formats
+    //
+
+    enum class Format {
+        mbox,       // mboxrd ("From " lines escaped, LF line endings)
+        tar         // POSIX (pax) tar of the .eml files as is
+    };
+
+    //
+    // Export results
+    //
+
+    struct ExportResults {
+        std::uint64_t messages { 0 };       // .eml files exported
+        std::uint64_t bytesRead { 0 };      // Their size
+        std::uint64_t bytesWritten { 0 };   // Output written (after any compression)
+        std::uint64_t unreadable { 0 };     // Files that could not be read (skipped)
+        std::uint64_t rejected { 0 };       // Files that could not be written as a tar entry (skipped)
+    };
+
+    //
+    // Return export format from its name (mbox or tar).
+    //
+
+    Format formatFromName(const std::string& formatName);
+
+    //
+    // Export mailbox folders (under archiveFolder) in UID order to a file descriptor,
+    // readerCount threads reading files ahead of the single writer. Tar entries are
+    // named mailbox folder/file name. zstd compression is only available if built
+    // with it.
+    //
+
+    ExportResults exportMailBoxes(const std::string& archiveFolder, const std::vector<std::string>& mailBoxFolders,
+                                  Format format, bool bCompress, int outputFD, std::size_t readerCount);
+
+} // namespace Pendulum_Export
+#endif /* PENDULUM_EXPORT_HPP */
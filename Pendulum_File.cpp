@@ -7,6 +7,8 @@
 // 
 // C11++              : Use of C11++ features.
 // Antik Classes      : CPath, CFile.
+// OpenSSL            : SHA-256 (EVP).
+// Linux              : Target platform
 //
 
 // =============
@@ -19,7 +21,25 @@
 
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+#include <strings.h>
+
+//
+// OpenSSL
+//
+
+#include <openssl/evp.h>
 
 //
 // Antik Classes
@@ -34,6 +54,9 @@
 
 #include "Pendulum.hpp"
 #include "Pendulum_File.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Trace.hpp"
+#include "Pendulum_Log.hpp"
 
 // =========
 // NAMESPACE
@@ -47,36 +70,328 @@ namespace Pendulum_File {
 
     using namespace Antik::File;
 
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Bytes read from the start of an existing .eml file to find its date
+    //
+
+    constexpr std::size_t kDateHeaderRead { 8192 };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Index being appended to (kept open as messages are archived one mailbox at a
+    // time); one per thread as the daemon archives from several at once.
+    //
+
+    struct IndexStream {
+        std::string fileName;
+        std::ofstream stream;
+    };
+
+    static thread_local IndexStream currentIndex;
+
+    //
+    // Checksum manifest being appended to (as for the index)
+    //
+
+    static thread_local IndexStream currentChecksums;
+
     // ===============
     // LOCAL FUNCTIONS
     // ===============
 
+    //
+    // Convert a RFC 2822 date ("[Day,] DD Mon YYYY HH:MM[:SS] +ZZZZ") to seconds since
+    // the epoch. Returns 0 if it cannot be parsed.
+    //
+
+    static std::int64_t parseDateField(std::string_view field) {
+
+        static const char *kMonths[] { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+        std::string date { field };
+        int day { 0 }, year { 0 }, hour { 0 }, minute { 0 }, second { 0 };
+        char month[4] {};
+        char zone[8] {};
+
+        if (date.find(',') != std::string::npos) {
+            date = date.substr(date.find(',') + 1);
+        }
+
+        int fields = std::sscanf(date.c_str(), " %d %3s %d %d:%d:%d %7s", &day, month, &year, &hour, &minute, &second, zone);
+        if (fields == 5) { // No seconds
+            second = 0;
+            fields = std::sscanf(date.c_str(), " %d %3s %d %d:%d %7s", &day, month, &year, &hour, &minute, zone);
+        }
+        if (fields < 5) {
+            return (0);
+        }
+
+        struct tm dateTime {};
+
+        dateTime.tm_mon = -1;
+        for (int monthNo = 0; monthNo < 12; monthNo++) {
+            if (strncasecmp(month, kMonths[monthNo], 3) == 0) {
+                dateTime.tm_mon = monthNo;
+                break;
+            }
+        }
+        if (dateTime.tm_mon < 0) {
+            return (0);
+        }
+
+        if (year < 50) {
+            year += 2000;
+        } else if (year < 100) {
+            year += 1900;
+        }
+
+        dateTime.tm_year = year - 1900;
+        dateTime.tm_mday = day;
+        dateTime.tm_hour = hour;
+        dateTime.tm_min = minute;
+        dateTime.tm_sec = second;
+
+        // Numeric zone only; named zones (GMT, UT etc.) are taken as UTC
+
+        std::int64_t offset { 0 };
+        if (((zone[0] == '+') || (zone[0] == '-')) && (std::strlen(zone) == 5)) {
+            int zoneValue { std::atoi(&zone[1]) };
+            offset = ((zoneValue / 100) * 3600 + (zoneValue % 100) * 60) * ((zone[0] == '-') ? -1 : 1);
+        }
+
+        return (static_cast<std::int64_t>(timegm(&dateTime)) - offset);
+
+    }
+
+    //
+    // Find "Date:" in a message's headers and return it as seconds since the epoch (0 if none).
+    //
+
+    static std::int64_t parseMessageDate(std::string_view message) {
+
+        std::size_t headersEnd { message.find("\r\n\r\n") };
+        if (headersEnd == std::string_view::npos) {
+            headersEnd = message.find("\n\n");
+        }
+
+        std::string_view headers { message.substr(0, headersEnd) };
+        std::size_t lineStart { 0 };
+
+        while (lineStart < headers.size()) {
+            std::size_t lineEnd { headers.find('\n', lineStart) };
+            if (lineEnd == std::string_view::npos) {
+                lineEnd = headers.size();
+            }
+            std::string_view line { headers.substr(lineStart, lineEnd - lineStart) };
+            if ((line.size() > 5) && (strncasecmp(line.data(), "Date:", 5) == 0)) {
+                return (parseDateField(line.substr(5)));
+            }
+            lineStart = lineEnd + 1;
+        }
+
+        return (0);
+
+    }
+
+    //
+    // Create index record for a message.
+    //
+
+    static IndexRecord createIndexRecord(std::uint64_t uid, const std::string& subject, std::string_view message, std::uint64_t size) {
+
+        IndexRecord record {};
+
+        record.uid = uid;
+        record.date = parseMessageDate(message);
+        record.size = size;
+        subject.copy(record.subject, kIndexSubjectLength - 1);
+
+        return (record);
+
+    }
+
+    static void writeIndexHeader(std::ofstream& indexStream) {
+        IndexHeader header {};
+        std::memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+        header.recordSize = sizeof(IndexRecord);
+        indexStream.write(reinterpret_cast<const char *> (&header), sizeof(header));
+    }
+
+    //
+    // Append record to a mailbox folder's index.
+    //
+
+    static void appendIndexRecord(const std::string& destFolder, const IndexRecord& record) {
+
+        CPath indexPath { destFolder };
+        indexPath.join(kIndexFileName);
+
+        if (currentIndex.fileName != indexPath.toString()) {
+            bool bNewIndex { !CFile::exists(indexPath) };
+            currentIndex.stream.close();
+            currentIndex.stream.clear();
+            currentIndex.fileName = indexPath.toString();
+            currentIndex.stream.open(currentIndex.fileName, std::ios::binary | std::ios::app);
+            if (currentIndex.stream.is_open() && bNewIndex) {
+                writeIndexHeader(currentIndex.stream);
+            }
+        }
+
+        // Flushed so that the new message is seen by anything browsing the archive
+
+        if (currentIndex.stream.is_open()) {
+            currentIndex.stream.write(reinterpret_cast<const char *> (&record), sizeof(record));
+            currentIndex.stream.flush();
+        }
+
+    }
+
+    //
+    // Append a file's checksum to a mailbox folder's manifest.
+    //
+
+    static void appendChecksum(const std::string& destFolder, const std::string& fileName, const std::string& checksum) {
+
+        CPath checksumPath { destFolder };
+        checksumPath.join(kChecksumFileName);
+
+        if (currentChecksums.fileName != checksumPath.toString()) {
+            currentChecksums.stream.close();
+            currentChecksums.stream.clear();
+            currentChecksums.fileName = checksumPath.toString();
+            currentChecksums.stream.open(currentChecksums.fileName, std::ios::app);
+        }
+
+        if (currentChecksums.stream.is_open()) {
+            currentChecksums.stream << checksum << "  " << fileName << '\n';
+            currentChecksums.stream.flush();
+        } else {
+            Pendulum_Log::warning("Failed to write checksum manifest [" + checksumPath.toString() + "]",
+                                  Pendulum_Log::Fields().withFile(checksumPath.toString()));
+        }
+
+    }
+
+    //
+    // Index the .eml files already in a mailbox folder. The index is written to a
+    // temporary file and then linked into place so that an index being created by
+    // something else at the same time (i.e. QtPendulum) is never overwritten.
+    //
+
+    static void buildMailboxIndex(const std::string& mailBoxFolder) {
+
+        CPath indexPath { mailBoxFolder };
+        CPath tmpIndexPath { mailBoxFolder };
+        std::vector<IndexRecord> records;
+
+        indexPath.join(kIndexFileName);
+        tmpIndexPath.join(std::string(kIndexFileName) + "." + std::to_string(::getpid()));
+
+        // Nested mailbox folders have their own index
+
+        for (auto& file : CFile::directoryContentsList(CPath(mailBoxFolder))) {
+            if (CFile::isFile(file) && (CPath(file).extension().compare(Pendulum::kEMLFileExt) == 0) &&
+                (CPath(file).parentPath() == mailBoxFolder)) {
+                std::string fileName { CPath(file).fileName() };
+                std::size_t uidEnd { fileName.find(") ") };
+                if ((fileName.front() != '(') || (uidEnd == std::string::npos)) {
+                    continue;
+                }
+                std::string subject { fileName.substr(uidEnd + 2, fileName.size() - uidEnd - 2 - std::strlen(Pendulum::kEMLFileExt)) };
+                std::ifstream emlFileStream { file, std::ios::binary | std::ios::ate };
+                if (!emlFileStream.is_open()) {
+                    continue;
+                }
+                std::uint64_t size { static_cast<std::uint64_t> (emlFileStream.tellg()) };
+                std::string headers(std::min<std::uint64_t>(size, kDateHeaderRead), '\0');
+                emlFileStream.seekg(0);
+                emlFileStream.read(&headers[0], headers.size());
+                records.push_back(createIndexRecord(std::strtoull(fileName.c_str() + 1, nullptr, 10), subject, headers, size));
+            }
+        }
+
+        std::ofstream indexStream { tmpIndexPath.toString(), std::ios::binary | std::ios::trunc };
+        if (!indexStream.is_open()) {
+            Pendulum_Log::warning("Failed to create index [" + indexPath.toString() + "]",
+                                  Pendulum_Log::Fields().withFile(indexPath.toString()));
+            return;
+        }
+
+        writeIndexHeader(indexStream);
+        indexStream.write(reinterpret_cast<const char *> (records.data()), records.size() * sizeof(IndexRecord));
+        indexStream.close();
+
+        if (indexStream.good() && (::link(tmpIndexPath.toString().c_str(), indexPath.toString().c_str()) == 0)) {
+            Pendulum_Log::info("Created index [" + indexPath.toString() + "] of " + std::to_string(records.size()) + " messages",
+                               Pendulum_Log::Fields().withFile(indexPath.toString()).withCount(records.size()));
+        }
+        ::unlink(tmpIndexPath.toString().c_str());
+
+    }
+
     // ================
     // PUBLIC FUNCTIONS
     // ================
 
     //
-    // Create destination for mailbox archive
+    // Folder name for a mailbox
     //
 
-    std::string createMailboxFolder(const std::string& destFolder, const std::string& mailBoxName) {
+    std::string mailBoxFolderName(const std::string& mailBoxName) {
 
-        std::string mailBoxFolder { mailBoxName };
+        std::string folderName { mailBoxName };
 
         // Clear any quotes from mailbox name for folder name
 
-        if (mailBoxFolder.front() == '\"') mailBoxFolder = mailBoxName.substr(1);
-        if (mailBoxFolder.back() == '\"') mailBoxFolder.pop_back();
+        if (!folderName.empty() && (folderName.front() == '\"')) folderName = folderName.substr(1);
+        if (!folderName.empty() && (folderName.back() == '\"')) folderName.pop_back();
+
+        return (folderName);
+
+    }
+
+    //
+    // Destination folder for a mailbox archive
+    //
+
+    std::string mailBoxFolder(const std::string& destFolder, const std::string& mailBoxName) {
+
+        CPath mailBoxPath { destFolder };
+
+        mailBoxPath.join(mailBoxFolderName(mailBoxName));
+
+        return (mailBoxPath.toString());
+
+    }
+
+    //
+    // Create destination for mailbox archive
+    //
+
+    std::string createMailboxFolder(const std::string& destFolder, const std::string& mailBoxName) {
 
         // Create mailbox destination folder
 
-        CPath mailBoxPath {destFolder };
+        CPath mailBoxPath { mailBoxFolder(destFolder, mailBoxName) };
         
-        mailBoxPath.join(mailBoxFolder);
         if (!CFile::exists(mailBoxPath)) {
-            std::cout << "Creating destination folder = [" << mailBoxPath.toString() << "]" << std::endl;
+            Pendulum_Log::info("Creating destination folder = [" + mailBoxPath.toString() + "]",
+                               Pendulum_Log::Fields().withMailBox(mailBoxName).withFile(mailBoxPath.toString()));
             CFile::createDirectory(mailBoxPath);
         }
+
+        CPath indexPath { mailBoxPath };
+        indexPath.join(kIndexFileName);
+        if (!CFile::exists(indexPath)) {
+            buildMailboxIndex(mailBoxPath.toString());
+        }
         
         return(mailBoxPath.toString());
         
@@ -86,26 +401,91 @@ namespace Pendulum_File {
     // Create .eml for downloaded email.
     //
 
-    void createEMLFile(const std::pair<std::string, std::string>& emailContents, uint64_t uid, const std::string& destFolder) {
+    std::string createEMLFile(const std::string& subject, std::string_view body, uint64_t uid, const std::string& destFolder) {
+
+        static Pendulum_Metrics::Histogram& createLatency { Pendulum_Metrics::histogram("pendulum_file_create_seconds", ".eml file creation latency.") };
+        static Pendulum_Metrics::Counter& messagesWritten { Pendulum_Metrics::counter("pendulum_messages_written_total", ".eml files written.") };
+        static Pendulum_Metrics::Counter& bytesWritten { Pendulum_Metrics::counter("pendulum_written_bytes_total", "Bytes written to .eml files.") };
+
+        Pendulum_Trace::Span span { "createEMLFile", "file", uid };
+        Pendulum_Metrics::ScopedTimer timer { createLatency };
 
-        if (!emailContents.second.empty()) {
+        if (!body.empty()) {
             CPath fullFilePath { destFolder };
-            fullFilePath.join("(" + std::to_string(uid) + ") " + emailContents.first + Pendulum::kEMLFileExt);
+            fullFilePath.join("(" + std::to_string(uid) + ") " + subject + Pendulum::kEMLFileExt);
             if (!CFile::exists(fullFilePath)) {
-                std::istringstream emailBodyStream { emailContents.second };
-                std::ofstream emlFileStream { fullFilePath.toString(), std::ios::binary };
+                std::string partialFileName { fullFilePath.toString() + Pendulum::kPartialFileExt };
+                std::ofstream emlFileStream { partialFileName, std::ios::binary };
                 if (emlFileStream.is_open()) {
-                    std::cout << "Creating [" << fullFilePath.toString() << "]" << std::endl;
-                    for (std::string line; getline(emailBodyStream, line, '\n');) {
-                        line.push_back('\n');
-                        emlFileStream.write(&line[0], line.length());
+                    Pendulum_Log::info("Creating [" + fullFilePath.toString() + "]",
+                                       Pendulum_Log::Fields().withFile(fullFilePath.toString()).withUID(uid).withBytes(body.size()));
+                    // Body written in one go; last line always terminated by a newline.
+                    emlFileStream.write(body.data(), body.size());
+                    if (body.back() != '\n') {
+                        emlFileStream.put('\n');
                     }
+                    emlFileStream.close();
+                    if (!emlFileStream.good() || (std::rename(partialFileName.c_str(), fullFilePath.toString().c_str()) != 0)) {
+                        ::unlink(partialFileName.c_str());
+                        Pendulum_Log::error("Failed to write file [" + fullFilePath.toString() + "]",
+                                            Pendulum_Log::Fields().withFile(fullFilePath.toString()).withUID(uid));
+                        return ("");
+                    }
+                    appendIndexRecord(destFolder, createIndexRecord(uid, subject, body, body.size() + ((body.back() != '\n') ? 1 : 0)));
+                    appendChecksum(destFolder, fullFilePath.fileName(), fileChecksum(body, (body.back() != '\n') ? "\n" : ""));
+                    messagesWritten.add();
+                    bytesWritten.add(body.size());
+                    return (fullFilePath.toString());
                 } else {
-                    std::cerr << "Failed to create file [" << fullFilePath.toString() << "]" << std::endl;
+                    Pendulum_Log::error("Failed to create file [" + fullFilePath.toString() + "]",
+                                        Pendulum_Log::Fields().withFile(fullFilePath.toString()).withUID(uid));
                 }
             }
         }
 
+        return ("");
+
+    }
+
+    //
+    // Date of a message from its headers.
+    //
+
+    std::int64_t messageDate(std::string_view message) {
+        return (parseMessageDate(message));
+    }
+
+    //
+    // SHA-256 of a file's contents (OpenSSL's uses the CPU's SHA extensions/SIMD).
+    //
+
+    std::string fileChecksum(std::string_view contents, std::string_view trailer) {
+
+        static const char kHexDigits[] { "0123456789abcdef" };
+
+        EVP_MD_CTX *hashContext { EVP_MD_CTX_new() };
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int digestLength { 0 };
+
+        if (!hashContext || !EVP_DigestInit_ex(hashContext, EVP_sha256(), nullptr) ||
+            !EVP_DigestUpdate(hashContext, contents.data(), contents.size()) ||
+            !EVP_DigestUpdate(hashContext, trailer.data(), trailer.size()) ||
+            !EVP_DigestFinal_ex(hashContext, digest, &digestLength)) {
+            EVP_MD_CTX_free(hashContext);
+            throw std::runtime_error("Could not calculate SHA-256.");
+        }
+
+        EVP_MD_CTX_free(hashContext);
+
+        std::string checksum;
+        checksum.reserve(digestLength * 2);
+        for (unsigned int byteNo = 0; byteNo < digestLength; byteNo++) {
+            checksum += kHexDigits[digest[byteNo] >> 4];
+            checksum += kHexDigits[digest[byteNo] & 0xf];
+        }
+
+        return (checksum);
+
     }
 
     //
@@ -115,6 +495,8 @@ namespace Pendulum_File {
 
     uint64_t getNewestUID(const std::string& destFolder) {
 
+        Pendulum_Trace::Span span { "getNewestUID", "file" };
+
         if (CFile::exists(destFolder) && CFile::isDirectory(destFolder)) {
 
             uint64_t highestIndex { 1 };
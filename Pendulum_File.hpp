@@ -6,21 +6,84 @@
 //
 
 #include <string>
-#include <utility>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
 
 namespace Pendulum_File {
+
+    //
+    // Each mailbox folder has an index of the .eml files archived to it (one fixed size
+    // record per message appended after a header, host byte order) so that QtPendulum
+    // can page through and sort an archive without listing the folder. A record's file
+    // is "(uid) subject.eml"; date is seconds since the epoch (0 if not known).
+    //
+
+    constexpr char const *kIndexFileName { ".pendulum_index" };
+    constexpr char kIndexMagic[8] { 'P', 'N', 'D', 'I', 'N', 'D', 'X', '1' };
+    constexpr std::size_t kIndexSubjectLength { 104 };
+
+    struct IndexHeader {
+        char magic[8];                      // kIndexMagic
+        std::uint32_t recordSize;           // sizeof(IndexRecord)
+        std::uint32_t reserved;
+    };
+
+    struct IndexRecord {
+        std::uint64_t uid;                  // Message UID
+        std::int64_t date;                  // "Date:" header (UTC)
+        std::uint64_t size;                 // .eml file size
+        char subject[kIndexSubjectLength];  // Subject as in file name (null terminated)
+    };
+
+    static_assert(sizeof(IndexHeader) == 16, "Archive index header must be 16 bytes");
+    static_assert(sizeof(IndexRecord) == 128, "Archive index record must be 128 bytes");
+
+    //
+    // Each mailbox folder also has a manifest of the SHA-256 of every .eml file as it
+    // was written, a line per message appended when it is committed. The lines are in
+    // sha256sum format ("hash  file name") so a folder can be checked by hand too.
+    //
+
+    constexpr char const *kChecksumFileName { ".pendulum_checksums" };
     
     //
-    // Create destination for mailbox archive
+    // Folder name for a mailbox (its name with any quotes cleared)
+    //
+
+    std::string mailBoxFolderName(const std::string& mailBoxName);
+
+    //
+    // Destination folder for a mailbox archive (not created)
+    //
+
+    std::string mailBoxFolder(const std::string& destFolder, const std::string& mailBoxName);
+
+    //
+    // Create destination for mailbox archive (and its index if there is not one)
     //
 
     std::string createMailboxFolder(const std::string& destFolder, const std::string& mailBoxName);
      
     //
-    // Create .eml file for a given e-mail message
+    // Create .eml file for a given e-mail message returning its name (empty if not created).
+    // The file is written under a partial name and renamed once complete so an .eml file
+    // is never left half written.
+    //
+
+    std::string createEMLFile(const std::string& subject, std::string_view body, std::uint64_t uid, const std::string& destFolder);
+
+    //
+    // Return a message's "Date:" header as seconds since the epoch (0 if none).
+    //
+
+    std::int64_t messageDate(std::string_view message);
+
+    //
+    // Return SHA-256 (hex) of contents followed by trailer.
     //
 
-    void createEMLFile(const std::pair<std::string, std::string>& emailContents, std::uint64_t uid, const std::string& destFolder);
+    std::string fileChecksum(std::string_view contents, std::string_view trailer = "");
 
     //
     // Return the UID of the newest e-mail message archived for a mailbox.
@@ -0,0 +1,320 @@
+
+//
+// Module: Pendulum_Journal
+//
+// Description: Pendulum crash-safe resume journal. When a mailbox search finds
+// messages to archive the UIDs are written to a journal in its archive folder (a
+// new journal is written to a temporary file and renamed into place so a plan is
+// never seen half written) and a line is appended as each message is committed.
+// If the run dies part way through, the next one removes any partially written
+// .eml files and carries on with the uncommitted UIDs of the plan without searching
+// the mailbox again or refetching messages already archived. The journal is
+// removed once the plan is complete. Lines are flushed as written so the journal
+// survives the process being killed (it is not synced to disk for each message).
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CPath, CFile.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+
+//
+// Antik Classes
+//
+
+#include "CFile.hpp"
+#include "CPath.hpp"
+
+//
+// Pendulum components
+//
+
+#include "Pendulum.hpp"
+#include "Pendulum_Journal.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Journal {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Antik::File;
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Journal first line
+    //
+
+    constexpr char const *kJournalHeader { "PENDULUM-JOURNAL 1" };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Journals open for appending (by mailbox folder). The daemon archives several
+    // mailboxes at once so access is serialised.
+    //
+
+    static std::mutex journalMutex;
+    static std::map<std::string, std::ofstream> openJournals;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Journal file name for a mailbox folder.
+    //
+
+    static std::string journalFileName(const std::string& mailBoxFolder) {
+        CPath journalPath { mailBoxFolder };
+        journalPath.join(kJournalFileName);
+        return (journalPath.toString());
+    }
+
+    //
+    // Close a mailbox folder's journal if open. Caller holds the lock.
+    //
+
+    static void closeJournal(const std::string& mailBoxFolder) {
+        auto openJournal = openJournals.find(mailBoxFolder);
+        if (openJournal != openJournals.end()) {
+            openJournal->second.close();
+            openJournals.erase(openJournal);
+        }
+    }
+
+    //
+    // Encode sorted UIDs as an IMAP style sequence set (1:100,105,...).
+    //
+
+    static std::string encodeUIDSet(const std::vector<std::uint64_t>& messageUID) {
+
+        std::string uidSet;
+
+        for (std::size_t uidNo = 0; uidNo < messageUID.size();) {
+            std::size_t rangeEnd { uidNo };
+            while (((rangeEnd + 1) < messageUID.size()) && (messageUID[rangeEnd + 1] == messageUID[rangeEnd] + 1)) {
+                rangeEnd++;
+            }
+            if (!uidSet.empty()) {
+                uidSet += ',';
+            }
+            uidSet += std::to_string(messageUID[uidNo]);
+            if (rangeEnd != uidNo) {
+                uidSet += ':' + std::to_string(messageUID[rangeEnd]);
+            }
+            uidNo = rangeEnd + 1;
+        }
+
+        return (uidSet);
+
+    }
+
+    //
+    // Decode a sequence set written by encodeUIDSet().
+    //
+
+    static std::vector<std::uint64_t> decodeUIDSet(const std::string& uidSet) {
+
+        std::vector<std::uint64_t> messageUID;
+        std::istringstream uidStream { uidSet };
+        std::string range;
+
+        while (std::getline(uidStream, range, ',')) {
+            std::size_t colon { range.find(':') };
+            std::uint64_t first { std::strtoull(range.c_str(), nullptr, 10) };
+            std::uint64_t last { (colon == std::string::npos) ? first : std::strtoull(range.c_str() + colon + 1, nullptr, 10) };
+            for (std::uint64_t uid = first; (uid != 0) && (uid <= last); uid++) {
+                messageUID.push_back(uid);
+            }
+        }
+
+        return (messageUID);
+
+    }
+
+    //
+    // Remove partially written .eml files left in a mailbox folder; return how many.
+    //
+
+    static std::uint64_t removePartialFiles(const std::string& mailBoxFolder) {
+
+        std::uint64_t partialFiles { 0 };
+
+        for (auto& file : CFile::directoryContentsList(CPath(mailBoxFolder))) {
+            if (CFile::isFile(file) && (CPath(file).extension().compare(Pendulum::kPartialFileExt) == 0) &&
+                (CPath(file).parentPath() == mailBoxFolder)) {
+                Pendulum_Log::warning("Removing partially written file [" + file + "]", Pendulum_Log::Fields().withFile(file));
+                CFile::remove(file);
+                partialFiles++;
+            }
+        }
+
+        return (partialFiles);
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    bool resumeMailBox(const std::string& mailBoxFolder, ResumePlan& resumePlan) {
+
+        std::unique_lock<std::mutex> locker(journalMutex);
+
+        closeJournal(mailBoxFolder);
+
+        resumePlan = ResumePlan();
+        resumePlan.partialFiles = removePartialFiles(mailBoxFolder);
+
+        std::string fileName { journalFileName(mailBoxFolder) };
+        std::ifstream journalStream { fileName, std::ios::binary };
+
+        if (!journalStream.is_open()) {
+            return (false);
+        }
+
+        // Only whole lines count (the last may have been cut short)
+
+        std::string journal { std::istreambuf_iterator<char>(journalStream), std::istreambuf_iterator<char>() };
+        std::vector<std::uint64_t> plannedUID;
+        std::set<std::uint64_t> committedUID;
+        bool bPlanned { false };
+        std::size_t lineStart { 0 };
+
+        for (std::size_t lineEnd; (lineEnd = journal.find('\n', lineStart)) != std::string::npos; lineStart = lineEnd + 1) {
+            std::istringstream lineStream { journal.substr(lineStart, lineEnd - lineStart) };
+            std::string record;
+            lineStream >> record;
+            if (lineStart == 0) {
+                if (journal.compare(0, lineEnd, kJournalHeader) != 0) {
+                    break;
+                }
+            } else if (record == "PLAN") {
+                std::uint64_t plannedCount { 0 };
+                std::string uidSet;
+                lineStream >> resumePlan.highestUID >> plannedCount >> uidSet;
+                plannedUID = decodeUIDSet(uidSet);
+                bPlanned = (plannedUID.size() == plannedCount);
+            } else if (record == "DONE") {
+                std::uint64_t uid { 0 };
+                lineStream >> uid;
+                committedUID.insert(uid);
+            }
+        }
+
+        // Drop any cut short line so that commits are appended after a whole one
+
+        if (lineStart < journal.size()) {
+            if (::truncate(fileName.c_str(), lineStart) != 0) {
+                bPlanned = false;
+            }
+        }
+
+        if (!bPlanned) {
+            Pendulum_Log::warning("Ignoring unreadable journal [" + fileName + "]", Pendulum_Log::Fields().withFile(fileName));
+            ::unlink(fileName.c_str());
+            return (false);
+        }
+
+        resumePlan.plannedCount = plannedUID.size();
+        for (auto uid : plannedUID) {
+            if (!committedUID.count(uid)) {
+                resumePlan.messageUID.push_back(uid);
+            }
+        }
+
+        return (true);
+
+    }
+
+    void planMailBox(const std::string& mailBoxFolder, const std::vector<std::uint64_t>& messageUID, std::uint64_t highestUID) {
+
+        std::unique_lock<std::mutex> locker(journalMutex);
+
+        std::string fileName { journalFileName(mailBoxFolder) };
+        std::string tmpFileName { fileName + "." + std::to_string(::getpid()) };
+
+        closeJournal(mailBoxFolder);
+
+        {
+            std::ofstream journalStream { tmpFileName, std::ios::binary | std::ios::trunc };
+            journalStream << kJournalHeader << "\n"
+                          << "PLAN " << highestUID << " " << messageUID.size() << " " << encodeUIDSet(messageUID) << "\n";
+            journalStream.close();
+            if (!journalStream.good() || (std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)) {
+                ::unlink(tmpFileName.c_str());
+                Pendulum_Log::warning("Failed to write journal [" + fileName + "]", Pendulum_Log::Fields().withFile(fileName));
+                return;
+            }
+        }
+
+        openJournals[mailBoxFolder].open(fileName, std::ios::binary | std::ios::app);
+
+    }
+
+    void commitMessage(const std::string& mailBoxFolder, std::uint64_t uid) {
+
+        std::unique_lock<std::mutex> locker(journalMutex);
+
+        auto openJournal = openJournals.find(mailBoxFolder);
+
+        // A resumed plan is reopened on its first commit
+
+        if (openJournal == openJournals.end()) {
+            std::string fileName { journalFileName(mailBoxFolder) };
+            if (!CFile::exists(fileName)) {
+                return;
+            }
+            openJournal = openJournals.emplace(mailBoxFolder, std::ofstream(fileName, std::ios::binary | std::ios::app)).first;
+        }
+
+        openJournal->second << "DONE " << uid << "\n";
+        openJournal->second.flush();
+
+    }
+
+    void finishMailBox(const std::string& mailBoxFolder) {
+
+        std::unique_lock<std::mutex> locker(journalMutex);
+
+        closeJournal(mailBoxFolder);
+
+        ::unlink(journalFileName(mailBoxFolder).c_str());
+
+    }
+
+} // namespace Pendulum_Journal
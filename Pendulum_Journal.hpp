@@ -0,0 +1,64 @@
+#ifndef PENDULUM_JOURNAL_HPP
+#define PENDULUM_JOURNAL_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Journal {
+
+    //
+    // Each mailbox folder being archived has a write-ahead journal of the messages
+    // planned (the UIDs found by a search) and those committed (.eml file in place)
+    // so that a run that dies part way through a mailbox resumes where it left off.
+    // It is removed once every planned message is committed.
+    //
+
+    constexpr char const *kJournalFileName { ".pendulum_journal" };
+
+    //
+    // Messages still to archive from an unfinished plan
+    //
+
+    struct ResumePlan {
+        std::vector<std::uint64_t> messageUID;      // Planned UIDs not yet committed
+        std::uint64_t plannedCount { 0 };           // UIDs planned
+        std::uint64_t highestUID { 0 };             // Highest UID found by the planning search
+        std::uint64_t partialFiles { 0 };           // Partially written .eml files removed
+    };
+
+    //
+    // Recover a mailbox folder: remove any partially written .eml files and, if an
+    // unfinished plan is journaled, return true with what is left of it.
+    //
+
+    bool resumeMailBox(const std::string& mailBoxFolder, ResumePlan& resumePlan);
+
+    //
+    // Journal the messages planned for a mailbox (replacing any previous plan).
+    //
+
+    void planMailBox(const std::string& mailBoxFolder, const std::vector<std::uint64_t>& messageUID, std::uint64_t highestUID);
+
+    //
+    // Journal a planned message as done (archived, skipped or already present).
+    //
+
+    void commitMessage(const std::string& mailBoxFolder, std::uint64_t uid);
+
+    //
+    // Every planned message committed; remove the journal.
+    //
+
+    void finishMailBox(const std::string& mailBoxFolder);
+
+} // namespace Pendulum_Journal
+#endif /* PENDULUM_JOURNAL_HPP */
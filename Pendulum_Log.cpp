@@ -0,0 +1,398 @@
+//
+// Module: Pendulum_Log
+//
+// Description: Pendulum logging. Log lines are pushed onto a lock free multiple
+// producer/single consumer queue and a background thread drains it, formats the
+// lines and writes each batch to std::cout/std::cerr with a single flush, so the
+// archive loop no longer pays for a flush (and a write() when std::cout is
+// redirected to a log file) per line. Lines are plain text (as before) or JSON
+// objects one per line with level, time and structured fields.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdexcept>
+#include <cstdio>
+#include <ctime>
+
+//
+// Pendulum logging
+//
+
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Log {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    constexpr std::chrono::milliseconds kDrainInterval { 50 };     // Idle wait between queue drains
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Queued log line
+    //
+
+    struct Record {
+        std::atomic<Record *> next { nullptr };
+        Level level { Level::Info };
+        std::chrono::system_clock::time_point time;
+        std::string message;
+        Fields fields;
+    };
+
+    //
+    // Intrusive MPSC queue (Vyukov). Producers only exchange the head pointer; the
+    // logger thread is the only consumer.
+    //
+
+    struct RecordQueue {
+        RecordQueue() : head(&stub), tail(&stub) {
+        }
+        std::atomic<Record *> head;
+        Record *tail;
+        Record stub;
+    };
+
+    //
+    // Logger state
+    //
+
+    struct LoggerState {
+        RecordQueue queue;
+        std::atomic<bool> bRunning { false };
+        std::atomic<int> level { static_cast<int>(Level::Info) };
+        bool bJSON { false };
+        std::mutex outputMutex;                 // Serialises direct (no logger thread) output
+        std::mutex stopMutex;
+        std::condition_variable stopRequested;
+        bool bStopping { false };
+        std::thread loggerThread;
+    };
+
+    static LoggerState state;
+
+    //
+    // Account of lines logged on this thread (see AccountScope)
+    //
+
+    static thread_local std::string threadAccount;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    static void push(Record *record) {
+        record->next.store(nullptr, std::memory_order_relaxed);
+        Record *previous { state.queue.head.exchange(record, std::memory_order_acq_rel) };
+        previous->next.store(record, std::memory_order_release);
+    }
+
+    //
+    // Pop oldest record; nullptr if empty (or a producer is mid push).
+    //
+
+    static Record *pop() {
+
+        RecordQueue& queue { state.queue };
+        Record *tail { queue.tail };
+        Record *next { tail->next.load(std::memory_order_acquire) };
+
+        if (tail == &queue.stub) {
+            if (next == nullptr) {
+                return (nullptr);
+            }
+            queue.tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next != nullptr) {
+            queue.tail = next;
+            return (tail);
+        }
+
+        if (tail != queue.head.load(std::memory_order_acquire)) {
+            return (nullptr);
+        }
+
+        push(&queue.stub);
+
+        next = tail->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            queue.tail = next;
+            return (tail);
+        }
+
+        return (nullptr);
+
+    }
+
+    static const char *levelName(Level level) {
+        switch (level) {
+            case Level::Debug:
+                return ("debug");
+            case Level::Info:
+                return ("info");
+            case Level::Warning:
+                return ("warning");
+            default:
+                return ("error");
+        }
+    }
+
+    //
+    // Append a line formatted as JSON.
+    //
+
+    static void formatJSON(std::string& output, const Record& record) {
+
+        std::time_t seconds { std::chrono::system_clock::to_time_t(record.time) };
+        long milliseconds { static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                record.time.time_since_epoch()).count() % 1000) };
+        std::tm utcTime;
+        char timeStamp[40];
+
+        gmtime_r(&seconds, &utcTime);
+        std::size_t length { std::strftime(timeStamp, sizeof (timeStamp), "%Y-%m-%dT%H:%M:%S", &utcTime) };
+        std::snprintf(timeStamp + length, sizeof (timeStamp) - length, ".%03ldZ", milliseconds);
+
+        output += "{\"time\":\"";
+        output += timeStamp;
+        output += "\",\"level\":\"";
+        output += levelName(record.level);
+        output += "\",\"message\":";
+        appendJSONString(output, record.message);
+        if (!record.fields.account.empty()) {
+            output += ",\"account\":";
+            appendJSONString(output, record.fields.account);
+        }
+        if (!record.fields.mailBox.empty()) {
+            output += ",\"mailbox\":";
+            appendJSONString(output, record.fields.mailBox);
+        }
+        if (!record.fields.file.empty()) {
+            output += ",\"file\":";
+            appendJSONString(output, record.fields.file);
+        }
+        if (record.fields.uid) {
+            output += ",\"uid\":" + std::to_string(*record.fields.uid);
+        }
+        if (record.fields.bytes) {
+            output += ",\"bytes\":" + std::to_string(*record.fields.bytes);
+        }
+        if (record.fields.count) {
+            output += ",\"count\":" + std::to_string(*record.fields.count);
+        }
+        if (record.fields.latency) {
+            output += ",\"latency_us\":" + std::to_string(record.fields.latency->count());
+        }
+        output += "}\n";
+
+    }
+
+    //
+    // Append record to the standard output or error batch.
+    //
+
+    static void format(const Record& record, std::string& outputBatch, std::string& errorBatch) {
+        if (state.bJSON) {
+            formatJSON(outputBatch, record);
+        } else {
+            std::string& batch { (record.level >= Level::Warning) ? errorBatch : outputBatch };
+            if (!record.fields.account.empty()) {
+                batch += "[" + record.fields.account + "] ";
+            }
+            batch += record.message;
+            batch += '\n';
+        }
+    }
+
+    static void write(const std::string& outputBatch, const std::string& errorBatch) {
+        if (!outputBatch.empty()) {
+            std::cout.write(outputBatch.data(), outputBatch.size());
+            std::cout.flush();
+        }
+        if (!errorBatch.empty()) {
+            std::cerr.write(errorBatch.data(), errorBatch.size());
+            std::cerr.flush();
+        }
+    }
+
+    //
+    // Drain queue writing a batch; returns false if it was empty.
+    //
+
+    static bool drainQueue() {
+
+        std::string outputBatch;
+        std::string errorBatch;
+        Record *record;
+
+        while ((record = pop()) != nullptr) {
+            format(*record, outputBatch, errorBatch);
+            delete record;
+        }
+
+        write(outputBatch, errorBatch);
+
+        return (!outputBatch.empty() || !errorBatch.empty());
+
+    }
+
+    //
+    // Logger thread: drain queue until stopped (then drain it a final time).
+    //
+
+    static void runLogger() {
+
+        while (true) {
+            if (drainQueue()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock { state.stopMutex };
+            if (state.stopRequested.wait_for(lock, kDrainInterval, [] { return (state.bStopping); })) {
+                break;
+            }
+        }
+
+        drainQueue();
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    Logger::Logger(bool bJSON, Level level) {
+
+        if (state.bRunning.load()) {
+            throw std::logic_error("Only one Pendulum_Log::Logger may exist at a time.");
+        }
+
+        state.bJSON = bJSON;
+        state.level.store(static_cast<int>(level));
+        state.bStopping = false;
+        state.loggerThread = std::thread(runLogger);
+        state.bRunning.store(true);
+
+    }
+
+    Logger::~Logger() {
+
+        state.bRunning.store(false);        // New lines are now written directly
+
+        {
+            std::lock_guard<std::mutex> locker(state.stopMutex);
+            state.bStopping = true;
+        }
+
+        state.stopRequested.notify_all();
+        state.loggerThread.join();
+
+        std::lock_guard<std::mutex> locker(state.outputMutex);
+        drainQueue();                       // Lines queued while stopping
+
+    }
+
+    AccountScope::AccountScope(const std::string& account) : previousAccount { threadAccount } {
+        threadAccount = account;
+    }
+
+    AccountScope::~AccountScope() {
+        threadAccount = previousAccount;
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    void appendJSONString(std::string& output, const std::string& value) {
+
+        output += '"';
+        for (unsigned char ch : value) {
+            if ((ch == '"') || (ch == '\\')) {
+                output += '\\';
+                output += static_cast<char>(ch);
+            } else if (ch == '\n') {
+                output += "\\n";
+            } else if (ch < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof (escaped), "\\u%04x", ch);
+                output += escaped;
+            } else {
+                output += static_cast<char>(ch);
+            }
+        }
+        output += '"';
+
+    }
+
+    Level levelFromName(const std::string& name) {
+        for (Level level : { Level::Debug, Level::Info, Level::Warning, Level::Error }) {
+            if (name == levelName(level)) {
+                return (level);
+            }
+        }
+        throw std::invalid_argument("Unknown log level [" + name + "].");
+    }
+
+    bool isEnabled(Level level) {
+        return (static_cast<int>(level) >= state.level.load(std::memory_order_relaxed));
+    }
+
+    void log(Level level, std::string message, Fields fields) {
+
+        if (!isEnabled(level)) {
+            return;
+        }
+
+        Record *record { new Record() };
+        record->level = level;
+        record->time = std::chrono::system_clock::now();
+        record->message = std::move(message);
+        record->fields = std::move(fields);
+        if (record->fields.account.empty()) {
+            record->fields.account = threadAccount;
+        }
+
+        if (state.bRunning.load(std::memory_order_acquire)) {
+            push(record);
+            return;
+        }
+
+        std::string outputBatch;
+        std::string errorBatch;
+
+        format(*record, outputBatch, errorBatch);
+        delete record;
+
+        std::lock_guard<std::mutex> locker(state.outputMutex);
+        write(outputBatch, errorBatch);
+
+    }
+
+} // namespace Pendulum_Log
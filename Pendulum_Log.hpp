@@ -0,0 +1,162 @@
+#ifndef PENDULUM_LOG_HPP
+#define PENDULUM_LOG_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <optional>
+#include <chrono>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Log {
+
+    //
+    // Log levels
+    //
+
+    enum class Level {
+        Debug,
+        Info,
+        Warning,
+        Error
+    };
+
+    //
+    // Structured fields attached to a log line (only output in JSON mode).
+    //
+
+    class Fields {
+    public:
+
+        Fields& withAccount(const std::string& value) {
+            account = value;
+            return (*this);
+        }
+
+        Fields& withMailBox(const std::string& value) {
+            mailBox = value;
+            return (*this);
+        }
+
+        Fields& withFile(const std::string& value) {
+            file = value;
+            return (*this);
+        }
+
+        Fields& withUID(std::uint64_t value) {
+            uid = value;
+            return (*this);
+        }
+
+        Fields& withBytes(std::uint64_t value) {
+            bytes = value;
+            return (*this);
+        }
+
+        Fields& withCount(std::uint64_t value) {
+            count = value;
+            return (*this);
+        }
+
+        Fields& withLatency(std::chrono::microseconds value) {
+            latency = value;
+            return (*this);
+        }
+
+        std::string account;
+        std::string mailBox;
+        std::string file;
+        std::optional<std::uint64_t> uid;
+        std::optional<std::uint64_t> bytes;
+        std::optional<std::uint64_t> count;
+        std::optional<std::chrono::microseconds> latency;
+
+    };
+
+    //
+    // Background logger. While one exists log lines are queued (lock free) and
+    // written in batches by its thread; otherwise they are written directly.
+    // Destroying it writes any lines still queued.
+    //
+
+    class Logger {
+    public:
+
+        explicit Logger(bool bJSON, Level level = Level::Info);
+        ~Logger();
+
+        Logger(const Logger&) = delete;
+        Logger& operator=(const Logger&) = delete;
+
+    };
+
+    //
+    // Account that lines logged on this thread are for (while in scope). Any line
+    // without an account field gets it and in text mode is prefixed "[account] ".
+    //
+
+    class AccountScope {
+    public:
+
+        explicit AccountScope(const std::string& account);
+        ~AccountScope();
+
+        AccountScope(const AccountScope&) = delete;
+        AccountScope& operator=(const AccountScope&) = delete;
+
+    private:
+
+        std::string previousAccount;
+
+    };
+
+    //
+    // Level from name (debug, info, warning, error); throws on an unknown name.
+    //
+
+    Level levelFromName(const std::string& name);
+
+    //
+    // True if lines at level are output (use to skip building expensive messages).
+    //
+
+    bool isEnabled(Level level);
+
+    //
+    // Append string to output quoted and escaped for JSON (for other JSON line output).
+    //
+
+    void appendJSONString(std::string& output, const std::string& value);
+
+    //
+    // Log a line. In text mode the message is output as is (info and debug to
+    // std::cout, warnings and errors to std::cerr); in JSON mode each line is a
+    // JSON object with time, level, message and any fields, all to std::cout.
+    //
+
+    void log(Level level, std::string message, Fields fields = Fields());
+
+    inline void debug(std::string message, Fields fields = Fields()) {
+        log(Level::Debug, std::move(message), std::move(fields));
+    }
+
+    inline void info(std::string message, Fields fields = Fields()) {
+        log(Level::Info, std::move(message), std::move(fields));
+    }
+
+    inline void warning(std::string message, Fields fields = Fields()) {
+        log(Level::Warning, std::move(message), std::move(fields));
+    }
+
+    inline void error(std::string message, Fields fields = Fields()) {
+        log(Level::Error, std::move(message), std::move(fields));
+    }
+
+} // namespace Pendulum_Log
+#endif /* PENDULUM_LOG_HPP */
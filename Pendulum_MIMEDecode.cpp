@@ -0,0 +1,586 @@
+
+//
+// Module: Pendulum_MIMEDecode
+//
+// Description: Pendulum MIME decoding functionality. Base64, quoted-printable and
+// RFC 2047 encoded-word decoders plus a file name sanitiser. The inner loops have
+// SSE4.2 and AVX2 implementations which are selected at runtime according to what
+// the CPU supports, with a scalar fallback for anything else (and for the odd
+// bytes at the end of a run).
+//
+// Base64 is decoded 16/32 characters at a time: each character is range checked
+// and translated to its 6 bit value, then the sextets are packed into 12/24 bytes
+// with multiply-add and shuffle instructions. Any block containing characters
+// outside the alphabet (line breaks, padding, junk) is passed to the scalar code.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// GCC/Clang          : Function target attributes and CPU detection builtins.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <array>
+#include <algorithm>
+
+//
+// SIMD intrinsics
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PENDULUM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+//
+// Pendulum MIME decode
+//
+
+#include "Pendulum_MIMEDecode.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_MIMEDecode {
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Base64 character to sextet (0xff = not in alphabet)
+    //
+
+    static constexpr std::array<std::uint8_t, 256> kBase64Table = [] {
+        std::array<std::uint8_t, 256> table {};
+        for (auto& entry : table) entry = 0xff;
+        for (int ch = 'A'; ch <= 'Z'; ch++) table[ch] = ch - 'A';
+        for (int ch = 'a'; ch <= 'z'; ch++) table[ch] = ch - 'a' + 26;
+        for (int ch = '0'; ch <= '9'; ch++) table[ch] = ch - '0' + 52;
+        table['+'] = 62;
+        table['/'] = 63;
+        return (table);
+    }();
+
+    //
+    // Hex digit to value (0xff = not a hex digit)
+    //
+
+    static constexpr std::array<std::uint8_t, 256> kHexTable = [] {
+        std::array<std::uint8_t, 256> table {};
+        for (auto& entry : table) entry = 0xff;
+        for (int ch = '0'; ch <= '9'; ch++) table[ch] = ch - '0';
+        for (int ch = 'A'; ch <= 'F'; ch++) table[ch] = ch - 'A' + 10;
+        for (int ch = 'a'; ch <= 'f'; ch++) table[ch] = ch - 'a' + 10;
+        return (table);
+    }();
+
+    //
+    // SIMD kernels. Base64 kernel decodes kernel width characters to 3/4 of that
+    // number of bytes returning false (having written nothing) if any character is
+    // not in the alphabet; it may write up to 8 bytes past the decoded data. Find
+    // special returns the index of the first '=' (or '_' if bUnderscore) or length.
+    //
+
+    struct SIMDKernels {
+        SIMDLevel level;
+        std::size_t base64Width;
+        bool (*decodeBase64Block)(const char *encoded, char *decoded);
+        std::size_t (*findQPSpecial)(const char *encoded, std::size_t length, bool bUnderscore);
+        void (*sanitise)(char *name, std::size_t length);
+    };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Scalar kernels
+    //
+
+    static bool decodeBase64BlockScalar(const char *, char *) {
+        return (false);
+    }
+
+    static std::size_t findQPSpecialScalar(const char *encoded, std::size_t length, bool bUnderscore) {
+
+        for (std::size_t index = 0; index < length; index++) {
+            if ((encoded[index] == '=') || (bUnderscore && (encoded[index] == '_'))) {
+                return (index);
+            }
+        }
+
+        return (length);
+
+    }
+
+    static bool isAlphaNumeric(char ch) {
+        return (((ch >= '0') && (ch <= '9')) || ((ch >= 'A') && (ch <= 'Z')) || ((ch >= 'a') && (ch <= 'z')));
+    }
+
+    static void sanitiseScalar(char *name, std::size_t length) {
+
+        for (std::size_t index = 0; index < length; index++) {
+            if (!isAlphaNumeric(name[index])) {
+                name[index] = ' ';
+            }
+        }
+
+    }
+
+#ifdef PENDULUM_X86_SIMD
+
+    //
+    // SSE4.2 kernels (16 bytes at a time)
+    //
+
+    __attribute__((target("sse4.2")))
+    static bool decodeBase64BlockSSE42(const char *encoded, char *decoded) {
+
+        const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(encoded));
+
+        // Range check and per-range offset to sextet value (bytes >= 0x80 compare as negative so fail all ranges)
+
+        const __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(input, _mm_set1_epi8('Z' + 1)));
+        const __m128i isLower = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(input, _mm_set1_epi8('z' + 1)));
+        const __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(input, _mm_set1_epi8('9' + 1)));
+        const __m128i isPlus = _mm_cmpeq_epi8(input, _mm_set1_epi8('+'));
+        const __m128i isSlash = _mm_cmpeq_epi8(input, _mm_set1_epi8('/'));
+
+        const __m128i isValid = _mm_or_si128(_mm_or_si128(isUpper, isLower), _mm_or_si128(_mm_or_si128(isDigit, isPlus), isSlash));
+        if (_mm_movemask_epi8(isValid) != 0xffff) {
+            return (false);
+        }
+
+        __m128i shift = _mm_and_si128(isUpper, _mm_set1_epi8(-'A'));
+        shift = _mm_or_si128(shift, _mm_and_si128(isLower, _mm_set1_epi8(26 - 'a')));
+        shift = _mm_or_si128(shift, _mm_and_si128(isDigit, _mm_set1_epi8(52 - '0')));
+        shift = _mm_or_si128(shift, _mm_and_si128(isPlus, _mm_set1_epi8(62 - '+')));
+        shift = _mm_or_si128(shift, _mm_and_si128(isSlash, _mm_set1_epi8(63 - '/')));
+
+        const __m128i sextets = _mm_add_epi8(input, shift);
+
+        // Pack 4 sextets per 32 bits into 24 bits then gather the 12 bytes big endian
+
+        const __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+        const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+        const __m128i packed = _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(decoded), packed);
+
+        return (true);
+
+    }
+
+    __attribute__((target("sse4.2")))
+    static std::size_t findQPSpecialSSE42(const char *encoded, std::size_t length, bool bUnderscore) {
+
+        const __m128i equals = _mm_set1_epi8('=');
+        const __m128i underscore = _mm_set1_epi8(bUnderscore ? '_' : '=');
+        std::size_t index { 0 };
+
+        for (; index + 16 <= length; index += 16) {
+            const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(encoded + index));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(input, equals), _mm_cmpeq_epi8(input, underscore)));
+            if (mask) {
+                return (index + __builtin_ctz(mask));
+            }
+        }
+
+        return (index + findQPSpecialScalar(encoded + index, length - index, bUnderscore));
+
+    }
+
+    __attribute__((target("sse4.2")))
+    static void sanitiseSSE42(char *name, std::size_t length) {
+
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        std::size_t index { 0 };
+
+        for (; index + 16 <= length; index += 16) {
+            const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(name + index));
+            const __m128i lower = _mm_or_si128(input, caseBit);
+            const __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(input, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(input, _mm_set1_epi8('9' + 1)));
+            const __m128i isAlpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+            const __m128i output = _mm_blendv_epi8(space, input, _mm_or_si128(isDigit, isAlpha));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(name + index), output);
+        }
+
+        sanitiseScalar(name + index, length - index);
+
+    }
+
+    //
+    // AVX2 kernels (32 bytes at a time)
+    //
+
+    __attribute__((target("avx2")))
+    static bool decodeBase64BlockAVX2(const char *encoded, char *decoded) {
+
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(encoded));
+
+        const __m256i isUpper = _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), input));
+        const __m256i isLower = _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), input));
+        const __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), input));
+        const __m256i isPlus = _mm256_cmpeq_epi8(input, _mm256_set1_epi8('+'));
+        const __m256i isSlash = _mm256_cmpeq_epi8(input, _mm256_set1_epi8('/'));
+
+        const __m256i isValid = _mm256_or_si256(_mm256_or_si256(isUpper, isLower), _mm256_or_si256(_mm256_or_si256(isDigit, isPlus), isSlash));
+        if (static_cast<std::uint32_t>(_mm256_movemask_epi8(isValid)) != 0xffffffffU) {
+            return (false);
+        }
+
+        __m256i shift = _mm256_and_si256(isUpper, _mm256_set1_epi8(-'A'));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(isLower, _mm256_set1_epi8(26 - 'a')));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(isDigit, _mm256_set1_epi8(52 - '0')));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(isPlus, _mm256_set1_epi8(62 - '+')));
+        shift = _mm256_or_si256(shift, _mm256_and_si256(isSlash, _mm256_set1_epi8(63 - '/')));
+
+        const __m256i sextets = _mm256_add_epi8(input, shift);
+
+        // Pack each 128 bit lane to 12 bytes then move the two lanes together (24 bytes)
+
+        const __m256i pairs = _mm256_maddubs_epi16(sextets, _mm256_set1_epi32(0x01400140));
+        const __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        const __m256i packed = _mm256_shuffle_epi8(words, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                                           2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        const __m256i output = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(decoded), output);
+
+        return (true);
+
+    }
+
+    __attribute__((target("avx2")))
+    static std::size_t findQPSpecialAVX2(const char *encoded, std::size_t length, bool bUnderscore) {
+
+        const __m256i equals = _mm256_set1_epi8('=');
+        const __m256i underscore = _mm256_set1_epi8(bUnderscore ? '_' : '=');
+        std::size_t index { 0 };
+
+        for (; index + 32 <= length; index += 32) {
+            const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(encoded + index));
+            std::uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(input, equals), _mm256_cmpeq_epi8(input, underscore)));
+            if (mask) {
+                return (index + __builtin_ctz(mask));
+            }
+        }
+
+        return (index + findQPSpecialScalar(encoded + index, length - index, bUnderscore));
+
+    }
+
+    __attribute__((target("avx2")))
+    static void sanitiseAVX2(char *name, std::size_t length) {
+
+        const __m256i space = _mm256_set1_epi8(' ');
+        const __m256i caseBit = _mm256_set1_epi8(0x20);
+        std::size_t index { 0 };
+
+        for (; index + 32 <= length; index += 32) {
+            const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(name + index));
+            const __m256i lower = _mm256_or_si256(input, caseBit);
+            const __m256i isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(input, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), input));
+            const __m256i isAlpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+            const __m256i output = _mm256_blendv_epi8(space, input, _mm256_or_si256(isDigit, isAlpha));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(name + index), output);
+        }
+
+        sanitiseSSE42(name + index, length - index);
+
+    }
+
+#endif // PENDULUM_X86_SIMD
+
+    //
+    // Return kernels for a given SIMD level.
+    //
+
+    static SIMDKernels kernelsForLevel(SIMDLevel level) {
+
+#ifdef PENDULUM_X86_SIMD
+        if (level == SIMDLevel::AVX2) {
+            return { SIMDLevel::AVX2, 32, decodeBase64BlockAVX2, findQPSpecialAVX2, sanitiseAVX2 };
+        } else if (level == SIMDLevel::SSE42) {
+            return { SIMDLevel::SSE42, 16, decodeBase64BlockSSE42, findQPSpecialSSE42, sanitiseSSE42 };
+        }
+#endif
+        return { SIMDLevel::Scalar, 4, decodeBase64BlockScalar, findQPSpecialScalar, sanitiseScalar };
+
+    }
+
+    //
+    // Detect best SIMD level supported by CPU.
+    //
+
+    static SIMDLevel detectSIMDLevel() {
+
+#ifdef PENDULUM_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return (SIMDLevel::AVX2);
+        } else if (__builtin_cpu_supports("sse4.2")) {
+            return (SIMDLevel::SSE42);
+        }
+#endif
+        return (SIMDLevel::Scalar);
+
+    }
+
+    //
+    // Active kernels
+    //
+
+    static SIMDKernels& activeKernels() {
+        static SIMDKernels kernels { kernelsForLevel(detectSIMDLevel()) };
+        return (kernels);
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    SIMDLevel getSIMDLevel() {
+        return (activeKernels().level);
+    }
+
+    SIMDLevel getSupportedSIMDLevel() {
+        static SIMDLevel supportedLevel { detectSIMDLevel() };
+        return (supportedLevel);
+    }
+
+    void setSIMDLevel(SIMDLevel level) {
+
+        if (static_cast<int>(level) > static_cast<int>(getSupportedSIMDLevel())) {
+            level = getSupportedSIMDLevel();
+        }
+
+        activeKernels() = kernelsForLevel(level);
+
+    }
+
+    std::string getSIMDLevelName(SIMDLevel level) {
+
+        switch (level) {
+            case SIMDLevel::AVX2:
+                return ("AVX2");
+            case SIMDLevel::SSE42:
+                return ("SSE4.2");
+            default:
+                return ("Scalar");
+        }
+
+    }
+
+    //
+    // Decode base64. Whenever no partial quantum is pending, whole blocks of
+    // alphabet characters are handed to the SIMD kernel; everything else goes
+    // through the scalar quantum accumulator.
+    //
+
+    void Base64Decoder::decode(std::string_view encoded, std::string& decoded) {
+
+        const SIMDKernels& kernels { activeKernels() };
+        const char *input { encoded.data() };
+        std::size_t length { encoded.size() };
+        std::size_t index { 0 };
+        std::size_t outputStart { decoded.size() };
+
+        if (bPadded) {
+            return;
+        }
+
+        // Room for worst case plus kernel overrun
+
+        decoded.resize(outputStart + ((length / 4) * 3) + 3 + 32);
+        char *output { &decoded[outputStart] };
+
+        while (index < length) {
+            if ((quantumCount == 0) && ((length - index) >= kernels.base64Width) &&
+                kernels.decodeBase64Block(input + index, output)) {
+                index += kernels.base64Width;
+                output += (kernels.base64Width / 4) * 3;
+                continue;
+            }
+            // Scalar: past the character that stopped SIMD (at most one kernel width)
+            // then retry SIMD as soon as the quantum is aligned again.
+            std::size_t scalarEnd { std::min(length, index + kernels.base64Width) };
+            bool bSkipped { quantumCount != 0 };
+            for (; index < scalarEnd; index++) {
+                std::uint8_t sextet { kBase64Table[static_cast<std::uint8_t>(input[index])] };
+                if (sextet == 0xff) {
+                    if (input[index] == '=') {
+                        bPadded = true;
+                        index = length;
+                        break;
+                    }
+                    bSkipped = true;
+                    continue; // Skip line breaks and junk
+                }
+                quantum = (quantum << 6) | sextet;
+                if (++quantumCount == 4) {
+                    *output++ = static_cast<char>(quantum >> 16);
+                    *output++ = static_cast<char>(quantum >> 8);
+                    *output++ = static_cast<char>(quantum);
+                    quantum = 0;
+                    quantumCount = 0;
+                    if (bSkipped && ((length - index - 1) >= kernels.base64Width)) {
+                        index++;
+                        break;
+                    }
+                }
+            }
+        }
+
+        decoded.resize(output - decoded.data());
+
+    }
+
+    //
+    // Flush any partial quantum (2 or 3 sextets give 1 or 2 bytes).
+    //
+
+    void Base64Decoder::finish(std::string& decoded) {
+
+        if (quantumCount == 2) {
+            decoded.push_back(static_cast<char>(quantum >> 4));
+        } else if (quantumCount == 3) {
+            decoded.push_back(static_cast<char>(quantum >> 10));
+            decoded.push_back(static_cast<char>(quantum >> 2));
+        }
+
+        quantum = 0;
+        quantumCount = 0;
+        bPadded = false;
+
+    }
+
+    void decodeBase64(std::string_view encoded, std::string& decoded) {
+
+        Base64Decoder decoder;
+
+        decoder.decode(encoded, decoded);
+        decoder.finish(decoded);
+
+    }
+
+    //
+    // Decode quoted-printable; runs without '=' (or '_') are found by the SIMD
+    // kernel and copied as is.
+    //
+
+    void decodeQuotedPrintable(std::string_view encoded, std::string& decoded, bool bEncodedWord) {
+
+        const SIMDKernels& kernels { activeKernels() };
+        std::size_t index { 0 };
+
+        decoded.reserve(decoded.size() + encoded.size());
+
+        while (index < encoded.size()) {
+
+            std::size_t special { index + kernels.findQPSpecial(encoded.data() + index, encoded.size() - index, bEncodedWord) };
+
+            decoded.append(encoded.data() + index, special - index);
+            if (special == encoded.size()) {
+                break;
+            }
+
+            index = special + 1;
+
+            if (encoded[special] == '_') {
+                decoded.push_back(' ');
+            } else if (encoded.compare(index, 2, "\r\n") == 0) {
+                index += 2; // Soft line break
+            } else if ((index < encoded.size()) && (encoded[index] == '\n')) {
+                index++;    // Soft line break (bare LF)
+            } else if (((index + 1) < encoded.size()) &&
+                       (kHexTable[static_cast<std::uint8_t>(encoded[index])] != 0xff) &&
+                       (kHexTable[static_cast<std::uint8_t>(encoded[index + 1])] != 0xff)) {
+                decoded.push_back(static_cast<char>((kHexTable[static_cast<std::uint8_t>(encoded[index])] << 4) |
+                                                    kHexTable[static_cast<std::uint8_t>(encoded[index + 1])]));
+                index += 2;
+            } else {
+                decoded.push_back('='); // Not an escape so keep
+            }
+
+        }
+
+    }
+
+    //
+    // Decode RFC 2047 encoded words; whitespace between two adjacent encoded
+    // words is dropped. Malformed words are left as they are.
+    //
+
+    std::string decodeEncodedWords(std::string_view text) {
+
+        std::string decoded;
+        std::size_t index { 0 };
+        bool bLastWasEncoded { false };
+
+        decoded.reserve(text.size());
+
+        while (index < text.size()) {
+
+            std::size_t wordStart { text.find("=?", index) };
+            if (wordStart == std::string_view::npos) {
+                decoded.append(text.substr(index));
+                break;
+            }
+
+            std::size_t charsetEnd { text.find('?', wordStart + 2) };
+            std::size_t wordEnd { std::string_view::npos };
+            if ((charsetEnd != std::string_view::npos) && ((charsetEnd + 2) < text.size()) && (text[charsetEnd + 2] == '?')) {
+                wordEnd = text.find("?=", charsetEnd + 3);
+            }
+
+            if (wordEnd == std::string_view::npos) {
+                decoded.append(text.substr(index, (wordStart + 2) - index));
+                index = wordStart + 2;
+                bLastWasEncoded = false;
+                continue;
+            }
+
+            std::string_view between { text.substr(index, wordStart - index) };
+            if (!(bLastWasEncoded && (between.find_first_not_of(" \t\r\n") == std::string_view::npos))) {
+                decoded.append(between);
+            }
+
+            char encoding { text[charsetEnd + 1] };
+            std::string_view encodedText { text.substr(charsetEnd + 3, wordEnd - (charsetEnd + 3)) };
+            if ((encoding == 'B') || (encoding == 'b')) {
+                decodeBase64(encodedText, decoded);
+            } else if ((encoding == 'Q') || (encoding == 'q')) {
+                decodeQuotedPrintable(encodedText, decoded, true);
+            } else {
+                decoded.append(text.substr(wordStart, (wordEnd + 2) - wordStart));
+            }
+
+            index = wordEnd + 2;
+            bLastWasEncoded = true;
+
+        }
+
+        return (decoded);
+
+    }
+
+    void sanitiseFileName(std::string& name) {
+
+        if (!name.empty()) {
+            activeKernels().sanitise(&name[0], name.size());
+        }
+
+    }
+
+} // namespace Pendulum_MIMEDecode
@@ -0,0 +1,90 @@
+#ifndef PENDULUM_MIMEDECODE_HPP
+#define PENDULUM_MIMEDECODE_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_MIMEDecode {
+
+    //
+    // SIMD instruction set used by the decoders (selected at runtime).
+    //
+
+    enum class SIMDLevel {
+        Scalar = 0,
+        SSE42,
+        AVX2
+    };
+
+    //
+    // Base64 decoder. Input may be split across calls at any point (lines,
+    // read buffer boundaries); CR/LF and other non-alphabet characters are
+    // skipped and decoding stops at padding.
+    //
+
+    class Base64Decoder {
+    public:
+        void decode(std::string_view encoded, std::string& decoded);
+        void finish(std::string& decoded);
+    private:
+        std::uint32_t quantum { 0 };    // Sextets accumulated so far
+        int quantumCount { 0 };         // Number of sextets in quantum
+        bool bPadded { false };         // = true padding seen (end of data)
+    };
+
+    //
+    // Return SIMD level in use / supported by the CPU.
+    //
+
+    SIMDLevel getSIMDLevel();
+    SIMDLevel getSupportedSIMDLevel();
+
+    //
+    // Set SIMD level to use (clamped to what the CPU supports); for benchmarking.
+    //
+
+    void setSIMDLevel(SIMDLevel level);
+
+    //
+    // Return name of SIMD level.
+    //
+
+    std::string getSIMDLevelName(SIMDLevel level);
+
+    //
+    // Decode base64 appending result to decoded.
+    //
+
+    void decodeBase64(std::string_view encoded, std::string& decoded);
+
+    //
+    // Decode quoted-printable appending result to decoded. If bEncodedWord is
+    // true then the RFC 2047 "Q" variant is decoded ('_' is a space).
+    //
+
+    void decodeQuotedPrintable(std::string_view encoded, std::string& decoded, bool bEncodedWord = false);
+
+    //
+    // Decode any RFC 2047 encoded words ("=?charset?B|Q?text?=") in a header
+    // value. Decoded bytes are returned as is (no character set conversion).
+    //
+
+    std::string decodeEncodedWords(std::string_view text);
+
+    //
+    // Replace all but ASCII alpha numeric characters with spaces (file name safe).
+    //
+
+    void sanitiseFileName(std::string& name);
+
+} // namespace Pendulum_MIMEDecode
+#endif /* PENDULUM_MIMEDECODE_HPP */
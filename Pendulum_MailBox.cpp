@@ -9,6 +9,8 @@
 // 
 // C11++              : Use of C11++ features.
 // Antik Classes      : CIMAP, CIMAPParse, CMIME.
+// Pendulum           : Pendulum_ResponseParse (zero-copy parser), Pendulum_Arena,
+//                      Pendulum_MIMEDecode, Pendulum_File.
 //
 
 // =============
@@ -21,6 +23,8 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
+#include <chrono>
 
 //
 // Antik Classes
@@ -34,6 +38,14 @@
 //
 
 #include "Pendulum_MailBox.hpp"
+#include "Pendulum_ResponseParse.hpp"
+#include "Pendulum_MIMEDecode.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Trace.hpp"
+#include "Pendulum_Bandwidth.hpp"
+#include "Pendulum_Log.hpp"
+#include "Pendulum_File.hpp"
+#include "Pendulum_Journal.hpp"
 
 // =========
 // NAMESPACE
@@ -48,10 +60,110 @@ namespace Pendulum_MailBox {
     using namespace Antik::IMAP;
     using namespace Antik::File;
 
+    using Pendulum_ResponseParse::PARSEDRESPONSE;
+
     // ===============
     // LOCAL FUNCTIONS
     // ===============
 
+    //
+    // Round trip latency histogram for a command (by command verb).
+    //
+
+    static Pendulum_Metrics::Histogram& commandLatency(const std::string& command) {
+
+        static const char *kName { "pendulum_imap_command_seconds" };
+        static const char *kHelp { "IMAP command round trip latency." };
+        static Pendulum_Metrics::Histogram& selectLatency { Pendulum_Metrics::histogram(kName, kHelp, "command=\"SELECT\"") };
+        static Pendulum_Metrics::Histogram& searchLatency { Pendulum_Metrics::histogram(kName, kHelp, "command=\"SEARCH\"") };
+        static Pendulum_Metrics::Histogram& fetchLatency { Pendulum_Metrics::histogram(kName, kHelp, "command=\"FETCH\"") };
+        static Pendulum_Metrics::Histogram& listLatency { Pendulum_Metrics::histogram(kName, kHelp, "command=\"LIST\"") };
+        static Pendulum_Metrics::Histogram& otherLatency { Pendulum_Metrics::histogram(kName, kHelp, "command=\"OTHER\"") };
+
+        std::size_t verbStart { (command.compare(0, 4, "UID ") == 0) ? 4u : 0u };
+
+        if (command.compare(verbStart, 6, "SELECT") == 0) {
+            return (selectLatency);
+        } else if (command.compare(verbStart, 6, "SEARCH") == 0) {
+            return (searchLatency);
+        } else if (command.compare(verbStart, 5, "FETCH") == 0) {
+            return (fetchLatency);
+        } else if (command.compare(verbStart, 4, "LIST") == 0) {
+            return (listLatency);
+        }
+
+        return (otherLatency);
+
+    }
+
+    //
+    // Send command to IMAP server recording round trip latency and bytes received
+    // (which are then charged to any bandwidth shaping).
+    //
+
+    static std::string sendTimedCommand(ServerConnection& imapConnection, const std::string& command) {
+
+        static Pendulum_Metrics::Counter& bytesReceived { Pendulum_Metrics::counter("pendulum_imap_received_bytes_total", "IMAP response bytes received.") };
+
+        std::string commandResponse;
+        Pendulum_Metrics::Histogram& latencyHistogram { commandLatency(command) };
+
+        if (imapConnection.concurrency) {
+            imapConnection.concurrency->pace();
+        }
+
+        auto commandStart { std::chrono::steady_clock::now() };
+
+        {
+            Pendulum_Trace::Span span { "sendCommand", "imap", command };
+            Pendulum_Metrics::ScopedTimer timer { latencyHistogram };
+            commandResponse = imapConnection.server->sendCommand(command);
+        }
+
+        bytesReceived.add(commandResponse.size());
+
+        // FETCH latency drives the server's concurrency
+
+        if (imapConnection.concurrency && (&latencyHistogram == &commandLatency("FETCH"))) {
+            imapConnection.concurrency->commandCompleted(
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - commandStart), commandResponse.size());
+        }
+
+        Pendulum_Bandwidth::throttle(commandResponse.size());
+
+        return (commandResponse);
+
+    }
+
+    //
+    // Count IMAP command failures (NO/BAD response or BYE).
+    //
+
+    static void countCommandError() {
+        static Pendulum_Metrics::Counter& commandErrors { Pendulum_Metrics::counter("pendulum_imap_command_errors_total", "IMAP commands failed (NO/BAD or BYE).") };
+        commandErrors.add();
+    }
+
+    //
+    // Throw command error; a throttle response is reported to the server's concurrency
+    // controller and thrown as ThrottledException so that the command can be retried.
+    //
+
+    static void throwCommandError(ServerConnection& imapConnection, const std::string& command, const std::string& errorMessage) {
+
+        countCommandError();
+
+        if (Pendulum_Concurrency::isThrottleResponse(errorMessage)) {
+            if (imapConnection.concurrency) {
+                imapConnection.concurrency->throttled(errorMessage);
+            }
+            throw Pendulum_Concurrency::ThrottledException(command + ": " + errorMessage);
+        }
+
+        throw CIMAP::Exception(command + ": " + errorMessage);
+
+    }
+
     //
     // Send command to IMAP server, parse received response and return it.
     // At present it catches any thrown exceptions then re-throws. Also any 
@@ -64,8 +176,9 @@ namespace Pendulum_MailBox {
 
         try {
             
-            std::string commandResponse { imapConnection.server.sendCommand(command) };
+            std::string commandResponse { sendTimedCommand(imapConnection, command) };
             if (commandResponse.size()) {
+                Pendulum_Trace::Span span { "CIMAPParse::parseResponse", "parse", commandResponse.size() };
                 parsedResponse = CIMAPParse::parseResponse(commandResponse);
             }
        
@@ -77,9 +190,45 @@ namespace Pendulum_MailBox {
         // successfully received and response parsed.
 
         if (parsedResponse->byeSent) {
+            countCommandError();
             throw CIMAP::Exception("Received BYE from server: " + parsedResponse->errorMessage);
         } else if (parsedResponse->status != CIMAPParse::RespCode::OK) {
-            throw CIMAP::Exception(command + ": " + parsedResponse->errorMessage);
+            throwCommandError(imapConnection, command, parsedResponse->errorMessage);
+        }
+
+        return (parsedResponse);
+
+    }
+
+    //
+    // Send command to IMAP server and parse the response with the zero-copy parser
+    // into the connections command arena. Server disconnect and command errors are
+    // signaled in the same way as sendCommand().
+    //
+
+    static PARSEDRESPONSE sendCommandZeroCopy(ServerConnection& imapConnection, const std::string& command) {
+
+        PARSEDRESPONSE parsedResponse;
+
+        std::string commandResponse { sendTimedCommand(imapConnection, command) };
+        if (commandResponse.empty()) {
+            throw CIMAP::Exception(command + ": empty response");
+        }
+
+        if (!imapConnection.commandArena) {
+            imapConnection.commandArena = Pendulum_Arena::CommandArena::create();
+        }
+
+        {
+            Pendulum_Trace::Span span { "Pendulum_ResponseParse::parseResponse", "parse", commandResponse.size() };
+            parsedResponse = Pendulum_ResponseParse::parseResponse(std::move(commandResponse), imapConnection.commandArena->acquire());
+        }
+
+        if (parsedResponse->byeSent) {
+            countCommandError();
+            throw CIMAP::Exception("Received BYE from server: " + std::string(parsedResponse->errorMessage));
+        } else if (parsedResponse->status != CIMAPParse::RespCode::OK) {
+            throwCommandError(imapConnection, command, std::string(parsedResponse->errorMessage));
         }
 
         return (parsedResponse);
@@ -92,43 +241,64 @@ namespace Pendulum_MailBox {
     
     static void serverReconnect(ServerConnection& imapConnection) {
 
+        static Pendulum_Metrics::Counter& reconnects { Pendulum_Metrics::counter("pendulum_imap_reconnects_total", "Reconnects after a server disconnect.") };
+
+        reconnects.add();
+
+        if (imapConnection.concurrency) {
+            imapConnection.concurrency->reconnected();
+        }
+
         serverConnect(imapConnection);
 
-        if (imapConnection.server.getConnectedStatus() && imapConnection.reconnectMailBox.size()) {
+        if (imapConnection.server->getConnectedStatus() && imapConnection.reconnectMailBox.size()) {
             CIMAPParse::COMMANDRESPONSE parsedResponse;
-            parsedResponse = sendCommand(imapConnection, "SELECT " + imapConnection.reconnectMailBox);
+            parsedResponse = sendCommand(imapConnection, (imapConnection.bReadOnly ? "EXAMINE " : "SELECT ") + imapConnection.reconnectMailBox);
             if ((parsedResponse) && (parsedResponse->status == CIMAPParse::RespCode::OK)) {
-                std::cerr << "Reconnected to MailBox [" << imapConnection.reconnectMailBox << "]" << std::endl;
+                Pendulum_Log::warning("Reconnected to MailBox [" + imapConnection.reconnectMailBox + "]",
+                                      Pendulum_Log::Fields().withMailBox(imapConnection.reconnectMailBox));
             }
         }
 
     }
     
     //
-    // Send a command to IMAP server. If the server disconnects try to reconnect
-    // and resend command even if it was successful.
+    // Send a command to IMAP server (using passed in send function). If the server 
+    // disconnects try to reconnect and resend command even if it was successful.
+    // A throttled command is resent (after the controller's pacing delay) up to
+    // the retry count.
     //
     
-    static CIMAPParse::COMMANDRESPONSE sendCommandRetry(ServerConnection& imapConnection, const std::string& command) {
+    template <typename SendFn>
+    static auto sendCommandRetry(ServerConnection& imapConnection, const std::string& command, SendFn sendFn) {
         
-        CIMAPParse::COMMANDRESPONSE parsedResponse;
-
-        try {
-            parsedResponse = sendCommand(imapConnection, command);
-        } catch (...) {
-            // If still connected  re-throw error as not connection related.
-            if (imapConnection.server.getConnectedStatus()) {
-                throw;
+        decltype(sendFn(imapConnection, command)) parsedResponse;
+
+        for (int throttleRetries = imapConnection.retryCount; ; throttleRetries--) {
+            try {
+                parsedResponse = sendFn(imapConnection, command);
+            } catch (const Pendulum_Concurrency::ThrottledException& e) {
+                if (throttleRetries <= 1) {
+                    throw;
+                }
+                Pendulum_Log::warning(std::string(e.what()) + "\nRetrying ...");
+                continue;
+            } catch (...) {
+                // If still connected  re-throw error as not connection related.
+                if (imapConnection.server->getConnectedStatus()) {
+                    throw;
+                }
             }
+            break;
         }
 
         try {
             // The command may have been successful but if a disconnect was detected
             // try to reconnect and repeat command just in case.
-            if (!imapConnection.server.getConnectedStatus()) {
-                std::cerr << "Server Disconnect.\nTrying to reconnect ..." << std::endl;
+            if (!imapConnection.server->getConnectedStatus()) {
+                Pendulum_Log::warning("Server Disconnect.\nTrying to reconnect ...");
                 serverReconnect(imapConnection);
-                parsedResponse = sendCommand(imapConnection, command);
+                parsedResponse = sendFn(imapConnection, command);
             }
         } catch (...) {
             throw;  // Signal reconnect/command failure.
@@ -137,19 +307,98 @@ namespace Pendulum_MailBox {
         return(parsedResponse);
         
     }
-    
+
+    static CIMAPParse::COMMANDRESPONSE sendCommandRetry(ServerConnection& imapConnection, const std::string& command) {
+        return (sendCommandRetry(imapConnection, command, sendCommand));
+    }
+
+    //
+    // Extract file name safe subject from "Subject:" header field (CMIME best ASCII fit).
+    // Both response parsers use the same decoder as the subject is part of the .eml file
+    // name; a different name for the same message would archive it again.
+    //
+
+    static std::string extractSubject(const std::string& subjectField) {
+
+        std::string subject;
+
+        if (subjectField.find("Subject:") != std::string::npos) { // Contains "Subject:"
+            Pendulum_Trace::Span span { "extractSubject", "mime" };
+            subject = CMIME::convertMIMEStringToASCII(subjectField.substr(8));
+            if (subject.length() > kMaxSubjectLine) { // Truncate for file name
+                subject = subject.substr(0, kMaxSubjectLine);
+            }
+            Pendulum_MIMEDecode::sanitiseFileName(subject); // Remove all but alpha numeric from subject
+        }
+
+        return (subject);
+
+    }
+
+    //
+    // Log fetched message with its mailbox, size and fetch latency.
+    //
+
+    static void logFetch(const ServerConnection& imapConnection, uint64_t index, std::size_t bytes,
+                         std::chrono::steady_clock::time_point fetchStart) {
+        Pendulum_Log::info("EMAIL MESSAGE NO. [" + std::to_string(index) + "]",
+                           Pendulum_Log::Fields().withMailBox(imapConnection.reconnectMailBox).withUID(index).withBytes(bytes)
+                           .withLatency(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - fetchStart)));
+    }
+
+    //
+    // Fetch e-mail contents using the zero-copy parser; the body is a view into the
+    // raw FETCH response which is kept alive by the returned contents.
+    //
+
+    static EmailContents fetchEmailContentsZeroCopy(ServerConnection& imapConnection, const std::string& command) {
+
+        EmailContents emailContents;
+        auto fetchStart { std::chrono::steady_clock::now() };
+        std::shared_ptr<Pendulum_ResponseParse::ParsedResponse> parsedResponse {
+            sendCommandRetry(imapConnection, command, sendCommandZeroCopy)
+        };
+
+        if (parsedResponse) {
+            for (auto& fetchEntry : parsedResponse->fetchList) {
+                emailContents.body = Pendulum_ResponseParse::findFetchItem(fetchEntry, "BODY[]");
+                emailContents.subject = extractSubject(std::string(Pendulum_ResponseParse::findFetchItem(fetchEntry, "BODY[HEADER.FIELDS (SUBJECT)]")));
+                logFetch(imapConnection, fetchEntry.index, emailContents.body.size(), fetchStart);
+            }
+            emailContents.owner = parsedResponse;
+        }
+
+        return (emailContents);
+
+    }
+
     // ================
     // PUBLIC FUNCTIONS
     // ================
 
     //
-    // Connect to IMAP server (performing retryCount times until successful).
+    // Connect to IMAP server (performing retryCount times until successful). A logged
+    // in spare connection is used instead when one is ready.
     //
     
     void serverConnect(ServerConnection& imapConnection) {
 
+        static Pendulum_Metrics::Histogram& connectLatency { Pendulum_Metrics::histogram("pendulum_imap_connect_seconds", "IMAP server connect (TLS and login) latency.") };
+        static Pendulum_Metrics::Counter& connectFailures { Pendulum_Metrics::counter("pendulum_imap_connect_failures_total", "IMAP server connect attempts failed.") };
+
+        Pendulum_Trace::Span span { "serverConnect", "imap" };
+
         std::exception_ptr thrownException { nullptr };
         int retryCount {imapConnection.retryCount };
+
+        if (imapConnection.spares) {
+            std::unique_ptr<CIMAP> spare { imapConnection.spares->take() };
+            if (spare) {
+                imapConnection.server = std::move(spare);
+                Pendulum_Log::info("Connected (spare connection).");
+                return;
+            }
+        }
        
         // Connect retry loop
         
@@ -157,17 +406,22 @@ namespace Pendulum_MailBox {
 
             // Try to connect
             
+            auto connectStart { std::chrono::steady_clock::now() };
+
             try {             
-                imapConnection.server.connect(); 
+                Pendulum_Metrics::ScopedTimer timer { connectLatency };
+                imapConnection.server->connect(); 
                 thrownException = nullptr;  // Possible success
             } catch (...) {
                 thrownException = std::current_exception(); // Error        
+                connectFailures.add();
             }
 
             // If connected return
             
-            if (imapConnection.server.getConnectedStatus() && !thrownException) {
-                std::cout << "Connected." << std::endl;
+            if (imapConnection.server->getConnectedStatus() && !thrownException) {
+                Pendulum_Log::info("Connected.", Pendulum_Log::Fields().withLatency(
+                        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - connectStart)));
                 break;
             } 
             
@@ -177,7 +431,7 @@ namespace Pendulum_MailBox {
                 std::rethrow_exception(thrownException);
             }
             
-            std::cerr << "Trying to reconnect ..." << std::endl;
+            Pendulum_Log::warning("Trying to reconnect ...");
 
         }
 
@@ -210,25 +464,31 @@ namespace Pendulum_MailBox {
         
         if (bAllMailBoxes) {
             
-            CIMAPParse::COMMANDRESPONSE parsedResponse;
-            
-            // Get list of all mailboxes
-            
-            parsedResponse = sendCommandRetry(imapConnection, "LIST \"\" *");
-
-            if (parsedResponse) {
+            // Ignore mailbox with attribute no select or that is on ignore list
 
-                // Ignore mailbox with attribute no select or that is on ignore list
-                
-                for (auto& mailBoxEntry : parsedResponse->mailBoxList) {
+            auto addMailBoxes = [&] (const auto& mailBoxList) {
+                for (auto& mailBoxEntry : mailBoxList) {
                     if ((std::find(ignoreMailBoxesList.begin(), ignoreMailBoxesList.end(), mailBoxEntry.mailBoxName) == ignoreMailBoxesList.end()) &&
                         (mailBoxEntry.attributes.find("\\Noselect") == std::string::npos)) {
-                        mailBoxesList.push_back( { mailBoxEntry.mailBoxName, 0, ""} );
+                        mailBoxesList.push_back( { std::string(mailBoxEntry.mailBoxName), 0, ""} );
                     } else {
-                        std::cout << "Ignoring mailbox [" << mailBoxEntry.mailBoxName << "]" << std::endl;                       
+                        Pendulum_Log::info("Ignoring mailbox [" + std::string(mailBoxEntry.mailBoxName) + "]");
                     }
                 }
+            };
 
+            // Get list of all mailboxes
+            
+            if (imapConnection.bZeroCopy) {
+                PARSEDRESPONSE parsedResponse { sendCommandRetry(imapConnection, "LIST \"\" *", sendCommandZeroCopy) };
+                if (parsedResponse) {
+                    addMailBoxes(parsedResponse->mailBoxList);
+                }
+            } else {
+                CIMAPParse::COMMANDRESPONSE parsedResponse { sendCommandRetry(imapConnection, "LIST \"\" *") };
+                if (parsedResponse) {
+                    addMailBoxes(parsedResponse->mailBoxList);
+                }
             }
 
         } else {
@@ -243,7 +503,7 @@ namespace Pendulum_MailBox {
                 if (std::find(ignoreMailBoxesList.begin(), ignoreMailBoxesList.end(), mailBox) == ignoreMailBoxesList.end()) {
                     mailBoxesList.push_back({ mailBox, 0, ""} );
                 } else {
-                    std::cout << "Ignoring mailbox [" << mailBox << "]" << std::endl;
+                    Pendulum_Log::info("Ignoring mailbox [" + mailBox + "]", Pendulum_Log::Fields().withMailBox(mailBox));
                 }
             }
             
@@ -253,21 +513,71 @@ namespace Pendulum_MailBox {
 
     }
 
+    //
+    // SELECT (or EXAMINE) a mailbox (response ignored).
+    //
+
+    void selectMailBox(ServerConnection& imapConnection, const std::string& mailBoxName) {
+
+        Pendulum_Log::info("MAIL BOX [" + mailBoxName + "]", Pendulum_Log::Fields().withMailBox(mailBoxName));
+
+        sendCommandRetry(imapConnection, (imapConnection.bReadOnly ? "EXAMINE " : "SELECT ") + mailBoxName);
+
+    }
+
+    //
+    // STATUS a mailbox for its message count and next UID. The zero-copy parser skips
+    // STATUS responses so the values are read from its raw response buffer.
+    //
+
+    MailBoxStatus fetchMailBoxStatus(ServerConnection& imapConnection, const std::string& mailBoxName) {
+
+        MailBoxStatus mailBoxStatus;
+        PARSEDRESPONSE parsedResponse { sendCommandRetry(imapConnection, "STATUS " + mailBoxName + " (MESSAGES UIDNEXT)", sendCommandZeroCopy) };
+
+        if (parsedResponse) {
+            std::string_view response { parsedResponse->buffer };
+            std::size_t statusStart { response.find("* STATUS ") };
+            if (statusStart != std::string_view::npos) {
+                std::string_view statusLine { response.substr(statusStart, response.find("\r\n", statusStart) - statusStart) };
+                auto statusItem = [&statusLine] (std::string_view itemName) -> uint64_t {
+                    std::size_t itemStart { statusLine.rfind(itemName) };
+                    if (itemStart == std::string_view::npos) {
+                        return (0);
+                    }
+                    return (std::strtoull(std::string(statusLine.substr(itemStart + itemName.size())).c_str(), nullptr, 10));
+                };
+                mailBoxStatus.messages = statusItem("MESSAGES ");
+                mailBoxStatus.uidNext = statusItem("UIDNEXT ");
+            }
+        }
+
+        return (mailBoxStatus);
+
+    }
+
+    //
+    // Send NOOP and time its round trip.
+    //
+
+    std::chrono::microseconds pingServer(ServerConnection& imapConnection) {
+        auto pingStart { std::chrono::steady_clock::now() };
+        sendCommandRetry(imapConnection, "NOOP");
+        return (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - pingStart));
+    }
+
     //
     // Search a mailbox for e-mails with UIDs greater than searchUID and return
     // a vector of their  UIDs.
     //
 
-    std::vector<uint64_t> fetchMailBoxMessages(ServerConnection& imapConnection, const MailBoxDetails& mailBoxEntry) {
+    std::vector<uint64_t> fetchMailBoxMessages(ServerConnection& imapConnection, const MailBoxDetails& mailBoxEntry,
+                                               const std::string& searchCriteria) {
 
         CIMAPParse::COMMANDRESPONSE parsedResponse;
         std::vector<uint64_t> messageID {};
 
-        std::cout << "MAIL BOX [" << mailBoxEntry.name << "]" << std::endl;
-
-        // SELECT mailbox (ignore response)
-
-        parsedResponse = sendCommandRetry(imapConnection, "SELECT " + mailBoxEntry.name);
+        selectMailBox(imapConnection, mailBoxEntry.name);
 
         // SEARCH for all or new e-mail messages
 
@@ -276,20 +586,32 @@ namespace Pendulum_MailBox {
             searchUID++; // Search from 1 (all messages)
         }
         
-        std::cout << "Searching from UID [" << std::to_string(searchUID) << "]" << std::endl;
+        Pendulum_Log::info("Searching from UID [" + std::to_string(searchUID) + "]",
+                           Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withUID(searchUID));
         
-        parsedResponse = sendCommandRetry(imapConnection, "UID SEARCH UID " + std::to_string(searchUID) + ":*");
+        std::string command { "UID SEARCH UID " + std::to_string(searchUID) + ":*" + searchCriteria };
 
         // Parse response and create vector of message UID(s)
         
-        if (parsedResponse) {
-            
-            for (auto uid :  parsedResponse->indexes) {
+        auto addMessageUIDs = [&] (const auto& indexes) {
+            messageID.reserve(indexes.size());
+            for (auto uid : indexes) {
                 if (uid > mailBoxEntry.searchUID) {
                    messageID.push_back(uid); 
                 }
             }
-            
+        };
+
+        if (imapConnection.bZeroCopy) {
+            PARSEDRESPONSE searchResponse { sendCommandRetry(imapConnection, command, sendCommandZeroCopy) };
+            if (searchResponse) {
+                addMessageUIDs(searchResponse->indexes);
+            }
+        } else {
+            parsedResponse = sendCommandRetry(imapConnection, command);
+            if (parsedResponse) {
+                addMessageUIDs(parsedResponse->indexes);
+            }
         }
 
         return (messageID);
@@ -297,43 +619,180 @@ namespace Pendulum_MailBox {
     }
 
     //
-    // For a given message UID fetch its subject line and body and return as a pair.
+    // Prefetch envelope and size of messages in batches of kEnvelopeBatchSize. The
+    // response is always parsed with the zero-copy parser as that returns ENVELOPE
+    // as a single list value.
     //
 
-    std::pair<std::string, std::string> fetchEmailContents(ServerConnection& imapConnection, uint64_t uid) {
+    std::vector<Pendulum_Policy::MessageEnvelope> fetchMessageEnvelopes(ServerConnection& imapConnection,
+                                                                        const std::vector<uint64_t>& messageUID, bool bSizesOnly) {
 
-        std::string subject;
-        std::string emailBody;
+        std::vector<Pendulum_Policy::MessageEnvelope> envelopes;
+
+        envelopes.reserve(messageUID.size());
+
+        for (std::size_t batchStart = 0; batchStart < messageUID.size(); batchStart += kEnvelopeBatchSize) {
+
+            std::size_t batchEnd { std::min(batchStart + kEnvelopeBatchSize, messageUID.size()) };
+            std::string uidSet;
+
+            // Create UID set compressing consecutive runs into ranges
+
+            for (std::size_t index = batchStart; index < batchEnd;) {
+                std::size_t rangeEnd { index };
+                while (((rangeEnd + 1) < batchEnd) && (messageUID[rangeEnd + 1] == messageUID[rangeEnd] + 1)) {
+                    rangeEnd++;
+                }
+                uidSet += (uidSet.empty() ? "" : ",") + std::to_string(messageUID[index]);
+                if (rangeEnd != index) {
+                    uidSet += ":" + std::to_string(messageUID[rangeEnd]);
+                }
+                index = rangeEnd + 1;
+            }
+
+            PARSEDRESPONSE parsedResponse { sendCommandRetry(imapConnection, "UID FETCH " + uidSet + (bSizesOnly ? " (UID RFC822.SIZE)" : " (UID RFC822.SIZE ENVELOPE)"), sendCommandZeroCopy) };
+
+            if (parsedResponse) {
+                for (auto& fetchEntry : parsedResponse->fetchList) {
+                    Pendulum_Policy::MessageEnvelope envelope;
+                    envelope.uid = fetchEntry.uid;
+                    envelope.size = std::strtoull(std::string(Pendulum_ResponseParse::findFetchItem(fetchEntry, "RFC822.SIZE")).c_str(), nullptr, 10);
+                    std::string_view envelopeList { Pendulum_ResponseParse::findFetchItem(fetchEntry, "ENVELOPE") };
+                    if (!envelopeList.empty()) {
+                        Pendulum_Policy::parseEnvelope(envelopeList, envelope);
+                    }
+                    envelopes.push_back(std::move(envelope));
+                }
+            }
+
+        }
+
+        return (envelopes);
+
+    }
+
+    //
+    // For a given message UID fetch its subject line and body and return them.
+    //
+
+    EmailContents fetchEmailContents(ServerConnection& imapConnection, uint64_t uid) {
+
+        EmailContents emailContents;
         CIMAPParse::COMMANDRESPONSE parsedResponse;
+        std::string command { "UID FETCH " + std::to_string(uid) + " (BODY[] BODY[HEADER.FIELDS (SUBJECT)])" };
+
+        if (imapConnection.bZeroCopy) {
+            return (fetchEmailContentsZeroCopy(imapConnection, command));
+        }
         
-        parsedResponse = sendCommandRetry(imapConnection, 
-                "UID FETCH " + std::to_string(uid) + " (BODY[] BODY[HEADER.FIELDS (SUBJECT)])");
+        auto fetchStart { std::chrono::steady_clock::now() };
+
+        parsedResponse = sendCommandRetry(imapConnection, command);
 
         if (parsedResponse) {
 
             for (auto& fetchEntry : parsedResponse->fetchList) {
-                std::cout << "EMAIL MESSAGE NO. [" << fetchEntry.index << "]" << std::endl;
                 for (auto& resp : fetchEntry.responseMap) {
                     if (resp.first.find("BODY[]") == 0) {
-                        emailBody = resp.second;
+                        auto emailBody = std::make_shared<std::string>(std::move(resp.second));
+                        emailContents.body = *emailBody;
+                        emailContents.owner = emailBody;
                     } else if (resp.first.find("BODY[HEADER.FIELDS (SUBJECT)]") == 0) {
-                        if (resp.second.find("Subject:") != std::string::npos) { // Contains "Subject:"
-                            subject = resp.second.substr(8);
-                            subject = CMIME::convertMIMEStringToASCII(subject);
-                            if (subject.length() > kMaxSubjectLine) { // Truncate for file name
-                                subject = subject.substr(0, kMaxSubjectLine);
-                            }
-                            for (auto &ch : subject) { // Remove all but alpha numeric from subject
-                                if (!isalnum(ch)) ch = ' ';
-                            }
-                        }
+                        emailContents.subject = extractSubject(resp.second);
                     }
                 }
+                logFetch(imapConnection, fetchEntry.index, emailContents.body.size(), fetchStart);
             }
             
         }
 
-        return (make_pair(subject, emailBody));
+        return (emailContents);
+
+    }
+
+    //
+    // Find messages to archive in a mailbox.
+    //
+
+    MailBoxMessages findArchiveMessages(ServerConnection& imapConnection, MailBoxDetails& mailBoxEntry,
+                                        const std::string& destinationFolder, bool bOnlyUpdates,
+                                        const Pendulum_Policy::ArchivePolicy& archivePolicy,
+                                        const std::string& policySearchCriteria, bool bSizes) {
+
+        static Pendulum_Metrics::Counter& messagesExcluded { Pendulum_Metrics::counter("pendulum_messages_excluded_total", "Messages excluded by archive policy prefetch.") };
+
+        MailBoxMessages mailBoxMessages;
+
+        // Set mailbox to select on reconnect.
+
+        imapConnection.reconnectMailBox = mailBoxEntry.name;
+
+        // Set mailbox archive folder
+
+        if (mailBoxEntry.path.empty()) {
+            mailBoxEntry.path = Pendulum_File::createMailboxFolder(destinationFolder, mailBoxEntry.name);
+        }
+
+        // Carry on with any plan left unfinished by a run that died part way through
+        // the mailbox (no search; only messages not yet committed are fetched)
+
+        Pendulum_Journal::ResumePlan resumePlan;
+
+        if (Pendulum_Journal::resumeMailBox(mailBoxEntry.path, resumePlan)) {
+            Pendulum_Log::info("Resuming from journal, messages left = " + std::to_string(resumePlan.messageUID.size())
+                               + " of " + std::to_string(resumePlan.plannedCount),
+                               Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(resumePlan.messageUID.size()));
+            selectMailBox(imapConnection, mailBoxEntry.name);
+            mailBoxMessages.messageUID = std::move(resumePlan.messageUID);
+            mailBoxMessages.highestUID = resumePlan.highestUID;
+            if (bSizes && mailBoxMessages.messageUID.size()) {
+                for (auto& envelope : fetchMessageEnvelopes(imapConnection, mailBoxMessages.messageUID, true)) {
+                    mailBoxMessages.bytes += envelope.size;
+                }
+            }
+            return (mailBoxMessages);
+        }
+
+        // If only updates specified find highest UID to search from
+
+        if (bOnlyUpdates && (imapConnection.connectCount == 0)) {
+            mailBoxEntry.searchUID = Pendulum_File::getNewestUID(mailBoxEntry.path);
+        }
+
+        // Get vector of new mail UID(s)
+
+        mailBoxMessages.messageUID = fetchMailBoxMessages(imapConnection, mailBoxEntry, policySearchCriteria);
+        mailBoxMessages.highestUID = mailBoxMessages.messageUID.empty() ? 0 : mailBoxMessages.messageUID.back();
+
+        // Apply policy rules the server can't to envelope prefetch
+
+        if (Pendulum_Policy::needsPrefetch(archivePolicy) && mailBoxMessages.messageUID.size()) {
+            std::vector<uint64_t> archiveUID;
+            for (auto& envelope : fetchMessageEnvelopes(imapConnection, mailBoxMessages.messageUID)) {
+                if (Pendulum_Policy::isMessageArchived(archivePolicy, envelope)) {
+                    archiveUID.push_back(envelope.uid);
+                    mailBoxMessages.bytes += envelope.size;
+                }
+            }
+            std::sort(archiveUID.begin(), archiveUID.end());
+            std::uint64_t excludedCount { mailBoxMessages.messageUID.size() - archiveUID.size() };
+            Pendulum_Log::info("Messages excluded by policy = " + std::to_string(excludedCount),
+                               Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(excludedCount));
+            messagesExcluded.add(excludedCount);
+            mailBoxMessages.messageUID = std::move(archiveUID);
+        } else if (bSizes && mailBoxMessages.messageUID.size()) {
+            for (auto& envelope : fetchMessageEnvelopes(imapConnection, mailBoxMessages.messageUID, true)) {
+                mailBoxMessages.bytes += envelope.size;
+            }
+        }
+
+        // Journal the plan before any message is fetched
+
+        if (mailBoxMessages.messageUID.size()) {
+            Pendulum_Journal::planMailBox(mailBoxEntry.path, mailBoxMessages.messageUID, mailBoxMessages.highestUID);
+        }
+
+        return (mailBoxMessages);
 
     }
 
@@ -8,6 +8,9 @@
 #include <string>
 #include <vector>
 #include <utility>
+#include <memory>
+#include <string_view>
+#include <chrono>
 
 //
 // Antikythera Classes
@@ -15,6 +18,30 @@
 
 #include "CIMAP.hpp"
 
+//
+// Pendulum arena
+//
+
+#include "Pendulum_Arena.hpp"
+
+//
+// Pendulum policy
+//
+
+#include "Pendulum_Policy.hpp"
+
+//
+// Pendulum concurrency control
+//
+
+#include "Pendulum_Concurrency.hpp"
+
+//
+// Pendulum spare connections
+//
+
+#include "Pendulum_SparePool.hpp"
+
 // =========
 // NAMESPACE
 // =========
@@ -42,10 +69,45 @@ namespace Pendulum_MailBox {
     //
     
     struct ServerConnection {
-        CIMAP server;                    // IMAP server connection
+        std::unique_ptr<CIMAP> server { std::make_unique<CIMAP>() }; // IMAP server connection (replaced by a spare)
         std::string reconnectMailBox; // Reconnect select mailbox
         int connectCount { 0 };          // Connection count
         int retryCount;                  // Retry count
+        bool bZeroCopy { false };        // = true use zero-copy response parser
+        bool bReadOnly { false };        // = true EXAMINE mailboxes (messages not marked seen)
+        std::shared_ptr<Pendulum_Arena::CommandArena> commandArena; // Zero-copy parser arena
+        std::shared_ptr<Pendulum_Concurrency::Controller> concurrency; // Server's concurrency controller (if any)
+        std::shared_ptr<Pendulum_SparePool::SparePool> spares; // Spare logged in connections (if any)
+    };
+
+    //
+    // E-mail contents. The body is a view into a buffer kept alive by owner
+    // (either the raw FETCH response or the body string parsed from it).
+    //
+
+    struct EmailContents {
+        std::string subject;             // Subject line (file name safe)
+        std::string_view body;           // E-mail body
+        std::shared_ptr<const void> owner; // Owner of body data
+    };
+
+    //
+    // Mailbox STATUS
+    //
+
+    struct MailBoxStatus {
+        uint64_t messages { 0 };            // Messages in mailbox
+        uint64_t uidNext { 0 };             // Next UID to be assigned
+    };
+
+    //
+    // Messages to archive from a mailbox
+    //
+
+    struct MailBoxMessages {
+        std::vector<uint64_t> messageUID;   // UIDs to archive
+        uint64_t bytes { 0 };               // Their total size (if found)
+        uint64_t highestUID { 0 };          // Highest UID found (including any excluded)
     };
 
     //
@@ -53,10 +115,16 @@ namespace Pendulum_MailBox {
     //
 
     constexpr int kMaxSubjectLine = 80;
+
+    //
+    // Number of messages per envelope prefetch command
+    //
+
+    constexpr std::size_t kEnvelopeBatchSize = 500;
     
     
     //
-    // Initial server connect with retry
+    // Server connect with retry (a ready spare connection is taken instead if there is one)
     //
     
     void serverConnect(ServerConnection& imapConnection);
@@ -69,16 +137,58 @@ namespace Pendulum_MailBox {
                                                  const std::string& ignoreList, bool bAllMailBoxes);
 
     //
-    // Return a vector of e-mail  UIDs to be archived (.eml file created).
+    // Return a vector of e-mail  UIDs to be archived (.eml file created). Any extra
+    // search criteria (e.g. from an archive policy) are added to the UID SEARCH.
     //
     
-    std::vector<uint64_t> fetchMailBoxMessages(ServerConnection& imapConnection, const MailBoxDetails& mailBoxEntry);
+    std::vector<uint64_t> fetchMailBoxMessages(ServerConnection& imapConnection, const MailBoxDetails& mailBoxEntry,
+                                               const std::string& searchCriteria = "");
 
     //
-    // Return string pair of an e-mails subject line and contents.
+    // SELECT a mailbox (EXAMINE if the connection is read only).
+    //
+
+    void selectMailBox(ServerConnection& imapConnection, const std::string& mailBoxName);
+
+    //
+    // Return a mailbox's message count and next UID (STATUS; the mailbox is not selected).
+    //
+
+    MailBoxStatus fetchMailBoxStatus(ServerConnection& imapConnection, const std::string& mailBoxName);
+
+    //
+    // Send NOOP and return its round trip time.
+    //
+
+    std::chrono::microseconds pingServer(ServerConnection& imapConnection);
+
+    //
+    // Return envelopes and sizes for a list of message UIDs (no bodies are fetched).
+    // Only the UID and size of each envelope are filled in if bSizesOnly is set.
+    //
+
+    std::vector<Pendulum_Policy::MessageEnvelope> fetchMessageEnvelopes(ServerConnection& imapConnection,
+                                                                        const std::vector<uint64_t>& messageUID,
+                                                                        bool bSizesOnly = false);
+
+    //
+    // Return an e-mails subject line and contents.
     //
     
-    std::pair<std::string, std::string> fetchEmailContents(ServerConnection& imapConnection, std::uint64_t uid);
+    EmailContents fetchEmailContents(ServerConnection& imapConnection, std::uint64_t uid);
+
+    //
+    // Find messages to archive in a mailbox; set up its archive folder and search UID,
+    // search it and apply any policy rules the server can't to an envelope prefetch.
+    // If bSizes is set their total size is also found (RFC822.SIZE fetch if no prefetch).
+    // The messages found are journaled (Pendulum_Journal); an unfinished journaled plan
+    // is resumed instead of searching.
+    //
+
+    MailBoxMessages findArchiveMessages(ServerConnection& imapConnection, MailBoxDetails& mailBoxEntry,
+                                        const std::string& destinationFolder, bool bOnlyUpdates,
+                                        const Pendulum_Policy::ArchivePolicy& archivePolicy,
+                                        const std::string& policySearchCriteria, bool bSizes);
 
 } // namespace Pendulum_MailBox
 #endif /* PENDULUM_MAILBOX_HPP */
@@ -0,0 +1,459 @@
+//
+// Module: Pendulum_Metrics
+//
+// Description: Pendulum in-process metrics registry. Counters, gauges and log-linear
+// (HDR style) histograms are lock free to update; the registry lock is only taken
+// to register a metric (once per call site) and to export. Metrics are exported in
+// Prometheus text format to a file (for the node exporter textfile collector)
+// periodically by a background thread and once more when it is stopped.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+
+//
+// Pendulum metrics
+//
+
+#include "Pendulum_Metrics.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Metrics {
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Registered metric
+    //
+
+    enum class MetricType {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    struct Metric {
+        std::string name;
+        std::string help;
+        std::string labels;
+        MetricType type;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+    };
+
+    //
+    // Registry (function local so it is safe to use from static initialisers)
+    //
+
+    struct Registry {
+        std::mutex registryMutex;
+        std::vector<std::unique_ptr<Metric>> metrics;
+    };
+
+    static Registry& registry() {
+        static Registry metricsRegistry;
+        return (metricsRegistry);
+    }
+
+    //
+    // Exporter thread state
+    //
+
+    struct Exporter {
+        ~Exporter() {       // exit() without stopExporter() must not terminate on a joinable thread
+            {
+                std::lock_guard<std::mutex> locker(exporterMutex);
+                bStopping = true;
+            }
+            stopRequested.notify_all();
+            if (exporterThread.joinable()) {
+                exporterThread.join();
+            }
+        }
+        std::mutex exporterMutex;
+        std::condition_variable stopRequested;
+        std::thread exporterThread;
+        std::string fileName;
+        bool bStopping { false };
+    };
+
+    static Exporter exporter;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Find or register a metric.
+    //
+
+    static Metric& registerMetric(const std::string& name, const std::string& help, const std::string& labels,
+                                  MetricType type, Unit unit) {
+
+        std::lock_guard<std::mutex> locker(registry().registryMutex);
+
+        for (auto& metric : registry().metrics) {
+            if ((metric->name == name) && (metric->labels == labels)) {
+                if (metric->type != type) {
+                    throw std::logic_error("Metric [" + name + "] registered with a different type.");
+                }
+                return (*metric);
+            }
+        }
+
+        auto metric { std::make_unique<Metric>() };
+        metric->name = name;
+        metric->help = help;
+        metric->labels = labels;
+        metric->type = type;
+        switch (type) {
+            case MetricType::Counter:
+                metric->counter = std::make_unique<Counter>();
+                break;
+            case MetricType::Gauge:
+                metric->gauge = std::make_unique<Gauge>();
+                break;
+            case MetricType::Histogram:
+                metric->histogram = std::make_unique<Histogram>(unit);
+                break;
+        }
+
+        registry().metrics.push_back(std::move(metric));
+
+        return (*registry().metrics.back());
+
+    }
+
+    //
+    // Histogram value in export units (seconds for latencies).
+    //
+
+    static double exportValue(const Histogram& histogram, std::uint64_t value) {
+        return ((histogram.getUnit() == Unit::Microseconds) ? static_cast<double>(value) / 1e6 : static_cast<double>(value));
+    }
+
+    //
+    // Series name with labels (extra label appended to any existing).
+    //
+
+    static std::string seriesName(const std::string& name, const std::string& labels, const std::string& extraLabel = "") {
+
+        std::string allLabels { labels };
+
+        if (!extraLabel.empty()) {
+            allLabels += (allLabels.empty() ? "" : ",") + extraLabel;
+        }
+
+        return (allLabels.empty() ? name : name + "{" + allLabels + "}");
+
+    }
+
+    //
+    // Export histogram as cumulative buckets at each power of two up to its maximum.
+    //
+
+    static void formatHistogram(std::ostream& output, const Metric& metric) {
+
+        const Histogram& histogram { *metric.histogram };
+        int lastIndex { Histogram::bucketIndex(histogram.max()) };
+        std::uint64_t cumulative { 0 };
+
+        for (int index = 0; index <= lastIndex; index++) {
+            cumulative += histogram.bucketCount(index);
+            if ((((index + 1) % Histogram::kSubBucketCount) == 0) || (index == lastIndex)) {
+                output << seriesName(metric.name + "_bucket", metric.labels,
+                                     "le=\"" + std::to_string(exportValue(histogram, Histogram::bucketUpperBound(index))) + "\"")
+                       << " " << cumulative << "\n";
+            }
+        }
+
+        output << seriesName(metric.name + "_bucket", metric.labels, "le=\"+Inf\"") << " " << histogram.count() << "\n";
+        output << seriesName(metric.name + "_sum", metric.labels) << " " << exportValue(histogram, histogram.sum()) << "\n";
+        output << seriesName(metric.name + "_count", metric.labels) << " " << histogram.count() << "\n";
+
+    }
+
+    //
+    // Export thread: write metrics file every interval until stopped.
+    //
+
+    static void exportMetrics(std::chrono::seconds interval) {
+
+        std::unique_lock<std::mutex> lock { exporter.exporterMutex };
+
+        while (!exporter.stopRequested.wait_for(lock, interval, [] { return (exporter.bStopping); })) {
+            try {
+                writeMetricsFile(exporter.fileName);
+            } catch (std::exception& e) {
+                std::cerr << "Metrics export failed: " << e.what() << std::endl;
+            }
+        }
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    void Histogram::record(std::uint64_t value) {
+
+        buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        valueCount.fetch_add(1, std::memory_order_relaxed);
+        valueSum.fetch_add(value, std::memory_order_relaxed);
+
+        std::uint64_t currentMax { valueMax.load(std::memory_order_relaxed) };
+        while ((value > currentMax) && !valueMax.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+        }
+
+    }
+
+    std::uint64_t Histogram::count() const {
+        return (valueCount.load(std::memory_order_relaxed));
+    }
+
+    std::uint64_t Histogram::sum() const {
+        return (valueSum.load(std::memory_order_relaxed));
+    }
+
+    std::uint64_t Histogram::max() const {
+        return (valueMax.load(std::memory_order_relaxed));
+    }
+
+    std::uint64_t Histogram::percentile(double percent) const {
+
+        std::uint64_t total { count() };
+
+        if (total == 0) {
+            return (0);
+        }
+
+        std::uint64_t target { static_cast<std::uint64_t>((percent / 100.0) * static_cast<double>(total) + 0.5) };
+        std::uint64_t cumulative { 0 };
+
+        target = std::max<std::uint64_t>(target, 1);
+
+        for (int index = 0; index < kBucketCount; index++) {
+            cumulative += bucketCount(index);
+            if (cumulative >= target) {
+                return (std::min(bucketUpperBound(index), max()));
+            }
+        }
+
+        return (max());
+
+    }
+
+    std::uint64_t Histogram::bucketCount(int index) const {
+        return (buckets[index].load(std::memory_order_relaxed));
+    }
+
+    //
+    // Values < 8 index directly; otherwise the exponent selects a group of 8 buckets
+    // and the 3 bits below the leading one the bucket in it.
+    //
+
+    int Histogram::bucketIndex(std::uint64_t value) {
+
+        if (value < kSubBucketCount) {
+            return (static_cast<int>(value));
+        }
+
+        int exponent { 63 - __builtin_clzll(value) };
+        int subBucket { static_cast<int>((value >> (exponent - kSubBucketBits)) & (kSubBucketCount - 1)) };
+
+        return (((exponent - kSubBucketBits + 1) << kSubBucketBits) + subBucket);
+
+    }
+
+    std::uint64_t Histogram::bucketUpperBound(int index) {
+
+        if (index < kSubBucketCount) {
+            return (static_cast<std::uint64_t>(index));
+        }
+
+        int shift { (index >> kSubBucketBits) - 1 };
+        std::uint64_t lowerBound { static_cast<std::uint64_t>(kSubBucketCount + (index & (kSubBucketCount - 1))) << shift };
+
+        return (lowerBound + ((std::uint64_t { 1 } << shift) - 1));
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels) {
+        return (*registerMetric(name, help, labels, MetricType::Counter, Unit::Bytes).counter);
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels) {
+        return (*registerMetric(name, help, labels, MetricType::Gauge, Unit::Bytes).gauge);
+    }
+
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels, Unit unit) {
+        return (*registerMetric(name, help, labels, MetricType::Histogram, unit).histogram);
+    }
+
+    //
+    // Series of the same name must be together so metrics are grouped by name in
+    // order of first registration with HELP/TYPE written once per name.
+    //
+
+    std::string formatPrometheus() {
+
+        std::ostringstream output;
+        std::vector<std::string> exportedNames;
+
+        std::lock_guard<std::mutex> locker(registry().registryMutex);
+
+        output << std::setprecision(9);
+
+        for (auto& first : registry().metrics) {
+
+            if (std::find(exportedNames.begin(), exportedNames.end(), first->name) != exportedNames.end()) {
+                continue;
+            }
+            exportedNames.push_back(first->name);
+
+            output << "# HELP " << first->name << " " << first->help << "\n";
+            output << "# TYPE " << first->name << " " << ((first->type == MetricType::Counter) ? "counter" :
+                                                          (first->type == MetricType::Gauge) ? "gauge" : "histogram") << "\n";
+
+            for (auto& metric : registry().metrics) {
+                if (metric->name != first->name) {
+                    continue;
+                }
+                switch (metric->type) {
+                    case MetricType::Counter:
+                        output << seriesName(metric->name, metric->labels) << " " << metric->counter->get() << "\n";
+                        break;
+                    case MetricType::Gauge:
+                        output << seriesName(metric->name, metric->labels) << " " << metric->gauge->get() << "\n";
+                        break;
+                    case MetricType::Histogram:
+                        formatHistogram(output, *metric);
+                        break;
+                }
+            }
+
+        }
+
+        return (output.str());
+
+    }
+
+    std::string formatSummary() {
+
+        std::ostringstream output;
+
+        std::lock_guard<std::mutex> locker(registry().registryMutex);
+
+        output << std::fixed << std::setprecision(3);
+
+        for (auto& metric : registry().metrics) {
+            output << seriesName(metric->name, metric->labels) << " = ";
+            switch (metric->type) {
+                case MetricType::Counter:
+                    output << metric->counter->get();
+                    break;
+                case MetricType::Gauge:
+                    output << metric->gauge->get();
+                    break;
+                case MetricType::Histogram:
+                {
+                    const Histogram& histogram { *metric->histogram };
+                    const char *unit { (histogram.getUnit() == Unit::Microseconds) ? "ms" : "" };
+                    double scale { (histogram.getUnit() == Unit::Microseconds) ? 1000.0 : 1.0 };
+                    output << "count " << histogram.count();
+                    if (histogram.count() != 0) {
+                        output << ", p50 " << (histogram.percentile(50.0) / scale) << unit
+                               << ", p90 " << (histogram.percentile(90.0) / scale) << unit
+                               << ", p99 " << (histogram.percentile(99.0) / scale) << unit
+                               << ", max " << (histogram.max() / scale) << unit;
+                    }
+                    break;
+                }
+            }
+            output << "\n";
+        }
+
+        return (output.str());
+
+    }
+
+    void writeMetricsFile(const std::string& fileName) {
+
+        std::string temporaryFileName { fileName + ".tmp" };
+
+        {
+            std::ofstream metricsFile { temporaryFileName, std::ios::trunc };
+            if (!metricsFile) {
+                throw std::runtime_error("Could not create metrics file [" + temporaryFileName + "].");
+            }
+            metricsFile << formatPrometheus();
+        }
+
+        if (std::rename(temporaryFileName.c_str(), fileName.c_str()) != 0) {
+            throw std::runtime_error("Could not rename metrics file to [" + fileName + "].");
+        }
+
+    }
+
+    void startExporter(const std::string& fileName, std::chrono::seconds interval) {
+
+        stopExporter();
+
+        std::lock_guard<std::mutex> locker(exporter.exporterMutex);
+
+        exporter.fileName = fileName;
+        exporter.bStopping = false;
+        exporter.exporterThread = std::thread(exportMetrics, std::max(interval, std::chrono::seconds(1)));
+
+    }
+
+    void stopExporter() {
+
+        {
+            std::lock_guard<std::mutex> locker(exporter.exporterMutex);
+            if (!exporter.exporterThread.joinable()) {
+                return;
+            }
+            exporter.bStopping = true;
+        }
+
+        exporter.stopRequested.notify_all();
+        exporter.exporterThread.join();
+
+        writeMetricsFile(exporter.fileName);
+
+    }
+
+} // namespace Pendulum_Metrics
@@ -0,0 +1,189 @@
+#ifndef PENDULUM_METRICS_HPP
+#define PENDULUM_METRICS_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Metrics {
+
+    //
+    // Monotonic counter
+    //
+
+    class Counter {
+    public:
+
+        void add(std::uint64_t amount = 1) {
+            value.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        std::uint64_t get() const {
+            return (value.load(std::memory_order_relaxed));
+        }
+
+    private:
+
+        std::atomic<std::uint64_t> value { 0 };
+
+    };
+
+    //
+    // Gauge (current value)
+    //
+
+    class Gauge {
+    public:
+
+        void set(std::int64_t newValue) {
+            value.store(newValue, std::memory_order_relaxed);
+        }
+
+        void add(std::int64_t amount) {
+            value.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        std::int64_t get() const {
+            return (value.load(std::memory_order_relaxed));
+        }
+
+    private:
+
+        std::atomic<std::int64_t> value { 0 };
+
+    };
+
+    //
+    // Histogram value unit (latencies are recorded in microseconds and exported in seconds)
+    //
+
+    enum class Unit {
+        Microseconds,
+        Bytes
+    };
+
+    //
+    // HDR style log-linear histogram: values below 8 have their own bucket, above
+    // that each power of two is split into 8 linear sub-buckets (so any value is
+    // within 12.5% of its bucket bound). Recording is a few instructions and one
+    // relaxed atomic increment per field; there are no locks.
+    //
+
+    class Histogram {
+    public:
+
+        static constexpr int kSubBucketBits { 3 };
+        static constexpr int kSubBucketCount { 1 << kSubBucketBits };
+        static constexpr int kBucketCount { (64 - kSubBucketBits + 1) * kSubBucketCount };
+
+        explicit Histogram(Unit unit = Unit::Microseconds) : unit(unit) {
+        }
+
+        void record(std::uint64_t value);
+
+        std::uint64_t count() const;
+        std::uint64_t sum() const;
+        std::uint64_t max() const;
+
+        //
+        // Value at percentile (0..100); upper bound of its bucket.
+        //
+
+        std::uint64_t percentile(double percent) const;
+
+        //
+        // Bucket access (for export).
+        //
+
+        std::uint64_t bucketCount(int index) const;
+        static std::uint64_t bucketUpperBound(int index);
+        static int bucketIndex(std::uint64_t value);
+
+        Unit getUnit() const {
+            return (unit);
+        }
+
+    private:
+
+        Unit unit;
+        std::array<std::atomic<std::uint64_t>, kBucketCount> buckets {};
+        std::atomic<std::uint64_t> valueCount { 0 };
+        std::atomic<std::uint64_t> valueSum { 0 };
+        std::atomic<std::uint64_t> valueMax { 0 };
+
+    };
+
+    //
+    // Record elapsed microseconds into a histogram when destroyed.
+    //
+
+    class ScopedTimer {
+    public:
+
+        explicit ScopedTimer(Histogram& histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {
+        }
+
+        ~ScopedTimer() {
+            histogram.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count()));
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+
+        Histogram& histogram;
+        std::chrono::steady_clock::time_point start;
+
+    };
+
+    //
+    // Register (or find already registered) metric by name and labels (for example
+    // command="FETCH"). Returned references stay valid for the program lifetime so
+    // call sites keep them in function local statics and never look them up again.
+    //
+
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                         Unit unit = Unit::Microseconds);
+
+    //
+    // Prometheus text exposition format of all metrics.
+    //
+
+    std::string formatPrometheus();
+
+    //
+    // Human readable summary (counters, gauges and histogram percentiles).
+    //
+
+    std::string formatSummary();
+
+    //
+    // Write metrics to a file atomically (temporary file then rename) as required
+    // by the node exporter textfile collector.
+    //
+
+    void writeMetricsFile(const std::string& fileName);
+
+    //
+    // Start periodic export to file; stop writes a final export.
+    //
+
+    void startExporter(const std::string& fileName, std::chrono::seconds interval);
+    void stopExporter();
+
+} // namespace Pendulum_Metrics
+#endif /* PENDULUM_METRICS_HPP */
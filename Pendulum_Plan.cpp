@@ -0,0 +1,379 @@
+
+//
+// Module: Pendulum_Plan
+//
+// Description: Pendulum archive planning (--plan). Before committing an account to
+// a long first archive this reports what it would fetch: each mailbox's message count
+// (STATUS), the messages an archive would take (the same search and policy, with the
+// mailbox EXAMINEd so nothing on the server changes) and their size from RFC822.SIZE
+// alone. Big mailboxes have only a spread sample of sizes fetched, the total being
+// estimated from its mean with a 95% confidence interval, so that even a million
+// message account is planned in minutes. A few messages are fetched whole to measure
+// bandwidth, how much attachment extraction would store after deduplication and how
+// well the archive compresses; with the NOOP round trip these give an estimated time.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CPath, CFile.
+// zlib               : Compression estimate.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+#include <cmath>
+
+//
+// zlib
+//
+
+#include <zlib.h>
+
+//
+// Antik Classes
+//
+
+#include "CPath.hpp"
+#include "CFile.hpp"
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_Plan.hpp"
+#include "Pendulum_Policy.hpp"
+#include "Pendulum_Attachments.hpp"
+#include "Pendulum_File.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Plan {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Pendulum_MailBox;
+    using namespace Antik::File;
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // z for a 95% confidence interval
+    //
+
+    constexpr double kConfidenceZ { 1.96 };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Pick up to sampleCount entries spread evenly across values (all if no more).
+    //
+
+    static std::vector<std::uint64_t> spreadSample(const std::vector<std::uint64_t>& values, std::size_t sampleCount) {
+
+        if (values.size() <= sampleCount) {
+            return (values);
+        }
+
+        std::vector<std::uint64_t> sample;
+        sample.reserve(sampleCount);
+        for (std::size_t sampleNo = 0; sampleNo < sampleCount; sampleNo++) {
+            sample.push_back(values[sampleNo * values.size() / sampleCount]);
+        }
+
+        return (sample);
+
+    }
+
+    //
+    // Size of a message body compressed with zlib (its size if it fails).
+    //
+
+    static std::uint64_t compressedSize(std::string_view body) {
+
+        uLongf compressedLength { ::compressBound(static_cast<uLong>(body.size())) };
+        std::vector<Bytef> compressed(compressedLength);
+
+        if (::compress2(compressed.data(), &compressedLength, reinterpret_cast<const Bytef *>(body.data()),
+                        static_cast<uLong>(body.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+            return (body.size());
+        }
+
+        return (compressedLength);
+
+    }
+
+    //
+    // Format bytes for the report.
+    //
+
+    static std::string formatBytes(std::uint64_t bytes) {
+
+        std::ostringstream bytesStream;
+        double value { static_cast<double>(bytes) };
+        const char *units[] { "B", "KB", "MB", "GB", "TB" };
+        int unit { 0 };
+
+        while ((value >= 1024.0) && (unit < 4)) {
+            value /= 1024.0;
+            unit++;
+        }
+
+        bytesStream << std::fixed << std::setprecision(unit ? 1 : 0) << value << " " << units[unit];
+
+        return (bytesStream.str());
+
+    }
+
+    //
+    // Format a duration as [Nd ]HH:MM:SS.
+    //
+
+    static std::string formatTime(std::chrono::seconds duration) {
+
+        std::int64_t seconds { duration.count() };
+        char time[48];
+
+        if (seconds >= 86400) {
+            std::snprintf(time, sizeof (time), "%lldd %02lld:%02lld:%02lld", static_cast<long long>(seconds / 86400),
+                          static_cast<long long>((seconds / 3600) % 24), static_cast<long long>((seconds / 60) % 60),
+                          static_cast<long long>(seconds % 60));
+        } else {
+            std::snprintf(time, sizeof (time), "%02lld:%02lld:%02lld", static_cast<long long>(seconds / 3600),
+                          static_cast<long long>((seconds / 60) % 60), static_cast<long long>(seconds % 60));
+        }
+
+        return (time);
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    AccountPlan planAccount(ServerConnection& imapConnection, const std::vector<MailBoxDetails>& mailBoxList,
+                            const Pendulum_CommandLine::PendulumOptions& optionData) {
+
+        AccountPlan accountPlan;
+        Pendulum_Policy::ArchivePolicy archivePolicy { Pendulum_Policy::createArchivePolicy(optionData.maxSizeMB, optionData.sinceDate,
+                                                                                            optionData.excludeList) };
+        std::string policySearchCriteria { Pendulum_Policy::buildSearchCriteria(archivePolicy) };
+        bool bPrefetch { Pendulum_Policy::needsPrefetch(archivePolicy) };
+        std::set<std::string> attachmentHashes;
+        std::chrono::microseconds sampleFetchTime { 0 };
+
+        // Nothing is changed on the server (FETCH BODY[] in an EXAMINEd mailbox does not set \Seen)
+
+        imapConnection.bReadOnly = true;
+
+        // Round trip (median of a few NOOPs)
+
+        std::vector<std::chrono::microseconds> roundTrips;
+        for (int pingNo = 0; pingNo < kPingCount; pingNo++) {
+            roundTrips.push_back(pingServer(imapConnection));
+        }
+        std::sort(roundTrips.begin(), roundTrips.end());
+        accountPlan.roundTrip = roundTrips[roundTrips.size() / 2];
+
+        for (auto& mailBoxEntry : mailBoxList) {
+
+            MailBoxPlan mailBoxPlan;
+            mailBoxPlan.name = mailBoxEntry.name;
+            mailBoxPlan.messages = fetchMailBoxStatus(imapConnection, mailBoxEntry.name).messages;
+
+            if (mailBoxPlan.messages == 0) {
+                accountPlan.mailBoxes.push_back(mailBoxPlan);
+                continue;
+            }
+
+            // Search as an archive would (from the newest archived UID if only updates)
+
+            MailBoxDetails searchEntry { mailBoxEntry };
+            imapConnection.reconnectMailBox = mailBoxEntry.name;
+            if (optionData.bOnlyUpdates) {
+                searchEntry.searchUID = Pendulum_File::getNewestUID(Pendulum_File::mailBoxFolder(optionData.destinationFolder, mailBoxEntry.name));
+            }
+
+            std::vector<std::uint64_t> messageUID { fetchMailBoxMessages(imapConnection, searchEntry, policySearchCriteria) };
+
+            // Sizes of all or a sample of the messages found (envelopes too if the policy needs them)
+
+            std::vector<std::uint64_t> sampleUID { spreadSample(messageUID, (messageUID.size() <= kSizeLimit) ? kSizeLimit : kSizeSamples) };
+            std::vector<std::uint64_t> archivedUID;
+            double sizeSum { 0.0 }, sizeSquareSum { 0.0 };
+
+            mailBoxPlan.bSampled = (sampleUID.size() < messageUID.size());
+
+            if (sampleUID.size()) {
+                for (auto& envelope : fetchMessageEnvelopes(imapConnection, sampleUID, !bPrefetch)) {
+                    if (!bPrefetch || Pendulum_Policy::isMessageArchived(archivePolicy, envelope)) {
+                        archivedUID.push_back(envelope.uid);
+                        sizeSum += static_cast<double>(envelope.size);
+                        sizeSquareSum += static_cast<double>(envelope.size) * static_cast<double>(envelope.size);
+                    }
+                }
+            }
+
+            if (!mailBoxPlan.bSampled) {
+                mailBoxPlan.archiveMessages = archivedUID.size();
+                mailBoxPlan.archiveBytes = static_cast<std::uint64_t>(sizeSum);
+            } else if (archivedUID.size()) {
+                double sampleCount { static_cast<double>(archivedUID.size()) };
+                double meanSize { sizeSum / sampleCount };
+                double sizeDeviation { std::sqrt(std::max(0.0, sizeSquareSum / sampleCount - meanSize * meanSize)) };
+                mailBoxPlan.archiveMessages = static_cast<std::uint64_t>(std::llround(static_cast<double>(messageUID.size()) * sampleCount /
+                                                                                      static_cast<double>(sampleUID.size())));
+                mailBoxPlan.archiveBytes = static_cast<std::uint64_t>(meanSize * static_cast<double>(mailBoxPlan.archiveMessages));
+                mailBoxPlan.bytesError = static_cast<std::uint64_t>(kConfidenceZ * sizeDeviation / std::sqrt(sampleCount) *
+                                                                    static_cast<double>(mailBoxPlan.archiveMessages));
+            }
+
+            // Fetch a few messages whole for bandwidth, attachments and compression
+
+            std::uint64_t bodyBytes { 0 };
+            for (auto uid : spreadSample(archivedUID, kBodySamples)) {
+                if (bodyBytes >= kBodySampleBytes) {
+                    break;
+                }
+                auto fetchStart { std::chrono::steady_clock::now() };
+                EmailContents emailContents { fetchEmailContents(imapConnection, uid) };
+                sampleFetchTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - fetchStart);
+                bodyBytes += emailContents.body.size();
+                accountPlan.sampleMessages++;
+                accountPlan.sampleBytes += emailContents.body.size();
+                accountPlan.sampleCompressedBytes += compressedSize(emailContents.body);
+                if (!optionData.attachmentFolder.empty()) {
+                    Pendulum_Attachments::AttachmentStatistics statistics;
+                    std::istringstream messageStream { std::string(emailContents.body) };
+                    for (auto& attachment : Pendulum_Attachments::extractAttachments(messageStream, "", statistics)) {
+                        accountPlan.sampleAttachmentBytes += attachment.size;
+                        if (attachmentHashes.insert(attachment.hash).second) {
+                            accountPlan.sampleUniqueAttachmentBytes += attachment.size;
+                        }
+                    }
+                }
+            }
+
+            Pendulum_Log::info("Planned = " + std::to_string(mailBoxPlan.archiveMessages) + " of " + std::to_string(mailBoxPlan.messages)
+                               + (mailBoxPlan.bSampled ? " (sampled)" : ""),
+                               Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(mailBoxPlan.archiveMessages)
+                               .withBytes(mailBoxPlan.archiveBytes));
+
+            accountPlan.archiveMessages += mailBoxPlan.archiveMessages;
+            accountPlan.archiveBytes += mailBoxPlan.archiveBytes;
+            accountPlan.bytesError += mailBoxPlan.bytesError;
+            accountPlan.mailBoxes.push_back(mailBoxPlan);
+
+        }
+
+        // Bandwidth: whole message fetch time less a round trip each
+
+        double transferSeconds { (static_cast<double>(sampleFetchTime.count()) - static_cast<double>(accountPlan.sampleMessages) *
+                                  static_cast<double>(accountPlan.roundTrip.count())) / 1e6 };
+        if (accountPlan.sampleBytes && (transferSeconds <= 0.0)) {
+            transferSeconds = static_cast<double>(sampleFetchTime.count()) / 1e6;   // Round trip swamped by noise
+        }
+        if (accountPlan.sampleBytes && (transferSeconds > 0.0)) {
+            accountPlan.bytesPerSecond = static_cast<double>(accountPlan.sampleBytes) / transferSeconds;
+        }
+
+        // Archive size: the .eml files plus distinct attachments (if extracting); compressed by the sampled ratio
+
+        if (accountPlan.sampleBytes) {
+            double sampleBytes { static_cast<double>(accountPlan.sampleBytes) };
+            accountPlan.storeBytes = static_cast<std::uint64_t>(static_cast<double>(accountPlan.archiveBytes) *
+                                                                static_cast<double>(accountPlan.sampleUniqueAttachmentBytes) / sampleBytes);
+            accountPlan.compressedBytes = static_cast<std::uint64_t>(static_cast<double>(accountPlan.archiveBytes + accountPlan.storeBytes) *
+                                                                     static_cast<double>(accountPlan.sampleCompressedBytes) / sampleBytes);
+        }
+
+        // Time: a FETCH round trip per message plus its bytes at the measured bandwidth
+
+        double archiveSeconds { static_cast<double>(accountPlan.archiveMessages) * static_cast<double>(accountPlan.roundTrip.count()) / 1e6 };
+        if (accountPlan.bytesPerSecond > 0.0) {
+            archiveSeconds += static_cast<double>(accountPlan.archiveBytes) / accountPlan.bytesPerSecond;
+        }
+        accountPlan.archiveTime = std::chrono::seconds(static_cast<std::int64_t>(archiveSeconds));
+
+        imapConnection.bReadOnly = false;
+
+        return (accountPlan);
+
+    }
+
+    std::string formatPlan(const AccountPlan& accountPlan, bool bAttachments) {
+
+        std::ostringstream planStream;
+        std::size_t nameWidth { 7 };
+
+        for (auto& mailBoxPlan : accountPlan.mailBoxes) {
+            nameWidth = std::max(nameWidth, mailBoxPlan.name.size());
+        }
+
+        planStream << std::left << std::setw(nameWidth) << "Mailbox" << std::right << std::setw(12) << "Messages"
+                   << std::setw(12) << "To archive" << std::setw(14) << "Bytes" << "\n";
+
+        for (auto& mailBoxPlan : accountPlan.mailBoxes) {
+            planStream << std::left << std::setw(nameWidth) << mailBoxPlan.name << std::right << std::setw(12) << mailBoxPlan.messages
+                       << std::setw(12) << mailBoxPlan.archiveMessages << std::setw(14) << formatBytes(mailBoxPlan.archiveBytes);
+            if (mailBoxPlan.bSampled) {
+                planStream << " +/- " << formatBytes(mailBoxPlan.bytesError) << " (sampled)";
+            }
+            planStream << "\n";
+        }
+
+        planStream << std::left << std::setw(nameWidth) << "Total" << std::right << std::setw(12) << ""
+                   << std::setw(12) << accountPlan.archiveMessages << std::setw(14) << formatBytes(accountPlan.archiveBytes);
+        if (accountPlan.bytesError) {
+            planStream << " +/- " << formatBytes(accountPlan.bytesError);
+        }
+        planStream << "\n\n";
+
+        planStream << "Round trip = " << std::fixed << std::setprecision(1) << (static_cast<double>(accountPlan.roundTrip.count()) / 1000.0) << " ms";
+        if (accountPlan.bytesPerSecond > 0.0) {
+            planStream << ", bandwidth = " << formatBytes(static_cast<std::uint64_t>(accountPlan.bytesPerSecond)) << "/s";
+        } else {
+            planStream << ", bandwidth unknown";
+        }
+        planStream << " (" << accountPlan.sampleMessages << " messages, " << formatBytes(accountPlan.sampleBytes) << " fetched whole)\n";
+
+        planStream << "Estimated archive size = " << formatBytes(accountPlan.archiveBytes + accountPlan.storeBytes);
+        if (bAttachments) {
+            planStream << " (.eml " << formatBytes(accountPlan.archiveBytes) << " + attachment store " << formatBytes(accountPlan.storeBytes)
+                       << " after deduplication)";
+        }
+        if (accountPlan.sampleBytes) {
+            planStream << ", about " << formatBytes(accountPlan.compressedBytes) << " compressed";
+        }
+        planStream << "\n";
+
+        planStream << "Estimated archive time = " << formatTime(accountPlan.archiveTime) << " (one connection";
+        if (accountPlan.bytesPerSecond <= 0.0) {
+            planStream << ", round trips only";
+        }
+        planStream << ")";
+
+        return (planStream.str());
+
+    }
+
+} // namespace Pendulum_Plan
@@ -0,0 +1,99 @@
+#ifndef PENDULUM_PLAN_HPP
+#define PENDULUM_PLAN_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Pendulum mailbox and command line
+//
+
+#include "Pendulum_MailBox.hpp"
+#include "Pendulum_CommandLine.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Plan {
+
+    //
+    // Mailboxes with up to kSizeLimit messages to archive have every size fetched;
+    // larger ones have kSizeSamples sizes fetched evenly spread across their UIDs.
+    //
+
+    constexpr std::size_t kSizeLimit { 20000 };
+    constexpr std::size_t kSizeSamples { 2000 };
+
+    //
+    // Messages (and bytes) fetched whole per mailbox to measure bandwidth, attachment
+    // deduplication and compression
+    //
+
+    constexpr std::size_t kBodySamples { 10 };
+    constexpr std::uint64_t kBodySampleBytes { 4 * 1024 * 1024 };
+
+    //
+    // NOOPs timed for the round trip
+    //
+
+    constexpr int kPingCount { 5 };
+
+    //
+    // Plan of one mailbox
+    //
+
+    struct MailBoxPlan {
+        std::string name;                       // Mailbox name
+        std::uint64_t messages { 0 };           // Messages in mailbox (STATUS)
+        std::uint64_t archiveMessages { 0 };    // Messages to archive (estimated if sampled)
+        std::uint64_t archiveBytes { 0 };       // Their size (estimated if sampled)
+        std::uint64_t bytesError { 0 };         // 95% confidence half width of bytes (0 = exact)
+        bool bSampled { false };                // = true sizes sampled
+    };
+
+    //
+    // Plan of an account
+    //
+
+    struct AccountPlan {
+        std::vector<MailBoxPlan> mailBoxes;             // Mailbox plans
+        std::uint64_t archiveMessages { 0 };            // Totals of mailbox plans
+        std::uint64_t archiveBytes { 0 };
+        std::uint64_t bytesError { 0 };
+        std::chrono::microseconds roundTrip { 0 };      // Median NOOP round trip
+        double bytesPerSecond { 0.0 };                  // Measured FETCH bandwidth (0 = unknown)
+        std::uint64_t sampleMessages { 0 };             // Messages fetched whole
+        std::uint64_t sampleBytes { 0 };                // and their bytes
+        std::uint64_t sampleCompressedBytes { 0 };      // compressed (zlib)
+        std::uint64_t sampleAttachmentBytes { 0 };      // attachments decoded
+        std::uint64_t sampleUniqueAttachmentBytes { 0 }; // distinct attachments decoded
+        std::uint64_t storeBytes { 0 };                 // Estimated attachment store bytes (if extracting)
+        std::uint64_t compressedBytes { 0 };            // Estimated archive bytes if compressed
+        std::chrono::seconds archiveTime { 0 };         // Estimated archive time (one connection)
+    };
+
+    //
+    // Plan archiving an account's mailboxes without archiving anything: mailboxes are
+    // EXAMINEd (read only) and searched as an archive would, sizes fetched (sampled
+    // for big mailboxes) and a few messages fetched whole to measure the rest.
+    //
+
+    AccountPlan planAccount(Pendulum_MailBox::ServerConnection& imapConnection, const std::vector<Pendulum_MailBox::MailBoxDetails>& mailBoxList,
+                            const Pendulum_CommandLine::PendulumOptions& optionData);
+
+    //
+    // Plan report (a table of mailboxes then the account estimates).
+    //
+
+    std::string formatPlan(const AccountPlan& accountPlan, bool bAttachments);
+
+} // namespace Pendulum_Plan
+#endif /* PENDULUM_PLAN_HPP */
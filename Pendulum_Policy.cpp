@@ -0,0 +1,343 @@
+
+//
+// Module: Pendulum_Policy
+//
+// Description: Pendulum archive policy engine. Retention rules (maximum message size,
+// only mail since a date, excluded senders) are turned into UID SEARCH criteria
+// (SINCE, NOT LARGER, NOT FROM) wherever IMAP can express them so that the server
+// never returns messages that would be thrown away. Sender exclusions containing
+// wildcards cannot be searched for so they, and a re-check of every rule, are done
+// against a bulk ENVELOPE/RFC822.SIZE prefetch before any bodies are downloaded.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <sstream>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+
+//
+// Pendulum policy
+//
+
+#include "Pendulum_Policy.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Policy {
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    static const char *kMonths[] { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Lower case a string.
+    //
+
+    static std::string toLower(std::string value) {
+
+        for (auto& ch : value) {
+            ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+        }
+
+        return (value);
+
+    }
+
+    //
+    // Does a sender exclusion contain wildcards (so can't be a server side FROM search) ?
+    //
+
+    static bool isWildcardPattern(const std::string& pattern) {
+        return (pattern.find_first_of("*?") != std::string::npos);
+    }
+
+    //
+    // Convert date YYYY-MM-DD or DD-Mon-YYYY to IMAP search date (D-Mon-YYYY).
+    //
+
+    static std::string convertToIMAPDate(const std::string& date) {
+
+        int day { 0 }, month { 0 }, year { 0 };
+
+        if ((date.size() == 10) && (date[4] == '-') && (date[7] == '-')) {
+            year = std::atoi(date.substr(0, 4).c_str());
+            month = std::atoi(date.substr(5, 2).c_str());
+            day = std::atoi(date.substr(8, 2).c_str());
+        } else {
+            std::size_t firstDash { date.find('-') };
+            std::size_t secondDash { date.find('-', firstDash + 1) };
+            if ((firstDash != std::string::npos) && (secondDash != std::string::npos)) {
+                day = std::atoi(date.substr(0, firstDash).c_str());
+                std::string monthName { toLower(date.substr(firstDash + 1, secondDash - firstDash - 1)) };
+                for (int monthNo = 0; monthNo < 12; monthNo++) {
+                    if (monthName == toLower(kMonths[monthNo])) {
+                        month = monthNo + 1;
+                    }
+                }
+                year = std::atoi(date.substr(secondDash + 1).c_str());
+            }
+        }
+
+        if ((day < 1) || (day > 31) || (month < 1) || (month > 12) || (year < 1970)) {
+            throw std::invalid_argument("Invalid since date [" + date + "] (use YYYY-MM-DD or DD-Mon-YYYY).");
+        }
+
+        return (std::to_string(day) + "-" + kMonths[month - 1] + "-" + std::to_string(year));
+
+    }
+
+    //
+    // Quote string for use in a SEARCH command.
+    //
+
+    static std::string quoteString(const std::string& value) {
+
+        std::string quoted { "\"" };
+
+        for (char ch : value) {
+            if ((ch == '\"') || (ch == '\\')) {
+                quoted += '\\';
+            }
+            quoted += ch;
+        }
+
+        return (quoted + "\"");
+
+    }
+
+    //
+    // Minimal IMAP list (s-expression) parser for ENVELOPE. Values are NIL, atoms,
+    // quoted strings (unescaped) or literals; lists nest.
+    //
+
+    struct ListNode {
+        bool bList { false };
+        bool bNil { false };
+        std::string value;
+        std::vector<ListNode> items;
+    };
+
+    static void skipSpaces(std::string_view text, std::size_t& position) {
+        while ((position < text.size()) && ((text[position] == ' ') || (text[position] == '\r') || (text[position] == '\n'))) {
+            position++;
+        }
+    }
+
+    static ListNode parseListNode(std::string_view text, std::size_t& position) {
+
+        ListNode node;
+
+        skipSpaces(text, position);
+
+        if (position >= text.size()) {
+            throw std::runtime_error("Envelope parse error: unexpected end");
+        }
+
+        if (text[position] == '(') {
+            node.bList = true;
+            position++;
+            while (true) {
+                skipSpaces(text, position);
+                if (position >= text.size()) {
+                    throw std::runtime_error("Envelope parse error: unterminated list");
+                }
+                if (text[position] == ')') {
+                    position++;
+                    break;
+                }
+                node.items.push_back(parseListNode(text, position));
+            }
+        } else if (text[position] == '\"') {
+            position++;
+            while ((position < text.size()) && (text[position] != '\"')) {
+                if ((text[position] == '\\') && ((position + 1) < text.size())) {
+                    position++;
+                }
+                node.value += text[position++];
+            }
+            position++;
+        } else if (text[position] == '{') {
+            std::size_t lengthEnd { text.find('}', position) };
+            if (lengthEnd == std::string_view::npos) {
+                throw std::runtime_error("Envelope parse error: malformed literal");
+            }
+            std::size_t literalLength { std::strtoull(std::string(text.substr(position + 1, lengthEnd - position - 1)).c_str(), nullptr, 10) };
+            position = lengthEnd + 3; // "}\r\n"
+            if (position + literalLength > text.size()) {
+                throw std::runtime_error("Envelope parse error: truncated literal");
+            }
+            node.value = std::string(text.substr(position, literalLength));
+            position += literalLength;
+        } else {
+            std::size_t start { position };
+            while ((position < text.size()) && (text[position] != ' ') && (text[position] != ')') && (text[position] != '(')) {
+                position++;
+            }
+            node.value = std::string(text.substr(start, position - start));
+            node.bNil = (node.value == "NIL");
+        }
+
+        return (node);
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    ArchivePolicy createArchivePolicy(int maxSizeMB, const std::string& sinceDate, const std::string& excludeList) {
+
+        ArchivePolicy policy;
+
+        if (maxSizeMB > 0) {
+            policy.maxSize = static_cast<std::uint64_t>(maxSizeMB) * 1024 * 1024;
+        }
+
+        if (!sinceDate.empty()) {
+            policy.since = convertToIMAPDate(sinceDate);
+        }
+
+        std::istringstream excludeStream { excludeList };
+        for (std::string sender; std::getline(excludeStream, sender, ',');) {
+            std::size_t start { sender.find_first_not_of(' ') };
+            if (start != std::string::npos) {
+                policy.excludeSenders.push_back(sender.substr(start, sender.find_last_not_of(' ') - start + 1));
+            }
+        }
+
+        return (policy);
+
+    }
+
+    bool isPolicyActive(const ArchivePolicy& policy) {
+        return ((policy.maxSize != 0) || !policy.since.empty() || !policy.excludeSenders.empty());
+    }
+
+    std::string buildSearchCriteria(const ArchivePolicy& policy) {
+
+        std::string criteria;
+
+        if (!policy.since.empty()) {
+            criteria += " SINCE " + policy.since;
+        }
+
+        if (policy.maxSize != 0) {
+            criteria += " NOT LARGER " + std::to_string(policy.maxSize);
+        }
+
+        for (auto& sender : policy.excludeSenders) {
+            if (!isWildcardPattern(sender)) {
+                criteria += " NOT FROM " + quoteString(sender);
+            }
+        }
+
+        return (criteria);
+
+    }
+
+    bool needsPrefetch(const ArchivePolicy& policy) {
+
+        for (auto& sender : policy.excludeSenders) {
+            if (isWildcardPattern(sender)) {
+                return (true);
+            }
+        }
+
+        return (false);
+
+    }
+
+    bool isMessageArchived(const ArchivePolicy& policy, const MessageEnvelope& envelope) {
+
+        if ((policy.maxSize != 0) && (envelope.size > policy.maxSize)) {
+            return (false);
+        }
+
+        for (auto& sender : policy.excludeSenders) {
+            for (auto& address : envelope.fromAddresses) {
+                if (isWildcardPattern(sender) ? wildcardMatch(sender, address) :
+                        (toLower(address).find(toLower(sender)) != std::string::npos)) {
+                    return (false);
+                }
+            }
+        }
+
+        return (true);
+
+    }
+
+    //
+    // ENVELOPE is (date subject from sender reply-to to cc bcc in-reply-to message-id)
+    // with each address list ((name adl mailbox host) ...).
+    //
+
+    void parseEnvelope(std::string_view envelopeList, MessageEnvelope& envelope) {
+
+        std::size_t position { 0 };
+        ListNode envelopeNode { parseListNode(envelopeList, position) };
+
+        if (!envelopeNode.bList || (envelopeNode.items.size() < 3)) {
+            throw std::runtime_error("Envelope parse error: not an envelope");
+        }
+
+        envelope.date = envelopeNode.items[0].value;
+        envelope.subject = envelopeNode.items[1].value;
+
+        for (auto& address : envelopeNode.items[2].items) {
+            if (address.bList && (address.items.size() == 4)) {
+                envelope.fromAddresses.push_back(address.items[2].value + "@" + address.items[3].value);
+            }
+        }
+
+    }
+
+    bool wildcardMatch(const std::string& pattern, const std::string& text) {
+
+        std::size_t patternIndex { 0 }, textIndex { 0 };
+        std::size_t starIndex { std::string::npos }, starTextIndex { 0 };
+
+        while (textIndex < text.size()) {
+            if ((patternIndex < pattern.size()) && ((pattern[patternIndex] == '?') ||
+                (std::tolower(static_cast<unsigned char>(pattern[patternIndex])) == std::tolower(static_cast<unsigned char>(text[textIndex]))))) {
+                patternIndex++;
+                textIndex++;
+            } else if ((patternIndex < pattern.size()) && (pattern[patternIndex] == '*')) {
+                starIndex = patternIndex++;
+                starTextIndex = textIndex;
+            } else if (starIndex != std::string::npos) {
+                patternIndex = starIndex + 1;
+                textIndex = ++starTextIndex;
+            } else {
+                return (false);
+            }
+        }
+
+        while ((patternIndex < pattern.size()) && (pattern[patternIndex] == '*')) {
+            patternIndex++;
+        }
+
+        return (patternIndex == pattern.size());
+
+    }
+
+} // namespace Pendulum_Policy
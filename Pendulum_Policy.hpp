@@ -0,0 +1,86 @@
+#ifndef PENDULUM_POLICY_HPP
+#define PENDULUM_POLICY_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Policy {
+
+    //
+    // Archive (retention) policy. Rules that IMAP SEARCH can express are sent to
+    // the server; the rest are evaluated against prefetched message envelopes.
+    //
+
+    struct ArchivePolicy {
+        std::uint64_t maxSize { 0 };                // Largest message archived in bytes (0 = no limit)
+        std::string since;                          // Only mail since IMAP date (empty = all)
+        std::vector<std::string> excludeSenders;    // Sender exclusions (substring or wildcard pattern)
+    };
+
+    //
+    // Message envelope/size from a header-only prefetch
+    //
+
+    struct MessageEnvelope {
+        std::uint64_t uid { 0 };                    // Message UID
+        std::uint64_t size { 0 };                   // RFC822.SIZE
+        std::string date;                           // Envelope date
+        std::string subject;                        // Envelope subject (raw)
+        std::vector<std::string> fromAddresses;     // Envelope from addresses (mailbox@host)
+    };
+
+    //
+    // Create policy from option values (maximum size in MB, since date as
+    // YYYY-MM-DD or DD-Mon-YYYY and comma separated sender exclusion list).
+    //
+
+    ArchivePolicy createArchivePolicy(int maxSizeMB, const std::string& sinceDate, const std::string& excludeList);
+
+    //
+    // Return true if policy has any rules.
+    //
+
+    bool isPolicyActive(const ArchivePolicy& policy);
+
+    //
+    // Return UID SEARCH criteria (with leading space) for the rules the server can evaluate.
+    //
+
+    std::string buildSearchCriteria(const ArchivePolicy& policy);
+
+    //
+    // Return true if some rules can only be evaluated against message envelopes.
+    //
+
+    bool needsPrefetch(const ArchivePolicy& policy);
+
+    //
+    // Return true if a message passes all policy rules.
+    //
+
+    bool isMessageArchived(const ArchivePolicy& policy, const MessageEnvelope& envelope);
+
+    //
+    // Parse an IMAP ENVELOPE list into envelope date, subject and from addresses.
+    //
+
+    void parseEnvelope(std::string_view envelopeList, MessageEnvelope& envelope);
+
+    //
+    // Case insensitive wildcard ('*' and '?') match.
+    //
+
+    bool wildcardMatch(const std::string& pattern, const std::string& text);
+
+} // namespace Pendulum_Policy
+#endif /* PENDULUM_POLICY_HPP */
@@ -0,0 +1,274 @@
+
+//
+// Module: Pendulum_PollSchedule
+//
+// Description: Pendulum per mailbox adaptive polling. Busy mailboxes (an INBOX taking
+// thousands of messages a day) are polled at the minimum interval while quiet ones
+// back off exponentially towards the maximum, so a dormant folder no longer costs a
+// SELECT and SEARCH every poll. Arrival rates and intervals are saved in the account's
+// destination folder so they survive restarts; each cycle's polls, skips and empty
+// polls (wasted SELECT/SEARCH round trips) are logged and counted.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CPath.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+
+//
+// Antik Classes
+//
+
+#include "CPath.hpp"
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_PollSchedule.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_PollSchedule {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Antik::File;
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Statistics file first line
+    //
+
+    constexpr char const *kScheduleHeader { "PENDULUM-POLL 1" };
+
+    //
+    // Arrival rate smoothing
+    //
+
+    constexpr double kRateSmoothing { 0.3 };
+
+    //
+    // Mailboxes due within this window of a cycle are polled with it (so that they
+    // are batched rather than each causing a connection of its own)
+    //
+
+    constexpr std::chrono::seconds kDueWindow { 60 };
+
+    //
+    // Round trips wasted by an empty poll (SELECT and SEARCH)
+    //
+
+    constexpr std::uint64_t kPollRoundTrips { 2 };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Current Unix time.
+    //
+
+    static std::int64_t unixTime() {
+        return (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Load saved statistics (mailbox<TAB>rate<TAB>interval<TAB>last poll per line).
+    //
+
+    void PollScheduler::load() {
+
+        std::ifstream scheduleStream { fileName };
+        std::string line;
+
+        if (!std::getline(scheduleStream, line) || (line != kScheduleHeader)) {
+            return;
+        }
+
+        while (std::getline(scheduleStream, line)) {
+            std::size_t nameEnd { line.find('\t') };
+            if (nameEnd == std::string::npos) {
+                continue;
+            }
+            MailBoxStatistics statistics;
+            std::int64_t interval { 0 };
+            std::istringstream fieldStream { line.substr(nameEnd + 1) };
+            if (fieldStream >> statistics.arrivalRate >> interval >> statistics.lastPoll) {
+                statistics.interval = std::clamp(std::chrono::seconds(interval), minInterval, std::max(minInterval, maxInterval));
+                mailBoxes[line.substr(0, nameEnd)] = statistics;
+            }
+        }
+
+    }
+
+    //
+    // Save statistics (temporary file then renamed into place).
+    //
+
+    void PollScheduler::save() {
+
+        std::string tmpFileName { fileName + "." + std::to_string(::getpid()) };
+        std::ofstream scheduleStream { tmpFileName, std::ios::trunc };
+
+        scheduleStream << kScheduleHeader << "\n";
+        for (auto& mailBox : mailBoxes) {
+            scheduleStream << mailBox.first << "\t" << mailBox.second.arrivalRate << "\t"
+                           << mailBox.second.interval.count() << "\t" << mailBox.second.lastPoll << "\n";
+        }
+        scheduleStream.close();
+
+        if (!scheduleStream.good() || (std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)) {
+            ::unlink(tmpFileName.c_str());
+            Pendulum_Log::warning("Failed to save poll statistics [" + fileName + "]", Pendulum_Log::Fields().withFile(fileName));
+        }
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    PollScheduler::PollScheduler(const std::string& destinationFolder, std::chrono::minutes minInterval, std::chrono::minutes maxInterval)
+            : minInterval { minInterval }, maxInterval { maxInterval } {
+
+        CPath schedulePath { destinationFolder };
+        schedulePath.join(kScheduleFileName);
+        fileName = schedulePath.toString();
+
+        load();
+
+    }
+
+    bool PollScheduler::isDue(const std::string& mailBoxName) {
+        auto mailBox = mailBoxes.find(mailBoxName);
+        return (!isAdaptive() || (mailBox == mailBoxes.end()) || (mailBox->second.nextPoll <= (unixTime() + kDueWindow.count())));
+    }
+
+    void PollScheduler::recordPoll(const std::string& mailBoxName, std::uint64_t messagesFound) {
+
+        static Pendulum_Metrics::Counter& pollCount { Pendulum_Metrics::counter("pendulum_mailbox_polls_total", "Mailboxes polled (SELECT/SEARCH).") };
+        static Pendulum_Metrics::Counter& emptyPollCount { Pendulum_Metrics::counter("pendulum_mailbox_polls_empty_total", "Mailbox polls that found no new messages.") };
+
+        MailBoxStatistics& statistics { mailBoxes[mailBoxName] };
+        std::int64_t now { unixTime() };
+
+        // Arrival rate over the time since the last poll (the first poll finds a backlog, not arrivals)
+
+        if (statistics.lastPoll && (now > statistics.lastPoll)) {
+            double sample { static_cast<double>(messagesFound) * 3600.0 / static_cast<double>(now - statistics.lastPoll) };
+            statistics.arrivalRate += (sample - statistics.arrivalRate) * kRateSmoothing;
+        }
+
+        // Expect about one new message each poll; back off when there are none
+
+        if (messagesFound == 0) {
+            statistics.interval = std::max(minInterval, statistics.interval * 2);
+        } else if (statistics.arrivalRate > 0.0) {
+            statistics.interval = std::chrono::seconds(static_cast<std::int64_t>(std::min(3600.0 / statistics.arrivalRate,
+                                                                                          static_cast<double>(maxInterval.count()))));
+        } else {
+            statistics.interval = minInterval;
+        }
+
+        statistics.interval = std::clamp(statistics.interval, minInterval, std::max(minInterval, maxInterval));
+        statistics.lastPoll = now;
+        statistics.nextPoll = now + statistics.interval.count();
+
+        cycle.polled++;
+        pollCount.add();
+        if (messagesFound == 0) {
+            cycle.empty++;
+            emptyPollCount.add();
+        }
+
+    }
+
+    void PollScheduler::recordSkip() {
+        static Pendulum_Metrics::Counter& skippedCount { Pendulum_Metrics::counter("pendulum_mailbox_polls_skipped_total", "Mailbox polls skipped as not due.") };
+        cycle.skipped++;
+        skippedCount.add();
+    }
+
+    void PollScheduler::deferPoll(const std::string& mailBoxName) {
+        mailBoxes[mailBoxName].nextPoll = unixTime() + minInterval.count();
+    }
+
+    std::chrono::seconds PollScheduler::timeToNextPoll() const {
+
+        std::int64_t now { unixTime() };
+        std::int64_t nextPoll { 0 };
+
+        // Saved mailboxes not polled by this run (no longer archived) are ignored
+
+        for (auto& mailBox : mailBoxes) {
+            if (mailBox.second.nextPoll && (!nextPoll || (mailBox.second.nextPoll < nextPoll))) {
+                nextPoll = mailBox.second.nextPoll;
+            }
+        }
+
+        if (!isAdaptive() || !nextPoll) {
+            return (minInterval);
+        }
+
+        return (std::chrono::seconds(std::max<std::int64_t>(nextPoll - now, 0)));
+
+    }
+
+    CycleStatistics PollScheduler::endCycle() {
+
+        static Pendulum_Metrics::Gauge& wastedRoundTrips { Pendulum_Metrics::gauge("pendulum_poll_wasted_round_trips", "SELECT/SEARCH round trips of last poll cycle that found nothing.") };
+
+        CycleStatistics cycleStatistics { cycle };
+
+        wastedRoundTrips.set(cycleStatistics.empty * kPollRoundTrips);
+
+        Pendulum_Log::info("Poll cycle: polled = " + std::to_string(cycleStatistics.polled)
+                           + ", empty = " + std::to_string(cycleStatistics.empty)
+                           + ", skipped = " + std::to_string(cycleStatistics.skipped)
+                           + ", wasted round trips = " + std::to_string(cycleStatistics.empty * kPollRoundTrips)
+                           + ", next poll in " + std::to_string(timeToNextPoll().count()) + "s",
+                           Pendulum_Log::Fields().withCount(cycleStatistics.polled));
+
+        cycle = CycleStatistics();
+
+        save();
+
+        return (cycleStatistics);
+
+    }
+
+} // namespace Pendulum_PollSchedule
@@ -0,0 +1,111 @@
+#ifndef PENDULUM_POLLSCHEDULE_HPP
+#define PENDULUM_POLLSCHEDULE_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_PollSchedule {
+
+    //
+    // Learned poll statistics are kept in the account's destination folder
+    //
+
+    constexpr char const *kScheduleFileName { ".pendulum_poll" };
+
+    //
+    // Poll statistics of a mailbox
+    //
+
+    struct MailBoxStatistics {
+        double arrivalRate { 0.0 };                 // Smoothed arrivals (messages/hour)
+        std::chrono::seconds interval { 0 };        // Current poll interval
+        std::int64_t lastPoll { 0 };                // Unix time of last poll (0 = never)
+        std::int64_t nextPoll { 0 };                // Unix time next poll due
+    };
+
+    //
+    // Polls of one cycle (pass)
+    //
+
+    struct CycleStatistics {
+        std::uint64_t polled { 0 };                 // Mailboxes polled (SELECT/SEARCH)
+        std::uint64_t empty { 0 };                  // of which found nothing
+        std::uint64_t skipped { 0 };                // Mailboxes not due
+    };
+
+    //
+    // Per mailbox poll scheduler for an account. Each mailbox's arrival rate is
+    // learned from what its polls find; a mailbox that finds mail is next polled
+    // after about the time one more message is expected to take to arrive and an
+    // empty poll doubles its interval, always within the minimum and maximum. When
+    // the maximum is no more than the minimum every mailbox is polled each cycle
+    // (statistics are still kept and reported). Not thread safe; the daemon only
+    // uses an account's scheduler from its scheduler thread.
+    //
+
+    class PollScheduler {
+    public:
+
+        PollScheduler(const std::string& destinationFolder, std::chrono::minutes minInterval, std::chrono::minutes maxInterval);
+
+        //
+        // Mailbox due to be polled this cycle (a mailbox never polled always is).
+        //
+
+        bool isDue(const std::string& mailBoxName);
+
+        //
+        // Mailbox polled finding messagesFound new messages / skipped as not due.
+        //
+
+        void recordPoll(const std::string& mailBoxName, std::uint64_t messagesFound);
+        void recordSkip();
+
+        //
+        // Mailbox poll failed; try again after the minimum interval.
+        //
+
+        void deferPoll(const std::string& mailBoxName);
+
+        //
+        // Time until the next mailbox is due (the minimum interval when not adaptive or
+        // no mailbox has been polled).
+        //
+
+        std::chrono::seconds timeToNextPoll() const;
+
+        //
+        // Complete a cycle: report and reset its statistics and save what has been learned.
+        //
+
+        CycleStatistics endCycle();
+
+        bool isAdaptive() const {
+            return (maxInterval > minInterval);
+        }
+
+    private:
+
+        void load();
+        void save();
+
+        std::string fileName;                                   // Statistics file
+        std::chrono::seconds minInterval;                       // Shortest poll interval
+        std::chrono::seconds maxInterval;                       // Longest poll interval
+        std::map<std::string, MailBoxStatistics> mailBoxes;     // Statistics by mailbox name
+        CycleStatistics cycle;                                  // Current cycle
+
+    };
+
+} // namespace Pendulum_PollSchedule
+#endif /* PENDULUM_POLLSCHEDULE_HPP */
@@ -0,0 +1,109 @@
+
+//
+// Module: Pendulum_Priority
+//
+// Description: Pendulum mailbox priorities. Mailboxes are given a priority by the
+// first of a list of name patterns they match (INBOX and sent mail first unless a
+// list is given) and their work is queued by priority a slice at a time, so a huge
+// backfill of a low priority folder no longer holds up the archiving of new mail in
+// INBOX for hours.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <sstream>
+#include <stdexcept>
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_Priority.hpp"
+#include "Pendulum_Policy.hpp"
+#include "Pendulum_File.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Priority {
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Trim leading/trailing whitespace.
+    //
+
+    static std::string trim(const std::string& text) {
+        std::size_t first { text.find_first_not_of(" \t") };
+        if (first == std::string::npos) {
+            return ("");
+        }
+        return (text.substr(first, text.find_last_not_of(" \t") - first + 1));
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    std::vector<PriorityRule> parsePriorities(const std::string& priorityList) {
+
+        std::vector<PriorityRule> priorityRules;
+        std::istringstream priorityStream { priorityList.empty() ? std::string(kDefaultPriorities) : priorityList };
+        std::string rule;
+
+        while (std::getline(priorityStream, rule, ',')) {
+            std::size_t equals { rule.rfind('=') };
+            if (trim(rule).empty()) {
+                continue;
+            }
+            PriorityRule priorityRule;
+            priorityRule.pattern = trim(rule.substr(0, equals));
+            try {
+                std::size_t priorityEnd { 0 };
+                std::string priority { trim(rule.substr(equals + 1)) };
+                if ((equals == std::string::npos) || priorityRule.pattern.empty()) {
+                    throw std::invalid_argument(rule);
+                }
+                priorityRule.priority = std::stoi(priority, &priorityEnd);
+                if (priorityEnd != priority.size()) {
+                    throw std::invalid_argument(rule);
+                }
+            } catch (const std::logic_error&) {
+                throw std::invalid_argument("Invalid mailbox priority [" + trim(rule) + "] (use pattern=priority).");
+            }
+            priorityRules.push_back(priorityRule);
+        }
+
+        return (priorityRules);
+
+    }
+
+    int mailBoxPriority(const std::vector<PriorityRule>& priorityRules, const std::string& mailBoxName) {
+
+        std::string name { Pendulum_File::mailBoxFolderName(mailBoxName) };
+
+        for (auto& priorityRule : priorityRules) {
+            if (Pendulum_Policy::wildcardMatch(priorityRule.pattern, name)) {
+                return (priorityRule.priority);
+            }
+        }
+
+        return (0);
+
+    }
+
+} // namespace Pendulum_Priority
@@ -0,0 +1,111 @@
+#ifndef PENDULUM_PRIORITY_HPP
+#define PENDULUM_PRIORITY_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <utility>
+#include <cstddef>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Priority {
+
+    //
+    // Messages archived from a mailbox before it yields to the next mailbox in line
+    // (so a huge mailbox is archived in slices interleaved with the others).
+    //
+
+    constexpr std::size_t kSliceMessages { 250 };
+
+    //
+    // Priorities used when none are given: INBOX then sent mail first.
+    //
+
+    constexpr char const *kDefaultPriorities { "INBOX=100,Sent=50,Sent Items=50,Sent Messages=50,Sent Mail=50,*/Sent Mail=50" };
+
+    //
+    // Mailbox name pattern (wildcards allowed) and its priority
+    //
+
+    struct PriorityRule {
+        std::string pattern;        // Mailbox name pattern
+        int priority { 0 };         // Priority (higher first)
+    };
+
+    //
+    // Parse a comma separated pattern=priority list (an empty list gives the defaults).
+    //
+
+    std::vector<PriorityRule> parsePriorities(const std::string& priorityList);
+
+    //
+    // Priority of a mailbox: that of the first rule its name matches (0 if none).
+    //
+
+    int mailBoxPriority(const std::vector<PriorityRule>& priorityRules, const std::string& mailBoxName);
+
+    //
+    // Queue of mailbox work taken highest priority first and in the order queued
+    // within a priority, so work put back after a slice goes behind the other
+    // mailboxes of its priority.
+    //
+
+    template <typename Work>
+    class SliceQueue {
+    public:
+
+        void push(Work work, int priority) {
+            queues[priority].push_back(std::move(work));
+            workCount++;
+        }
+
+        Work pop() {
+            auto highest = queues.begin();
+            Work work { std::move(highest->second.front()) };
+            highest->second.pop_front();
+            if (highest->second.empty()) {
+                queues.erase(highest);
+            }
+            workCount--;
+            return (work);
+        }
+
+        //
+        // Priority of the work that would be taken next (queue must not be empty).
+        //
+
+        int topPriority() const {
+            return (queues.begin()->first);
+        }
+
+        bool empty() const {
+            return (workCount == 0);
+        }
+
+        std::size_t size() const {
+            return (workCount);
+        }
+
+        void clear() {
+            queues.clear();
+            workCount = 0;
+        }
+
+    private:
+
+        std::map<int, std::deque<Work>, std::greater<int>> queues;  // Work by priority (highest first)
+        std::size_t workCount { 0 };
+
+    };
+
+} // namespace Pendulum_Priority
+#endif /* PENDULUM_PRIORITY_HPP */
@@ -0,0 +1,544 @@
+//
+// Module: Pendulum_Progress
+//
+// Description: Pendulum archive progress. Each pass is given the messages (and bytes
+// where sizes are known) to archive per mailbox up front; the fetch loop only bumps
+// two atomic counters per message. A reporter thread samples the counters every
+// interval, smooths messages/s and MB/s with an exponentially weighted moving
+// average and logs percent complete and ETA for the current mailbox and the pass.
+// Optionally the same progress is written as JSON line events to a file descriptor
+// (every second) for a front end such as QtPendulum to display.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cerrno>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+
+//
+// Pendulum progress and logging
+//
+
+#include "Pendulum_Progress.hpp"
+#include "Pendulum_Bandwidth.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Progress {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    constexpr double kRateTimeConstant { 30.0 };       // Rate smoothing time constant (seconds)
+    constexpr double kMegaByte { 1024.0 * 1024.0 };
+    constexpr std::chrono::seconds kEventInterval { 1 };    // Progress event interval
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Mailbox work added to pass (and done by earlier turns at it when mailboxes are
+    // archived a slice at a time)
+    //
+
+    struct MailBoxTotals {
+        std::string name;
+        std::uint64_t messages { 0 };
+        std::uint64_t bytes { 0 };
+        std::uint64_t messagesDone { 0 };
+        std::uint64_t bytesDone { 0 };
+    };
+
+    //
+    // Pass progress. Done counters are updated without the lock.
+    //
+
+    struct Progress {
+        std::mutex progressMutex;
+        std::vector<MailBoxTotals> mailBoxes;
+        MailBoxTotals currentMailBox;
+        std::uint64_t mailBoxStartMessages { 0 };       // Done counts when current mailbox started
+        std::uint64_t mailBoxStartBytes { 0 };
+        std::uint64_t totalMessages { 0 };
+        std::uint64_t totalBytes { 0 };
+        bool bBytesKnown { true };                      // Sizes known for every mailbox
+        std::atomic<std::uint64_t> messagesDone { 0 };
+        std::atomic<std::uint64_t> bytesDone { 0 };
+        std::chrono::steady_clock::time_point passStart;
+        bool bPassActive { false };
+        bool bRateValid { false };                      // Smoothed rates sampled at least once
+        double messageRate { 0.0 };
+        double byteRate { 0.0 };
+        std::uint64_t lastMessages { 0 };
+        std::uint64_t lastBytes { 0 };
+        std::chrono::steady_clock::time_point lastSample;
+    };
+
+    static Progress progress;
+
+    //
+    // Reporter thread state
+    //
+
+    struct Reporter {
+        ~Reporter() {       // exit() without stopReporter() must not terminate on a joinable thread
+            {
+                std::lock_guard<std::mutex> locker(reporterMutex);
+                bStopping = true;
+            }
+            stopRequested.notify_all();
+            if (reporterThread.joinable()) {
+                reporterThread.join();
+            }
+        }
+        std::mutex reporterMutex;
+        std::condition_variable stopRequested;
+        std::thread reporterThread;
+        bool bStopping { false };
+        std::atomic<int> eventFD { -1 };                // Progress event file descriptor (-1 = none)
+    };
+
+    static Reporter reporter;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Format seconds as HH:MM:SS (or ? if unknown).
+    //
+
+    static std::string formatDuration(std::int64_t seconds) {
+
+        if (seconds < 0) {
+            return ("?");
+        }
+
+        char duration[32];
+        std::snprintf(duration, sizeof (duration), "%02lld:%02lld:%02lld", static_cast<long long>(seconds / 3600),
+                      static_cast<long long>((seconds / 60) % 60), static_cast<long long>(seconds % 60));
+
+        return (duration);
+
+    }
+
+    //
+    // Format done/total messages and bytes with percent complete (by bytes if known).
+    //
+
+    static std::string formatWork(std::uint64_t messagesDone, std::uint64_t messages, std::uint64_t bytesDone, std::uint64_t bytes) {
+
+        double percent { 100.0 };
+        char work[128];
+
+        if (bytes) {
+            percent = std::min(100.0, 100.0 * static_cast<double>(bytesDone) / static_cast<double>(bytes));
+        } else if (messages) {
+            percent = std::min(100.0, 100.0 * static_cast<double>(messagesDone) / static_cast<double>(messages));
+        }
+
+        if (bytes) {
+            std::snprintf(work, sizeof (work), "%llu/%llu messages (%.1f%%), %.1f/%.1f MB",
+                          static_cast<unsigned long long>(messagesDone), static_cast<unsigned long long>(messages), percent,
+                          static_cast<double>(bytesDone) / kMegaByte, static_cast<double>(bytes) / kMegaByte);
+        } else {
+            std::snprintf(work, sizeof (work), "%llu/%llu messages (%.1f%%), %.1f MB",
+                          static_cast<unsigned long long>(messagesDone), static_cast<unsigned long long>(messages), percent,
+                          static_cast<double>(bytesDone) / kMegaByte);
+        }
+
+        return (work);
+
+    }
+
+    //
+    // Seconds to complete remaining work at current rates (-1 if unknown).
+    //
+
+    static std::int64_t remainingSeconds(std::uint64_t messagesDone, std::uint64_t messages, std::uint64_t bytesDone,
+                                         std::uint64_t bytes, double messageRate, double byteRate) {
+
+        if (bytes && (byteRate > 0.0)) {
+            return (static_cast<std::int64_t>(static_cast<double>(bytes - std::min(bytes, bytesDone)) / byteRate));
+        } else if (messageRate > 0.0) {
+            return (static_cast<std::int64_t>(static_cast<double>(messages - std::min(messages, messagesDone)) / messageRate));
+        }
+
+        return (-1);
+
+    }
+
+    //
+    // Write JSON line event to event file descriptor (if any). Events stop if the
+    // reader goes away.
+    //
+
+    static void writeEvent(std::string event) {
+
+        int eventFD { reporter.eventFD.load() };
+
+        if (eventFD < 0) {
+            return;
+        }
+
+        event += '\n';
+
+        for (std::size_t written = 0; written < event.size();) {
+            ssize_t count { ::write(eventFD, event.data() + written, event.size() - written) };
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                reporter.eventFD.store(-1);
+                return;
+            }
+            written += static_cast<std::size_t>(count);
+        }
+
+    }
+
+    //
+    // Progress event
+    //
+
+    static void writeProgressEvent(const ProgressSnapshot& snapshot) {
+
+        if (reporter.eventFD.load() < 0) {
+            return;
+        }
+
+        char rates[96];
+        std::string event { "{\"event\":\"progress\",\"mailbox\":" };
+
+        std::snprintf(rates, sizeof (rates), ",\"message_rate\":%.2f,\"byte_rate\":%.0f", snapshot.messageRate, snapshot.byteRate);
+
+        Pendulum_Log::appendJSONString(event, snapshot.mailBox);
+        event += ",\"mailbox_done\":" + std::to_string(snapshot.mailBoxMessagesDone)
+                + ",\"mailbox_messages\":" + std::to_string(snapshot.mailBoxMessages)
+                + ",\"mailbox_bytes_done\":" + std::to_string(snapshot.mailBoxBytesDone)
+                + ",\"mailbox_bytes\":" + std::to_string(snapshot.mailBoxBytes)
+                + ",\"mailbox_eta\":" + std::to_string(remainingSeconds(snapshot.mailBoxMessagesDone, snapshot.mailBoxMessages,
+                        snapshot.mailBoxBytesDone, snapshot.mailBoxBytes, snapshot.messageRate, snapshot.byteRate))
+                + ",\"done\":" + std::to_string(snapshot.messagesDone)
+                + ",\"messages\":" + std::to_string(snapshot.totalMessages)
+                + ",\"bytes_done\":" + std::to_string(snapshot.bytesDone)
+                + ",\"bytes\":" + std::to_string(snapshot.totalBytes)
+                + ",\"eta\":" + std::to_string(estimateRemaining(snapshot))
+                + rates + ",\"elapsed\":" + std::to_string(snapshot.elapsed.count()) + "}";
+
+        writeEvent(std::move(event));
+
+    }
+
+    //
+    // Sample done counters and update smoothed rates.
+    //
+
+    static void sampleRates() {
+
+        std::lock_guard<std::mutex> locker(progress.progressMutex);
+
+        auto now { std::chrono::steady_clock::now() };
+        double interval { std::chrono::duration<double>(now - progress.lastSample).count() };
+
+        if (!progress.bPassActive || (interval <= 0.0)) {
+            return;
+        }
+
+        std::uint64_t messagesDone { progress.messagesDone.load(std::memory_order_relaxed) };
+        std::uint64_t bytesDone { progress.bytesDone.load(std::memory_order_relaxed) };
+        double messageRate { static_cast<double>(messagesDone - progress.lastMessages) / interval };
+        double byteRate { static_cast<double>(bytesDone - progress.lastBytes) / interval };
+
+        if (progress.bRateValid) {
+            double alpha { 1.0 - std::exp(-interval / kRateTimeConstant) };
+            progress.messageRate += alpha * (messageRate - progress.messageRate);
+            progress.byteRate += alpha * (byteRate - progress.byteRate);
+        } else {
+            progress.messageRate = messageRate;
+            progress.byteRate = byteRate;
+            progress.bRateValid = true;
+        }
+
+        progress.lastMessages = messagesDone;
+        progress.lastBytes = bytesDone;
+        progress.lastSample = now;
+
+    }
+
+    //
+    // Reporter thread: while a pass is active log progress every log interval (if
+    // any) and write a progress event every event interval (if writing events).
+    //
+
+    static void reportProgress(std::chrono::seconds logInterval) {
+
+        std::unique_lock<std::mutex> lock { reporter.reporterMutex };
+        std::chrono::seconds interval { (reporter.eventFD.load() >= 0) ? kEventInterval : std::max(logInterval, kEventInterval) };
+        auto lastLog { std::chrono::steady_clock::now() };
+
+        while (!reporter.stopRequested.wait_for(lock, interval, [] { return (reporter.bStopping); })) {
+            sampleRates();
+            ProgressSnapshot snapshot { getSnapshot() };
+            if (!snapshot.bPassActive) {
+                continue;
+            }
+            writeProgressEvent(snapshot);
+            if ((logInterval.count() > 0) && (std::chrono::steady_clock::now() - lastLog >= logInterval)) {
+                Pendulum_Log::info(formatProgress(snapshot), Pendulum_Log::Fields().withMailBox(snapshot.mailBox)
+                                   .withCount(snapshot.messagesDone).withBytes(snapshot.bytesDone));
+                lastLog = std::chrono::steady_clock::now();
+            }
+        }
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    void startPass() {
+
+        std::lock_guard<std::mutex> locker(progress.progressMutex);
+
+        progress.mailBoxes.clear();
+        progress.currentMailBox = MailBoxTotals();
+        progress.mailBoxStartMessages = progress.mailBoxStartBytes = 0;
+        progress.totalMessages = progress.totalBytes = 0;
+        progress.bBytesKnown = true;
+        progress.messagesDone.store(0, std::memory_order_relaxed);
+        progress.bytesDone.store(0, std::memory_order_relaxed);
+        progress.passStart = progress.lastSample = std::chrono::steady_clock::now();
+        progress.lastMessages = progress.lastBytes = 0;
+        progress.messageRate = progress.byteRate = 0.0;
+        progress.bRateValid = false;
+        progress.bPassActive = true;
+
+    }
+
+    void addMailBox(const std::string& mailBox, std::uint64_t messages, std::uint64_t bytes) {
+
+        std::lock_guard<std::mutex> locker(progress.progressMutex);
+
+        // A mailbox searched again during the pass adds to its work
+
+        auto mailBoxEntry = std::find_if(progress.mailBoxes.begin(), progress.mailBoxes.end(),
+                                         [&mailBox] (const MailBoxTotals& totals) { return (totals.name == mailBox); });
+
+        if (mailBoxEntry != progress.mailBoxes.end()) {
+            mailBoxEntry->messages += messages;
+            mailBoxEntry->bytes += bytes;
+            if (progress.currentMailBox.name == mailBox) {
+                progress.currentMailBox.messages += messages;
+                progress.currentMailBox.bytes += bytes;
+            }
+        } else {
+            progress.mailBoxes.push_back({ mailBox, messages, bytes, 0, 0 });
+        }
+
+        progress.totalMessages += messages;
+        progress.totalBytes += bytes;
+        if (messages && !bytes) {
+            progress.bBytesKnown = false;
+        }
+
+    }
+
+    void startMailBox(const std::string& mailBox) {
+
+        std::lock_guard<std::mutex> locker(progress.progressMutex);
+
+        std::uint64_t messagesDone { progress.messagesDone.load(std::memory_order_relaxed) };
+        std::uint64_t bytesDone { progress.bytesDone.load(std::memory_order_relaxed) };
+
+        auto findMailBox = [] (const std::string& name) {
+            return (std::find_if(progress.mailBoxes.begin(), progress.mailBoxes.end(),
+                                 [&name] (const MailBoxTotals& totals) { return (totals.name == name); }));
+        };
+
+        // Keep what was done by the current mailbox's turn for when it is returned to
+
+        auto currentEntry = findMailBox(progress.currentMailBox.name);
+        if (currentEntry != progress.mailBoxes.end()) {
+            currentEntry->messagesDone = messagesDone - progress.mailBoxStartMessages;
+            currentEntry->bytesDone = bytesDone - progress.mailBoxStartBytes;
+        }
+
+        auto mailBoxEntry = findMailBox(mailBox);
+
+        progress.currentMailBox = (mailBoxEntry != progress.mailBoxes.end()) ? *mailBoxEntry : MailBoxTotals { mailBox, 0, 0, 0, 0 };
+        progress.mailBoxStartMessages = messagesDone - progress.currentMailBox.messagesDone;
+        progress.mailBoxStartBytes = bytesDone - progress.currentMailBox.bytesDone;
+
+        // Rates measured from when fetching starts (not from the start of mailbox searches)
+
+        if (messagesDone == 0) {
+            progress.lastSample = std::chrono::steady_clock::now();
+            progress.lastMessages = progress.lastBytes = 0;
+            progress.bRateValid = false;
+        }
+
+        if (reporter.eventFD.load() >= 0) {
+            std::string event { "{\"event\":\"mailbox\",\"mailbox\":" };
+            Pendulum_Log::appendJSONString(event, progress.currentMailBox.name);
+            event += ",\"messages\":" + std::to_string(progress.currentMailBox.messages)
+                    + ",\"bytes\":" + std::to_string(progress.currentMailBox.bytes)
+                    + ",\"total_messages\":" + std::to_string(progress.totalMessages)
+                    + ",\"total_bytes\":" + std::to_string(progress.bBytesKnown ? progress.totalBytes : 0) + "}";
+            writeEvent(std::move(event));
+        }
+
+    }
+
+    void messageDone(std::uint64_t bytes) {
+        progress.messagesDone.fetch_add(1, std::memory_order_relaxed);
+        progress.bytesDone.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void endPass() {
+
+        ProgressSnapshot snapshot { getSnapshot() };
+
+        {
+            std::lock_guard<std::mutex> locker(progress.progressMutex);
+            if (!progress.bPassActive) {
+                return;
+            }
+            progress.bPassActive = false;
+        }
+
+        double seconds { std::max(1.0, static_cast<double>(snapshot.elapsed.count())) };
+        char rates[64];
+
+        writeProgressEvent(snapshot);
+        writeEvent("{\"event\":\"pass_complete\",\"messages\":" + std::to_string(snapshot.messagesDone)
+                   + ",\"bytes\":" + std::to_string(snapshot.bytesDone)
+                   + ",\"elapsed\":" + std::to_string(snapshot.elapsed.count()) + "}");
+
+        std::snprintf(rates, sizeof (rates), "%.1f messages/s, %.2f MB/s", static_cast<double>(snapshot.messagesDone) / seconds,
+                      static_cast<double>(snapshot.bytesDone) / kMegaByte / seconds);
+
+        Pendulum_Log::info("Pass complete: " + std::to_string(snapshot.messagesDone) + " messages in "
+                           + formatDuration(snapshot.elapsed.count()) + " (" + rates + ")",
+                           Pendulum_Log::Fields().withCount(snapshot.messagesDone).withBytes(snapshot.bytesDone)
+                           .withLatency(std::chrono::duration_cast<std::chrono::microseconds>(snapshot.elapsed)));
+
+    }
+
+    ProgressSnapshot getSnapshot() {
+
+        std::lock_guard<std::mutex> locker(progress.progressMutex);
+
+        ProgressSnapshot snapshot;
+
+        snapshot.bPassActive = progress.bPassActive;
+        snapshot.mailBox = progress.currentMailBox.name;
+        snapshot.mailBoxMessages = progress.currentMailBox.messages;
+        snapshot.mailBoxBytes = progress.currentMailBox.bytes;
+        snapshot.totalMessages = progress.totalMessages;
+        snapshot.totalBytes = progress.bBytesKnown ? progress.totalBytes : 0;
+        snapshot.messagesDone = progress.messagesDone.load(std::memory_order_relaxed);
+        snapshot.bytesDone = progress.bytesDone.load(std::memory_order_relaxed);
+        snapshot.mailBoxMessagesDone = snapshot.messagesDone - progress.mailBoxStartMessages;
+        snapshot.mailBoxBytesDone = snapshot.bytesDone - progress.mailBoxStartBytes;
+        snapshot.elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - progress.passStart);
+
+        // Average rates until the reporter has sampled
+
+        if (progress.bRateValid) {
+            snapshot.messageRate = progress.messageRate;
+            snapshot.byteRate = progress.byteRate;
+        } else if (snapshot.elapsed.count() > 0) {
+            snapshot.messageRate = static_cast<double>(snapshot.messagesDone) / static_cast<double>(snapshot.elapsed.count());
+            snapshot.byteRate = static_cast<double>(snapshot.bytesDone) / static_cast<double>(snapshot.elapsed.count());
+        }
+
+        return (snapshot);
+
+    }
+
+    std::int64_t estimateRemaining(const ProgressSnapshot& snapshot) {
+        return (remainingSeconds(snapshot.messagesDone, snapshot.totalMessages, snapshot.bytesDone,
+                                 snapshot.totalBytes, snapshot.messageRate, snapshot.byteRate));
+    }
+
+    std::string formatProgress(const ProgressSnapshot& snapshot) {
+
+        char rates[96];
+        std::uint64_t bandwidthLimit { Pendulum_Bandwidth::currentLimit() };
+
+        if (bandwidthLimit) {
+            std::snprintf(rates, sizeof (rates), "%.1f messages/s, %.2f MB/s (limit %.2f MB/s)", snapshot.messageRate,
+                          snapshot.byteRate / kMegaByte, static_cast<double>(bandwidthLimit) / kMegaByte);
+        } else {
+            std::snprintf(rates, sizeof (rates), "%.1f messages/s, %.2f MB/s", snapshot.messageRate, snapshot.byteRate / kMegaByte);
+        }
+
+        return ("Progress [" + snapshot.mailBox + "] "
+                + formatWork(snapshot.mailBoxMessagesDone, snapshot.mailBoxMessages, snapshot.mailBoxBytesDone, snapshot.mailBoxBytes)
+                + ", " + rates + ", ETA "
+                + formatDuration(remainingSeconds(snapshot.mailBoxMessagesDone, snapshot.mailBoxMessages, snapshot.mailBoxBytesDone,
+                                                  snapshot.mailBoxBytes, snapshot.messageRate, snapshot.byteRate))
+                + "; pass " + formatWork(snapshot.messagesDone, snapshot.totalMessages, snapshot.bytesDone, snapshot.totalBytes)
+                + ", ETA " + formatDuration(estimateRemaining(snapshot)));
+
+    }
+
+    void startReporter(std::chrono::seconds logInterval, int eventFD) {
+
+        stopReporter();
+
+        std::lock_guard<std::mutex> locker(reporter.reporterMutex);
+
+        reporter.bStopping = false;
+        reporter.eventFD.store(eventFD);
+        reporter.reporterThread = std::thread(reportProgress, (logInterval.count() > 0) ? std::max(logInterval, kEventInterval)
+                                                                                         : std::chrono::seconds(0));
+
+    }
+
+    void stopReporter() {
+
+        {
+            std::lock_guard<std::mutex> locker(reporter.reporterMutex);
+            if (!reporter.reporterThread.joinable()) {
+                return;
+            }
+            reporter.bStopping = true;
+        }
+
+        reporter.stopRequested.notify_all();
+        reporter.reporterThread.join();
+
+    }
+
+} // namespace Pendulum_Progress
@@ -0,0 +1,84 @@
+#ifndef PENDULUM_PROGRESS_HPP
+#define PENDULUM_PROGRESS_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Progress {
+
+    //
+    // Progress of the current mailbox and whole pass. Byte totals are zero if
+    // message sizes are not known (percent complete and ETA are then by message).
+    //
+
+    struct ProgressSnapshot {
+        bool bPassActive { false };             // Pass started and not ended
+        std::string mailBox;                    // Current mailbox
+        std::uint64_t mailBoxMessages { 0 };    // Current mailbox messages to archive
+        std::uint64_t mailBoxBytes { 0 };       // Current mailbox bytes to archive
+        std::uint64_t mailBoxMessagesDone { 0 };
+        std::uint64_t mailBoxBytesDone { 0 };
+        std::uint64_t totalMessages { 0 };      // Pass messages to archive
+        std::uint64_t totalBytes { 0 };         // Pass bytes to archive
+        std::uint64_t messagesDone { 0 };
+        std::uint64_t bytesDone { 0 };
+        double messageRate { 0.0 };             // Smoothed messages/second
+        double byteRate { 0.0 };                // Smoothed bytes/second
+        std::chrono::seconds elapsed { 0 };
+    };
+
+    //
+    // Start a pass (resets all totals) then add each mailbox's work to it.
+    //
+
+    void startPass();
+    void addMailBox(const std::string& mailBox, std::uint64_t messages, std::uint64_t bytes);
+
+    //
+    // Mailbox now being archived (must have been added). Mailboxes archived a slice
+    // at a time may be returned to; a mailbox added again adds to its work.
+    //
+
+    void startMailBox(const std::string& mailBox);
+
+    //
+    // Message archived (two relaxed atomic adds; safe to call per message).
+    //
+
+    void messageDone(std::uint64_t bytes);
+
+    //
+    // End pass; logs a summary line.
+    //
+
+    void endPass();
+
+    //
+    // Current progress, formatted progress line and estimated seconds remaining
+    // for the pass (negative if not yet known).
+    //
+
+    ProgressSnapshot getSnapshot();
+    std::string formatProgress(const ProgressSnapshot& snapshot);
+    std::int64_t estimateRemaining(const ProgressSnapshot& snapshot);
+
+    //
+    // Start reporting progress: logged every log interval (0 = not logged) and, if
+    // an event file descriptor is given, written to it as JSON line events (mailbox,
+    // progress every second, pass_complete). Stop ends reporting.
+    //
+
+    void startReporter(std::chrono::seconds logInterval, int eventFD = -1);
+    void stopReporter();
+
+} // namespace Pendulum_Progress
+#endif /* PENDULUM_PROGRESS_HPP */
@@ -0,0 +1,437 @@
+
+//
+// Module: Pendulum_ResponseParse
+//
+// Description: Pendulum zero-copy IMAP command response parser. The raw response
+// is moved into the parsed response and all attributes/literals are returned as
+// string views into it; so a multi-megabyte message body is never copied between
+// being received and being written to its .eml file. Only the parts of a response
+// that Pendulum uses are decoded (FETCH, SEARCH, LIST, BYE and the tagged status
+// line); all other untagged responses are skipped. Result lists are allocated from
+// a per-command arena (Pendulum_Arena) when one is supplied.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CIMAPParse (response codes).
+// Pendulum           : Pendulum_Arena.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <stdexcept>
+#include <cstdlib>
+
+//
+// Pendulum response parser
+//
+
+#include "Pendulum_ResponseParse.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_ResponseParse {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Antik::IMAP;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Throw parse error.
+    //
+
+    [[noreturn]] static void parseError(const std::string& errMsg) {
+        throw std::runtime_error("Response parse error: " + errMsg);
+    }
+
+    //
+    // Parse unsigned decimal at position (position left after last digit).
+    //
+
+    static std::uint64_t parseNumber(std::string_view response, std::size_t& position) {
+
+        std::uint64_t number { 0 };
+        std::size_t start { position };
+
+        while ((position < response.size()) && (response[position] >= '0') && (response[position] <= '9')) {
+            number = (number * 10) + (response[position++] - '0');
+        }
+
+        if (position == start) {
+            parseError("number expected");
+        }
+
+        return (number);
+
+    }
+
+    //
+    // Parse literal "{n}\r\n<n bytes>" at position and return view of its data.
+    //
+
+    static std::string_view parseLiteral(std::string_view response, std::size_t& position) {
+
+        position++; // '{'
+        std::size_t literalLength = parseNumber(response, position);
+        if (response.compare(position, 3, "}\r\n") != 0) {
+            parseError("malformed literal");
+        }
+        position += 3;
+        if (literalLength > (response.size() - position)) {
+            parseError("truncated literal");
+        }
+        std::string_view literal { response.substr(position, literalLength) };
+        position += literalLength;
+
+        return (literal);
+
+    }
+
+    //
+    // Parse quoted string at position and return view of its contents (escapes not removed).
+    //
+
+    static std::string_view parseQuoted(std::string_view response, std::size_t& position) {
+
+        std::size_t start { ++position };
+
+        while (position < response.size()) {
+            if (response[position] == '\\') {
+                position += 2;
+            } else if (response[position] == '\"') {
+                return (response.substr(start, (position++) - start));
+            } else {
+                position++;
+            }
+        }
+
+        parseError("unterminated quoted string");
+
+    }
+
+    //
+    // Parse parenthesised list (which may contain quoted strings and literals) at
+    // position and return view of it including its enclosing parentheses.
+    //
+
+    static std::string_view parseList(std::string_view response, std::size_t& position) {
+
+        std::size_t start { position };
+        int depth { 0 };
+
+        while (position < response.size()) {
+            switch (response[position]) {
+                case '(':
+                    depth++;
+                    position++;
+                    break;
+                case ')':
+                    position++;
+                    if (--depth == 0) {
+                        return (response.substr(start, position - start));
+                    }
+                    break;
+                case '\"':
+                    parseQuoted(response, position);
+                    break;
+                case '{':
+                    parseLiteral(response, position);
+                    break;
+                default:
+                    position++;
+                    break;
+            }
+        }
+
+        parseError("unterminated list");
+
+    }
+
+    //
+    // Parse FETCH item name. Names may contain spaces within square brackets
+    // (e.g. "BODY[HEADER.FIELDS (SUBJECT)]") and an optional "<origin>" suffix.
+    //
+
+    static std::string_view parseItemName(std::string_view response, std::size_t& position) {
+
+        std::size_t start { position };
+        int bracketDepth { 0 };
+
+        while (position < response.size()) {
+            char ch { response[position] };
+            if (ch == '[') {
+                bracketDepth++;
+            } else if (ch == ']') {
+                bracketDepth--;
+            } else if ((bracketDepth == 0) && ((ch == ' ') || (ch == ')'))) {
+                break;
+            }
+            position++;
+        }
+
+        if (position == start) {
+            parseError("fetch item name expected");
+        }
+
+        return (response.substr(start, position - start));
+
+    }
+
+    //
+    // Parse FETCH item value (literal, quoted string, list, or atom/number/NIL).
+    //
+
+    static std::string_view parseItemValue(std::string_view response, std::size_t& position) {
+
+        if (position >= response.size()) {
+            parseError("fetch item value expected");
+        }
+
+        switch (response[position]) {
+            case '{':
+                return (parseLiteral(response, position));
+            case '\"':
+                return (parseQuoted(response, position));
+            case '(':
+                return (parseList(response, position));
+            default:
+            {
+                std::size_t start { position };
+                while ((position < response.size()) && (response[position] != ' ') &&
+                       (response[position] != ')') && (response[position] != '\r')) {
+                    position++;
+                }
+                return (response.substr(start, position - start));
+            }
+        }
+
+    }
+
+    //
+    // Parse "(item value item value ...)" of a FETCH response into a fetch entry.
+    //
+
+    static void parseFetchItems(std::string_view response, std::size_t& position, FetchEntry& fetchEntry) {
+
+        if ((position >= response.size()) || (response[position] != '(')) {
+            parseError("fetch item list expected");
+        }
+
+        position++;
+
+        while (true) {
+            while ((position < response.size()) && (response[position] == ' ')) {
+                position++;
+            }
+            if (position >= response.size()) {
+                parseError("unterminated fetch item list");
+            }
+            if (response[position] == ')') {
+                position++;
+                break;
+            }
+            FetchItem fetchItem;
+            fetchItem.name = parseItemName(response, position);
+            if ((position < response.size()) && (response[position] == ' ')) {
+                position++;
+            }
+            fetchItem.value = parseItemValue(response, position);
+            if (fetchItem.name == "UID") {
+                fetchEntry.uid = std::strtoull(std::string(fetchItem.value).c_str(), nullptr, 10);
+            }
+            fetchEntry.items.push_back(fetchItem);
+        }
+
+    }
+
+    //
+    // Parse "n n n ..." of a SEARCH response appending UIDs to indexes.
+    //
+
+    static void parseSearch(std::string_view response, std::size_t position, ParsedResponse& parsedResponse) {
+
+        while ((position < response.size()) && (response[position] == ' ')) {
+            position++;
+            if ((position < response.size()) && (response[position] >= '0') && (response[position] <= '9')) {
+                parsedResponse.indexes.push_back(parseNumber(response, position));
+            }
+        }
+
+    }
+
+    //
+    // Parse "(attributes) delimiter name" of a LIST response. The returned position
+    // is after the mailbox name (which may be a literal).
+    //
+
+    static std::size_t parseListResponse(std::string_view response, std::size_t position, ParsedResponse& parsedResponse) {
+
+        ListEntry listEntry;
+
+        if ((position < response.size()) && (response[position] == '(')) {
+            listEntry.attributes = parseList(response, position);
+        }
+
+        if ((position < response.size()) && (response[position] == ' ')) {
+            position++;
+        }
+        if ((position < response.size()) && (response[position] == '\"')) {
+            listEntry.hierDel = parseQuoted(response, position);
+        } else {
+            listEntry.hierDel = parseItemValue(response, position); // NIL
+        }
+
+        if ((position < response.size()) && (response[position] == ' ')) {
+            position++;
+        }
+        if ((position < response.size()) && (response[position] == '\"')) {
+            std::size_t nameStart { position };
+            parseQuoted(response, position);
+            listEntry.mailBoxName = response.substr(nameStart, position - nameStart);
+        } else {
+            listEntry.mailBoxName = parseItemValue(response, position);
+        }
+
+        parsedResponse.mailBoxList.push_back(listEntry);
+
+        return (position);
+
+    }
+
+    //
+    // Return position of the start of the next line.
+    //
+
+    static std::size_t nextLine(std::string_view response, std::size_t position) {
+
+        std::size_t lineEnd { response.find('\n', position) };
+
+        return ((lineEnd == std::string_view::npos) ? response.size() : lineEnd + 1);
+
+    }
+
+    //
+    // Return view of text from position up to the end of the current line.
+    //
+
+    static std::string_view restOfLine(std::string_view response, std::size_t position) {
+
+        std::size_t lineEnd { response.find_first_of("\r\n", position) };
+        if (lineEnd == std::string_view::npos) {
+            lineEnd = response.size();
+        }
+
+        return (response.substr(position, lineEnd - position));
+
+    }
+
+    //
+    // Parse tagged status line ("tag OK|NO|BAD text").
+    //
+
+    static void parseTaggedLine(std::string_view response, std::size_t position, ParsedResponse& parsedResponse) {
+
+        std::string_view line { restOfLine(response, position) };
+        std::size_t codeStart { line.find(' ') };
+
+        if (codeStart != std::string_view::npos) {
+            std::string_view code { line.substr(codeStart + 1, line.find(' ', codeStart + 1) - (codeStart + 1)) };
+            if (code == "OK") {
+                parsedResponse.status = CIMAPParse::RespCode::OK;
+            } else if (code == "NO") {
+                parsedResponse.status = CIMAPParse::RespCode::NO;
+            } else if (code == "BAD") {
+                parsedResponse.status = CIMAPParse::RespCode::BAD;
+            }
+        }
+
+        if (parsedResponse.status != CIMAPParse::RespCode::OK) {
+            parsedResponse.errorMessage = line;
+        }
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    //
+    // Parse a raw IMAP command response. The response is moved into the returned
+    // structure and everything parsed is a view into it.
+    //
+
+    PARSEDRESPONSE parseResponse(std::string&& response, Pendulum_Arena::ArenaLease&& lease) {
+
+        PARSEDRESPONSE parsedResponse { std::make_unique<ParsedResponse>(std::move(response), std::move(lease)) };
+        std::string_view buffer { parsedResponse->buffer };
+        std::size_t position { 0 };
+
+        while (position < buffer.size()) {
+
+            if (buffer.compare(position, 2, "* ") == 0) {
+
+                std::size_t untagged { position + 2 };
+
+                if (buffer.compare(untagged, 6, "SEARCH") == 0) {
+                    parseSearch(buffer, untagged + 6, *parsedResponse);
+                } else if (buffer.compare(untagged, 5, "LIST ") == 0) {
+                    position = parseListResponse(buffer, untagged + 5, *parsedResponse); // Skip any literal
+                } else if (buffer.compare(untagged, 4, "BYE ") == 0) {
+                    parsedResponse->byeSent = true;
+                    parsedResponse->errorMessage = restOfLine(buffer, untagged + 4);
+                } else if ((untagged < buffer.size()) && (buffer[untagged] >= '0') && (buffer[untagged] <= '9')) {
+                    std::size_t itemPosition { untagged };
+                    std::uint64_t index { parseNumber(buffer, itemPosition) };
+                    if (buffer.compare(itemPosition, 7, " FETCH ") == 0) {
+                        itemPosition += 7;
+                        FetchEntry fetchEntry { parsedResponse->lease.resource() };
+                        fetchEntry.index = index;
+                        parseFetchItems(buffer, itemPosition, fetchEntry);
+                        parsedResponse->fetchList.push_back(std::move(fetchEntry));
+                        position = itemPosition; // Skip any literals
+                    }
+                }
+
+            } else if ((buffer[position] != '+') && (buffer[position] != '\r') && (buffer[position] != '\n')) {
+                parseTaggedLine(buffer, position, *parsedResponse);
+            }
+
+            position = nextLine(buffer, position);
+
+        }
+
+        return (parsedResponse);
+
+    }
+
+    //
+    // Return view of the value of the first FETCH item whose name starts with itemName.
+    //
+
+    std::string_view findFetchItem(const FetchEntry& fetchEntry, std::string_view itemName) {
+
+        for (auto& fetchItem : fetchEntry.items) {
+            if (fetchItem.name.compare(0, itemName.size(), itemName) == 0) {
+                return (fetchItem.value);
+            }
+        }
+
+        return (std::string_view());
+
+    }
+
+} // namespace Pendulum_ResponseParse
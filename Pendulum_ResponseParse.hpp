@@ -0,0 +1,113 @@
+#ifndef PENDULUM_RESPONSEPARSE_HPP
+#define PENDULUM_RESPONSEPARSE_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <cstdint>
+
+//
+// Antikythera Classes
+//
+
+#include "CIMAPParse.hpp"
+
+//
+// Pendulum arena
+//
+
+#include "Pendulum_Arena.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_ResponseParse {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using Antik::IMAP::CIMAPParse;
+
+    //
+    // FETCH response item (name and value are views into the raw response).
+    // Literal values are the literal data, quoted values have their quotes
+    // removed and parenthesised lists are returned complete with parentheses.
+    //
+
+    struct FetchItem {
+        std::string_view name;           // Item name (e.g. "BODY[]")
+        std::string_view value;          // Item value
+    };
+
+    //
+    // Single "* n FETCH (...)" response
+    //
+
+    struct FetchEntry {
+        explicit FetchEntry(std::pmr::memory_resource* resource) : items { resource } {}
+        std::uint64_t index { 0 };       // Message sequence number
+        std::uint64_t uid { 0 };         // Message UID (if returned)
+        std::pmr::vector<FetchItem> items; // Fetch items in server order
+    };
+
+    //
+    // Single "* LIST (attributes) "delimiter" name" response
+    //
+
+    struct ListEntry {
+        std::string_view attributes;     // Mailbox attributes (with parentheses)
+        std::string_view hierDel;        // Hierarchy delimiter
+        std::string_view mailBoxName;    // Mailbox name (quotes retained)
+    };
+
+    //
+    // Parsed command response. All views are into buffer which is owned by the
+    // response so it must be kept alive for as long as any view is in use; hence
+    // it is only ever handed out on the heap (PARSEDRESPONSE) and never moved.
+    // Lists are allocated from the command arena held by lease (or the default
+    // heap if there isn't one); the lease is declared first so that it is
+    // released only after they have been destroyed.
+    //
+
+    struct ParsedResponse {
+        ParsedResponse(std::string&& response, Pendulum_Arena::ArenaLease&& lease)
+            : lease { std::move(lease) }, buffer { std::move(response) },
+              indexes { this->lease.resource() }, mailBoxList { this->lease.resource() },
+              fetchList { this->lease.resource() } {}
+        ParsedResponse(const ParsedResponse&) = delete;
+        ParsedResponse& operator=(const ParsedResponse&) = delete;
+        Pendulum_Arena::ArenaLease lease;                   // Command arena lease
+        const std::string buffer;                           // Raw server response
+        CIMAPParse::RespCode status { CIMAPParse::RespCode::NONE }; // Tagged response status
+        std::string_view errorMessage;                      // Tagged/BYE response text
+        bool byeSent { false };                             // = true server sent BYE
+        std::pmr::vector<std::uint64_t> indexes;            // SEARCH results
+        std::pmr::vector<ListEntry> mailBoxList;            // LIST responses
+        std::pmr::vector<FetchEntry> fetchList;             // FETCH responses
+    };
+
+    typedef std::unique_ptr<ParsedResponse> PARSEDRESPONSE;
+
+    //
+    // Parse a raw IMAP command response without copying any of its data. Any
+    // lists are allocated from the arena of the passed in lease.
+    //
+
+    PARSEDRESPONSE parseResponse(std::string&& response, Pendulum_Arena::ArenaLease&& lease = Pendulum_Arena::ArenaLease());
+
+    //
+    // Return view of named item in a FETCH entry (empty view if not present).
+    //
+
+    std::string_view findFetchItem(const FetchEntry& fetchEntry, std::string_view itemName);
+
+} // namespace Pendulum_ResponseParse
+#endif /* PENDULUM_RESPONSEPARSE_HPP */
@@ -0,0 +1,257 @@
+
+//
+// Module: Pendulum_SparePool
+//
+// Description: Pendulum spare connection pool. Every connect to an IMAP server costs
+// a TCP connect, full TLS handshake and LOGIN, which with a flaky provider and the
+// reconnects of --retry is a large part of a run. A background thread keeps a few
+// logged in spare connections to the account's server so that serverConnect() can
+// hand one over immediately when a connection is dropped; a spare idle for a while
+// is checked with NOOP before use and replaced before the server logs it out.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CIMAP, CIMAPParse.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <vector>
+
+//
+// Antik Classes
+//
+
+#include "CIMAPParse.hpp"
+
+//
+// Pendulum components
+//
+
+#include "Pendulum_SparePool.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_SparePool {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Antik::IMAP;
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Spares ready gauge (all pools)
+    //
+
+    static Pendulum_Metrics::Gauge& sparesReady() {
+        static Pendulum_Metrics::Gauge& ready { Pendulum_Metrics::gauge("pendulum_spare_connections", "Spare logged in connections ready.") };
+        return (ready);
+    }
+
+    //
+    // Log out of a spare; it may already be broken so any error is ignored.
+    //
+
+    static void disconnectSpare(CIMAP& server) {
+        try {
+            server.disconnect();
+        } catch (const std::exception&) {
+        }
+    }
+
+    //
+    // Spare still logged in (NOOP answered OK).
+    //
+
+    static bool checkSpare(CIMAP& server) {
+        try {
+            std::string commandResponse { server.sendCommand("NOOP") };
+            return (server.getConnectedStatus() && !commandResponse.empty() &&
+                    (CIMAPParse::parseResponse(commandResponse)->status == CIMAPParse::RespCode::OK));
+        } catch (const std::exception&) {
+            return (false);
+        }
+    }
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Connect and log in a new spare (null on failure).
+    //
+
+    std::unique_ptr<CIMAP> SparePool::connectSpare() {
+
+        static Pendulum_Metrics::Histogram& connectLatency { Pendulum_Metrics::histogram("pendulum_imap_connect_seconds", "IMAP server connect (TLS and login) latency.") };
+        static Pendulum_Metrics::Counter& connectFailures { Pendulum_Metrics::counter("pendulum_imap_connect_failures_total", "IMAP server connect attempts failed.") };
+
+        std::unique_ptr<CIMAP> server { std::make_unique<CIMAP>() };
+
+        server->setServer(serverURL);
+        server->setUserAndPassword(userName, userPassword);
+
+        try {
+            Pendulum_Metrics::ScopedTimer timer { connectLatency };
+            server->connect();
+        } catch (const std::exception& e) {
+            Pendulum_Log::warning("Spare connection failed: " + std::string(e.what()));
+        }
+
+        if (!server->getConnectedStatus()) {
+            connectFailures.add();
+            return (nullptr);
+        }
+
+        return (server);
+
+    }
+
+    //
+    // Refill thread: keep spareCount spares ready, replacing any idle for kMaxIdle.
+    //
+
+    void SparePool::run() {
+
+        std::unique_ptr<Pendulum_Log::AccountScope> accountScope;
+
+        if (!accountName.empty()) {
+            accountScope = std::make_unique<Pendulum_Log::AccountScope>(accountName);
+        }
+
+        std::unique_lock<std::mutex> locker(spareMutex);
+
+        while (!bStopping) {
+
+            // Drop spares the server may be about to log out
+
+            std::vector<Spare> expired;
+            auto now = std::chrono::steady_clock::now();
+            while (!spares.empty() && ((now - spares.front().lastUsed) >= kMaxIdle)) {
+                expired.push_back(std::move(spares.front()));
+                spares.pop_front();
+                sparesReady().add(-1);
+            }
+
+            if (!expired.empty()) {
+                locker.unlock();
+                for (auto& spare : expired) {
+                    disconnectSpare(*spare.server);
+                }
+                locker.lock();
+                continue;
+            }
+
+            if (spares.size() < spareCount) {
+                locker.unlock();
+                std::unique_ptr<CIMAP> server { connectSpare() };
+                locker.lock();
+                if (server) {
+                    spares.push_back({ std::move(server), std::chrono::steady_clock::now() });
+                    sparesReady().add(1);
+                } else {
+                    spareChanged.wait_for(locker, kRetryWait, [this]() { return (bStopping); });
+                }
+                continue;
+            }
+
+            // Wait for a spare to be taken or the oldest to need replacing
+
+            if (spares.empty()) {
+                spareChanged.wait(locker, [this]() { return (bStopping); });
+            } else {
+                spareChanged.wait_until(locker, spares.front().lastUsed + kMaxIdle, [this]() {
+                    return (bStopping || (spares.size() < spareCount));
+                });
+            }
+
+        }
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    SparePool::SparePool(const std::string& serverURL, const std::string& userName, const std::string& userPassword,
+                         std::size_t spareCount, const std::string& accountName) :
+            serverURL { serverURL }, userName { userName }, userPassword { userPassword },
+            spareCount { spareCount }, accountName { accountName } {
+
+        refillThread = std::thread(&SparePool::run, this);
+
+    }
+
+    SparePool::~SparePool() {
+
+        {
+            std::unique_lock<std::mutex> locker(spareMutex);
+            bStopping = true;
+        }
+        spareChanged.notify_all();
+
+        if (refillThread.joinable()) {
+            refillThread.join();
+        }
+
+        for (auto& spare : spares) {
+            disconnectSpare(*spare.server);
+            sparesReady().add(-1);
+        }
+
+    }
+
+    std::unique_ptr<CIMAP> SparePool::take() {
+
+        static Pendulum_Metrics::Counter& sparesUsed { Pendulum_Metrics::counter("pendulum_spare_connections_used_total", "Spare connections taken in place of a connect.") };
+
+        while (true) {
+
+            Spare spare;
+
+            {
+                std::unique_lock<std::mutex> locker(spareMutex);
+                if (spares.empty()) {
+                    return (nullptr);
+                }
+                spare = std::move(spares.back());   // Most recently used first
+                spares.pop_back();
+                sparesReady().add(-1);
+            }
+            spareChanged.notify_all();
+
+            if (((std::chrono::steady_clock::now() - spare.lastUsed) < kCheckIdle) || checkSpare(*spare.server)) {
+                sparesUsed.add();
+                return (std::move(spare.server));
+            }
+
+            Pendulum_Log::warning("Spare connection no longer logged in; discarded.");
+            disconnectSpare(*spare.server);
+
+        }
+
+    }
+
+    std::size_t SparePool::readyCount() const {
+        std::unique_lock<std::mutex> locker(spareMutex);
+        return (spares.size());
+    }
+
+} // namespace Pendulum_SparePool
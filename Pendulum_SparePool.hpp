@@ -0,0 +1,100 @@
+#ifndef PENDULUM_SPAREPOOL_HPP
+#define PENDULUM_SPAREPOOL_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+
+//
+// Antikythera Classes
+//
+
+#include "CIMAP.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_SparePool {
+
+    //
+    // A spare is replaced once idle this long (well inside the 30 minute minimum
+    // autologout timer of RFC 3501) and checked with a NOOP before it is used if it
+    // has been idle longer than kCheckIdle.
+    //
+
+    constexpr std::chrono::minutes kMaxIdle { 20 };
+    constexpr std::chrono::seconds kCheckIdle { 60 };
+
+    //
+    // Wait before trying again after a spare failed to connect
+    //
+
+    constexpr std::chrono::seconds kRetryWait { 30 };
+
+    //
+    // Pool of spare logged in connections to an account's server. A background
+    // thread keeps spareCount connections (TLS handshake and LOGIN done) ready so
+    // that a dropped connection can be replaced by one straight away instead of
+    // waiting on a fresh connect; each spare taken is replaced in the background.
+    // Spares are extra connections to the server so count towards any limit it has
+    // on connections per user.
+    //
+
+    class SparePool {
+    public:
+
+        SparePool(const std::string& serverURL, const std::string& userName, const std::string& userPassword,
+                  std::size_t spareCount, const std::string& accountName = "");
+        ~SparePool();
+
+        SparePool(const SparePool&) = delete;
+        SparePool& operator=(const SparePool&) = delete;
+
+        //
+        // Take a logged in spare (null if none is ready; never waits on a connect).
+        //
+
+        std::unique_ptr<Antik::IMAP::CIMAP> take();
+
+        //
+        // Spares ready to be taken.
+        //
+
+        std::size_t readyCount() const;
+
+    private:
+
+        struct Spare {
+            std::unique_ptr<Antik::IMAP::CIMAP> server;         // Logged in connection
+            std::chrono::steady_clock::time_point lastUsed;     // Time connected/last checked
+        };
+
+        void run();
+        std::unique_ptr<Antik::IMAP::CIMAP> connectSpare();
+
+        std::string serverURL;
+        std::string userName;
+        std::string userPassword;
+        std::size_t spareCount;
+        std::string accountName;                    // Account logged (daemon)
+
+        mutable std::mutex spareMutex;
+        std::condition_variable spareChanged;
+        std::deque<Spare> spares;                   // Ready spares (oldest first)
+        bool bStopping { false };
+        std::thread refillThread;
+
+    };
+
+} // namespace Pendulum_SparePool
+#endif /* PENDULUM_SPAREPOOL_HPP */
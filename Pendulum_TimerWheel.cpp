@@ -0,0 +1,112 @@
+
+//
+// Module: Pendulum_TimerWheel
+//
+// Description: Pendulum hashed timer wheel used by the daemon to schedule
+// each account's next poll.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <algorithm>
+
+//
+// Pendulum timer wheel
+//
+
+#include "Pendulum_TimerWheel.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_TimerWheel {
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Tick a time falls in (times before the wheel started are tick 0).
+    //
+
+    std::uint64_t TimerWheel::tickFor(Clock::time_point time) const {
+        if (time <= start) {
+            return (0);
+        }
+        return (static_cast<std::uint64_t> ((time - start) / tick));
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    TimerWheel::TimerWheel(Clock::duration tick, std::size_t slotCount) :
+            tick { tick }, start { Clock::now() }, slots(slotCount ? slotCount : 1) {
+    }
+
+    void TimerWheel::schedule(std::uint64_t timerID, Clock::time_point expiry) {
+
+        // Rounded up so a timer never fires early; anything already due fires next tick
+
+        std::uint64_t expiryTick { tickFor(expiry) };
+        if ((start + expiryTick * tick) < expiry) {
+            expiryTick++;
+        }
+        expiryTick = std::max(expiryTick, currentTick + 1);
+
+        slots[expiryTick % slots.size()].push_back({ timerID, expiryTick });
+        timerCount++;
+
+    }
+
+    std::vector<std::uint64_t> TimerWheel::advance(Clock::time_point now) {
+
+        std::vector<std::uint64_t> expired;
+        std::uint64_t nowTick { tickFor(now) };
+
+        if (nowTick <= currentTick) {
+            return (expired);
+        }
+
+        // Each slot need only be looked at once however far the wheel has turned
+
+        std::uint64_t ticks { std::min<std::uint64_t>(nowTick - currentTick, slots.size()) };
+
+        for (std::uint64_t tickNo = nowTick - ticks + 1; tickNo <= nowTick; tickNo++) {
+            std::vector<Timer>& slot { slots[tickNo % slots.size()] };
+            auto pending = std::stable_partition(slot.begin(), slot.end(), [nowTick](const Timer& timer) {
+                return (timer.expiryTick > nowTick);
+            });
+            std::vector<Timer> slotExpired(pending, slot.end());
+            slot.erase(pending, slot.end());
+            std::sort(slotExpired.begin(), slotExpired.end(), [](const Timer& lhs, const Timer& rhs) {
+                return (lhs.expiryTick < rhs.expiryTick);
+            });
+            for (auto& timer : slotExpired) {
+                expired.push_back(timer.timerID);
+            }
+        }
+
+        timerCount -= expired.size();
+        currentTick = nowTick;
+
+        return (expired);
+
+    }
+
+    std::size_t TimerWheel::size() const {
+        return (timerCount);
+    }
+
+} // namespace Pendulum_TimerWheel
@@ -0,0 +1,69 @@
+#ifndef PENDULUM_TIMERWHEEL_HPP
+#define PENDULUM_TIMERWHEEL_HPP
+
+//
+// C++ STL
+//
+
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_TimerWheel {
+
+    //
+    // Hashed timer wheel. Timers are kept in the slot for their expiry tick (modulo
+    // the number of slots) so scheduling is constant time and advancing only looks
+    // at the slots for the ticks passed, however many timers are pending. Timers
+    // further away than one revolution just stay in their slot for later turns.
+    //
+
+    class TimerWheel {
+    public:
+
+        using Clock = std::chrono::steady_clock;
+
+        TimerWheel(Clock::duration tick, std::size_t slotCount);
+
+        //
+        // Add timer to expire at (or after) a time.
+        //
+
+        void schedule(std::uint64_t timerID, Clock::time_point expiry);
+
+        //
+        // Return the timers expired by a time (earliest tick first) and remove them.
+        //
+
+        std::vector<std::uint64_t> advance(Clock::time_point now);
+
+        //
+        // Number of timers pending.
+        //
+
+        std::size_t size() const;
+
+    private:
+
+        struct Timer {
+            std::uint64_t timerID;              // Caller's timer ID
+            std::uint64_t expiryTick;           // Tick expired on
+        };
+
+        std::uint64_t tickFor(Clock::time_point time) const;
+
+        Clock::duration tick;                   // Tick length
+        Clock::time_point start;                // Time of tick 0
+        std::uint64_t currentTick { 0 };        // Last tick advanced to
+        std::vector<std::vector<Timer>> slots;  // Timers by expiry tick modulo slots
+        std::size_t timerCount { 0 };           // Pending timers
+
+    };
+
+} // namespace Pendulum_TimerWheel
+#endif /* PENDULUM_TIMERWHEEL_HPP */
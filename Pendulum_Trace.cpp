@@ -0,0 +1,324 @@
+//
+// Module: Pendulum_Trace
+//
+// Description: Pendulum span tracing. Each thread records begin/end events into its
+// own fixed size single producer/single consumer ring buffer (no locks or allocation
+// on the recording path; if a buffer fills events are dropped and counted). A
+// background thread drains the buffers into a Chrome trace event format JSON file
+// that can be loaded into Perfetto (ui.perfetto.dev) or chrome://tracing. When
+// tracing is off a span costs a single relaxed atomic load.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <algorithm>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+//
+// Pendulum tracing
+//
+
+#include "Pendulum_Trace.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Trace {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    constexpr std::size_t kRingSize { 8192 };                           // Events per thread (power of 2)
+    constexpr std::size_t kMaxDetail { 48 };                            // Span detail length kept
+    constexpr std::chrono::milliseconds kFlushInterval { 250 };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Recorded event
+    //
+
+    struct TraceEvent {
+        std::int64_t timeStamp;                                         // Steady clock nanoseconds
+        const char *name;
+        const char *category;
+        char phase;                                                     // 'B' or 'E'
+        char detail[kMaxDetail];
+    };
+
+    //
+    // Per-thread ring buffer. The owning thread is the only writer of head and
+    // the flush thread the only writer of tail.
+    //
+
+    struct ThreadBuffer {
+        long threadId { 0 };
+        std::atomic<std::uint64_t> head { 0 };
+        std::atomic<std::uint64_t> tail { 0 };
+        std::atomic<std::uint64_t> dropped { 0 };
+        std::array<TraceEvent, kRingSize> events;
+    };
+
+    //
+    // Tracer state. Buffers are never freed (a thread keeps a pointer to its own
+    // buffer and may outlive a trace).
+    //
+
+    struct Tracer {
+        ~Tracer() {         // exit() without stopTracing() must not terminate on a joinable thread
+            {
+                std::lock_guard<std::mutex> locker(tracerMutex);
+                bStopping = true;
+            }
+            stopRequested.notify_all();
+            if (flushThread.joinable()) {
+                flushThread.join();
+            }
+        }
+        std::mutex tracerMutex;
+        std::condition_variable stopRequested;
+        std::thread flushThread;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::ofstream traceFile;
+        std::chrono::steady_clock::time_point startTime;
+        bool bFirstEvent { true };
+        bool bStopping { false };
+    };
+
+    static Tracer tracer;
+
+    static thread_local ThreadBuffer *threadBuffer { nullptr };
+
+    std::atomic<bool> bTracing { false };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Return calling threads buffer, registering one on first use.
+    //
+
+    static ThreadBuffer& getThreadBuffer() {
+
+        if (threadBuffer == nullptr) {
+            auto buffer { std::make_unique<ThreadBuffer>() };
+            buffer->threadId = ::syscall(SYS_gettid);
+            std::lock_guard<std::mutex> locker(tracer.tracerMutex);
+            threadBuffer = buffer.get();
+            tracer.buffers.push_back(std::move(buffer));
+        }
+
+        return (*threadBuffer);
+
+    }
+
+    //
+    // Append event to calling threads ring buffer (dropped if full).
+    //
+
+    static void recordEvent(char phase, const char *name, const char *category, std::string_view detail) {
+
+        ThreadBuffer& buffer { getThreadBuffer() };
+
+        std::uint64_t head { buffer.head.load(std::memory_order_relaxed) };
+        if (head - buffer.tail.load(std::memory_order_acquire) >= kRingSize) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        TraceEvent& event { buffer.events[head & (kRingSize - 1)] };
+        event.timeStamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        event.name = name;
+        event.category = category;
+        event.phase = phase;
+        std::size_t length { std::min(detail.size(), kMaxDetail - 1) };
+        std::memcpy(event.detail, detail.data(), length);
+        event.detail[length] = '\0';
+
+        buffer.head.store(head + 1, std::memory_order_release);
+
+    }
+
+    //
+    // Write JSON string (escaped).
+    //
+
+    static void writeString(std::ostream& output, const char *value) {
+
+        output << '"';
+        for (; *value != '\0'; value++) {
+            unsigned char ch = static_cast<unsigned char>(*value);
+            if ((ch == '"') || (ch == '\\')) {
+                output << '\\' << ch;
+            } else if (ch < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof (escaped), "\\u%04x", ch);
+                output << escaped;
+            } else if (ch >= 0x80) {         // Detail may be truncated mid UTF-8 sequence
+                output << '?';
+            } else {
+                output << ch;
+            }
+        }
+        output << '"';
+
+    }
+
+    //
+    // Drain all thread buffers to the trace file. Called with tracer mutex held.
+    //
+
+    static void flushBuffers() {
+
+        std::int64_t startNanoseconds { std::chrono::duration_cast<std::chrono::nanoseconds>(
+                tracer.startTime.time_since_epoch()).count() };
+        long processId { ::getpid() };
+
+        for (auto& buffer : tracer.buffers) {
+            std::uint64_t tail { buffer->tail.load(std::memory_order_relaxed) };
+            std::uint64_t head { buffer->head.load(std::memory_order_acquire) };
+            for (; tail != head; tail++) {
+                const TraceEvent& event { buffer->events[tail & (kRingSize - 1)] };
+                char timeStamp[32];
+                std::snprintf(timeStamp, sizeof (timeStamp), "%.3f",
+                        static_cast<double>(event.timeStamp - startNanoseconds) / 1000.0);
+                tracer.traceFile << (tracer.bFirstEvent ? "\n" : ",\n") << "{\"name\":";
+                writeString(tracer.traceFile, event.name);
+                tracer.traceFile << ",\"cat\":";
+                writeString(tracer.traceFile, event.category);
+                tracer.traceFile << ",\"ph\":\"" << event.phase << "\",\"ts\":" << timeStamp
+                        << ",\"pid\":" << processId << ",\"tid\":" << buffer->threadId;
+                if (event.detail[0] != '\0') {
+                    tracer.traceFile << ",\"args\":{\"detail\":";
+                    writeString(tracer.traceFile, event.detail);
+                    tracer.traceFile << "}";
+                }
+                tracer.traceFile << "}";
+                tracer.bFirstEvent = false;
+            }
+            buffer->tail.store(head, std::memory_order_release);
+        }
+
+        tracer.traceFile.flush();
+
+    }
+
+    //
+    // Flush thread: drain buffers every interval until stopped.
+    //
+
+    static void flushTrace() {
+
+        std::unique_lock<std::mutex> lock { tracer.tracerMutex };
+
+        while (!tracer.stopRequested.wait_for(lock, kFlushInterval, [] { return (tracer.bStopping); })) {
+            flushBuffers();
+        }
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    void beginEvent(const char *name, const char *category, std::string_view detail) {
+        recordEvent('B', name, category, detail);
+    }
+
+    void endEvent(const char *name, const char *category) {
+        recordEvent('E', name, category, {});
+    }
+
+    void startTracing(const std::string& fileName) {
+
+        stopTracing();
+
+        std::lock_guard<std::mutex> locker(tracer.tracerMutex);
+
+        tracer.traceFile.open(fileName, std::ios::trunc);
+        if (!tracer.traceFile.is_open()) {
+            throw std::runtime_error("Could not open trace file [" + fileName + "].");
+        }
+
+        // Discard anything recorded by spans still open from a previous trace
+
+        for (auto& buffer : tracer.buffers) {
+            buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+        }
+
+        tracer.traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        tracer.bFirstEvent = true;
+        tracer.bStopping = false;
+        tracer.startTime = std::chrono::steady_clock::now();
+        tracer.flushThread = std::thread(flushTrace);
+
+        bTracing.store(true, std::memory_order_relaxed);
+
+    }
+
+    void stopTracing() {
+
+        {
+            std::lock_guard<std::mutex> locker(tracer.tracerMutex);
+            if (!tracer.flushThread.joinable()) {
+                return;
+            }
+            bTracing.store(false, std::memory_order_relaxed);
+            tracer.bStopping = true;
+        }
+
+        tracer.stopRequested.notify_all();
+        tracer.flushThread.join();
+
+        std::lock_guard<std::mutex> locker(tracer.tracerMutex);
+
+        flushBuffers();
+
+        std::uint64_t dropped { 0 };
+        for (auto& buffer : tracer.buffers) {
+            dropped += buffer->dropped.load(std::memory_order_relaxed);
+        }
+
+        tracer.traceFile << (tracer.bFirstEvent ? "\n" : ",\n")
+                << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << ::getpid()
+                << ",\"args\":{\"name\":\"Pendulum\"}}\n],\"otherData\":{\"droppedEvents\":\"" << dropped << "\"}}\n";
+        tracer.traceFile.close();
+
+    }
+
+} // namespace Pendulum_Trace
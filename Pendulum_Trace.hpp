@@ -0,0 +1,93 @@
+#ifndef PENDULUM_TRACE_HPP
+#define PENDULUM_TRACE_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Trace {
+
+    //
+    // Tracing enabled flag (the only cost of a span when tracing is off is one
+    // relaxed load of this).
+    //
+
+    extern std::atomic<bool> bTracing;
+
+    inline bool isTracing() {
+        return (bTracing.load(std::memory_order_relaxed));
+    }
+
+    //
+    // Record span begin/end events on the calling thread. Name and category must
+    // be string literals (only their pointers are kept); detail is copied (truncated).
+    //
+
+    void beginEvent(const char *name, const char *category, std::string_view detail);
+    void endEvent(const char *name, const char *category);
+
+    //
+    // Span from construction to destruction with optional detail (for example the
+    // command sent or a message UID).
+    //
+
+    class Span {
+    public:
+
+        Span(const char *name, const char *category, std::string_view detail = {})
+        : name(name), category(category), bActive(isTracing()) {
+            if (bActive) {
+                beginEvent(name, category, detail);
+            }
+        }
+
+        Span(const char *name, const char *category, std::uint64_t value)
+        : name(name), category(category), bActive(isTracing()) {
+            if (bActive) {
+                char detail[24];
+                beginEvent(name, category, std::string_view(detail, std::to_chars(detail, detail + sizeof (detail), value).ptr - detail));
+            }
+        }
+
+        ~Span() {
+            if (bActive) {
+                endEvent(name, category);
+            }
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+
+        const char *name;
+        const char *category;
+        bool bActive;
+
+    };
+
+    //
+    // Start tracing to a Chrome trace (JSON) file viewable in Perfetto or
+    // chrome://tracing. Events are flushed to it by a background thread.
+    //
+
+    void startTracing(const std::string& fileName);
+
+    //
+    // Stop tracing; remaining events are flushed and the file completed.
+    //
+
+    void stopTracing();
+
+} // namespace Pendulum_Trace
+#endif /* PENDULUM_TRACE_HPP */
@@ -0,0 +1,637 @@
+
+//
+// Module: Pendulum_Verify
+//
+// Description: Pendulum archive verification. Every .eml file written has its SHA-256
+// appended to its mailbox folder's checksum manifest; verification walks the archive
+// and checks each folder's files against its manifest, reporting any whose contents
+// have changed, any missing and any not in the manifest (which can instead be added to
+// it, so that archives written before manifests were kept can be seeded). Folders are
+// scanned and files hashed (memory mapped) by a pool of workers each with its own deque
+// of work, idle workers stealing from the others, so a large archive is checked at disk
+// speed rather than a file at a time. Optionally the UIDs archived for each mailbox are compared
+// with those on the server.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CPath.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <fstream>
+#include <deque>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+//
+// Linux
+//
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//
+// Antik Classes
+//
+
+#include "CPath.hpp"
+
+//
+// Pendulum components
+//
+
+#include "Pendulum.hpp"
+#include "Pendulum_Verify.hpp"
+#include "Pendulum_File.hpp"
+#include "Pendulum_Metrics.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Verify {
+
+    // =======
+    // IMPORTS
+    // =======
+
+    using namespace Pendulum_MailBox;
+    using namespace Antik::File;
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    //
+    // Length of a SHA-256 checksum (hex)
+    //
+
+    constexpr std::size_t kChecksumLength { 64 };
+
+    //
+    // Wait before an idle worker looks for work to steal again
+    //
+
+    constexpr std::chrono::microseconds kIdleWait { 200 };
+
+    // ===============
+    // LOCAL VARIABLES
+    // ===============
+
+    //
+    // Work for the scanner: a folder to scan or (checksum given) a file to hash.
+    //
+
+    struct Work {
+        std::string path;
+        std::string checksum;
+    };
+
+    //
+    // Results counted by the workers
+    //
+
+    struct ScanResults {
+        std::atomic<std::uint64_t> folders { 0 };
+        std::atomic<std::uint64_t> files { 0 };
+        std::atomic<std::uint64_t> bytes { 0 };
+        std::atomic<std::uint64_t> mismatched { 0 };
+        std::atomic<std::uint64_t> missing { 0 };
+        std::atomic<std::uint64_t> extra { 0 };
+        std::atomic<std::uint64_t> added { 0 };
+        std::atomic<std::uint64_t> unreadable { 0 };
+    };
+
+    //
+    // Work stealing scanner. Each worker takes work from the back of its own deque
+    // (so the files of the folder it just scanned are hashed while their directory
+    // entries are still cached) and when that is empty steals from the front of
+    // another's, where the oldest and usually largest pieces of work (folders) are.
+    //
+
+    class Scanner {
+    public:
+
+        explicit Scanner(std::size_t workerCount) {
+            for (std::size_t workerNo = 0; workerNo < workerCount; workerNo++) {
+                queues.push_back(std::make_unique<WorkQueue>());
+            }
+        }
+
+        void push(std::size_t workerNo, Work work) {
+            pending++;
+            std::unique_lock<std::mutex> locker(queues[workerNo]->mutex);
+            queues[workerNo]->work.push_back(std::move(work));
+        }
+
+        //
+        // Run workers until all work (including any they push) is done.
+        //
+
+        void run(const std::function<void(std::size_t, Work&)>& process) {
+
+            std::vector<std::thread> workers;
+
+            for (std::size_t workerNo = 0; workerNo < queues.size(); workerNo++) {
+                workers.emplace_back([this, workerNo, &process]() {
+                    Work work;
+                    while (pending) {
+                        if (pop(workerNo, work) || steal(workerNo, work)) {
+                            try {
+                                process(workerNo, work);
+                            } catch (const std::exception& e) {
+                                Pendulum_Log::error("Verify [" + work.path + "] failed: " + e.what(),
+                                                    Pendulum_Log::Fields().withFile(work.path));
+                            }
+                            pending--;
+                        } else {
+                            std::this_thread::sleep_for(kIdleWait);
+                        }
+                    }
+                });
+            }
+
+            for (auto& worker : workers) {
+                worker.join();
+            }
+
+        }
+
+    private:
+
+        struct WorkQueue {
+            std::mutex mutex;
+            std::deque<Work> work;
+        };
+
+        bool pop(std::size_t workerNo, Work& work) {
+            std::unique_lock<std::mutex> locker(queues[workerNo]->mutex);
+            if (queues[workerNo]->work.empty()) {
+                return (false);
+            }
+            work = std::move(queues[workerNo]->work.back());
+            queues[workerNo]->work.pop_back();
+            return (true);
+        }
+
+        bool steal(std::size_t workerNo, Work& work) {
+            for (std::size_t victimNo = 1; victimNo < queues.size(); victimNo++) {
+                WorkQueue& victim { *queues[(workerNo + victimNo) % queues.size()] };
+                std::unique_lock<std::mutex> locker(victim.mutex);
+                if (!victim.work.empty()) {
+                    work = std::move(victim.work.front());
+                    victim.work.pop_front();
+                    return (true);
+                }
+            }
+            return (false);
+        }
+
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::atomic<std::size_t> pending { 0 };     // Work pushed and not yet done
+
+    };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Read a folder's checksum manifest into a file name to checksum map (false if none).
+    //
+
+    static bool readManifest(const std::string& folder, std::map<std::string, std::string>& manifest) {
+
+        CPath manifestPath { folder };
+        manifestPath.join(Pendulum_File::kChecksumFileName);
+
+        std::ifstream manifestStream { manifestPath.toString() };
+        if (!manifestStream.is_open()) {
+            return (false);
+        }
+
+        // "checksum  file name" (or "checksum *file name"); the last line for a file wins
+
+        std::string line;
+        while (std::getline(manifestStream, line)) {
+            if ((line.size() > kChecksumLength + 2) && (line[kChecksumLength] == ' ')) {
+                manifest[line.substr(kChecksumLength + 2)] = line.substr(0, kChecksumLength);
+            }
+        }
+
+        return (true);
+
+    }
+
+    //
+    // Hash a file (memory mapped), returning its checksum and size (false if unreadable).
+    //
+
+    static bool hashFile(const std::string& fileName, std::string& checksum, std::size_t& fileSize, ScanResults& results) {
+
+        static Pendulum_Metrics::Counter& filesVerified { Pendulum_Metrics::counter("pendulum_verify_files_total", ".eml files verified.") };
+        static Pendulum_Metrics::Counter& bytesVerified { Pendulum_Metrics::counter("pendulum_verify_bytes_total", "Bytes of .eml files verified.") };
+
+        int fileDescriptor { ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC) };
+        struct stat fileStatus {};
+
+        if ((fileDescriptor < 0) || (::fstat(fileDescriptor, &fileStatus) != 0)) {
+            if (fileDescriptor >= 0) {
+                ::close(fileDescriptor);
+            }
+            results.unreadable++;
+            Pendulum_Log::error("Could not read [" + fileName + "]: " + std::strerror(errno), Pendulum_Log::Fields().withFile(fileName));
+            return (false);
+        }
+
+        fileSize = static_cast<std::size_t>(fileStatus.st_size);
+        void *contents { nullptr };
+
+        if (fileSize > 0) {
+            contents = ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+            if (contents == MAP_FAILED) {
+                ::close(fileDescriptor);
+                results.unreadable++;
+                Pendulum_Log::error("Could not map [" + fileName + "]: " + std::strerror(errno), Pendulum_Log::Fields().withFile(fileName));
+                return (false);
+            }
+            ::madvise(contents, fileSize, MADV_SEQUENTIAL);
+        }
+        ::close(fileDescriptor);
+
+        checksum = Pendulum_File::fileChecksum(std::string_view(static_cast<const char *>(contents), fileSize));
+
+        if (contents) {
+            ::munmap(contents, fileSize);
+        }
+
+        results.files++;
+        results.bytes += fileSize;
+        filesVerified.add();
+        bytesVerified.add(fileSize);
+
+        return (true);
+
+    }
+
+    //
+    // Hash a file and check it against its manifest checksum.
+    //
+
+    static void verifyFile(const Work& work, ScanResults& results) {
+
+        std::string checksum;
+        std::size_t fileSize { 0 };
+
+        if (!hashFile(work.path, checksum, fileSize, results)) {
+            return;
+        }
+
+        if (checksum != work.checksum) {
+            results.mismatched++;
+            Pendulum_Log::error("Checksum mismatch [" + work.path + "]", Pendulum_Log::Fields().withFile(work.path).withBytes(fileSize));
+        }
+
+    }
+
+    //
+    // Add files not in a folder's checksum manifest to it (creating it if there is none).
+    // They are hashed and appended by the worker that scanned the folder so a manifest
+    // only ever has one writer.
+    //
+
+    static void addToManifest(const std::string& folder, const std::set<std::string>& emlFiles, ScanResults& results) {
+
+        CPath manifestPath { folder };
+        manifestPath.join(Pendulum_File::kChecksumFileName);
+
+        std::ofstream manifestStream { manifestPath.toString(), std::ios::app };
+        if (!manifestStream.is_open()) {
+            results.unreadable++;
+            Pendulum_Log::error("Could not update checksum manifest [" + manifestPath.toString() + "]: " + std::strerror(errno),
+                                Pendulum_Log::Fields().withFile(manifestPath.toString()));
+            return;
+        }
+
+        std::uint64_t addedCount { 0 };
+
+        for (auto& fileName : emlFiles) {
+            CPath filePath { folder };
+            filePath.join(fileName);
+            std::string checksum;
+            std::size_t fileSize { 0 };
+            if (hashFile(filePath.toString(), checksum, fileSize, results)) {
+                manifestStream << checksum << "  " << fileName << '\n';
+                addedCount++;
+            }
+        }
+
+        manifestStream.flush();
+        if (!manifestStream) {
+            results.unreadable++;
+            Pendulum_Log::error("Could not update checksum manifest [" + manifestPath.toString() + "]", Pendulum_Log::Fields().withFile(manifestPath.toString()));
+            return;
+        }
+
+        results.added += addedCount;
+        Pendulum_Log::info("Added " + std::to_string(addedCount) + " files to checksum manifest [" + manifestPath.toString() + "]",
+                           Pendulum_Log::Fields().withFile(manifestPath.toString()).withCount(addedCount));
+
+    }
+
+    //
+    // Scan a folder: queue its sub-folders, check its .eml files against its manifest
+    // and queue those present to be hashed. Files not in the manifest are reported or
+    // (bUpdateManifest) added to it.
+    //
+
+    static void scanFolder(Scanner& scanner, std::size_t workerNo, const std::string& folder, bool bUpdateManifest, ScanResults& results) {
+
+        std::set<std::string> emlFiles;
+        DIR *directory { ::opendir(folder.c_str()) };
+
+        if (!directory) {
+            results.unreadable++;
+            Pendulum_Log::error("Could not read folder [" + folder + "]: " + std::strerror(errno), Pendulum_Log::Fields().withFile(folder));
+            return;
+        }
+
+        results.folders++;
+
+        while (struct dirent *entry = ::readdir(directory)) {
+            std::string name { entry->d_name };
+            if ((name == ".") || (name == "..")) {
+                continue;
+            }
+            CPath entryPath { folder };
+            entryPath.join(name);
+            unsigned char entryType { entry->d_type };
+            if (entryType == DT_UNKNOWN) {
+                struct stat entryStatus {};
+                if (::lstat(entryPath.toString().c_str(), &entryStatus) == 0) {
+                    entryType = S_ISDIR(entryStatus.st_mode) ? DT_DIR : (S_ISREG(entryStatus.st_mode) ? DT_REG : DT_UNKNOWN);
+                }
+            }
+            if (entryType == DT_DIR) {
+                scanner.push(workerNo, { entryPath.toString(), "" });
+            } else if ((entryType == DT_REG) && (name.size() > std::strlen(Pendulum::kEMLFileExt)) &&
+                       (name.compare(name.size() - std::strlen(Pendulum::kEMLFileExt), std::string::npos, Pendulum::kEMLFileExt) == 0)) {
+                emlFiles.insert(name);
+            }
+        }
+
+        ::closedir(directory);
+
+        std::map<std::string, std::string> manifest;
+
+        if (!readManifest(folder, manifest) && !bUpdateManifest) {
+            if (!emlFiles.empty()) {
+                results.extra += emlFiles.size();
+                Pendulum_Log::warning("No checksum manifest for " + std::to_string(emlFiles.size()) + " files in [" + folder + "]",
+                                      Pendulum_Log::Fields().withFile(folder).withCount(emlFiles.size()));
+            }
+            return;
+        }
+
+        for (auto& [fileName, checksum] : manifest) {
+            CPath filePath { folder };
+            filePath.join(fileName);
+            if (emlFiles.erase(fileName)) {
+                scanner.push(workerNo, { filePath.toString(), checksum });
+            } else {
+                results.missing++;
+                Pendulum_Log::error("Missing [" + filePath.toString() + "]", Pendulum_Log::Fields().withFile(filePath.toString()));
+            }
+        }
+
+        if (bUpdateManifest) {
+            if (!emlFiles.empty()) {
+                addToManifest(folder, emlFiles, results);
+            }
+            return;
+        }
+
+        for (auto& fileName : emlFiles) {
+            CPath filePath { folder };
+            filePath.join(fileName);
+            results.extra++;
+            Pendulum_Log::warning("Not in checksum manifest [" + filePath.toString() + "]", Pendulum_Log::Fields().withFile(filePath.toString()));
+        }
+
+    }
+
+    //
+    // UIDs of the .eml files in a mailbox folder (not its sub-folders), sorted.
+    //
+
+    static std::vector<std::uint64_t> archivedUIDs(const std::string& folder) {
+
+        std::vector<std::uint64_t> messageUID;
+        DIR *directory { ::opendir(folder.c_str()) };
+
+        if (directory) {
+            while (struct dirent *entry = ::readdir(directory)) {
+                std::string name { entry->d_name };
+                if ((name.front() == '(') && (name.find(") ") != std::string::npos) &&
+                    (name.size() > std::strlen(Pendulum::kEMLFileExt)) &&
+                    (name.compare(name.size() - std::strlen(Pendulum::kEMLFileExt), std::string::npos, Pendulum::kEMLFileExt) == 0)) {
+                    messageUID.push_back(std::strtoull(name.c_str() + 1, nullptr, 10));
+                }
+            }
+            ::closedir(directory);
+        }
+
+        std::sort(messageUID.begin(), messageUID.end());
+
+        return (messageUID);
+
+    }
+
+    //
+    // Remove from UIDs on the server but not archived those the archiver skips on purpose:
+    // excluded by a policy rule the server can't apply (checked against an envelope
+    // prefetch as when archiving) or empty (createEMLFile() writes no file for them).
+    //
+
+    static void removeSkippedUIDs(ServerConnection& imapConnection, const Pendulum_Policy::ArchivePolicy& archivePolicy,
+                                  std::vector<std::uint64_t>& notArchived, std::uint64_t& excludedCount, std::uint64_t& emptyCount) {
+
+        bool bPrefetch { Pendulum_Policy::needsPrefetch(archivePolicy) };
+        std::vector<std::uint64_t> missedUID;
+
+        for (auto& envelope : fetchMessageEnvelopes(imapConnection, notArchived, !bPrefetch)) {
+            if (bPrefetch && !Pendulum_Policy::isMessageArchived(archivePolicy, envelope)) {
+                excludedCount++;
+            } else if (envelope.size == 0) {
+                emptyCount++;
+            } else {
+                missedUID.push_back(envelope.uid);
+            }
+        }
+
+        std::sort(missedUID.begin(), missedUID.end());
+
+        notArchived = std::move(missedUID);
+
+    }
+
+    //
+    // List up to kReportUIDs UIDs.
+    //
+
+    static std::string listUIDs(const std::vector<std::uint64_t>& messageUID) {
+
+        std::string uidList;
+
+        for (std::size_t uidNo = 0; uidNo < std::min(messageUID.size(), kReportUIDs); uidNo++) {
+            uidList += (uidNo ? "," : "") + std::to_string(messageUID[uidNo]);
+        }
+        if (messageUID.size() > kReportUIDs) {
+            uidList += ",...";
+        }
+
+        return (uidList);
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    VerifyResults verifyArchive(const std::string& archiveFolder, std::size_t workerCount, bool bUpdateManifest) {
+
+        ScanResults scanResults;
+        Scanner scanner { std::max<std::size_t>(workerCount, 1) };
+
+        scanner.push(0, { archiveFolder, "" });
+
+        scanner.run([&scanner, &scanResults, bUpdateManifest](std::size_t workerNo, Work& work) {
+            if (work.checksum.empty()) {
+                scanFolder(scanner, workerNo, work.path, bUpdateManifest, scanResults);
+            } else {
+                verifyFile(work, scanResults);
+            }
+        });
+
+        VerifyResults results;
+
+        results.folders = scanResults.folders;
+        results.files = scanResults.files;
+        results.bytes = scanResults.bytes;
+        results.mismatched = scanResults.mismatched;
+        results.missing = scanResults.missing;
+        results.extra = scanResults.extra;
+        results.added = scanResults.added;
+        results.unreadable = scanResults.unreadable;
+
+        return (results);
+
+    }
+
+    void compareWithServer(ServerConnection& imapConnection, const std::vector<MailBoxDetails>& mailBoxList,
+                           const std::string& archiveFolder, const Pendulum_Policy::ArchivePolicy& archivePolicy,
+                           const std::string& searchCriteria, VerifyResults& results) {
+
+        // Nothing is changed on the server
+
+        imapConnection.bReadOnly = true;
+
+        for (auto& mailBoxEntry : mailBoxList) {
+
+            MailBoxDetails searchEntry { mailBoxEntry };
+            searchEntry.searchUID = 0;
+
+            std::vector<std::uint64_t> serverUID { fetchMailBoxMessages(imapConnection, searchEntry, searchCriteria) };
+            std::vector<std::uint64_t> archiveUID { archivedUIDs(Pendulum_File::mailBoxFolder(archiveFolder, mailBoxEntry.name)) };
+            std::vector<std::uint64_t> notArchived, notOnServer;
+
+            std::sort(serverUID.begin(), serverUID.end());
+            std::set_difference(serverUID.begin(), serverUID.end(), archiveUID.begin(), archiveUID.end(), std::back_inserter(notArchived));
+            std::set_difference(archiveUID.begin(), archiveUID.end(), serverUID.begin(), serverUID.end(), std::back_inserter(notOnServer));
+
+            std::uint64_t excludedCount { 0 };
+            std::uint64_t emptyCount { 0 };
+
+            if (!notArchived.empty()) {
+                removeSkippedUIDs(imapConnection, archivePolicy, notArchived, excludedCount, emptyCount);
+            }
+            if (excludedCount || emptyCount) {
+                Pendulum_Log::info("Messages on server skipped by archiver = " + std::to_string(excludedCount + emptyCount)
+                                   + " (excluded by policy = " + std::to_string(excludedCount) + ", empty = " + std::to_string(emptyCount) + ")",
+                                   Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(excludedCount + emptyCount));
+            }
+
+            if (!notArchived.empty()) {
+                Pendulum_Log::error("Messages on server not archived = " + std::to_string(notArchived.size()) + " [" + listUIDs(notArchived) + "]",
+                                    Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(notArchived.size()));
+            }
+            if (!notOnServer.empty()) {
+                Pendulum_Log::info("Archived messages no longer on server = " + std::to_string(notOnServer.size()) + " [" + listUIDs(notOnServer) + "]",
+                                   Pendulum_Log::Fields().withMailBox(mailBoxEntry.name).withCount(notOnServer.size()));
+            }
+
+            results.notArchived += notArchived.size();
+            results.excluded += excludedCount;
+            results.empty += emptyCount;
+            results.notOnServer += notOnServer.size();
+
+        }
+
+        imapConnection.bReadOnly = false;
+
+    }
+
+    std::string formatResults(const VerifyResults& results) {
+
+        std::string summary { "Folders = " + std::to_string(results.folders)
+                              + ", files verified = " + std::to_string(results.files)
+                              + ", bytes = " + std::to_string(results.bytes)
+                              + ", mismatched = " + std::to_string(results.mismatched)
+                              + ", missing = " + std::to_string(results.missing)
+                              + ", not in manifest = " + std::to_string(results.extra)
+                              + ", unreadable = " + std::to_string(results.unreadable) };
+
+        if (results.added) {
+            summary += ", added to manifest = " + std::to_string(results.added);
+        }
+
+        if (results.notArchived || results.notOnServer || results.excluded || results.empty) {
+            summary += ", not archived = " + std::to_string(results.notArchived)
+                       + ", no longer on server = " + std::to_string(results.notOnServer)
+                       + ", excluded by policy = " + std::to_string(results.excluded)
+                       + ", empty = " + std::to_string(results.empty);
+        }
+
+        return (summary);
+
+    }
+
+    bool hasProblems(const VerifyResults& results) {
+        return (results.mismatched || results.missing || results.unreadable || results.notArchived);
+    }
+
+} // namespace Pendulum_Verify
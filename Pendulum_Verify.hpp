@@ -0,0 +1,84 @@
+#ifndef PENDULUM_VERIFY_HPP
+#define PENDULUM_VERIFY_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//
+// Pendulum mailbox
+//
+
+#include "Pendulum_MailBox.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_Verify {
+
+    //
+    // Problems with up to kReportUIDs UIDs are listed in full when comparing against
+    // the server; more are only counted.
+    //
+
+    constexpr std::size_t kReportUIDs { 20 };
+
+    //
+    // Verification results
+    //
+
+    struct VerifyResults {
+        std::uint64_t folders { 0 };            // Folders scanned
+        std::uint64_t files { 0 };              // .eml files hashed
+        std::uint64_t bytes { 0 };              // Bytes hashed
+        std::uint64_t mismatched { 0 };         // Checksum differs from manifest
+        std::uint64_t missing { 0 };            // In manifest but no file
+        std::uint64_t extra { 0 };              // File not in manifest (reported, not a problem)
+        std::uint64_t added { 0 };              // File not in manifest added to it
+        std::uint64_t unreadable { 0 };         // File could not be read
+        std::uint64_t notArchived { 0 };        // On server but not archived
+        std::uint64_t excluded { 0 };           // On server but excluded by archive policy (not a problem)
+        std::uint64_t empty { 0 };              // On server but empty so never archived (not a problem)
+        std::uint64_t notOnServer { 0 };        // Archived but no longer on server (moved or deleted)
+    };
+
+    //
+    // Verify every mailbox folder under an archive folder against its checksum manifest,
+    // hashing files on workerCount threads. Problems are logged as found. If bUpdateManifest
+    // then files not in a folder's manifest (such as those archived before manifests were
+    // kept) are hashed and added to it, the manifest being created if there is none.
+    //
+
+    VerifyResults verifyArchive(const std::string& archiveFolder, std::size_t workerCount, bool bUpdateManifest);
+
+    //
+    // Compare the UIDs archived for each mailbox with those on the server (found by
+    // searchCriteria), adding the differences to results. Messages the archiver skips
+    // on purpose (excluded by archivePolicy rules applied to an envelope prefetch, or
+    // with an empty body) are counted apart from those not archived.
+    //
+
+    void compareWithServer(Pendulum_MailBox::ServerConnection& imapConnection, const std::vector<Pendulum_MailBox::MailBoxDetails>& mailBoxList,
+                           const std::string& archiveFolder, const Pendulum_Policy::ArchivePolicy& archivePolicy,
+                           const std::string& searchCriteria, VerifyResults& results);
+
+    //
+    // Results summary (one line).
+    //
+
+    std::string formatResults(const VerifyResults& results);
+
+    //
+    // Results contain any problem with the archive (files not in a manifest are not one).
+    //
+
+    bool hasProblems(const VerifyResults& results);
+
+} // namespace Pendulum_Verify
+#endif /* PENDULUM_VERIFY_HPP */
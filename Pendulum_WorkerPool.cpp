@@ -0,0 +1,143 @@
+
+//
+// Module: Pendulum_WorkerPool
+//
+// Description: Pendulum worker thread pool with a bounded task queue. Exceptions
+// thrown by a task are reported and do not take down the worker.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <exception>
+
+//
+// Pendulum worker pool
+//
+
+#include "Pendulum_WorkerPool.hpp"
+#include "Pendulum_Log.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_WorkerPool {
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Worker thread; run tasks until pool stopped and queue drained.
+    //
+
+    void WorkerPool::worker() {
+
+        while (true) {
+
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock { queueMutex };
+                taskAvailable.wait(lock, [this] { return (bStopping || !tasks.empty()); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                activeTasks++;
+            }
+
+            spaceAvailable.notify_one();
+
+            try {
+                task();
+            } catch (const std::exception& e) {
+                Pendulum_Log::error(std::string("Worker task failed: ") + e.what());
+            }
+
+            {
+                std::unique_lock<std::mutex> lock { queueMutex };
+                activeTasks--;
+                if (tasks.empty() && (activeTasks == 0)) {
+                    idle.notify_all();
+                }
+            }
+
+        }
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    WorkerPool::WorkerPool(std::size_t workerCount, std::size_t queueLimit) : queueLimit { queueLimit ? queueLimit : 1 } {
+
+        if (workerCount == 0) {
+            workerCount = 1;
+        }
+
+        for (std::size_t workerNo = 0; workerNo < workerCount; workerNo++) {
+            workers.emplace_back(&WorkerPool::worker, this);
+        }
+
+    }
+
+    WorkerPool::~WorkerPool() {
+
+        {
+            std::unique_lock<std::mutex> lock { queueMutex };
+            bStopping = true;
+        }
+
+        taskAvailable.notify_all();
+
+        for (auto& workerThread : workers) {
+            workerThread.join();
+        }
+
+    }
+
+    void WorkerPool::submit(std::function<void()> task) {
+
+        {
+            std::unique_lock<std::mutex> lock { queueMutex };
+            spaceAvailable.wait(lock, [this] { return (tasks.size() < queueLimit); });
+            tasks.push_back(std::move(task));
+        }
+
+        taskAvailable.notify_one();
+
+    }
+
+    void WorkerPool::waitIdle() {
+
+        std::unique_lock<std::mutex> lock { queueMutex };
+        idle.wait(lock, [this] { return (tasks.empty() && (activeTasks == 0)); });
+
+    }
+
+    std::size_t WorkerPool::queueDepth() {
+
+        std::unique_lock<std::mutex> lock { queueMutex };
+        return (tasks.size());
+
+    }
+
+    std::size_t WorkerPool::workerCount() const {
+        return (workers.size());
+    }
+
+} // namespace Pendulum_WorkerPool
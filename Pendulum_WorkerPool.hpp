@@ -0,0 +1,78 @@
+#ifndef PENDULUM_WORKERPOOL_HPP
+#define PENDULUM_WORKERPOOL_HPP
+
+//
+// C++ STL
+//
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace Pendulum_WorkerPool {
+
+    //
+    // Fixed size pool of worker threads taking tasks from a bounded queue. When
+    // the queue is full submit() blocks, which keeps the memory used by queued
+    // work bounded however fast it is produced.
+    //
+
+    class WorkerPool {
+    public:
+
+        WorkerPool(std::size_t workerCount, std::size_t queueLimit);
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        //
+        // Queue task (blocking while queue is full).
+        //
+
+        void submit(std::function<void()> task);
+
+        //
+        // Wait until the queue is empty and all workers are idle.
+        //
+
+        void waitIdle();
+
+        //
+        // Current number of queued (not yet started) tasks.
+        //
+
+        std::size_t queueDepth();
+
+        //
+        // Number of worker threads.
+        //
+
+        std::size_t workerCount() const;
+
+    private:
+
+        void worker();
+
+        std::vector<std::thread> workers;           // Worker threads
+        std::deque<std::function<void()>> tasks;    // Queued tasks
+        std::size_t queueLimit;                     // Maximum queued tasks
+        std::size_t activeTasks { 0 };              // Tasks being run
+        bool bStopping { false };                   // = true workers to exit
+        std::mutex queueMutex;
+        std::condition_variable taskAvailable;
+        std::condition_variable spaceAvailable;
+        std::condition_variable idle;
+
+    };
+
+} // namespace Pendulum_WorkerPool
+#endif /* PENDULUM_WORKERPOOL_HPP */
@@ -29,14 +29,31 @@ SOURCES += \
         main.cpp \
         pendulummainwindow.cpp \
         connectiondetailsdialog.cpp \
-        connectiondialog.cpp
+        connectiondialog.cpp \
+        pendulumprocess.cpp \
+        throughputgraph.cpp \
+        archivesupervisor.cpp \
+        supervisordialog.cpp \
+        archivemodel.cpp \
+        indexscanner.cpp \
+        archivebrowserdialog.cpp
 
 HEADERS += \
         pendulummainwindow.h \
         connectiondetailsdialog.h \
-        connectiondialog.h
+        connectiondialog.h \
+        pendulumprocess.h \
+        throughputgraph.h \
+        archivesupervisor.h \
+        supervisordialog.h \
+        archivemodel.h \
+        indexscanner.h \
+        archivebrowserdialog.h \
+        ../Pendulum_File.hpp
 
 FORMS += \
         pendulummainwindow.ui \
         connectiondetailsdialog.ui \
-        connectiondialog.ui
+        connectiondialog.ui \
+        supervisordialog.ui \
+        archivebrowserdialog.ui
@@ -0,0 +1,150 @@
+#include "archivebrowserdialog.h"
+#include "ui_archivebrowserdialog.h"
+
+#include <QDirIterator>
+#include <QHeaderView>
+
+ArchiveBrowserDialog::ArchiveBrowserDialog(const QString& connectionName, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ArchiveBrowserDialog), connectionName(connectionName)
+{
+    ui->setupUi(this);
+
+    this->setWindowTitle(this->connectionName + " Archive");
+
+    QSettings pendulumSettings;
+
+    pendulumSettings.beginGroup(this->connectionName);
+    restoreGeometry(pendulumSettings.value("browserGeometry").toByteArray());
+    this->destinationFolder = pendulumSettings.value("destination").toString();
+    pendulumSettings.endGroup();
+
+    // Mailbox folders (names with a hierarchy are archived to nested folders)
+
+    QDir destination(this->destinationFolder);
+    QDirIterator mailBoxFolders(this->destinationFolder, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    QStringList mailBoxNames;
+
+    while (mailBoxFolders.hasNext()) {
+        mailBoxNames.append(destination.relativeFilePath(mailBoxFolders.next()));
+    }
+    mailBoxNames.sort();
+
+    ui->mailBoxList->addItems(mailBoxNames);
+
+    ui->messageView->setModel(&this->archiveModel);
+    ui->messageView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    ui->messageView->setSelectionMode(QAbstractItemView::SingleSelection);
+    ui->messageView->setSortingEnabled(true);
+    ui->messageView->sortByColumn(ArchiveModel::kUID, Qt::AscendingOrder);
+    ui->messageView->horizontalHeader()->setStretchLastSection(true);
+    ui->messageView->verticalHeader()->setVisible(false);
+    ui->messageView->verticalHeader()->setDefaultSectionSize(ui->messageView->fontMetrics().height() + 4);
+
+    ui->messagePreview->setReadOnly(true);
+
+    connect (ui->mailBoxList, SIGNAL(currentTextChanged(QString)), this, SLOT(mailBoxSelected(QString)));
+    connect (ui->messageView->selectionModel(), SIGNAL(currentRowChanged(QModelIndex,QModelIndex)),
+             this, SLOT(messageSelected(QModelIndex,QModelIndex)));
+    connect (&this->archiveModel, SIGNAL(scanProgress(int)), this, SLOT(scanProgress(int)));
+    connect (&this->archiveModel, SIGNAL(scanFinished()), this, SLOT(scanFinished()));
+    connect (ui->refresh, SIGNAL(clicked()), this, SLOT(refresh()));
+
+    if (ui->mailBoxList->count() > 0) {
+        ui->mailBoxList->setCurrentRow(0);
+    } else {
+        ui->statusLabel->setText("Nothing archived to " + this->destinationFolder);
+    }
+
+}
+
+ArchiveBrowserDialog::~ArchiveBrowserDialog()
+{
+    delete ui;
+}
+
+void ArchiveBrowserDialog::updateStatus()
+{
+    ui->statusLabel->setText(QString("%1 messages").arg(this->archiveModel.messageCount()));
+}
+
+void ArchiveBrowserDialog::mailBoxSelected(const QString& mailBoxName)
+{
+
+    ui->messagePreview->clear();
+    ui->statusLabel->clear();
+
+    this->archiveModel.setMailBoxFolder(QDir(this->destinationFolder).filePath(mailBoxName));
+
+    updateStatus();
+
+}
+
+//
+// Only the start of a large message is shown; the rest of the file is never touched.
+//
+
+void ArchiveBrowserDialog::messageSelected(const QModelIndex& current, const QModelIndex& previous)
+{
+
+    Q_UNUSED(previous);
+
+    ui->messagePreview->clear();
+
+    QFile emlFile(this->archiveModel.filePath(current));
+
+    if (!emlFile.open(QIODevice::ReadOnly)) {
+        ui->messagePreview->setPlainText("Cannot open " + emlFile.fileName());
+        return;
+    }
+
+    qint64 previewSize = qMin<qint64>(emlFile.size(), kMaxPreview);
+    if (previewSize == 0) {
+        return;
+    }
+
+    uchar *message = emlFile.map(0, previewSize);
+    if (message == nullptr) {
+        ui->messagePreview->setPlainText("Cannot map " + emlFile.fileName());
+        return;
+    }
+
+    QString preview = QString::fromUtf8(reinterpret_cast<const char *>(message), static_cast<int>(previewSize));
+    emlFile.unmap(message);
+
+    if (previewSize < emlFile.size()) {
+        preview += QString("\n[%1 more bytes not shown]").arg(emlFile.size() - previewSize);
+    }
+
+    ui->messagePreview->setPlainText(preview);
+
+}
+
+void ArchiveBrowserDialog::scanProgress(int files)
+{
+    ui->statusLabel->setText(QString("No index; scanned %1 files").arg(files));
+}
+
+void ArchiveBrowserDialog::scanFinished()
+{
+    updateStatus();
+}
+
+void ArchiveBrowserDialog::refresh()
+{
+    ui->messagePreview->clear();
+    this->archiveModel.refresh();
+    updateStatus();
+}
+
+void ArchiveBrowserDialog::closeEvent(QCloseEvent *event)
+{
+    QSettings pendulumSettings;
+
+    pendulumSettings.beginGroup(this->connectionName);
+    pendulumSettings.setValue("browserGeometry", saveGeometry());
+    pendulumSettings.endGroup();
+
+    QDialog::closeEvent(event);
+
+}
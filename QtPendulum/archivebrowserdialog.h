@@ -0,0 +1,50 @@
+#ifndef ARCHIVEBROWSERDIALOG_H
+#define ARCHIVEBROWSERDIALOG_H
+
+#include <QDialog>
+#include <QtCore>
+
+#include "archivemodel.h"
+
+namespace Ui {
+class ArchiveBrowserDialog;
+}
+
+//
+// Browse the mailbox folders archived for a connection; a message is previewed
+// by memory mapping just its .eml file.
+//
+
+class ArchiveBrowserDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    static const int kMaxPreview = 256 * 1024;     // Bytes of a message shown
+
+    explicit ArchiveBrowserDialog(const QString& connectionName, QWidget *parent = 0);
+    ~ArchiveBrowserDialog();
+
+private:
+    Ui::ArchiveBrowserDialog *ui;
+
+    QString connectionName;
+    QString destinationFolder;
+
+    ArchiveModel archiveModel;
+
+    void updateStatus();
+
+public slots:
+    void mailBoxSelected(const QString& mailBoxName);
+    void messageSelected(const QModelIndex& current, const QModelIndex& previous);
+    void scanProgress(int files);
+    void scanFinished();
+    void refresh();
+
+protected:
+    void closeEvent(QCloseEvent *);
+
+};
+
+#endif // ARCHIVEBROWSERDIALOG_H
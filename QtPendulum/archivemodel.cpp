@@ -0,0 +1,340 @@
+#include "archivemodel.h"
+#include "indexscanner.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+
+//
+// Index for a mailbox folder; this is in the folder (where pendulum writes it) unless
+// there is none and the folder is read only, in which case a scan is kept in the cache.
+//
+
+static QString indexFileName(const QString& mailBoxFolder)
+{
+
+    QString fileName = QDir(mailBoxFolder).filePath(Pendulum_File::kIndexFileName);
+
+    if (QFileInfo::exists(fileName) || QFileInfo(mailBoxFolder).isWritable()) {
+        return fileName;
+    }
+
+    QString cacheFolder = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir().mkpath(cacheFolder);
+
+    return QDir(cacheFolder).filePath("index-" + QCryptographicHash::hash(mailBoxFolder.toUtf8(), QCryptographicHash::Sha1).toHex());
+
+}
+
+ArchiveModel::ArchiveModel(QObject *parent) :
+    QAbstractTableModel(parent)
+{
+}
+
+ArchiveModel::~ArchiveModel()
+{
+    if (this->scanner != nullptr) {
+        this->scanner->requestInterruption();
+        this->scanner->wait();
+    }
+    unmapIndex();
+}
+
+void ArchiveModel::setMailBoxFolder(const QString& mailBoxFolder)
+{
+
+    if (this->scanner != nullptr) {
+        this->scanner->disconnect(this);
+        this->scanner->requestInterruption();
+        this->scanner->wait();
+        delete this->scanner;
+        this->scanner = nullptr;
+    }
+
+    beginResetModel();
+
+    unmapIndex();
+    this->mailBoxFolder = mailBoxFolder;
+
+    if (!mapIndex() && !mailBoxFolder.isEmpty()) {
+        this->scanner = new IndexScanner(mailBoxFolder, indexFileName(mailBoxFolder), this);
+        connect(this->scanner, SIGNAL(scanProgress(int)), this, SIGNAL(scanProgress(int)));
+        connect(this->scanner, SIGNAL(finished()), this, SLOT(indexScanned()));
+        this->scanner->start(QThread::LowPriority);
+    } else {
+        sortRecords();
+    }
+
+    endResetModel();
+
+}
+
+//
+// Map the index again to pick up messages archived since it was last mapped.
+//
+
+void ArchiveModel::refresh()
+{
+
+    if (this->scanner != nullptr) {
+        return;
+    }
+
+    beginResetModel();
+    unmapIndex();
+    mapIndex();
+    sortRecords();
+    endResetModel();
+
+}
+
+void ArchiveModel::indexScanned()
+{
+
+    this->scanner->deleteLater();
+    this->scanner = nullptr;
+
+    refresh();
+
+    emit scanFinished();
+
+}
+
+bool ArchiveModel::mapIndex()
+{
+
+    this->indexFile.setFileName(indexFileName(this->mailBoxFolder));
+
+    if (!this->indexFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    qint64 indexSize = this->indexFile.size();
+    if (indexSize < static_cast<qint64>(sizeof(Pendulum_File::IndexHeader))) {
+        this->indexFile.close();
+        return false;
+    }
+
+    uchar *index = this->indexFile.map(0, indexSize);
+    if (index == nullptr) {
+        this->indexFile.close();
+        return false;
+    }
+
+    const Pendulum_File::IndexHeader *header = reinterpret_cast<const Pendulum_File::IndexHeader *>(index);
+    if ((std::memcmp(header->magic, Pendulum_File::kIndexMagic, sizeof(header->magic)) != 0) ||
+        (header->recordSize != sizeof(Pendulum_File::IndexRecord))) {
+        this->indexFile.unmap(index);
+        this->indexFile.close();
+        return false;
+    }
+
+    // Any partly written last record is ignored
+
+    this->records = reinterpret_cast<const Pendulum_File::IndexRecord *>(index + sizeof(Pendulum_File::IndexHeader));
+    this->recordCount = (indexSize - sizeof(Pendulum_File::IndexHeader)) / sizeof(Pendulum_File::IndexRecord);
+
+    return true;
+
+}
+
+void ArchiveModel::unmapIndex()
+{
+
+    if (this->records != nullptr) {
+        this->indexFile.unmap(reinterpret_cast<uchar *>(const_cast<Pendulum_File::IndexRecord *>(this->records)) -
+                              sizeof(Pendulum_File::IndexHeader));
+        this->records = nullptr;
+    }
+
+    this->indexFile.close();
+    this->recordCount = 0;
+    this->recordOrder.clear();
+    this->rowsFetched = 0;
+
+}
+
+//
+// Only the record numbers are sorted; records are compared where they are mapped.
+//
+
+void ArchiveModel::sortRecords()
+{
+
+    this->recordOrder.clear();
+
+    if ((this->sortColumn < 0) || (this->recordCount == 0)) {
+        return;
+    }
+
+    const Pendulum_File::IndexRecord *records = this->records;
+    int column = this->sortColumn;
+
+    this->recordOrder.resize(static_cast<int>(this->recordCount));
+    std::iota(this->recordOrder.begin(), this->recordOrder.end(), 0);
+
+    auto lessThan = [records, column](quint32 first, quint32 second) {
+        const Pendulum_File::IndexRecord &lhs = records[first];
+        const Pendulum_File::IndexRecord &rhs = records[second];
+        switch (column) {
+        case kDate:
+            return (lhs.date < rhs.date);
+        case kSize:
+            return (lhs.size < rhs.size);
+        case kSubject:
+            return (qstrnicmp(lhs.subject, rhs.subject, Pendulum_File::kIndexSubjectLength) < 0);
+        default:
+            return (lhs.uid < rhs.uid);
+        }
+    };
+
+    if (this->sortOrder == Qt::AscendingOrder) {
+        std::stable_sort(this->recordOrder.begin(), this->recordOrder.end(), lessThan);
+    } else {
+        std::stable_sort(this->recordOrder.begin(), this->recordOrder.end(),
+                         [&lessThan](quint32 first, quint32 second) { return lessThan(second, first); });
+    }
+
+}
+
+void ArchiveModel::sort(int column, Qt::SortOrder order)
+{
+
+    this->sortColumn = column;
+    this->sortOrder = order;
+
+    beginResetModel();
+    this->rowsFetched = 0;
+    sortRecords();
+    endResetModel();
+
+}
+
+const Pendulum_File::IndexRecord *ArchiveModel::record(int row) const
+{
+
+    if ((row < 0) || (row >= this->rowsFetched)) {
+        return nullptr;
+    }
+
+    return &this->records[this->recordOrder.isEmpty() ? row : this->recordOrder[row]];
+
+}
+
+QString ArchiveModel::filePath(const QModelIndex& index) const
+{
+
+    const Pendulum_File::IndexRecord *message = record(index.row());
+
+    if (message == nullptr) {
+        return "";
+    }
+
+    return QDir(this->mailBoxFolder).filePath(QString("(%1) ").arg(message->uid) +
+                                              QString::fromUtf8(message->subject, qstrnlen(message->subject, Pendulum_File::kIndexSubjectLength)) +
+                                              ".eml");
+
+}
+
+qint64 ArchiveModel::messageCount() const
+{
+    return this->recordCount;
+}
+
+int ArchiveModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : this->rowsFetched;
+}
+
+int ArchiveModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : kColumnCount;
+}
+
+bool ArchiveModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !parent.isValid() && (this->rowsFetched < this->recordCount);
+}
+
+void ArchiveModel::fetchMore(const QModelIndex& parent)
+{
+
+    if (parent.isValid()) {
+        return;
+    }
+
+    int rows = static_cast<int>(qMin<qint64>(kPageSize, this->recordCount - this->rowsFetched));
+    if (rows <= 0) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), this->rowsFetched, this->rowsFetched + rows - 1);
+    this->rowsFetched += rows;
+    endInsertRows();
+
+}
+
+QVariant ArchiveModel::data(const QModelIndex& index, int role) const
+{
+
+    const Pendulum_File::IndexRecord *message = record(index.row());
+
+    if (message == nullptr) {
+        return QVariant();
+    }
+
+    if (role == Qt::TextAlignmentRole) {
+        if ((index.column() == kUID) || (index.column() == kSize)) {
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        }
+        return QVariant();
+    }
+
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (index.column()) {
+    case kUID:
+        return QString::number(message->uid);
+    case kDate:
+        if (message->date == 0) {
+            return QString();
+        }
+        return QDateTime::fromSecsSinceEpoch(message->date).toString("yyyy-MM-dd hh:mm");
+    case kSize:
+        return QString("%1 KB").arg((message->size + 1023) / 1024);
+    case kSubject:
+        return QString::fromUtf8(message->subject, qstrnlen(message->subject, Pendulum_File::kIndexSubjectLength));
+    }
+
+    return QVariant();
+
+}
+
+QVariant ArchiveModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+
+    if ((orientation != Qt::Horizontal) || (role != Qt::DisplayRole)) {
+        return QVariant();
+    }
+
+    switch (section) {
+    case kUID:
+        return "UID";
+    case kDate:
+        return "Date";
+    case kSize:
+        return "Size";
+    case kSubject:
+        return "Subject";
+    }
+
+    return QVariant();
+
+}
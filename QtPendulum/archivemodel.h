@@ -0,0 +1,73 @@
+#ifndef ARCHIVEMODEL_H
+#define ARCHIVEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QFile>
+#include <QVector>
+#include <QtCore>
+
+#include "../Pendulum_File.hpp"
+
+class IndexScanner;
+
+//
+// Messages archived to a mailbox folder read from its pendulum index, which is
+// memory mapped so rows are only decoded when a view asks for them. Rows are
+// handed to views a page at a time (fetchMore()) and sorting just reorders a
+// list of record numbers. A folder without an index is scanned on a background
+// thread to create one.
+//
+
+class ArchiveModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { kUID, kDate, kSize, kSubject, kColumnCount };
+
+    static const int kPageSize = 1000;         // Rows added per fetchMore()
+
+    explicit ArchiveModel(QObject *parent = 0);
+    ~ArchiveModel();
+
+    void setMailBoxFolder(const QString& mailBoxFolder);
+    void refresh();
+
+    QString filePath(const QModelIndex& index) const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    qint64 messageCount() const;
+
+signals:
+    void scanProgress(int files);
+    void scanFinished();
+
+private slots:
+    void indexScanned();
+
+private:
+    bool mapIndex();
+    void unmapIndex();
+    void sortRecords();
+    const Pendulum_File::IndexRecord *record(int row) const;
+
+    QString mailBoxFolder;
+    QFile indexFile;
+    const Pendulum_File::IndexRecord *records = nullptr;
+    qint64 recordCount = 0;
+    QVector<quint32> recordOrder;           // Record number for each row (empty if index order)
+    int rowsFetched = 0;
+    int sortColumn = -1;
+    Qt::SortOrder sortOrder = Qt::AscendingOrder;
+    IndexScanner *scanner = nullptr;
+
+};
+
+#endif // ARCHIVEMODEL_H
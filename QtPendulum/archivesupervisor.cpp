@@ -0,0 +1,328 @@
+#include "archivesupervisor.h"
+
+#include <QRandomGenerator>
+
+ArchiveSupervisor::ArchiveSupervisor(QObject *parent) :
+    QObject(parent)
+{
+}
+
+ArchiveSupervisor::~ArchiveSupervisor()
+{
+    stopAll();
+}
+
+void ArchiveSupervisor::start(const QStringList& connectionNames, int maxConcurrent, const QString& binaryPath)
+{
+
+    this->binaryPath = binaryPath;
+    this->maxConcurrent = qMax(1, maxConcurrent);
+    this->clock.start();
+
+    foreach (QString connectionName, connectionNames) {
+        Job job;
+        job.status.connectionName = connectionName;
+        this->jobs.append(job);
+    }
+
+    // Timers are created here so that they belong to the supervisor thread
+
+    this->scheduleTimer = new QTimer(this);
+    connect(this->scheduleTimer, SIGNAL(timeout()), this, SLOT(scheduleJobs()));
+    this->scheduleTimer->start(kScheduleInterval);
+
+    this->publishTimer = new QTimer(this);
+    connect(this->publishTimer, SIGNAL(timeout()), this, SLOT(publishStatus()));
+    this->publishTimer->start(kPublishInterval);
+
+    scheduleJobs();
+    publishStatus();
+
+}
+
+//
+// A lower limit does not stop running connections; they are just not replaced.
+//
+
+void ArchiveSupervisor::setMaxConcurrent(int maxConcurrent)
+{
+    this->maxConcurrent = qMax(1, maxConcurrent);
+    scheduleJobs();
+}
+
+void ArchiveSupervisor::stopAll()
+{
+
+    if (this->bStopping) {
+        return;
+    }
+
+    this->bStopping = true;
+
+    if (this->scheduleTimer != nullptr) {
+        this->scheduleTimer->stop();
+    }
+
+    // Ask every connection to stop first so they shut down together
+
+    QVector<PendulumProcess *> processes;
+    for (Job &job : this->jobs) {
+        if (job.process != nullptr) {
+            job.process->terminate();
+            processes.append(job.process);
+        } else if (job.status.state != JobStatus::Finished) {
+            job.status.state = JobStatus::Stopped;
+        }
+    }
+
+    foreach (PendulumProcess *process, processes) {
+        if (!process->waitForFinished(kStopTimeout)) {
+            process->kill();
+            process->waitForFinished(kStopTimeout);
+        }
+    }
+
+    publishStatus();
+
+}
+
+void ArchiveSupervisor::scheduleJobs()
+{
+
+    if (this->bStopping) {
+        return;
+    }
+
+    int running = 0;
+    for (const Job &job : this->jobs) {
+        if (job.process != nullptr) {
+            running++;
+        }
+    }
+
+    qint64 now = this->clock.elapsed();
+
+    for (int jobNo = 0; (jobNo < this->jobs.size()) && (running < this->maxConcurrent); jobNo++) {
+        Job &job = this->jobs[jobNo];
+        if (job.process != nullptr) {
+            continue;
+        }
+        if ((job.status.state == JobStatus::Queued) ||
+            (((job.status.state == JobStatus::Waiting) || (job.status.state == JobStatus::Polling)) && (now >= job.restartAt))) {
+            startJob(job, jobNo);
+            running++;
+        }
+    }
+
+}
+
+void ArchiveSupervisor::publishStatus()
+{
+
+    QVector<JobStatus> statuses;
+    qint64 now = this->clock.elapsed();
+
+    statuses.reserve(this->jobs.size());
+    for (Job &job : this->jobs) {
+        if ((job.status.state == JobStatus::Waiting) ||
+            ((job.status.state == JobStatus::Polling) && (job.process == nullptr))) {
+            job.status.restartIn = qMax<qint64>(0, (job.restartAt - now + 999) / 1000);
+        } else {
+            job.status.restartIn = 0;
+        }
+        statuses.append(job.status);
+    }
+
+    emit statusChanged(statuses);
+
+}
+
+ArchiveSupervisor::Job *ArchiveSupervisor::senderJob()
+{
+
+    QObject *process = sender();
+
+    if (process == nullptr) {
+        return nullptr;
+    }
+
+    int jobNo = process->property("jobNo").toInt();
+    if ((jobNo < 0) || (jobNo >= this->jobs.size()) || (this->jobs[jobNo].process != process)) {
+        return nullptr;
+    }
+
+    return &this->jobs[jobNo];
+
+}
+
+void ArchiveSupervisor::startJob(Job& job, int jobNo)
+{
+
+    JobStatus &status = job.status;
+
+    status.state = JobStatus::Running;
+    status.mailBox.clear();
+    status.done = status.messages = status.bytesDone = status.bytes = 0;
+    status.messageRate = status.byteRate = 0.0;
+    status.eta = -1;
+
+    job.outputRemainder.clear();
+    job.runTime.start();
+
+    // Only the last line of output is kept so stdout and stderr can be read as one
+
+    job.process = new PendulumProcess(this);
+    job.process->setProperty("jobNo", jobNo);
+    job.process->setProcessChannelMode(QProcess::MergedChannels);
+
+    connect(job.process, SIGNAL(readyReadStandardOutput()), this, SLOT(processOutput()));
+    connect(job.process, SIGNAL(progressEvent(QJsonObject)), this, SLOT(processProgress(QJsonObject)));
+    connect(job.process, SIGNAL(finished(int,QProcess::ExitStatus)), this, SLOT(processFinished(int,QProcess::ExitStatus)));
+    connect(job.process, SIGNAL(errorOccurred(QProcess::ProcessError)), this, SLOT(processError(QProcess::ProcessError)));
+
+    // A polling pendulum never exits so each is run for a single pass (--poll 0) and
+    // started again by scheduleJobs() when its next poll is due.
+
+    QStringList arguments = PendulumProcess::connectionArguments(status.connectionName);
+    int pollArgument = arguments.indexOf("--poll");
+
+    job.pollInterval = 0;
+    if ((pollArgument >= 0) && (pollArgument + 1 < arguments.size())) {
+        job.pollInterval = qMax<qint64>(0, arguments[pollArgument + 1].toLongLong()) * 60000;
+        arguments[pollArgument + 1] = "0";
+    }
+
+    job.process->startPendulum(this->binaryPath, arguments);
+
+}
+
+//
+// Failed connections wait kInitialBackoff doubling up to kMaxBackoff (plus some
+// jitter so that connections to a server that went away don't all return at once).
+// Connections that poll are rescheduled for their next poll when a pass completes.
+//
+
+void ArchiveSupervisor::finishJob(Job& job, bool bSuccess)
+{
+
+    job.process->disconnect(this);
+    job.process->deleteLater();
+    job.process = nullptr;
+
+    job.status.messageRate = job.status.byteRate = 0.0;
+
+    if (this->bStopping) {
+        job.status.state = JobStatus::Stopped;
+    } else if (bSuccess) {
+        job.status.state = (job.pollInterval > 0) ? JobStatus::Polling : JobStatus::Finished;
+        job.restartAt = this->clock.elapsed() + job.pollInterval;
+        job.status.eta = 0;
+        job.failures = 0;
+    } else {
+        if (job.runTime.elapsed() >= kStableRunTime) {
+            job.failures = 0;
+        }
+        job.failures++;
+        job.status.restarts++;
+        qint64 backoff = qMin<qint64>(kMaxBackoff, static_cast<qint64>(kInitialBackoff) << qMin(job.failures - 1, 16));
+        backoff += QRandomGenerator::global()->bounded(static_cast<int>(backoff / 4) + 1);
+        job.restartAt = this->clock.elapsed() + backoff;
+        job.status.state = JobStatus::Waiting;
+        job.status.eta = -1;
+    }
+
+    scheduleJobs();
+
+}
+
+void ArchiveSupervisor::processOutput()
+{
+
+    Job *job = senderJob();
+
+    if (job == nullptr) {
+        return;
+    }
+
+    job->outputRemainder.append(job->process->readAllStandardOutput());
+
+    int lastLineEnd = job->outputRemainder.lastIndexOf('\n');
+    if (lastLineEnd < 0) {
+        return;
+    }
+
+    QStringList strLines = QString::fromUtf8(job->outputRemainder.left(lastLineEnd)).split("\n");
+    job->outputRemainder.remove(0, lastLineEnd + 1);
+
+    for (int lineNo = strLines.size() - 1; lineNo >= 0; lineNo--) {
+        QString line = strLines[lineNo].trimmed();
+        if (!line.isEmpty()) {
+            job->status.lastLine = line;
+            break;
+        }
+    }
+
+}
+
+void ArchiveSupervisor::processProgress(const QJsonObject& event)
+{
+
+    Job *job = senderJob();
+
+    if (job == nullptr) {
+        return;
+    }
+
+    JobStatus &status = job->status;
+    QString eventType = event.value("event").toString();
+
+    if (eventType == "progress") {
+        status.mailBox = event.value("mailbox").toString();
+        status.done = event.value("done").toVariant().toLongLong();
+        status.messages = event.value("messages").toVariant().toLongLong();
+        status.bytesDone = event.value("bytes_done").toVariant().toLongLong();
+        status.bytes = event.value("bytes").toVariant().toLongLong();
+        status.messageRate = event.value("message_rate").toDouble();
+        status.byteRate = event.value("byte_rate").toDouble();
+        status.eta = event.value("eta").toVariant().toLongLong();
+    } else if (eventType == "mailbox") {
+        status.state = JobStatus::Running;
+        status.mailBox = event.value("mailbox").toString();
+        status.messages = event.value("total_messages").toVariant().toLongLong();
+        status.bytes = event.value("total_bytes").toVariant().toLongLong();
+    } else if (eventType == "pass_complete") {
+        status.state = JobStatus::Polling;
+        status.done = event.value("messages").toVariant().toLongLong();
+        status.bytesDone = event.value("bytes").toVariant().toLongLong();
+        status.messageRate = status.byteRate = 0.0;
+        status.eta = 0;
+    }
+
+}
+
+void ArchiveSupervisor::processFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+
+    Job *job = senderJob();
+
+    if (job != nullptr) {
+        finishJob(*job, (exitStatus == QProcess::NormalExit) && (exitCode == 0));
+    }
+
+}
+
+//
+// finished() is never sent for a program that could not be started.
+//
+
+void ArchiveSupervisor::processError(QProcess::ProcessError error)
+{
+
+    Job *job = senderJob();
+
+    if ((job != nullptr) && (error == QProcess::FailedToStart)) {
+        job->status.lastLine = job->process->errorString();
+        finishJob(*job, false);
+    }
+
+}
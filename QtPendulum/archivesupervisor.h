@@ -0,0 +1,103 @@
+#ifndef ARCHIVESUPERVISOR_H
+#define ARCHIVESUPERVISOR_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QtCore>
+
+#include "pendulumprocess.h"
+
+//
+// Status of one supervised connection (copied to the GUI thread).
+//
+
+struct JobStatus
+{
+    enum State { Queued, Running, Polling, Waiting, Finished, Stopped };
+
+    QString connectionName;
+    State state = Queued;
+    int restarts = 0;
+    qint64 restartIn = 0;           // Seconds until restart when Waiting (or next poll when Polling)
+    QString mailBox;
+    qint64 done = 0;
+    qint64 messages = 0;
+    qint64 bytesDone = 0;
+    qint64 bytes = 0;
+    double messageRate = 0.0;
+    double byteRate = 0.0;
+    qint64 eta = -1;
+    QString lastLine;
+};
+
+Q_DECLARE_METATYPE(JobStatus)
+
+//
+// Runs pendulum for a list of connections, at most maxConcurrent at once,
+// restarting any that fail after an exponential backoff. Connections that poll
+// are run one pass at a time and started again when their next poll is due, so
+// that they do not hold a place between polls. It is moved to its
+// own thread so that all child output and progress events are read off the
+// GUI thread; status is published on a timer with statusChanged().
+//
+
+class ArchiveSupervisor : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int kScheduleInterval = 1000;      // Milliseconds between scheduling passes
+    static const int kPublishInterval = 500;        // Milliseconds between status updates
+    static const int kInitialBackoff = 5000;        // First restart delay (milliseconds)
+    static const int kMaxBackoff = 600000;          // Longest restart delay (milliseconds)
+    static const int kStableRunTime = 600000;       // Run this long and failures are forgotten
+    static const int kStopTimeout = 3000;           // Wait for terminate before kill (milliseconds)
+
+    explicit ArchiveSupervisor(QObject *parent = 0);
+    ~ArchiveSupervisor();
+
+public slots:
+    void start(const QStringList& connectionNames, int maxConcurrent, const QString& binaryPath);
+    void setMaxConcurrent(int maxConcurrent);
+    void stopAll();
+
+signals:
+    void statusChanged(const QVector<JobStatus>& jobs);
+
+private slots:
+    void scheduleJobs();
+    void publishStatus();
+    void processOutput();
+    void processProgress(const QJsonObject& event);
+    void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void processError(QProcess::ProcessError error);
+
+private:
+    struct Job
+    {
+        JobStatus status;
+        PendulumProcess *process = nullptr;
+        int failures = 0;
+        qint64 restartAt = 0;
+        qint64 pollInterval = 0;    // Milliseconds between passes (0 = no polling)
+        QElapsedTimer runTime;
+        QByteArray outputRemainder;
+    };
+
+    Job *senderJob();
+    void startJob(Job& job, int jobNo);
+    void finishJob(Job& job, bool bSuccess);
+
+    QVector<Job> jobs;
+    QString binaryPath;
+    int maxConcurrent = 1;
+    bool bStopping = false;
+    QElapsedTimer clock;
+    QTimer *scheduleTimer = nullptr;
+    QTimer *publishTimer = nullptr;
+
+};
+
+#endif // ARCHIVESUPERVISOR_H
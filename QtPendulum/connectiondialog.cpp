@@ -1,17 +1,53 @@
 #include "connectiondialog.h"
 #include "ui_connectiondialog.h"
 
+//
+// Set progress bar from done/total messages (by bytes if total bytes known).
+//
+
+static void setProgress(QProgressBar *progressBar, qint64 done, qint64 total, qint64 bytesDone, qint64 bytes)
+{
+    double fraction = 0.0;
+
+    if (bytes > 0) {
+        fraction = static_cast<double>(bytesDone) / bytes;
+    } else if (total > 0) {
+        fraction = static_cast<double>(done) / total;
+    }
+
+    progressBar->setValue(static_cast<int>(qBound(0.0, fraction, 1.0) * progressBar->maximum()));
+    progressBar->setFormat(QString("%1/%2 messages").arg(done).arg(total) + " (%p%)");
+}
+
+//
+// Format seconds as HH:MM:SS (? if not known).
+//
+
+QString ConnectionDialog::formatETA(qint64 seconds)
+{
+    if (seconds < 0) {
+        return "?";
+    }
+
+    return QString("%1:%2:%3").arg(seconds / 3600, 2, 10, QChar('0'))
+                              .arg((seconds / 60) % 60, 2, 10, QChar('0'))
+                              .arg(seconds % 60, 2, 10, QChar('0'));
+}
+
 ConnectionDialog::ConnectionDialog(const QString& connectionName, QWidget *parent) :
     QDialog(parent),
     ui(new Ui::ConnectionDialog),  connectionName(connectionName)
 {
     ui->setupUi(this);
 
-    QStringList args;
-
     this->setWindowTitle(this->connectionName);
 
     ui->connectionOutput->setReadOnly(true);
+    ui->connectionOutput->setMaximumBlockCount(kMaxLogLines);
+    ui->mailBoxProgress->setRange(0, 1000);
+    ui->mailBoxProgress->setValue(0);
+    ui->passProgress->setRange(0, 1000);
+    ui->passProgress->setValue(0);
 
     QSettings pendulumSettings;
 
@@ -19,67 +55,138 @@ ConnectionDialog::ConnectionDialog(const QString& connectionName, QWidget *paren
 
     restoreGeometry(pendulumSettings.value("geometry").toByteArray());
 
-    args << "--server" <<  pendulumSettings.value("server").toString() <<
-            "--user" <<  pendulumSettings.value("user").toString() <<
-            "--password" <<  pendulumSettings.value("password").toString() <<
-            "--mailbox" <<  pendulumSettings.value("mailbox").toString() <<
-            "--destination" <<  pendulumSettings.value("destination").toString() <<
-            "--ignore" << pendulumSettings.value("ignore").toString() <<
-            "--poll" << pendulumSettings.value("poll").toString() <<
-            "--retry" << pendulumSettings.value("retry").toString();
-
-    if ( pendulumSettings.value("updates").toBool()) {
-        args << "--updates";
-
-    }
-
-    if ( pendulumSettings.value("all").toBool()) {
-        args <<  "--all";
-    }
-
     pendulumSettings.endGroup();
 
     connect (&this->pendulum, SIGNAL(readyReadStandardOutput()), this, SLOT(processOutput()));
     connect (&this->pendulum, SIGNAL(readyReadStandardError()), this, SLOT(processError()));
+    connect (&this->pendulum, SIGNAL(progressEvent(QJsonObject)), this, SLOT(processProgress(QJsonObject)));
     connect (&this->pendulum, SIGNAL(finished(int)), this, SLOT(processFinished(int)));
 
-    pendulum.start("/home/robt/Projects/NetBeansProjects/Pendulum/dist/Debug/GNU-Linux/pendulum", args);
+    // Output and progress are only shown on a timer so a busy pendulum can't flood the UI
+
+    connect (&this->updateTimer, SIGNAL(timeout()), this, SLOT(updateView()));
+    this->updateTimer.start(kUpdateInterval);
+
+    pendulum.startPendulum(PendulumProcess::binaryPath(), PendulumProcess::connectionArguments(this->connectionName));
 
 }
 
 ConnectionDialog::~ConnectionDialog()
 {
+    this->updateTimer.stop();
     this->pendulum.close();
     this->pendulum.kill();
     delete ui;
 }
 
-void ConnectionDialog::processOutput()
+//
+// Queue complete lines from output (any partial last line is kept for next time).
+// Only the last kMaxLogLines are kept as that is all the view shows.
+//
+
+void ConnectionDialog::queueLines(QByteArray& remainder, const QByteArray& byteArray)
 {
 
-    QByteArray byteArray = this->pendulum.readAllStandardOutput();
-    QStringList strLines = QString(byteArray).split("\n");
+    remainder.append(byteArray);
+
+    int lastLineEnd = remainder.lastIndexOf('\n');
+    if (lastLineEnd < 0) {
+        return;
+    }
+
+    QStringList strLines = QString::fromUtf8(remainder.left(lastLineEnd)).split("\n");
+    remainder.remove(0, lastLineEnd + 1);
 
     foreach (QString line, strLines){
-        if (!line.isEmpty())  {
-            ui->connectionOutput->append(line);
+        if (line.endsWith("\r"))   line.chop(1);
+        if (!line.isEmpty()) {
+            this->pendingLines.append(line);
         }
     }
 
+    if (this->pendingLines.size() > kMaxLogLines) {
+        this->pendingLines.erase(this->pendingLines.begin(), this->pendingLines.end() - kMaxLogLines);
+    }
+
+}
+
+void ConnectionDialog::processOutput()
+{
+    queueLines(this->outputRemainder, this->pendulum.readAllStandardOutput());
 }
 
 void ConnectionDialog::processError()
 {
+    queueLines(this->errorRemainder, this->pendulum.readAllStandardError());
+}
 
-    QByteArray byteArray = this->pendulum. readAllStandardError();
-    QStringList strLines = QString(byteArray).split("\n");
+void ConnectionDialog::processProgress(const QJsonObject& event)
+{
 
-    foreach (QString line, strLines){
-        if (!line.isEmpty()) {
-            if (line.endsWith("\r"))   line.chop(1);
-            ui->connectionOutput->append(line);
+    QString eventType = event.value("event").toString();
+
+    if (eventType == "progress") {
+        this->lastProgress = event;
+        ui->throughputGraph->addSample(event.value("byte_rate").toDouble() / (1024.0 * 1024.0));
+    } else if (eventType == "mailbox") {
+        this->lastProgress.insert("mailbox", event.value("mailbox"));
+        this->lastProgress.insert("mailbox_messages", event.value("messages"));
+        this->lastProgress.insert("mailbox_bytes", event.value("bytes"));
+        this->lastProgress.insert("mailbox_done", 0);
+        this->lastProgress.insert("mailbox_bytes_done", 0);
+        this->lastProgress.insert("mailbox_eta", -1);
+        this->lastProgress.insert("messages", event.value("total_messages"));
+        this->lastProgress.insert("bytes", event.value("total_bytes"));
+        if (!this->lastProgress.contains("eta")) {
+            this->lastProgress.insert("eta", -1);
         }
+    } else if (eventType == "pass_complete") {
+        this->lastProgress.insert("done", event.value("messages"));
+        this->lastProgress.insert("bytes_done", event.value("bytes"));
+        this->lastProgress.insert("eta", 0);
+        this->lastProgress.insert("mailbox_eta", 0);
+    } else {
+        return;
     }
+
+    this->progressChanged = true;
+
+}
+
+void ConnectionDialog::updateView()
+{
+
+    // Append all queued lines in one go
+
+    if (!this->pendingLines.isEmpty()) {
+        ui->connectionOutput->appendPlainText(this->pendingLines.join("\n"));
+        this->pendingLines.clear();
+    }
+
+    if (!this->progressChanged) {
+        return;
+    }
+
+    this->progressChanged = false;
+
+    const QJsonObject &progress = this->lastProgress;
+
+    ui->mailBoxLabel->setText(progress.value("mailbox").toString());
+    setProgress(ui->mailBoxProgress, progress.value("mailbox_done").toVariant().toLongLong(),
+                progress.value("mailbox_messages").toVariant().toLongLong(),
+                progress.value("mailbox_bytes_done").toVariant().toLongLong(),
+                progress.value("mailbox_bytes").toVariant().toLongLong());
+    setProgress(ui->passProgress, progress.value("done").toVariant().toLongLong(),
+                progress.value("messages").toVariant().toLongLong(),
+                progress.value("bytes_done").toVariant().toLongLong(),
+                progress.value("bytes").toVariant().toLongLong());
+
+    ui->rateLabel->setText(QString("%1 messages/s, %2 MB/s, ETA %3 (mailbox %4)")
+                           .arg(progress.value("message_rate").toDouble(), 0, 'f', 1)
+                           .arg(progress.value("byte_rate").toDouble() / (1024.0 * 1024.0), 0, 'f', 2)
+                           .arg(formatETA(progress.value("eta").toVariant().toLongLong()))
+                           .arg(formatETA(progress.value("mailbox_eta").toVariant().toLongLong())));
+
 }
 
 void ConnectionDialog::processFinished(int exitCode)
@@ -87,6 +194,8 @@ void ConnectionDialog::processFinished(int exitCode)
 
     Q_UNUSED(exitCode);
 
+    updateView();
+
     this->close();
 
 }
@@ -2,8 +2,11 @@
 #define CONNECTIONDIALOG_H
 
 #include <QDialog>
+#include <QJsonObject>
 #include <QtCore>
 
+#include "pendulumprocess.h"
+
 namespace Ui {
 class ConnectionDialog;
 }
@@ -13,21 +16,36 @@ class ConnectionDialog : public QDialog
     Q_OBJECT
 
 public:
+    static const int kMaxLogLines = 5000;       // Lines kept in output view
+    static const int kUpdateInterval = 200;     // Milliseconds between view updates
+
     explicit ConnectionDialog(const QString& connectionName, QWidget *parent = 0);
     ~ConnectionDialog();
 
+    static QString formatETA(qint64 seconds);
 
 private:
     Ui::ConnectionDialog *ui;
 
     QString connectionName;
 
-    QProcess pendulum;
+    PendulumProcess pendulum;
+
+    QTimer updateTimer;
+    QStringList pendingLines;
+    QByteArray outputRemainder;
+    QByteArray errorRemainder;
+    QJsonObject lastProgress;
+    bool progressChanged=false;
+
+    void queueLines(QByteArray& remainder, const QByteArray& byteArray);
 
 public slots:
     void processOutput();
     void processError();
+    void processProgress(const QJsonObject& event);
     void processFinished(int exitCode);
+    void updateView();
 
 protected:
     void closeEvent(QCloseEvent *);
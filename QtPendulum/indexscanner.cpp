@@ -0,0 +1,98 @@
+#include "indexscanner.h"
+
+#include "../Pendulum_File.hpp"
+
+#include <QDirIterator>
+#include <QFileInfo>
+
+#include <vector>
+#include <cstring>
+
+#include <unistd.h>
+
+//
+// "Date:" header of a message as seconds since the epoch (0 if none).
+//
+
+static qint64 messageDate(const QByteArray& headers)
+{
+
+    foreach (QByteArray line, headers.split('\n')) {
+        if (line.trimmed().isEmpty()) {
+            break;
+        }
+        if (line.left(5).toLower() == "date:") {
+            QDateTime date = QDateTime::fromString(QString::fromLatin1(line.mid(5).trimmed()), Qt::RFC2822Date);
+            return (date.isValid() ? date.toSecsSinceEpoch() : 0);
+        }
+    }
+
+    return 0;
+
+}
+
+IndexScanner::IndexScanner(const QString& mailBoxFolder, const QString& indexFileName, QObject *parent) :
+    QThread(parent), mailBoxFolder(mailBoxFolder), indexFileName(indexFileName)
+{
+}
+
+void IndexScanner::run()
+{
+
+    std::vector<Pendulum_File::IndexRecord> records;
+    QDirIterator emlFiles(this->mailBoxFolder, QStringList() << "*.eml", QDir::Files);
+
+    while (emlFiles.hasNext() && !isInterruptionRequested()) {
+
+        QString filePath = emlFiles.next();
+        QString fileName = emlFiles.fileName();
+        int uidEnd = fileName.indexOf(") ");
+
+        if (!fileName.startsWith('(') || (uidEnd < 0)) {
+            continue;
+        }
+
+        QFile emlFile(filePath);
+        if (!emlFile.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        Pendulum_File::IndexRecord record {};
+        QByteArray subject = fileName.mid(uidEnd + 2, fileName.size() - uidEnd - 6).toUtf8();
+
+        record.uid = fileName.mid(1, uidEnd - 1).toULongLong();
+        record.date = messageDate(emlFile.read(kDateHeaderRead));
+        record.size = static_cast<std::uint64_t>(emlFile.size());
+        std::memcpy(record.subject, subject.constData(), qMin<size_t>(subject.size(), Pendulum_File::kIndexSubjectLength - 1));
+
+        records.push_back(record);
+
+        if ((records.size() % kProgressInterval) == 0) {
+            emit scanProgress(static_cast<int>(records.size()));
+        }
+
+    }
+
+    if (isInterruptionRequested()) {
+        return;
+    }
+
+    // Written to one side and linked into place so an index pendulum creates meanwhile is kept
+
+    QString tmpFileName = this->indexFileName + "." + QString::number(QCoreApplication::applicationPid());
+    QFile indexFile(tmpFileName);
+
+    if (indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        Pendulum_File::IndexHeader header {};
+        std::memcpy(header.magic, Pendulum_File::kIndexMagic, sizeof(header.magic));
+        header.recordSize = sizeof(Pendulum_File::IndexRecord);
+        indexFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        indexFile.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(Pendulum_File::IndexRecord));
+        if (indexFile.flush()) {
+            ::link(QFile::encodeName(tmpFileName).constData(), QFile::encodeName(this->indexFileName).constData());
+        }
+        indexFile.close();
+        indexFile.remove();
+    }
+
+}
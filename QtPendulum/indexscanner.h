@@ -0,0 +1,34 @@
+#ifndef INDEXSCANNER_H
+#define INDEXSCANNER_H
+
+#include <QThread>
+#include <QtCore>
+
+//
+// Builds the index of a mailbox folder archived before pendulum wrote one by
+// scanning its "(uid) subject.eml" files on a background thread.
+//
+
+class IndexScanner : public QThread
+{
+    Q_OBJECT
+
+public:
+    static const int kProgressInterval = 1000;     // Files between progress signals
+    static const int kDateHeaderRead = 8192;       // Bytes read from each file to find its date
+
+    IndexScanner(const QString& mailBoxFolder, const QString& indexFileName, QObject *parent = 0);
+
+signals:
+    void scanProgress(int files);
+
+protected:
+    void run() override;
+
+private:
+    QString mailBoxFolder;
+    QString indexFileName;
+
+};
+
+#endif // INDEXSCANNER_H
@@ -2,6 +2,10 @@
 #include "ui_pendulummainwindow.h"
 #include "connectiondetailsdialog.h"
 #include "connectiondialog.h"
+#include "supervisordialog.h"
+#include "archivebrowserdialog.h"
+
+#include <QFileDialog>
 
 PendulumMainWindow::PendulumMainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -19,6 +23,8 @@ PendulumMainWindow::PendulumMainWindow(QWidget *parent) :
     ui->editConnection->setEnabled(false);
     ui->deleteConnection->setEnabled(false);
     ui->connect->setEnabled(false);
+    ui->browse->setEnabled(false);
+    ui->runAll->setEnabled(!this->connectionList.isEmpty());
 
     QSettings pendulumSettings;
     restoreGeometry(pendulumSettings.value("geometry").toByteArray());
@@ -92,6 +98,7 @@ void PendulumMainWindow::populateConnectionList()
 
     ui->connectionList->clear();
     ui->connectionList->addItems(this->connectionList);
+    ui->runAll->setEnabled(!this->connectionList.isEmpty());
     this->saveConnectionList();
 
 }
@@ -139,6 +146,38 @@ void PendulumMainWindow::on_connect_clicked()
     }
 }
 
+void PendulumMainWindow::on_browse_clicked()
+{
+    // Browse archive
+
+    QListWidgetItem *connectionToBrowse = ui->connectionList->currentItem();
+
+    if(connectionToBrowse != nullptr) {
+        ArchiveBrowserDialog archiveBrowser(connectionToBrowse->text(), this);
+        archiveBrowser.exec();
+    }
+}
+
+void PendulumMainWindow::on_runAll_clicked()
+{
+    // Run all connections together
+
+    if (!this->connectionList.isEmpty()) {
+        SupervisorDialog supervisor(this->connectionList, this);
+        supervisor.exec();
+    }
+}
+
+void PendulumMainWindow::on_pendulumProgram_clicked()
+{
+    // Pendulum program used to run connections
+
+    QString path = QFileDialog::getOpenFileName(this, "Pendulum Program", PendulumProcess::binaryPath());
+
+    if (!path.isEmpty()) {
+        PendulumProcess::setBinaryPath(path);
+    }
+}
 
 void PendulumMainWindow::on_connectionList_clicked(const QModelIndex &index)
 {
@@ -148,6 +187,7 @@ void PendulumMainWindow::on_connectionList_clicked(const QModelIndex &index)
     ui->editConnection->setEnabled(true);
     ui->deleteConnection->setEnabled(true);
     ui->connect->setEnabled(true);
+    ui->browse->setEnabled(true);
 
 }
 
@@ -24,6 +24,9 @@ private slots:
     void on_editConnection_clicked();
     void on_deleteConnection_clicked();
     void on_connect_clicked();
+    void on_browse_clicked();
+    void on_runAll_clicked();
+    void on_pendulumProgram_clicked();
     void on_connectionList_clicked(const QModelIndex &index);
     void on_connectionList_doubleClicked(const QModelIndex &index);
 
@@ -0,0 +1,178 @@
+#include "pendulumprocess.h"
+
+#include <QJsonDocument>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QCoreApplication>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+PendulumProcess::PendulumProcess(QObject *parent) :
+    QProcess(parent)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    setChildProcessModifier([this]() { this->setupProgressFD(); });
+#endif
+}
+
+PendulumProcess::~PendulumProcess()
+{
+    closeProgressPipe();
+}
+
+void PendulumProcess::startPendulum(const QString& program, QStringList arguments)
+{
+
+    closeProgressPipe();
+
+    // Both ends close on exec; only the copy made on kProgressFD in the child survives.
+
+    if (::pipe2(this->progressPipe, O_CLOEXEC) == 0) {
+        ::fcntl(this->progressPipe[0], F_SETFL, O_NONBLOCK);
+        arguments << "--progress-fd" << QString::number(kProgressFD);
+        this->progressNotifier = new QSocketNotifier(this->progressPipe[0], QSocketNotifier::Read, this);
+        connect(this->progressNotifier, SIGNAL(activated(int)), this, SLOT(readProgress()));
+    }
+
+    start(program, arguments);
+
+    // Child has its own write end now (end of file is seen when it exits)
+
+    if (this->progressPipe[1] >= 0) {
+        ::close(this->progressPipe[1]);
+        this->progressPipe[1] = -1;
+    }
+
+}
+
+//
+// Pendulum program to run; if not set then look on PATH and then next to QtPendulum.
+//
+
+QString PendulumProcess::binaryPath()
+{
+
+    QSettings pendulumSettings;
+
+    QString path = pendulumSettings.value("Settings/pendulum").toString();
+
+    if (path.isEmpty()) {
+        path = QStandardPaths::findExecutable("pendulum");
+    }
+    if (path.isEmpty()) {
+        path = QCoreApplication::applicationDirPath() + "/pendulum";
+    }
+
+    return path;
+
+}
+
+void PendulumProcess::setBinaryPath(const QString& path)
+{
+    QSettings pendulumSettings;
+    pendulumSettings.setValue("Settings/pendulum", path);
+}
+
+//
+// Pendulum command line for a saved connection.
+//
+
+QStringList PendulumProcess::connectionArguments(const QString& connectionName)
+{
+
+    QStringList args;
+    QSettings pendulumSettings;
+
+    pendulumSettings.beginGroup(connectionName);
+
+    args << "--server" <<  pendulumSettings.value("server").toString() <<
+            "--user" <<  pendulumSettings.value("user").toString() <<
+            "--password" <<  pendulumSettings.value("password").toString() <<
+            "--mailbox" <<  pendulumSettings.value("mailbox").toString() <<
+            "--destination" <<  pendulumSettings.value("destination").toString() <<
+            "--ignore" << pendulumSettings.value("ignore").toString() <<
+            "--poll" << pendulumSettings.value("poll").toString() <<
+            "--retry" << pendulumSettings.value("retry").toString();
+
+    if ( pendulumSettings.value("updates").toBool()) {
+        args << "--updates";
+    }
+
+    if ( pendulumSettings.value("all").toBool()) {
+        args <<  "--all";
+    }
+
+    pendulumSettings.endGroup();
+
+    return args;
+
+}
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+void PendulumProcess::setupChildProcess()
+{
+    setupProgressFD();
+}
+#endif
+
+//
+// Runs in the child between fork and exec: move pipe write end to kProgressFD.
+//
+
+void PendulumProcess::setupProgressFD()
+{
+    if (this->progressPipe[1] == kProgressFD) {
+        ::fcntl(kProgressFD, F_SETFD, 0);
+    } else if (this->progressPipe[1] >= 0) {
+        ::dup2(this->progressPipe[1], kProgressFD);
+    }
+}
+
+void PendulumProcess::readProgress()
+{
+
+    char buffer[4096];
+    ssize_t count;
+
+    while ((count = ::read(this->progressPipe[0], buffer, sizeof(buffer))) > 0) {
+        this->progressBuffer.append(buffer, static_cast<int>(count));
+    }
+
+    // Emit each complete line
+
+    int lineEnd;
+    while ((lineEnd = this->progressBuffer.indexOf('\n')) >= 0) {
+        QJsonDocument event = QJsonDocument::fromJson(this->progressBuffer.left(lineEnd));
+        this->progressBuffer.remove(0, lineEnd + 1);
+        if (event.isObject()) {
+            emit progressEvent(event.object());
+        }
+    }
+
+    if ((count == 0) || ((count < 0) && (errno != EAGAIN) && (errno != EINTR))) {
+        closeProgressPipe();
+    }
+
+}
+
+void PendulumProcess::closeProgressPipe()
+{
+
+    if (this->progressNotifier != nullptr) {
+        this->progressNotifier->setEnabled(false);
+        this->progressNotifier->deleteLater();
+        this->progressNotifier = nullptr;
+    }
+
+    for (int &fd : this->progressPipe) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    this->progressBuffer.clear();
+
+}
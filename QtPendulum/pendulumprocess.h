@@ -0,0 +1,51 @@
+#ifndef PENDULUMPROCESS_H
+#define PENDULUMPROCESS_H
+
+#include <QProcess>
+#include <QSocketNotifier>
+#include <QJsonObject>
+#include <QtCore>
+
+//
+// QProcess that runs pendulum with a pipe on file descriptor 3 passed as its
+// --progress-fd and emits each JSON line progress event it writes.
+//
+
+class PendulumProcess : public QProcess
+{
+    Q_OBJECT
+
+public:
+    static const int kProgressFD = 3;
+
+    explicit PendulumProcess(QObject *parent = 0);
+    ~PendulumProcess();
+
+    void startPendulum(const QString& program, QStringList arguments);
+
+    static QString binaryPath();
+    static void setBinaryPath(const QString& path);
+    static QStringList connectionArguments(const QString& connectionName);
+
+signals:
+    void progressEvent(const QJsonObject& event);
+
+private slots:
+    void readProgress();
+
+private:
+    void closeProgressPipe();
+    void setupProgressFD();
+
+    int progressPipe[2] = { -1, -1 };
+    QSocketNotifier *progressNotifier = nullptr;
+    QByteArray progressBuffer;
+
+protected:
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    void setupChildProcess() override;
+#endif
+
+};
+
+#endif // PENDULUMPROCESS_H
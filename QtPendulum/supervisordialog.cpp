@@ -0,0 +1,230 @@
+#include "supervisordialog.h"
+#include "ui_supervisordialog.h"
+#include "connectiondialog.h"
+
+#include <QHeaderView>
+
+//
+// Text for a connection's state.
+//
+
+static QString stateName(const JobStatus& job)
+{
+
+    switch (job.state) {
+    case JobStatus::Queued:
+        return "Queued";
+    case JobStatus::Running:
+        return "Running";
+    case JobStatus::Polling:
+        return (job.restartIn > 0) ? QString("Next poll in %1s").arg(job.restartIn) : QString("Polling");
+    case JobStatus::Waiting:
+        return QString("Restart in %1s").arg(job.restartIn);
+    case JobStatus::Finished:
+        return "Finished";
+    case JobStatus::Stopped:
+        return "Stopped";
+    }
+
+    return "";
+
+}
+
+SupervisorDialog::SupervisorDialog(const QStringList& connectionNames, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::SupervisorDialog)
+{
+    ui->setupUi(this);
+
+    this->setWindowTitle("Supervisor");
+
+    QSettings pendulumSettings;
+
+    pendulumSettings.beginGroup("Supervisor");
+    restoreGeometry(pendulumSettings.value("geometry").toByteArray());
+    int maxConcurrent = pendulumSettings.value("maxConcurrent", kDefaultConcurrent).toInt();
+    pendulumSettings.endGroup();
+
+    ui->maxConcurrent->setRange(1, 64);
+    ui->maxConcurrent->setValue(maxConcurrent);
+
+    ui->jobTable->setColumnCount(kColumnCount);
+    ui->jobTable->setHorizontalHeaderLabels(QStringList() << "Connection" << "State" << "Restarts" <<
+                                            "Progress" << "Messages/s" << "MB/s" << "ETA" << "Output");
+    ui->jobTable->setRowCount(connectionNames.size());
+    ui->jobTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    ui->jobTable->horizontalHeader()->setStretchLastSection(true);
+    ui->jobTable->verticalHeader()->setVisible(false);
+
+    for (int row = 0; row < connectionNames.size(); row++) {
+        for (int column = 0; column < kColumnCount; column++) {
+            ui->jobTable->setItem(row, column, new QTableWidgetItem());
+        }
+        setCell(row, kConnection, connectionNames[row]);
+    }
+
+    // All child processes are owned and read by the supervisor on its own thread
+
+    qRegisterMetaType<JobStatus>("JobStatus");
+    qRegisterMetaType<QVector<JobStatus>>("QVector<JobStatus>");
+
+    this->supervisor = new ArchiveSupervisor();
+    this->supervisor->moveToThread(&this->supervisorThread);
+
+    connect (&this->supervisorThread, SIGNAL(finished()), this->supervisor, SLOT(deleteLater()));
+    connect (this->supervisor, SIGNAL(statusChanged(QVector<JobStatus>)), this, SLOT(updateStatus(QVector<JobStatus>)));
+    connect (ui->maxConcurrent, SIGNAL(valueChanged(int)), this, SLOT(maxConcurrentChanged(int)));
+    connect (ui->stopAll, SIGNAL(clicked()), this, SLOT(stopAll()));
+
+    this->supervisorThread.start();
+
+    QMetaObject::invokeMethod(this->supervisor, "start", Qt::QueuedConnection,
+                              Q_ARG(QStringList, connectionNames),
+                              Q_ARG(int, maxConcurrent),
+                              Q_ARG(QString, PendulumProcess::binaryPath()));
+
+}
+
+SupervisorDialog::~SupervisorDialog()
+{
+    stopAll();
+    this->supervisorThread.quit();
+    this->supervisorThread.wait();
+    delete ui;
+}
+
+void SupervisorDialog::setCell(int row, int column, const QString& text)
+{
+    QTableWidgetItem *item = ui->jobTable->item(row, column);
+    if ((item != nullptr) && (item->text() != text)) {
+        item->setText(text);
+    }
+}
+
+void SupervisorDialog::updateStatus(const QVector<JobStatus>& jobs)
+{
+
+    int running = 0, queued = 0, waiting = 0, finished = 0, unplanned = 0;
+    double messageRate = 0.0, byteRate = 0.0;
+    qint64 remainingBytes = 0, remainingMessages = 0;
+
+    for (int row = 0; (row < jobs.size()) && (row < ui->jobTable->rowCount()); row++) {
+
+        const JobStatus &job = jobs[row];
+
+        setCell(row, kState, stateName(job));
+        setCell(row, kRestarts, QString::number(job.restarts));
+        if (job.messages > 0) {
+            setCell(row, kProgress, QString("%1/%2 (%3%)").arg(job.done).arg(job.messages)
+                    .arg((job.bytes > 0) ? (100 * job.bytesDone) / job.bytes : (100 * job.done) / job.messages));
+        } else {
+            setCell(row, kProgress, "");
+        }
+        setCell(row, kMessageRate, QString::number(job.messageRate, 'f', 1));
+        setCell(row, kByteRate, QString::number(job.byteRate / (1024.0 * 1024.0), 'f', 2));
+        setCell(row, kETA, ConnectionDialog::formatETA(job.eta));
+        setCell(row, kOutput, job.lastLine);
+
+        switch (job.state) {
+        case JobStatus::Running:
+            running++;
+            break;
+        case JobStatus::Queued:
+            queued++;
+            break;
+        case JobStatus::Waiting:
+            waiting++;
+            break;
+        case JobStatus::Finished:
+            finished++;
+            break;
+        default:
+            break;
+        }
+
+        // Work left is only known once a connection has planned its pass
+
+        if ((job.state == JobStatus::Running) || (job.state == JobStatus::Waiting) || (job.state == JobStatus::Queued)) {
+            if (job.bytes > 0) {
+                remainingBytes += qMax<qint64>(0, job.bytes - job.bytesDone);
+            } else if (job.messages > 0) {
+                remainingMessages += qMax<qint64>(0, job.messages - job.done);
+            } else {
+                unplanned++;
+            }
+        }
+
+        messageRate += job.messageRate;
+        byteRate += job.byteRate;
+
+    }
+
+    // Combined ETA assumes the connections share the current combined rate
+
+    qint64 eta = -1;
+    if ((remainingBytes == 0) && (remainingMessages == 0)) {
+        eta = (unplanned == 0) ? 0 : -1;
+    } else if (((remainingBytes == 0) || (byteRate > 0.0)) && ((remainingMessages == 0) || (messageRate > 0.0))) {
+        eta = 0;
+        if (remainingBytes > 0) {
+            eta += static_cast<qint64>(remainingBytes / byteRate);
+        }
+        if (remainingMessages > 0) {
+            eta += static_cast<qint64>(remainingMessages / messageRate);
+        }
+    }
+
+    QString summary = QString("%1 running, %2 queued, %3 waiting to restart, %4 finished; %5 messages/s, %6 MB/s, ETA %7")
+            .arg(running).arg(queued).arg(waiting).arg(finished)
+            .arg(messageRate, 0, 'f', 1)
+            .arg(byteRate / (1024.0 * 1024.0), 0, 'f', 2)
+            .arg(ConnectionDialog::formatETA(eta));
+    if ((unplanned > 0) && (eta >= 0)) {
+        summary += QString(" (+%1 not yet planned)").arg(unplanned);
+    }
+
+    ui->summaryLabel->setText(summary);
+    ui->throughputGraph->addSample(byteRate / (1024.0 * 1024.0));
+
+}
+
+void SupervisorDialog::maxConcurrentChanged(int maxConcurrent)
+{
+
+    QSettings pendulumSettings;
+
+    pendulumSettings.beginGroup("Supervisor");
+    pendulumSettings.setValue("maxConcurrent", maxConcurrent);
+    pendulumSettings.endGroup();
+
+    QMetaObject::invokeMethod(this->supervisor, "setMaxConcurrent", Qt::QueuedConnection, Q_ARG(int, maxConcurrent));
+
+}
+
+//
+// Blocks until every pendulum has exited so none are left behind when the dialog goes.
+//
+
+void SupervisorDialog::stopAll()
+{
+
+    if (this->supervisorThread.isRunning()) {
+        QMetaObject::invokeMethod(this->supervisor, "stopAll", Qt::BlockingQueuedConnection);
+    }
+
+    ui->stopAll->setEnabled(false);
+    ui->maxConcurrent->setEnabled(false);
+
+}
+
+void SupervisorDialog::closeEvent(QCloseEvent *event)
+{
+    QSettings pendulumSettings;
+
+    pendulumSettings.beginGroup("Supervisor");
+    pendulumSettings.setValue("geometry", saveGeometry());
+    pendulumSettings.endGroup();
+
+    QDialog::closeEvent(event);
+
+}
@@ -0,0 +1,49 @@
+#ifndef SUPERVISORDIALOG_H
+#define SUPERVISORDIALOG_H
+
+#include <QDialog>
+#include <QThread>
+#include <QtCore>
+
+#include "archivesupervisor.h"
+
+namespace Ui {
+class SupervisorDialog;
+}
+
+//
+// Runs many connections at once through an ArchiveSupervisor on its own thread
+// and shows per connection and combined progress, throughput and ETA.
+//
+
+class SupervisorDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    static const int kDefaultConcurrent = 4;    // Connections run at once unless set
+
+    explicit SupervisorDialog(const QStringList& connectionNames, QWidget *parent = 0);
+    ~SupervisorDialog();
+
+private:
+    enum Column { kConnection, kState, kRestarts, kProgress, kMessageRate, kByteRate, kETA, kOutput, kColumnCount };
+
+    Ui::SupervisorDialog *ui;
+
+    QThread supervisorThread;
+    ArchiveSupervisor *supervisor;
+
+    void setCell(int row, int column, const QString& text);
+
+public slots:
+    void updateStatus(const QVector<JobStatus>& jobs);
+    void maxConcurrentChanged(int maxConcurrent);
+    void stopAll();
+
+protected:
+    void closeEvent(QCloseEvent *);
+
+};
+
+#endif // SUPERVISORDIALOG_H
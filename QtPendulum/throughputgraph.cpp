@@ -0,0 +1,85 @@
+#include "throughputgraph.h"
+
+#include <QPainter>
+#include <QPainterPath>
+
+#include <algorithm>
+
+ThroughputGraph::ThroughputGraph(QWidget *parent) :
+    QWidget(parent)
+{
+    this->samples.reserve(kMaxSamples);
+}
+
+void ThroughputGraph::addSample(double sample)
+{
+
+    // Ring of the last kMaxSamples samples
+
+    if (this->samples.size() < kMaxSamples) {
+        this->samples.append(sample);
+    } else {
+        this->samples[this->nextSample] = sample;
+    }
+    this->nextSample = (this->nextSample + 1) % kMaxSamples;
+
+    update();
+
+}
+
+void ThroughputGraph::clear()
+{
+    this->samples.clear();
+    this->nextSample = 0;
+    update();
+}
+
+QSize ThroughputGraph::sizeHint() const
+{
+    return QSize(240, 48);
+}
+
+void ThroughputGraph::paintEvent(QPaintEvent *event)
+{
+
+    Q_UNUSED(event);
+
+    QPainter painter(this);
+
+    painter.fillRect(rect(), palette().base());
+
+    if (this->samples.size() < 2) {
+        return;
+    }
+
+    double maxSample = *std::max_element(this->samples.begin(), this->samples.end());
+    if (maxSample <= 0.0) {
+        maxSample = 1.0;
+    }
+
+    // Oldest sample on the left
+
+    int first = (this->samples.size() < kMaxSamples) ? 0 : this->nextSample;
+    double xStep = static_cast<double>(width() - 1) / (kMaxSamples - 1);
+    double xStart = (kMaxSamples - this->samples.size()) * xStep;
+    QPainterPath path;
+
+    for (int sampleNo = 0; sampleNo < this->samples.size(); sampleNo++) {
+        double sample = this->samples[(first + sampleNo) % this->samples.size()];
+        QPointF point(xStart + sampleNo * xStep, (height() - 1) * (1.0 - sample / maxSample));
+        if (sampleNo == 0) {
+            path.moveTo(point);
+        } else {
+            path.lineTo(point);
+        }
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen(palette().highlight(), 1.5));
+    painter.drawPath(path);
+
+    painter.setPen(palette().text().color());
+    painter.drawText(rect().adjusted(4, 2, -4, -2), Qt::AlignTop | Qt::AlignRight,
+                     QString::number(maxSample, 'f', 2) + " MB/s");
+
+}
@@ -0,0 +1,34 @@
+#ifndef THROUGHPUTGRAPH_H
+#define THROUGHPUTGRAPH_H
+
+#include <QWidget>
+#include <QtCore>
+
+//
+// Sparkline of the most recent throughput samples (scaled to the largest shown).
+//
+
+class ThroughputGraph : public QWidget
+{
+    Q_OBJECT
+
+public:
+    static const int kMaxSamples = 120;
+
+    explicit ThroughputGraph(QWidget *parent = 0);
+
+    void addSample(double sample);
+    void clear();
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    QVector<double> samples;
+    int nextSample = 0;
+
+};
+
+#endif // THROUGHPUTGRAPH_H
@@ -0,0 +1,296 @@
+
+//
+// Program: ArchiveBenchmark
+//
+// Description: End-to-end throughput benchmark. A fake IMAP server serving synthetic
+// mailboxes is started in process and the real Pendulum binary run against it (so the
+// whole archiveEmail path, TLS included, is measured). For each run messages/s, MB/s,
+// per-message latency percentiles and the peak RSS of Pendulum are reported as a
+// single line JSON object (appended to --output if given) so that results can be
+// tracked over time.
+//
+// Per-message latency is measured server side as the time from a body FETCH being
+// received to the next command on that connection (or the response being sent if
+// it was the last); that is the full cycle of fetch, parse and .eml file creation.
+//
+// Usage: ArchiveBenchmark [--pendulum path] [--runs n] [--output file] [--label name]
+//                         [--keep] [server options] [-- pendulum options]
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+
+//
+// Fake IMAP server
+//
+
+#include "FakeIMAPServer.hpp"
+
+//
+// Benchmark runner
+//
+
+#include "BenchmarkRunner.hpp"
+
+// =======
+// IMPORTS
+// =======
+
+using namespace FakeIMAP;
+using namespace BenchmarkRunner;
+
+namespace fs = std::filesystem;
+
+// ===============
+// LOCAL CONSTANTS
+// ===============
+
+#ifndef PENDULUM_BINARY
+#define PENDULUM_BINARY "./Pendulum"
+#endif
+
+// ===============
+// LOCAL FUNCTIONS
+// ===============
+
+//
+// Benchmark run result
+//
+
+struct RunResult {
+    ProcessResult process;
+    std::uint64_t expectedMessages { 0 };
+    ArchiveContents archive;
+    std::vector<double> latencies;
+    ServerStatistics serverStatistics;
+};
+
+//
+// Per-message latencies (ms) from the server command records.
+//
+
+static std::vector<double> messageLatencies(std::vector<CommandRecord> records) {
+
+    std::vector<double> latencies;
+
+    std::stable_sort(records.begin(), records.end(), [] (const CommandRecord& a, const CommandRecord& b) {
+        return ((a.connection < b.connection) || ((a.connection == b.connection) && (a.received < b.received)));
+    });
+
+    for (std::size_t recordNo = 0; recordNo < records.size(); recordNo++) {
+        if (records[recordNo].uid == 0) {
+            continue;
+        }
+        auto end { records[recordNo].sent };
+        if ((recordNo + 1 < records.size()) && (records[recordNo + 1].connection == records[recordNo].connection)) {
+            end = records[recordNo + 1].received;
+        }
+        latencies.push_back(std::chrono::duration<double, std::milli>(end - records[recordNo].received).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    return (latencies);
+
+}
+
+//
+// Format a run as a single line JSON object.
+//
+
+static std::string formatResult(const std::string& label, const ServerConfig& config,
+                                const std::vector<std::string>& extraArguments, int runNo, const RunResult& result) {
+
+    std::ostringstream json;
+
+    json << std::fixed << std::setprecision(3);
+    json << "{\"benchmark\":\"archive\",\"label\":" << jsonEscape(label) << ",\"timestamp\":" << jsonTimeStamp() << ",\"run\":" << runNo;
+
+    json << ",\"config\":{\"mailboxes\":{";
+    for (std::size_t mailBoxNo = 0; mailBoxNo < config.mailBoxes.size(); mailBoxNo++) {
+        json << ((mailBoxNo != 0) ? "," : "") << jsonEscape(config.mailBoxes[mailBoxNo].name) << ":" << config.mailBoxes[mailBoxNo].messageCount;
+    }
+    json << "},\"min_size\":" << config.minSize << ",\"median_size\":" << config.medianSize << ",\"max_size\":" << config.maxSize
+         << ",\"size_sigma\":" << config.sizeSigma << ",\"latency_ms\":" << (config.latency.count() / 1000.0)
+         << ",\"bandwidth\":" << config.bandwidth << ",\"tls\":" << (config.bTLS ? "true" : "false") << ",\"pendulum_args\":[";
+    for (std::size_t argumentNo = 0; argumentNo < extraArguments.size(); argumentNo++) {
+        json << ((argumentNo != 0) ? "," : "") << jsonEscape(extraArguments[argumentNo]);
+    }
+    json << "]}";
+
+    double megaBytes { static_cast<double>(result.archive.bytes) / (1024.0 * 1024.0) };
+    double seconds { std::max(result.process.seconds, 1e-9) };
+
+    json << ",\"results\":{\"exit_status\":" << result.process.exitStatus
+         << ",\"expected_messages\":" << result.expectedMessages
+         << ",\"messages\":" << result.archive.messages
+         << ",\"bytes\":" << result.archive.bytes
+         << ",\"seconds\":" << result.process.seconds
+         << ",\"messages_per_second\":" << (static_cast<double>(result.archive.messages) / seconds)
+         << ",\"mb_per_second\":" << (megaBytes / seconds)
+         << ",\"latency_ms\":{\"p50\":" << percentile(result.latencies, 50.0)
+         << ",\"p90\":" << percentile(result.latencies, 90.0)
+         << ",\"p99\":" << percentile(result.latencies, 99.0)
+         << ",\"max\":" << (result.latencies.empty() ? 0.0 : result.latencies.back()) << "}"
+         << ",\"peak_rss_kb\":" << result.process.peakRSSKB
+         << ",\"user_seconds\":" << result.process.userSeconds
+         << ",\"system_seconds\":" << result.process.systemSeconds
+         << ",\"server\":{\"connections\":" << result.serverStatistics.connections
+         << ",\"commands\":" << result.serverStatistics.commands
+         << ",\"bodies\":" << result.serverStatistics.bodiesSent
+         << ",\"bytes_sent\":" << result.serverStatistics.bytesSent << "}}}";
+
+    return (json.str());
+
+}
+
+//
+// Print usage.
+//
+
+static void usage() {
+
+    std::cerr << "Usage: ArchiveBenchmark [options] [server options] [-- pendulum options]\n"
+              << "  --pendulum path               Pendulum binary (default " << PENDULUM_BINARY << ")\n"
+              << "  --runs n                      Number of runs (default 1)\n"
+              << "  --output file                 Append JSON results to file (default stdout)\n"
+              << "  --label name                  Label recorded with the results\n"
+              << "  --keep                        Keep archive/log folders\n"
+              << serverOptionsHelp();
+
+}
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    try {
+
+        ServerConfig config;
+        std::string pendulum { PENDULUM_BINARY };
+        std::string outputFile;
+        std::string label { "default" };
+        std::vector<std::string> extraArguments;
+        int runs { 1 };
+        bool bKeep { false };
+
+        config.mailBoxes = { { "INBOX", 1000 } };
+
+        for (int argumentNo = 1; argumentNo < argc;) {
+            std::string option { argv[argumentNo] };
+            int consumed { parseServerOption(config, argc, argv, argumentNo) };
+            if (consumed != 0) {
+                argumentNo += consumed;
+            } else if (option == "--") {
+                extraArguments.assign(argv + argumentNo + 1, argv + argc);
+                break;
+            } else if (option == "--keep") {
+                bKeep = true;
+                argumentNo++;
+            } else if ((option == "--pendulum") && (argumentNo + 1 < argc)) {
+                pendulum = argv[argumentNo + 1];
+                argumentNo += 2;
+            } else if ((option == "--runs") && (argumentNo + 1 < argc)) {
+                runs = std::max(1, std::atoi(argv[argumentNo + 1]));
+                argumentNo += 2;
+            } else if ((option == "--output") && (argumentNo + 1 < argc)) {
+                outputFile = argv[argumentNo + 1];
+                argumentNo += 2;
+            } else if ((option == "--label") && (argumentNo + 1 < argc)) {
+                label = argv[argumentNo + 1];
+                argumentNo += 2;
+            } else {
+                usage();
+                return (EXIT_FAILURE);
+            }
+        }
+
+        std::string mailBoxList;
+        std::uint64_t expectedMessages { 0 };
+        for (auto& mailBox : config.mailBoxes) {
+            mailBoxList += (mailBoxList.empty() ? "" : ",") + mailBox.name;
+            expectedMessages += mailBox.messageCount;
+        }
+
+        int failedRuns { 0 };
+
+        for (int runNo = 1; runNo <= runs; runNo++) {
+
+            fs::path runFolder { createRunFolder() };
+            fs::path destination { runFolder / "archive" };
+            fs::create_directory(destination);
+
+            FakeIMAPServer server { config };
+            server.start();
+
+            std::vector<std::string> arguments { "--server", "127.0.0.1:" + std::to_string(server.getPort()),
+                                                 "--user", "benchmark", "--password", "benchmark",
+                                                 "--mailbox", mailBoxList, "--destination", destination.string() };
+            arguments.insert(arguments.end(), extraArguments.begin(), extraArguments.end());
+
+            RunResult result;
+            result.expectedMessages = expectedMessages;
+
+            result.process = runPendulum(pendulum, arguments, (runFolder / "pendulum.log").string());
+
+            server.stop();
+
+            result.serverStatistics = server.getStatistics();
+            result.latencies = messageLatencies(server.getCommandRecords());
+            result.archive = scanArchive(destination.string());
+
+            std::string json { formatResult(label, config, extraArguments, runNo, result) };
+            if (outputFile.empty()) {
+                std::cout << json << std::endl;
+            } else {
+                std::ofstream output { outputFile, std::ios::app };
+                output << json << std::endl;
+                std::cerr << "Run " << runNo << ": " << result.archive.messages << " messages in "
+                          << std::fixed << std::setprecision(2) << result.process.seconds << "s" << std::endl;
+            }
+
+            // Messages can legitimately be missing if archive policy options were passed
+
+            if (result.process.exitStatus != 0) {
+                std::cerr << "Run " << runNo << " failed (exit status " << result.process.exitStatus << "); see "
+                          << (runFolder / "pendulum.log").string() << std::endl;
+                failedRuns++;
+            } else if (result.archive.messages != result.expectedMessages) {
+                std::cerr << "Run " << runNo << " archived " << result.archive.messages << " of "
+                          << result.expectedMessages << " messages." << std::endl;
+            }
+
+            if (!bKeep && (result.process.exitStatus == 0)) {
+                fs::remove_all(runFolder);
+            }
+
+        }
+
+        return ((failedRuns == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return (EXIT_FAILURE);
+    }
+
+}
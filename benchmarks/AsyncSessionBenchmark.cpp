@@ -0,0 +1,325 @@
+
+//
+// Program: AsyncSessionBenchmark
+//
+// Description: Asynchronous IMAP session engine benchmark. A fake IMAP server is
+// started in process and --sessions sessions are driven against it by an engine of
+// --threads event loop threads; each session logs in, selects the first mailbox and
+// fetches (and parses with the zero-copy parser) every message in it one command at
+// a time, as Pendulum does, then logs out. Connect latency percentiles, messages/s,
+// MB/s, the peak number of sessions open and CPU time are reported as a single line
+// JSON object (appended to --output if given).
+//
+// The server runs a thread per connection and both ends of every session are in
+// this process so the open file limit (ulimit -n) needs to be above twice --sessions.
+//
+// Usage: AsyncSessionBenchmark [--sessions n] [--threads n] [--output file]
+//                              [--label name] [server options]
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Pendulum           : Pendulum_AsyncIMAP, Pendulum_ResponseParse.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+
+//
+// Linux
+//
+
+#include <sys/resource.h>
+
+//
+// Fake IMAP server and benchmark runner
+//
+
+#include "FakeIMAPServer.hpp"
+#include "BenchmarkRunner.hpp"
+
+//
+// Pendulum asynchronous sessions, response parser and metrics
+//
+
+#include "Pendulum_AsyncIMAP.hpp"
+#include "Pendulum_ResponseParse.hpp"
+#include "Pendulum_Metrics.hpp"
+
+// =======
+// IMPORTS
+// =======
+
+using namespace FakeIMAP;
+using namespace BenchmarkRunner;
+using namespace Pendulum_AsyncIMAP;
+
+// ===============
+// LOCAL VARIABLES
+// ===============
+
+//
+// Benchmark run shared by every session's continuations
+//
+
+struct BenchmarkState {
+    std::string mailBox;                                // Mailbox fetched
+    std::uint64_t messageCount { 0 };                   // Messages per session
+    std::chrono::steady_clock::time_point start;        // Run start
+    std::atomic<std::uint64_t> messages { 0 };          // Messages fetched and parsed
+    std::atomic<std::uint64_t> bytes { 0 };             // Body bytes
+    std::atomic<std::uint64_t> failures { 0 };          // Sessions failed
+    std::mutex stateMutex;
+    std::condition_variable sessionFinished;
+    std::uint64_t sessionsFinished { 0 };
+    std::vector<double> connectLatencies;               // Connect/login times (ms)
+    std::string firstError;                             // First failure
+};
+
+// ===============
+// LOCAL FUNCTIONS
+// ===============
+
+//
+// Session finished (or failed).
+//
+
+static void finishSession(BenchmarkState& state, std::exception_ptr error) {
+
+    std::unique_lock<std::mutex> locker(state.stateMutex);
+
+    if (error) {
+        state.failures++;
+        if (state.firstError.empty()) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception& e) {
+                state.firstError = e.what();
+            }
+        }
+    }
+
+    state.sessionsFinished++;
+    state.sessionFinished.notify_all();
+
+}
+
+//
+// Fetch message uid (then the next) or log out once all have been fetched.
+//
+
+static void fetchMessage(BenchmarkState& state, const std::shared_ptr<Session>& session, std::uint64_t uid) {
+
+    if (uid > state.messageCount) {
+        session->disconnect();
+        finishSession(state, nullptr);
+        return;
+    }
+
+    session->sendCommand("UID FETCH " + std::to_string(uid) + " (BODY[])", [&state, session, uid](std::string response, std::exception_ptr error) {
+        if (error) {
+            finishSession(state, error);
+            return;
+        }
+        Pendulum_ResponseParse::PARSEDRESPONSE parsedResponse { Pendulum_ResponseParse::parseResponse(std::move(response)) };
+        if ((parsedResponse->status != Antik::IMAP::CIMAPParse::RespCode::OK) || parsedResponse->fetchList.empty()) {
+            session->disconnect();
+            finishSession(state, std::make_exception_ptr(Exception("UID FETCH " + std::to_string(uid) + " failed")));
+            return;
+        }
+        state.messages++;
+        state.bytes += Pendulum_ResponseParse::findFetchItem(parsedResponse->fetchList.front(), "BODY[").size();
+        fetchMessage(state, session, uid + 1);
+    });
+
+}
+
+//
+// Start a session: connect, select mailbox and fetch its messages.
+//
+
+static void startSession(BenchmarkState& state, const std::shared_ptr<Session>& session) {
+
+    session->connect([&state, session](std::exception_ptr error) {
+        if (error) {
+            finishSession(state, error);
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> locker(state.stateMutex);
+            state.connectLatencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - state.start).count());
+        }
+        session->sendCommand("SELECT " + state.mailBox, [&state, session](std::string, std::exception_ptr error) {
+            if (error) {
+                finishSession(state, error);
+                return;
+            }
+            fetchMessage(state, session, 1);
+        });
+    });
+
+}
+
+//
+// CPU seconds used by the process.
+//
+
+static void cpuSeconds(double& userSeconds, double& systemSeconds) {
+    rusage usage {};
+    ::getrusage(RUSAGE_SELF, &usage);
+    userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    systemSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+//
+// Print usage.
+//
+
+static void usage() {
+
+    std::cerr << "Usage: AsyncSessionBenchmark [options] [server options]\n"
+              << "  --sessions n                  Sessions run at once (default 200)\n"
+              << "  --threads n                   Event loop threads (default 2)\n"
+              << "  --output file                 Append JSON results to file (default stdout)\n"
+              << "  --label name                  Label recorded with the results\n"
+              << serverOptionsHelp();
+
+}
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    try {
+
+        ServerConfig config;
+        std::string outputFile;
+        std::string label { "default" };
+        std::size_t sessionCount { 200 };
+        std::size_t threadCount { 2 };
+
+        config.mailBoxes = { { "INBOX", 20 } };
+
+        for (int argumentNo = 1; argumentNo < argc;) {
+            std::string option { argv[argumentNo] };
+            int consumed { parseServerOption(config, argc, argv, argumentNo) };
+            if (consumed != 0) {
+                argumentNo += consumed;
+            } else if ((option == "--sessions") && (argumentNo + 1 < argc)) {
+                sessionCount = std::max(1, std::atoi(argv[argumentNo + 1]));
+                argumentNo += 2;
+            } else if ((option == "--threads") && (argumentNo + 1 < argc)) {
+                threadCount = std::max(1, std::atoi(argv[argumentNo + 1]));
+                argumentNo += 2;
+            } else if ((option == "--output") && (argumentNo + 1 < argc)) {
+                outputFile = argv[argumentNo + 1];
+                argumentNo += 2;
+            } else if ((option == "--label") && (argumentNo + 1 < argc)) {
+                label = argv[argumentNo + 1];
+                argumentNo += 2;
+            } else {
+                usage();
+                return (EXIT_FAILURE);
+            }
+        }
+
+        FakeIMAPServer server { config };
+        server.start();
+
+        BenchmarkState state;
+        state.mailBox = config.mailBoxes.front().name;
+        state.messageCount = config.mailBoxes.front().messageCount;
+
+        std::size_t peakSessions { 0 };
+        double startUser, startSystem, endUser, endSystem;
+        std::chrono::duration<double> elapsed;
+
+        {
+            Engine engine { threadCount };
+            std::string serverURL { (config.bTLS ? "imaps://127.0.0.1:" : "imap://127.0.0.1:") + std::to_string(server.getPort()) };
+
+            cpuSeconds(startUser, startSystem);
+            state.start = std::chrono::steady_clock::now();
+
+            for (std::size_t sessionNo = 0; sessionNo < sessionCount; sessionNo++) {
+                startSession(state, engine.createSession(serverURL, "benchmark", "benchmark"));
+            }
+
+            std::unique_lock<std::mutex> locker(state.stateMutex);
+            while (state.sessionsFinished < sessionCount) {
+                state.sessionFinished.wait_for(locker, std::chrono::milliseconds(100));
+                peakSessions = std::max(peakSessions, engine.sessionCount());
+            }
+
+            elapsed = std::chrono::steady_clock::now() - state.start;
+            cpuSeconds(endUser, endSystem);
+        }
+
+        server.stop();
+
+        std::sort(state.connectLatencies.begin(), state.connectLatencies.end());
+
+        rusage usage {};
+        ::getrusage(RUSAGE_SELF, &usage);
+
+        double seconds { std::max(elapsed.count(), 1e-9) };
+        std::ostringstream json;
+
+        json << std::fixed << std::setprecision(3);
+        json << "{\"benchmark\":\"async_sessions\",\"label\":" << jsonEscape(label) << ",\"timestamp\":" << jsonTimeStamp()
+             << ",\"config\":{\"sessions\":" << sessionCount << ",\"threads\":" << threadCount
+             << ",\"mailbox\":" << jsonEscape(state.mailBox) << ",\"messages_per_session\":" << state.messageCount
+             << ",\"median_size\":" << config.medianSize << ",\"latency_ms\":" << (config.latency.count() / 1000.0)
+             << ",\"tls\":" << (config.bTLS ? "true" : "false") << "}"
+             << ",\"results\":{\"seconds\":" << elapsed.count()
+             << ",\"connected\":" << state.connectLatencies.size()
+             << ",\"failures\":" << state.failures
+             << ",\"messages\":" << state.messages
+             << ",\"bytes\":" << state.bytes
+             << ",\"messages_per_second\":" << (static_cast<double>(state.messages) / seconds)
+             << ",\"mb_per_second\":" << (static_cast<double>(state.bytes) / (1024.0 * 1024.0) / seconds)
+             << ",\"connect_ms\":{\"p50\":" << percentile(state.connectLatencies, 50.0)
+             << ",\"p99\":" << percentile(state.connectLatencies, 99.0)
+             << ",\"max\":" << (state.connectLatencies.empty() ? 0.0 : state.connectLatencies.back()) << "}"
+             << ",\"tls_handshakes\":" << Pendulum_Metrics::counter("pendulum_tls_handshakes_total", "TLS handshakes completed.").get()
+             << ",\"tls_resumed\":" << Pendulum_Metrics::counter("pendulum_tls_sessions_resumed_total", "TLS handshakes that resumed a cached session.").get()
+             << ",\"peak_sessions\":" << peakSessions
+             << ",\"user_seconds\":" << (endUser - startUser)
+             << ",\"system_seconds\":" << (endSystem - startSystem)
+             << ",\"peak_rss_kb\":" << usage.ru_maxrss;
+        if (!state.firstError.empty()) {
+            json << ",\"first_error\":" << jsonEscape(state.firstError);
+        }
+        json << "}}";
+
+        if (outputFile.empty()) {
+            std::cout << json.str() << std::endl;
+        } else {
+            std::ofstream output { outputFile, std::ios::app };
+            output << json.str() << std::endl;
+        }
+
+        return ((state.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    } catch (const std::exception& e) {
+        std::cerr << "AsyncSessionBenchmark Error: " << e.what() << std::endl;
+        return (EXIT_FAILURE);
+    }
+
+}
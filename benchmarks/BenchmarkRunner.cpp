@@ -0,0 +1,195 @@
+
+//
+// Module: BenchmarkRunner
+//
+// Description: Helpers shared by the end-to-end benchmarks: run the Pendulum binary as a
+// child process (collecting wall time, CPU time and peak RSS via wait4), scan the
+// resulting archive for .eml files and format JSON results.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+//
+// Benchmark runner
+//
+
+#include "BenchmarkRunner.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace BenchmarkRunner {
+
+    namespace fs = std::filesystem;
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    ProcessResult runPendulum(const std::string& pendulum, const std::vector<std::string>& arguments,
+                              const std::string& logFile) {
+
+        ProcessResult result;
+        std::vector<char *> argv;
+
+        argv.push_back(const_cast<char *>(pendulum.c_str()));
+        for (auto& argument : arguments) {
+            argv.push_back(const_cast<char *>(argument.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        auto start { std::chrono::steady_clock::now() };
+
+        pid_t pid { ::fork() };
+        if (pid < 0) {
+            throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+        }
+
+        if (pid == 0) {
+            int logFd { ::open(logFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+            if (logFd >= 0) {
+                ::dup2(logFd, STDOUT_FILENO);
+                ::dup2(logFd, STDERR_FILENO);
+                ::close(logFd);
+            }
+            ::execv(pendulum.c_str(), argv.data());
+            std::perror(pendulum.c_str());
+            ::_exit(127);
+        }
+
+        int status { 0 };
+        rusage usage {};
+        if (::wait4(pid, &status, 0, &usage) < 0) {
+            throw std::runtime_error(std::string("wait4 failed: ") + std::strerror(errno));
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : (128 + WTERMSIG(status));
+        result.peakRSSKB = usage.ru_maxrss;
+        result.userSeconds = static_cast<double>(usage.ru_utime.tv_sec) + static_cast<double>(usage.ru_utime.tv_usec) / 1e6;
+        result.systemSeconds = static_cast<double>(usage.ru_stime.tv_sec) + static_cast<double>(usage.ru_stime.tv_usec) / 1e6;
+
+        return (result);
+
+    }
+
+    //
+    // File names are "(UID) subject.eml" in a folder per mailbox.
+    //
+
+    ArchiveContents scanArchive(const std::string& destination) {
+
+        ArchiveContents contents;
+
+        if (!fs::exists(destination)) {
+            return (contents);
+        }
+
+        for (auto& entry : fs::recursive_directory_iterator(destination)) {
+            if (entry.is_regular_file() && (entry.path().extension() == ".eml")) {
+                contents.messages++;
+                contents.bytes += entry.file_size();
+                std::string fileName { entry.path().filename().string() };
+                if (fileName.front() == '(') {
+                    contents.files[fs::relative(entry.path().parent_path(), destination).string()].push_back(
+                            { std::strtoull(fileName.c_str() + 1, nullptr, 10), entry.file_size() });
+                }
+            }
+        }
+
+        for (auto& mailBox : contents.files) {
+            std::sort(mailBox.second.begin(), mailBox.second.end(),
+                      [] (const ArchivedFile& a, const ArchivedFile& b) { return (a.uid < b.uid); });
+        }
+
+        return (contents);
+
+    }
+
+    std::string createRunFolder() {
+
+        char runFolderTemplate[] { "/tmp/pendulum-benchmark-XXXXXX" };
+
+        if (::mkdtemp(runFolderTemplate) == nullptr) {
+            throw std::runtime_error(std::string("mkdtemp failed: ") + std::strerror(errno));
+        }
+
+        return (runFolderTemplate);
+
+    }
+
+    std::string jsonEscape(const std::string& value) {
+
+        std::ostringstream escaped;
+
+        for (unsigned char ch : value) {
+            if ((ch == '\"') || (ch == '\\')) {
+                escaped << '\\' << ch;
+            } else if (ch < 0x20) {
+                escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(ch) << std::dec;
+            } else {
+                escaped << ch;
+            }
+        }
+
+        return ("\"" + escaped.str() + "\"");
+
+    }
+
+    std::string jsonTimeStamp() {
+
+        std::time_t now { std::time(nullptr) };
+        char timeStamp[32];
+
+        std::strftime(timeStamp, sizeof(timeStamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        return ("\"" + std::string(timeStamp) + "\"");
+
+    }
+
+    double percentile(const std::vector<double>& sorted, double percent) {
+
+        if (sorted.empty()) {
+            return (0.0);
+        }
+
+        std::size_t index { static_cast<std::size_t>((percent / 100.0) * static_cast<double>(sorted.size() - 1) + 0.5) };
+
+        return (sorted[std::min(index, sorted.size() - 1)]);
+
+    }
+
+} // namespace BenchmarkRunner
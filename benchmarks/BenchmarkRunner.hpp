@@ -0,0 +1,79 @@
+#ifndef BENCHMARKRUNNER_HPP
+#define BENCHMARKRUNNER_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace BenchmarkRunner {
+
+    //
+    // Pendulum process run result
+    //
+
+    struct ProcessResult {
+        int exitStatus { -1 };          // Exit status (128 + signal if killed)
+        double seconds { 0.0 };         // Wall clock time
+        double userSeconds { 0.0 };     // User CPU time
+        double systemSeconds { 0.0 };   // System CPU time
+        long peakRSSKB { 0 };           // Peak resident set size (KB)
+    };
+
+    //
+    // Archived .eml files found under a destination folder
+    //
+
+    struct ArchivedFile {
+        std::uint64_t uid { 0 };        // UID from file name
+        std::uint64_t size { 0 };       // File size
+    };
+
+    struct ArchiveContents {
+        std::uint64_t messages { 0 };                                   // .eml files
+        std::uint64_t bytes { 0 };                                      // Total size
+        std::map<std::string, std::vector<ArchivedFile>> files;         // Mailbox folder -> files (UID order)
+    };
+
+    //
+    // Run Pendulum with arguments (output to logFile) and wait for it to exit.
+    //
+
+    ProcessResult runPendulum(const std::string& pendulum, const std::vector<std::string>& arguments,
+                              const std::string& logFile);
+
+    //
+    // Scan destination for archived .eml files.
+    //
+
+    ArchiveContents scanArchive(const std::string& destination);
+
+    //
+    // Create a temporary run folder.
+    //
+
+    std::string createRunFolder();
+
+    //
+    // JSON helpers.
+    //
+
+    std::string jsonEscape(const std::string& value);
+    std::string jsonTimeStamp();
+
+    //
+    // Return percentile (0..100) of sorted values.
+    //
+
+    double percentile(const std::vector<double>& sorted, double percent);
+
+} // namespace BenchmarkRunner
+#endif /* BENCHMARKRUNNER_HPP */
@@ -0,0 +1,965 @@
+
+//
+// Module: FakeIMAPServer
+//
+// Description: Self-contained IMAP stand-in used by the Pendulum end-to-end benchmarks.
+// It serves synthetic mailboxes (message count per mailbox, log-normal message size
+// distribution) over IMAPS using a self-signed certificate generated at start up
+// (or a supplied certificate/key), or plain TCP. A per-response latency and a per
+// connection send bandwidth can be configured to model real servers. Only the
+// commands Pendulum issues are implemented (CAPABILITY, LOGIN, AUTHENTICATE, SELECT,
+// EXAMINE, LIST, STATUS, SEARCH, FETCH, their UID forms, NOOP, IDLE and LOGOUT).
+// Every command is recorded with its receive/send times so that per-message
+// latency can be derived afterwards. Protocol faults (untagged BYE then close, and
+// connections closed part way through a message literal) can be injected on a
+// schedule for the reconnect recovery benchmarks.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// OpenSSL            : TLS and certificate generation.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+//
+// OpenSSL
+//
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/x509.h>
+
+//
+// Fake IMAP server
+//
+
+#include "FakeIMAPServer.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace FakeIMAP {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    constexpr std::size_t kReadBufferSize { 16 * 1024 };
+    constexpr std::size_t kWriteChunkSize { 16 * 1024 };
+    constexpr std::size_t kMaxRecordedCommand { 64 };
+    constexpr std::uint64_t kMinGeneratedSize { 1024 };
+    constexpr int kSenderCount { 50 };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Upper case a string.
+    //
+
+    static std::string toUpper(std::string value) {
+
+        for (auto& ch : value) {
+            ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+        }
+
+        return (value);
+
+    }
+
+    //
+    // Remove surrounding quotes from a mailbox name.
+    //
+
+    static std::string unquote(const std::string& value) {
+
+        if ((value.size() >= 2) && (value.front() == '\"') && (value.back() == '\"')) {
+            return (value.substr(1, value.size() - 2));
+        }
+
+        return (value);
+
+    }
+
+    //
+    // Parse size with optional K/M/G suffix.
+    //
+
+    static std::uint64_t parseSize(const std::string& value) {
+
+        char *suffix { nullptr };
+        double size { std::strtod(value.c_str(), &suffix) };
+
+        switch (std::toupper(static_cast<unsigned char>(*suffix))) {
+            case 'G': size *= 1024.0;
+                [[fallthrough]];
+            case 'M': size *= 1024.0;
+                [[fallthrough]];
+            case 'K': size *= 1024.0;
+                break;
+            default:
+                break;
+        }
+
+        return (static_cast<std::uint64_t>(size));
+
+    }
+
+    //
+    // Split command arguments on spaces; quoted strings and parenthesised lists are
+    // kept as single arguments.
+    //
+
+    static std::vector<std::string> splitArguments(const std::string& arguments) {
+
+        std::vector<std::string> argumentList;
+        std::string current;
+        int depth { 0 };
+        bool bQuoted { false };
+
+        for (char ch : arguments) {
+            if (ch == '\"') {
+                bQuoted = !bQuoted;
+            } else if (!bQuoted && (ch == '(')) {
+                depth++;
+            } else if (!bQuoted && (ch == ')')) {
+                depth--;
+            } else if (!bQuoted && (depth == 0) && (ch == ' ')) {
+                if (!current.empty()) {
+                    argumentList.push_back(current);
+                    current.clear();
+                }
+                continue;
+            }
+            current += ch;
+        }
+
+        if (!current.empty()) {
+            argumentList.push_back(current);
+        }
+
+        return (argumentList);
+
+    }
+
+    //
+    // Expand an IMAP sequence set ("1:5,7,9:*") against messages 1..messageCount.
+    //
+
+    static std::vector<std::uint64_t> expandSequenceSet(const std::string& sequenceSet, std::uint64_t messageCount) {
+
+        std::vector<std::uint64_t> uids;
+
+        if (messageCount == 0) {
+            return (uids);
+        }
+
+        auto toNumber = [messageCount] (const std::string& value) -> std::uint64_t {
+            return ((value == "*") ? messageCount : std::strtoull(value.c_str(), nullptr, 10));
+        };
+
+        std::istringstream setStream { sequenceSet };
+        for (std::string range; std::getline(setStream, range, ',');) {
+            std::size_t colon { range.find(':') };
+            std::uint64_t first { toNumber(range.substr(0, colon)) };
+            std::uint64_t last { (colon == std::string::npos) ? first : toNumber(range.substr(colon + 1)) };
+            if (first > last) {
+                std::swap(first, last);
+            }
+            first = std::max<std::uint64_t>(first, 1);
+            last = std::min(last, messageCount);
+            if ((first > messageCount) && (colon != std::string::npos) && (range.back() == '*')) {
+                first = last = messageCount; // n:* where n > highest matches highest
+            }
+            for (std::uint64_t uid = first; uid <= last; uid++) {
+                uids.push_back(uid);
+            }
+        }
+
+        std::sort(uids.begin(), uids.end());
+        uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+
+        return (uids);
+
+    }
+
+    //
+    // Deterministic seed for a message.
+    //
+
+    static std::uint64_t messageSeed(const std::string& mailBox, std::uint64_t uid) {
+        return (std::hash<std::string>{}(mailBox) ^ (uid * 0x9E3779B97F4A7C15ULL));
+    }
+
+    //
+    // Message header fields.
+    //
+
+    static std::string messageSubject(const std::string& mailBox, std::uint64_t uid) {
+        return ("Benchmark message " + mailBox + " " + std::to_string(uid));
+    }
+
+    static std::string messageSender(std::uint64_t uid) {
+        return ("sender" + std::to_string(uid % kSenderCount));
+    }
+
+    static std::string messageDate(std::uint64_t uid) {
+        return ("Mon, 1 Jan 2024 " + std::to_string(10 + (uid / 3600) % 14) + ":" +
+                std::to_string(10 + (uid / 60) % 50) + ":" + std::to_string(10 + uid % 50) + " +0000");
+    }
+
+    //
+    // Create a self-signed certificate and key for "localhost".
+    //
+
+    static void createSelfSignedCertificate(SSL_CTX *sslContext) {
+
+        EVP_PKEY *privateKey { nullptr };
+        EVP_PKEY_CTX *keyContext { EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr) };
+
+        if ((keyContext == nullptr) || (EVP_PKEY_keygen_init(keyContext) <= 0) ||
+            (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1) <= 0) ||
+            (EVP_PKEY_CTX_set_ec_param_enc(keyContext, OPENSSL_EC_NAMED_CURVE) <= 0) ||
+            (EVP_PKEY_keygen(keyContext, &privateKey) <= 0)) {
+            EVP_PKEY_CTX_free(keyContext);
+            throw std::runtime_error("Could not generate server key.");
+        }
+        EVP_PKEY_CTX_free(keyContext);
+
+        X509 *certificate { X509_new() };
+        X509_set_version(certificate, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+        X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+        X509_gmtime_adj(X509_getm_notAfter(certificate), 365L * 24 * 60 * 60);
+        X509_set_pubkey(certificate, privateKey);
+        X509_NAME *name { X509_get_subject_name(certificate) };
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(certificate, name);
+
+        bool bOK { (X509_sign(certificate, privateKey, EVP_sha256()) > 0) &&
+                   (SSL_CTX_use_certificate(sslContext, certificate) == 1) &&
+                   (SSL_CTX_use_PrivateKey(sslContext, privateKey) == 1) };
+
+        X509_free(certificate);
+        EVP_PKEY_free(privateKey);
+
+        if (!bOK) {
+            throw std::runtime_error("Could not create self-signed server certificate.");
+        }
+
+    }
+
+    // ==============
+    // CLIENT SESSION
+    // ==============
+
+    //
+    // Client connection (TLS or plain) with line reads and bandwidth paced writes.
+    //
+
+    class FakeIMAPServer::Session {
+    public:
+
+        Session(int socketFd, SSL_CTX *sslContext, std::uint64_t bandwidth)
+        : socketFd(socketFd), bandwidth(bandwidth) {
+            if (sslContext != nullptr) {
+                ssl = SSL_new(sslContext);
+                SSL_set_fd(ssl, socketFd);
+            }
+        }
+
+        ~Session() {
+            if (ssl != nullptr) {
+                SSL_shutdown(ssl);
+                SSL_free(ssl);
+            }
+        }
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+        bool handshake() {
+            return ((ssl == nullptr) || (SSL_accept(ssl) == 1));
+        }
+
+        //
+        // Read a CRLF terminated line (terminator removed); false on disconnect.
+        //
+
+        bool readLine(std::string& line) {
+
+            while (true) {
+                std::size_t lineEnd { readBuffer.find("\r\n") };
+                if (lineEnd != std::string::npos) {
+                    line = readBuffer.substr(0, lineEnd);
+                    readBuffer.erase(0, lineEnd + 2);
+                    return (true);
+                }
+                char buffer[kReadBufferSize];
+                long bytesRead { (ssl != nullptr) ? SSL_read(ssl, buffer, sizeof(buffer)) :
+                                                    ::recv(socketFd, buffer, sizeof(buffer), 0) };
+                if (bytesRead <= 0) {
+                    return (false);
+                }
+                readBuffer.append(buffer, static_cast<std::size_t>(bytesRead));
+            }
+
+        }
+
+        //
+        // Write data; if a bandwidth is set writes are paced to it.
+        //
+
+        bool write(const std::string& data) {
+
+            if (bandwidth != 0) {
+                auto now { std::chrono::steady_clock::now() };
+                if (now > paceStart + std::chrono::microseconds((totalWritten * 1000000) / bandwidth)) {
+                    paceStart = now;    // Idle time is not banked as burst credit
+                    totalWritten = 0;
+                }
+            }
+
+            for (std::size_t offset = 0; offset < data.size();) {
+                std::size_t chunkSize { std::min(kWriteChunkSize, data.size() - offset) };
+                long bytesWritten { (ssl != nullptr) ? SSL_write(ssl, data.data() + offset, static_cast<int>(chunkSize)) :
+                                                       ::send(socketFd, data.data() + offset, chunkSize, MSG_NOSIGNAL) };
+                if (bytesWritten <= 0) {
+                    return (false);
+                }
+                offset += static_cast<std::size_t>(bytesWritten);
+                totalWritten += static_cast<std::uint64_t>(bytesWritten);
+                if (bandwidth != 0) {
+                    auto due { paceStart + std::chrono::microseconds((totalWritten * 1000000) / bandwidth) };
+                    std::this_thread::sleep_until(due);
+                }
+            }
+
+            return (true);
+
+        }
+
+    private:
+
+        int socketFd { -1 };
+        SSL *ssl { nullptr };
+        std::uint64_t bandwidth { 0 };
+        std::string readBuffer;
+        std::uint64_t totalWritten { 0 };
+        std::chrono::steady_clock::time_point paceStart { std::chrono::steady_clock::now() };
+
+    };
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Create server TLS context using given certificate/key or a self-signed one.
+    //
+
+    void FakeIMAPServer::createTLSContext() {
+
+        sslContext = SSL_CTX_new(TLS_server_method());
+        if (sslContext == nullptr) {
+            throw std::runtime_error("Could not create server TLS context.");
+        }
+
+        if (!config.certFile.empty()) {
+            if ((SSL_CTX_use_certificate_chain_file(sslContext, config.certFile.c_str()) != 1) ||
+                (SSL_CTX_use_PrivateKey_file(sslContext, (config.keyFile.empty() ? config.certFile : config.keyFile).c_str(), SSL_FILETYPE_PEM) != 1)) {
+                throw std::runtime_error("Could not load server certificate [" + config.certFile + "].");
+            }
+        } else {
+            createSelfSignedCertificate(sslContext);
+        }
+
+    }
+
+    const MailBox* FakeIMAPServer::findMailBox(const std::string& name) const {
+
+        for (auto& mailBox : config.mailBoxes) {
+            if ((mailBox.name == name) || ((toUpper(name) == "INBOX") && (toUpper(mailBox.name) == "INBOX"))) {
+                return (&mailBox);
+            }
+        }
+
+        return (nullptr);
+
+    }
+
+    void FakeIMAPServer::recordCommand(const CommandRecord& record) {
+
+        std::lock_guard<std::mutex> locker(statisticsMutex);
+
+        statistics.commands++;
+        statistics.bytesSent += record.bytes;
+        if (record.uid != 0) {
+            statistics.bodiesSent++;
+        }
+        commandRecords.push_back(record);
+
+    }
+
+    void FakeIMAPServer::recordFault(bool bBye) {
+
+        std::lock_guard<std::mutex> locker(statisticsMutex);
+
+        if (bBye) {
+            statistics.byesInjected++;
+        } else {
+            statistics.truncationsInjected++;
+        }
+        faultTimes.push_back(std::chrono::steady_clock::now());
+
+    }
+
+    //
+    // Accept connections until stopped; each is served on its own thread.
+    //
+
+    void FakeIMAPServer::acceptConnections() {
+
+        std::uint64_t connectionNo { 0 };
+
+        while (bRunning) {
+            int socketFd { ::accept(listenFd, nullptr, nullptr) };
+            if (socketFd < 0) {
+                if (!bRunning) {
+                    break;
+                }
+                continue;
+            }
+            int noDelay { 1 };
+            ::setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            std::lock_guard<std::mutex> locker(connectionMutex);
+            connectionFds.push_back(socketFd);
+            connectionThreads.emplace_back(&FakeIMAPServer::serveConnection, this, socketFd, ++connectionNo);
+        }
+
+    }
+
+    //
+    // Serve one client connection.
+    //
+
+    void FakeIMAPServer::serveConnection(int socketFd, std::uint64_t connectionNo) {
+
+        {
+            std::lock_guard<std::mutex> locker(statisticsMutex);
+            statistics.connections++;
+        }
+
+        {
+            Session session { socketFd, sslContext, config.bandwidth };
+
+            if (session.handshake() && session.write("* OK [CAPABILITY IMAP4rev1 AUTH=PLAIN] Fake IMAP server ready\r\n")) {
+                std::string selectedMailBox;
+                for (std::string line; bRunning && session.readLine(line);) {
+                    CommandRecord record;
+                    record.connection = connectionNo;
+                    record.received = std::chrono::steady_clock::now();
+                    std::size_t tagEnd { line.find(' ') };
+                    if (tagEnd == std::string::npos) {
+                        continue;
+                    }
+                    std::string tag { line.substr(0, tagEnd) };
+                    std::string command { line.substr(tagEnd + 1) };
+                    record.command = command.substr(0, kMaxRecordedCommand);
+                    bool bConnected { true };
+                    try {
+                        bConnected = processCommand(session, tag, command, selectedMailBox, record);
+                    } catch (std::exception& e) {
+                        session.write(tag + " BAD " + e.what() + "\r\n");
+                    }
+                    record.mailBox = selectedMailBox;
+                    record.sent = std::chrono::steady_clock::now();
+                    recordCommand(record);
+                    if (!bConnected || (toUpper(command) == "LOGOUT")) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> locker(connectionMutex);
+        connectionFds.erase(std::remove(connectionFds.begin(), connectionFds.end(), socketFd), connectionFds.end());
+        ::close(socketFd);
+
+    }
+
+    //
+    // Process a single tagged command; returns false if the connection is to be closed.
+    //
+
+    bool FakeIMAPServer::processCommand(Session& session, const std::string& tag, const std::string& command,
+                                        std::string& selectedMailBox, CommandRecord& record) {
+
+        std::vector<std::string> arguments { splitArguments(command) };
+        std::string verb { toUpper(arguments.empty() ? "" : arguments[0]) };
+        bool bUID { false };
+
+        if ((verb == "UID") && (arguments.size() > 1)) {
+            bUID = true;
+            arguments.erase(arguments.begin());
+            verb = toUpper(arguments[0]);
+        }
+
+        std::string response;
+
+        if (config.latency.count() != 0) {
+            std::this_thread::sleep_for(config.latency);
+        }
+
+        if ((config.faults.byeEvery != 0) && ((verb == "SELECT") || (verb == "EXAMINE") || (verb == "SEARCH") ||
+            (verb == "FETCH") || (verb == "STATUS") || (verb == "LIST")) && ((++mailBoxCommands % config.faults.byeEvery) == 0)) {
+            recordFault(true);
+            session.write("* BYE Fault injected, server shutting down connection\r\n");
+            return (false);
+        }
+
+        if (verb == "CAPABILITY") {
+            response = "* CAPABILITY IMAP4rev1 AUTH=PLAIN IDLE\r\n" + tag + " OK CAPABILITY completed\r\n";
+        } else if (verb == "LOGIN") {
+            std::lock_guard<std::mutex> locker(statisticsMutex);
+            statistics.logins++;
+            response = tag + " OK LOGIN completed\r\n";
+        } else if (verb == "AUTHENTICATE") {
+            std::string credentials;
+            if ((arguments.size() < 3) && (!session.write("+ \r\n") || !session.readLine(credentials))) {
+                return (false);
+            }
+            std::lock_guard<std::mutex> locker(statisticsMutex);
+            statistics.logins++;
+            response = tag + " OK AUTHENTICATE completed\r\n";
+        } else if (((verb == "SELECT") || (verb == "EXAMINE")) && (arguments.size() > 1)) {
+            const MailBox *mailBox { findMailBox(unquote(arguments[1])) };
+            if (mailBox == nullptr) {
+                selectedMailBox.clear();
+                response = tag + " NO Mailbox does not exist\r\n";
+            } else {
+                selectedMailBox = mailBox->name;
+                response = "* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft)\r\n* " +
+                        std::to_string(mailBox->messageCount) + " EXISTS\r\n* 0 RECENT\r\n" +
+                        "* OK [UIDVALIDITY 1] UIDs valid\r\n* OK [UIDNEXT " + std::to_string(mailBox->messageCount + 1) +
+                        "] Predicted next UID\r\n" + tag + ((verb == "SELECT") ? " OK [READ-WRITE] SELECT" : " OK [READ-ONLY] EXAMINE") +
+                        " completed\r\n";
+            }
+        } else if (verb == "LIST") {
+            for (auto& mailBox : config.mailBoxes) {
+                response += "* LIST (\\HasNoChildren) \"/\" \"" + mailBox.name + "\"\r\n";
+            }
+            response += tag + " OK LIST completed\r\n";
+        } else if ((verb == "STATUS") && (arguments.size() > 1)) {
+            const MailBox *mailBox { findMailBox(unquote(arguments[1])) };
+            if (mailBox == nullptr) {
+                response = tag + " NO Mailbox does not exist\r\n";
+            } else {
+                response = "* STATUS \"" + mailBox->name + "\" (MESSAGES " + std::to_string(mailBox->messageCount) +
+                        " UIDNEXT " + std::to_string(mailBox->messageCount + 1) + " UIDVALIDITY 1)\r\n" +
+                        tag + " OK STATUS completed\r\n";
+            }
+        } else if (verb == "SEARCH") {
+            const MailBox *mailBox { findMailBox(selectedMailBox) };
+            if (mailBox == nullptr) {
+                response = tag + " BAD No mailbox selected\r\n";
+            } else {
+                std::vector<std::uint64_t> uids { expandSequenceSet("1:*", mailBox->messageCount) };
+                for (std::size_t argumentNo = 1; argumentNo < arguments.size(); argumentNo++) {
+                    std::string criterion { toUpper(arguments[argumentNo]) };
+                    bool bNot { (criterion == "NOT") && (argumentNo + 1 < arguments.size()) };
+                    if (bNot) {
+                        criterion = toUpper(arguments[++argumentNo]);
+                    }
+                    if (((criterion == "UID") || (criterion == "LARGER") || (criterion == "SMALLER") ||
+                         (criterion == "FROM") || (criterion == "SINCE")) && (argumentNo + 1 < arguments.size())) {
+                        std::string value { arguments[++argumentNo] };
+                        std::vector<std::uint64_t> matched;
+                        if (criterion == "UID") {
+                            matched = expandSequenceSet(value, mailBox->messageCount);
+                        } else {
+                            for (auto uid : uids) {
+                                std::uint64_t size { messageSize(mailBox->name, uid) };
+                                std::uint64_t limit { std::strtoull(value.c_str(), nullptr, 10) };
+                                if (((criterion == "LARGER") && (size > limit)) ||
+                                    ((criterion == "SMALLER") && (size < limit)) ||
+                                    ((criterion == "FROM") && (unquote(value).find(messageSender(uid)) != std::string::npos)) ||
+                                    (criterion == "SINCE")) {
+                                    matched.push_back(uid);
+                                }
+                            }
+                        }
+                        std::vector<std::uint64_t> result;
+                        for (auto uid : uids) {
+                            if (std::binary_search(matched.begin(), matched.end(), uid) != bNot) {
+                                result.push_back(uid);
+                            }
+                        }
+                        uids = std::move(result);
+                    }
+                }
+                response = "* SEARCH";
+                for (auto uid : uids) {
+                    response += " " + std::to_string(uid);
+                }
+                response += "\r\n" + tag + " OK SEARCH completed\r\n";
+            }
+        } else if ((verb == "FETCH") && (arguments.size() > 2)) {
+            const MailBox *mailBox { findMailBox(selectedMailBox) };
+            if (mailBox == nullptr) {
+                response = tag + " BAD No mailbox selected\r\n";
+            } else {
+                std::string items { toUpper(command.substr(command.find(arguments[2]))) };
+                if (!sendFetch(session, mailBox->name, expandSequenceSet(arguments[1], mailBox->messageCount), items, bUID, record)) {
+                    return (false);
+                }
+                response = tag + " OK FETCH completed\r\n";
+            }
+        } else if (verb == "IDLE") {
+            std::string done;
+            if (!session.write("+ idling\r\n") || !session.readLine(done)) {
+                return (false);
+            }
+            response = tag + " OK IDLE terminated\r\n";
+        } else if ((verb == "NOOP") || (verb == "CHECK")) {
+            response = tag + " OK " + verb + " completed\r\n";
+        } else if (verb == "LOGOUT") {
+            response = "* BYE Fake IMAP server logging out\r\n" + tag + " OK LOGOUT completed\r\n";
+        } else {
+            response = tag + " BAD Command unknown or arguments invalid\r\n";
+        }
+
+        record.bytes += response.size();
+
+        return (session.write(response));
+
+    }
+
+    //
+    // Send untagged FETCH responses for the passed UIDs (one write per message). Returns
+    // false if the connection is to be closed.
+    //
+
+    bool FakeIMAPServer::sendFetch(Session& session, const std::string& mailBox, const std::vector<std::uint64_t>& uids,
+                                   const std::string& items, bool bUID, CommandRecord& record) {
+
+        bool bBody { (items.find("BODY[]") != std::string::npos) || (items.find("BODY.PEEK[]") != std::string::npos) ||
+                     (items.find("RFC822 ") != std::string::npos) || (items.find("RFC822)") != std::string::npos) };
+
+        for (auto uid : uids) {
+
+            std::string response { "* " + std::to_string(uid) + " FETCH (" };
+            std::string separator;
+
+            if (bUID || (items.find("UID") != std::string::npos)) {
+                response += "UID " + std::to_string(uid);
+                separator = " ";
+            }
+            if (items.find("FLAGS") != std::string::npos) {
+                response += separator + "FLAGS (\\Seen)";
+                separator = " ";
+            }
+            if (items.find("RFC822.SIZE") != std::string::npos) {
+                response += separator + "RFC822.SIZE " + std::to_string(messageSize(mailBox, uid));
+                separator = " ";
+            }
+            if (items.find("ENVELOPE") != std::string::npos) {
+                std::string sender { "((\"Sender\" NIL \"" + messageSender(uid) + "\" \"example.com\"))" };
+                response += separator + "ENVELOPE (\"" + messageDate(uid) + "\" \"" + messageSubject(mailBox, uid) + "\" " +
+                        sender + " " + sender + " " + sender + " ((\"Archive\" NIL \"archive\" \"example.com\")) NIL NIL NIL \"<" +
+                        std::to_string(uid) + "." + mailBox + "@fakeimap>\")";
+                separator = " ";
+            }
+            if (bBody) {
+                std::string message { generateMessage(mailBox, uid) };
+                response += separator + "BODY[] {" + std::to_string(message.size()) + "}\r\n" + message;
+                separator = " ";
+                record.uid = uid;
+            }
+            if (items.find("HEADER.FIELDS (SUBJECT)") != std::string::npos) {
+                std::string subject { "Subject: " + messageSubject(mailBox, uid) + "\r\n\r\n" };
+                response += separator + "BODY[HEADER.FIELDS (SUBJECT)] {" + std::to_string(subject.size()) + "}\r\n" + subject;
+            }
+            response += ")\r\n";
+
+            if (bBody && (config.faults.truncateEvery != 0) && ((++bodyFetches % config.faults.truncateEvery) == 0)) {
+                recordFault(false);
+                response.resize(response.size() / 2);
+                record.bytes += response.size();
+                session.write(response);
+                return (false);
+            }
+
+            record.bytes += response.size();
+            if (!session.write(response)) {
+                return (false);
+            }
+
+        }
+
+        return (true);
+
+    }
+
+    // ================
+    // PUBLIC FUNCTIONS
+    // ================
+
+    int parseServerOption(ServerConfig& config, int argc, char *argv[], int argumentNo) {
+
+        std::string option { argv[argumentNo] };
+
+        if (option == "--plain") {
+            config.bTLS = false;
+            return (1);
+        }
+
+        if (argumentNo + 1 >= argc) {
+            return (0);
+        }
+
+        std::string value { argv[argumentNo + 1] };
+
+        if (option == "--port") {
+            config.port = std::atoi(value.c_str());
+        } else if (option == "--mailboxes") {
+            config.mailBoxes.clear();
+            std::istringstream mailBoxStream { value };
+            for (std::string mailBox; std::getline(mailBoxStream, mailBox, ',');) {
+                std::size_t colon { mailBox.rfind(':') };
+                if (colon == std::string::npos) {
+                    throw std::invalid_argument("Mailbox [" + mailBox + "] must be name:count.");
+                }
+                config.mailBoxes.push_back({ mailBox.substr(0, colon), std::strtoull(mailBox.substr(colon + 1).c_str(), nullptr, 10) });
+            }
+        } else if (option == "--min-size") {
+            config.minSize = parseSize(value);
+        } else if (option == "--median-size") {
+            config.medianSize = parseSize(value);
+        } else if (option == "--max-size") {
+            config.maxSize = parseSize(value);
+        } else if (option == "--sigma") {
+            config.sizeSigma = std::strtod(value.c_str(), nullptr);
+        } else if (option == "--latency-ms") {
+            config.latency = std::chrono::microseconds(static_cast<std::int64_t>(std::strtod(value.c_str(), nullptr) * 1000.0));
+        } else if (option == "--bandwidth") {
+            config.bandwidth = parseSize(value);
+        } else if (option == "--bye-every") {
+            config.faults.byeEvery = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (option == "--truncate-every") {
+            config.faults.truncateEvery = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (option == "--cert") {
+            config.certFile = value;
+        } else if (option == "--key") {
+            config.keyFile = value;
+        } else {
+            return (0);
+        }
+
+        return (2);
+
+    }
+
+    const char *serverOptionsHelp() {
+        return ("  --mailboxes name:count[,...]  Synthetic mailboxes (default INBOX:1000)\n"
+                "  --min-size/--median-size/--max-size n[K|M]  Message size distribution\n"
+                "  --sigma s                     Log-normal sigma of message size (default 1.0)\n"
+                "  --latency-ms ms               Delay before each response\n"
+                "  --bandwidth n[K|M]            Per connection send rate in bytes/s\n"
+                "  --cert file [--key file]      PEM certificate (default self-signed)\n"
+                "  --plain                       No TLS\n"
+                "  --bye-every n                 Send BYE and close every n mailbox commands\n"
+                "  --truncate-every n            Close part way through every n-th message\n");
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    FakeIMAPServer::FakeIMAPServer(const ServerConfig& config) : config(config) {
+    }
+
+    FakeIMAPServer::~FakeIMAPServer() {
+
+        stop();
+
+        if (sslContext != nullptr) {
+            SSL_CTX_free(sslContext);
+        }
+
+    }
+
+    //
+    // Create listen socket (localhost only) and start accepting connections.
+    //
+
+    void FakeIMAPServer::start() {
+
+        if (config.bTLS) {
+            createTLSContext();
+        }
+
+        // Clients dropping connections must not kill the process (SSL_write has no MSG_NOSIGNAL)
+
+        ::signal(SIGPIPE, SIG_IGN);
+
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("Could not create listen socket.");
+        }
+
+        int reuseAddress { 1 };
+        ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<std::uint16_t>(config.port));
+
+        if ((::bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) || (::listen(listenFd, 64) != 0)) {
+            ::close(listenFd);
+            listenFd = -1;
+            throw std::runtime_error("Could not listen on port " + std::to_string(config.port) + ": " + std::strerror(errno));
+        }
+
+        socklen_t addressLength { sizeof(address) };
+        ::getsockname(listenFd, reinterpret_cast<sockaddr *>(&address), &addressLength);
+        config.port = ntohs(address.sin_port);
+
+        bRunning = true;
+        acceptThread = std::thread(&FakeIMAPServer::acceptConnections, this);
+
+    }
+
+    //
+    // Stop accepting, disconnect clients and wait for all threads to finish.
+    //
+
+    void FakeIMAPServer::stop() {
+
+        if (!bRunning.exchange(false)) {
+            return;
+        }
+
+        ::shutdown(listenFd, SHUT_RDWR);
+        acceptThread.join();
+        ::close(listenFd);
+        listenFd = -1;
+
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> locker(connectionMutex);
+            for (auto socketFd : connectionFds) {
+                ::shutdown(socketFd, SHUT_RDWR);
+            }
+            threads.swap(connectionThreads);
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+    }
+
+    int FakeIMAPServer::getPort() const {
+        return (config.port);
+    }
+
+    //
+    // Message size drawn from a log-normal distribution around the median and
+    // clipped to [minSize, maxSize]; the same for a given mailbox/UID.
+    //
+
+    std::uint64_t FakeIMAPServer::messageSize(const std::string& mailBox, std::uint64_t uid) const {
+
+        std::mt19937_64 generator { messageSeed(mailBox, uid) };
+        std::normal_distribution<double> normal { 0.0, config.sizeSigma };
+        double size { static_cast<double>(config.medianSize) * std::exp(normal(generator)) };
+
+        size = std::max(size, static_cast<double>(std::max(config.minSize, kMinGeneratedSize)));
+        size = std::min(size, static_cast<double>(std::max(config.maxSize, kMinGeneratedSize)));
+
+        return (static_cast<std::uint64_t>(size));
+
+    }
+
+    //
+    // Generate a plain text RFC 5322 message of exactly messageSize() bytes.
+    //
+
+    std::string FakeIMAPServer::generateMessage(const std::string& mailBox, std::uint64_t uid) const {
+
+        static const std::string kLine { "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor.\r\n" };
+
+        std::uint64_t size { messageSize(mailBox, uid) };
+        std::string message;
+
+        message.reserve(size);
+        message += "From: Sender <" + messageSender(uid) + "@example.com>\r\n";
+        message += "To: Archive <archive@example.com>\r\n";
+        message += "Subject: " + messageSubject(mailBox, uid) + "\r\n";
+        message += "Date: " + messageDate(uid) + "\r\n";
+        message += "Message-ID: <" + std::to_string(uid) + "." + mailBox + "@fakeimap>\r\n";
+        message += "MIME-Version: 1.0\r\nContent-Type: text/plain; charset=us-ascii\r\n\r\n";
+
+        while (message.size() + kLine.size() + 2 <= size) {
+            message += kLine;
+        }
+        if (message.size() + 2 <= size) {
+            message.append(size - message.size() - 2, 'x');
+            message += "\r\n";
+        }
+
+        return (message);
+
+    }
+
+    ServerStatistics FakeIMAPServer::getStatistics() const {
+        std::lock_guard<std::mutex> locker(statisticsMutex);
+        return (statistics);
+    }
+
+    std::vector<CommandRecord> FakeIMAPServer::getCommandRecords() const {
+        std::lock_guard<std::mutex> locker(statisticsMutex);
+        return (commandRecords);
+    }
+
+    std::vector<std::chrono::steady_clock::time_point> FakeIMAPServer::getFaultTimes() const {
+        std::lock_guard<std::mutex> locker(statisticsMutex);
+        return (faultTimes);
+    }
+
+} // namespace FakeIMAP
@@ -0,0 +1,179 @@
+#ifndef FAKEIMAPSERVER_HPP
+#define FAKEIMAPSERVER_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+
+//
+// OpenSSL
+//
+
+#include <openssl/ssl.h>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace FakeIMAP {
+
+    //
+    // Synthetic mailbox
+    //
+
+    struct MailBox {
+        std::string name;                   // Mailbox name
+        std::uint64_t messageCount { 0 };   // Number of messages (UIDs 1..messageCount)
+    };
+
+    //
+    // Protocol level fault injection (byte level faults are injected by FaultProxy).
+    // Counts are over the server lifetime so faults recur across reconnects; 0 disables.
+    //
+
+    struct FaultSchedule {
+        std::uint64_t byeEvery { 0 };       // Send untagged BYE and close every N mailbox commands
+        std::uint64_t truncateEvery { 0 };  // Close part way through every N-th message literal
+    };
+
+    //
+    // Server configuration
+    //
+
+    struct ServerConfig {
+        int port { 0 };                             // Listen port (0 = ephemeral)
+        std::vector<MailBox> mailBoxes;             // Mailboxes served
+        std::uint64_t minSize { 2 * 1024 };         // Smallest message (bytes)
+        std::uint64_t medianSize { 64 * 1024 };     // Median message size (bytes, log-normal)
+        std::uint64_t maxSize { 8 * 1024 * 1024 };  // Largest message (bytes)
+        double sizeSigma { 1.0 };                   // Log-normal sigma
+        std::chrono::microseconds latency { 0 };    // Delay before each tagged response
+        std::uint64_t bandwidth { 0 };              // Per connection send rate (bytes/s, 0 = unlimited)
+        bool bTLS { true };                         // = true IMAPS (self-signed unless cert given)
+        std::string certFile;                       // PEM certificate
+        std::string keyFile;                        // PEM private key
+        FaultSchedule faults;                       // Fault injection
+    };
+
+    //
+    // Parse a server option (--port, --mailboxes, --min-size, --median-size, --max-size,
+    // --sigma, --latency-ms, --bandwidth, --cert, --key, --plain, --bye-every,
+    // --truncate-every) at argv[argumentNo] into
+    // config. Returns the number of arguments consumed (0 = not a server option).
+    //
+
+    int parseServerOption(ServerConfig& config, int argc, char *argv[], int argumentNo);
+
+    //
+    // Help text for the server options.
+    //
+
+    const char *serverOptionsHelp();
+
+    //
+    // Served command record (for latency analysis)
+    //
+
+    struct CommandRecord {
+        std::uint64_t connection { 0 };             // Connection number
+        std::chrono::steady_clock::time_point received; // Time command received
+        std::chrono::steady_clock::time_point sent;     // Time response sent
+        std::string command;                        // Command (tag removed)
+        std::string mailBox;                        // Selected mailbox
+        std::uint64_t uid { 0 };                    // UID of body fetched (BODY[] fetches)
+        std::uint64_t bytes { 0 };                  // Response bytes
+    };
+
+    //
+    // Server statistics
+    //
+
+    struct ServerStatistics {
+        std::uint64_t connections { 0 };
+        std::uint64_t logins { 0 };
+        std::uint64_t commands { 0 };
+        std::uint64_t bytesSent { 0 };
+        std::uint64_t bodiesSent { 0 };
+        std::uint64_t byesInjected { 0 };
+        std::uint64_t truncationsInjected { 0 };
+    };
+
+    //
+    // Minimal IMAP4rev1 server serving synthetic mailboxes. Messages are generated
+    // deterministically from mailbox name and UID so any message served twice has
+    // exactly the same content.
+    //
+
+    class FakeIMAPServer {
+    public:
+
+        explicit FakeIMAPServer(const ServerConfig& config);
+        ~FakeIMAPServer();
+
+        FakeIMAPServer(const FakeIMAPServer&) = delete;
+        FakeIMAPServer& operator=(const FakeIMAPServer&) = delete;
+
+        void start();
+        void stop();
+
+        int getPort() const;
+
+        //
+        // Size of a message / generate a message.
+        //
+
+        std::uint64_t messageSize(const std::string& mailBox, std::uint64_t uid) const;
+        std::string generateMessage(const std::string& mailBox, std::uint64_t uid) const;
+
+        //
+        // Statistics and command records.
+        //
+
+        ServerStatistics getStatistics() const;
+        std::vector<CommandRecord> getCommandRecords() const;
+        std::vector<std::chrono::steady_clock::time_point> getFaultTimes() const;
+
+    private:
+
+        class Session;
+
+        void acceptConnections();
+        void serveConnection(int socketFd, std::uint64_t connectionNo);
+        bool processCommand(Session& session, const std::string& tag, const std::string& command,
+                            std::string& selectedMailBox, CommandRecord& record);
+        bool sendFetch(Session& session, const std::string& mailBox, const std::vector<std::uint64_t>& uids,
+                       const std::string& items, bool bUID, CommandRecord& record);
+        void createTLSContext();
+        void recordCommand(const CommandRecord& record);
+        void recordFault(bool bBye);
+        const MailBox* findMailBox(const std::string& name) const;
+
+        ServerConfig config;
+        int listenFd { -1 };
+        std::atomic<bool> bRunning { false };
+        std::thread acceptThread;
+        std::vector<std::thread> connectionThreads;
+        std::vector<int> connectionFds;
+        std::mutex connectionMutex;
+        SSL_CTX *sslContext { nullptr };
+
+        mutable std::mutex statisticsMutex;
+        ServerStatistics statistics;
+        std::vector<CommandRecord> commandRecords;
+        std::vector<std::chrono::steady_clock::time_point> faultTimes;
+        std::atomic<std::uint64_t> mailBoxCommands { 0 };
+        std::atomic<std::uint64_t> bodyFetches { 0 };
+
+    };
+
+} // namespace FakeIMAP
+#endif /* FAKEIMAPSERVER_HPP */
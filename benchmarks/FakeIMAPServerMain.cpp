@@ -0,0 +1,100 @@
+
+//
+// Program: FakeIMAPServer
+//
+// Description: Run the fake IMAP server stand-alone (for example to point Pendulum or
+// the Qt front end at by hand). It listens on localhost until interrupted and then
+// prints the served command statistics.
+//
+// Usage: FakeIMAPServer [--port n] [server options]
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <cstdlib>
+
+//
+// Linux
+//
+
+#include <signal.h>
+
+//
+// Fake IMAP server
+//
+
+#include "FakeIMAPServer.hpp"
+
+// =======
+// IMPORTS
+// =======
+
+using namespace FakeIMAP;
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    try {
+
+        ServerConfig config;
+
+        config.port = 1993;
+        config.mailBoxes = { { "INBOX", 1000 } };
+
+        for (int argumentNo = 1; argumentNo < argc;) {
+            int consumed { parseServerOption(config, argc, argv, argumentNo) };
+            if (consumed == 0) {
+                std::cerr << "Usage: FakeIMAPServer [--port n] [options]\n" << serverOptionsHelp();
+                return (EXIT_FAILURE);
+            }
+            argumentNo += consumed;
+        }
+
+        // Block SIGINT/SIGTERM in all threads and wait for one here
+
+        sigset_t signalSet;
+        sigemptyset(&signalSet);
+        sigaddset(&signalSet, SIGINT);
+        sigaddset(&signalSet, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signalSet, nullptr);
+
+        FakeIMAPServer server { config };
+
+        server.start();
+
+        std::cout << "Fake IMAP server listening on 127.0.0.1:" << server.getPort()
+                  << (config.bTLS ? " (TLS)" : " (plain)") << std::endl;
+
+        int signalNo { 0 };
+        sigwait(&signalSet, &signalNo);
+
+        server.stop();
+
+        ServerStatistics statistics { server.getStatistics() };
+        std::cout << "Connections = " << statistics.connections << " Logins = " << statistics.logins
+                  << " Commands = " << statistics.commands << " Bodies = " << statistics.bodiesSent
+                  << " Bytes sent = " << statistics.bytesSent << std::endl;
+
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return (EXIT_FAILURE);
+    }
+
+    return (EXIT_SUCCESS);
+
+}
@@ -0,0 +1,363 @@
+
+//
+// Module: FaultProxy
+//
+// Description: Localhost TCP proxy placed between Pendulum and the fake IMAP server by
+// the reconnect recovery benchmarks. Traffic is forwarded unchanged except that on a
+// (jittered, repeatable) schedule the connection is dropped after a number of server
+// bytes (which almost always lands inside a message literal so the client sees a
+// truncated response), dropped once it has been open for a time, or stalled.
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+//
+// Fault proxy
+//
+
+#include "FaultProxy.hpp"
+
+// =========
+// NAMESPACE
+// =========
+
+namespace FakeIMAP {
+
+    // ===============
+    // LOCAL CONSTANTS
+    // ===============
+
+    constexpr std::size_t kForwardBufferSize { 16 * 1024 };
+    constexpr std::uint64_t kNoFault { std::numeric_limits<std::uint64_t>::max() };
+
+    // ===============
+    // LOCAL FUNCTIONS
+    // ===============
+
+    //
+    // Write all of a buffer to a socket.
+    //
+
+    static bool sendAll(int socketFd, const char *buffer, std::size_t length) {
+
+        while (length != 0) {
+            ssize_t bytesSent { ::send(socketFd, buffer, length, MSG_NOSIGNAL) };
+            if (bytesSent <= 0) {
+                return (false);
+            }
+            buffer += bytesSent;
+            length -= static_cast<std::size_t>(bytesSent);
+        }
+
+        return (true);
+
+    }
+
+    //
+    // Connect to localhost port.
+    //
+
+    static int connectUpstream(int port) {
+
+        int socketFd { ::socket(AF_INET, SOCK_STREAM, 0) };
+        sockaddr_in address {};
+
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<std::uint16_t>(port));
+
+        if ((socketFd >= 0) && (::connect(socketFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)) {
+            ::close(socketFd);
+            socketFd = -1;
+        }
+
+        if (socketFd >= 0) {
+            int noDelay { 1 };
+            ::setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+
+        return (socketFd);
+
+    }
+
+    // ===============
+    // PRIVATE METHODS
+    // ===============
+
+    //
+    // Next fault point in bytes: every +/- 50% (xorshift so runs are repeatable).
+    // Called with statisticsMutex held.
+    //
+
+    std::uint64_t FaultProxy::nextFaultPoint(std::uint64_t every) {
+
+        if (every == 0) {
+            return (kNoFault);
+        }
+
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 7;
+        randomState ^= randomState << 17;
+
+        return (statistics.bytesToClient + (every / 2) + (randomState % (every + 1)));
+
+    }
+
+    void FaultProxy::recordFault(bool bDisconnect) {
+
+        if (bDisconnect) {
+            statistics.disconnects++;
+        } else {
+            statistics.stalls++;
+        }
+        faultTimes.push_back(std::chrono::steady_clock::now());
+
+    }
+
+    void FaultProxy::acceptConnections() {
+
+        while (bRunning) {
+            int clientFd { ::accept(listenFd, nullptr, nullptr) };
+            if (clientFd < 0) {
+                if (!bRunning) {
+                    break;
+                }
+                continue;
+            }
+            int noDelay { 1 };
+            ::setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            std::lock_guard<std::mutex> locker(connectionMutex);
+            connectionFds.push_back(clientFd);
+            connectionThreads.emplace_back(&FaultProxy::forwardConnection, this, clientFd);
+        }
+
+    }
+
+    //
+    // Forward traffic between client and server injecting faults.
+    //
+
+    void FaultProxy::forwardConnection(int clientFd) {
+
+        int serverFd { connectUpstream(config.upstreamPort) };
+        auto opened { std::chrono::steady_clock::now() };
+        char buffer[kForwardBufferSize];
+
+        {
+            std::lock_guard<std::mutex> locker(statisticsMutex);
+            statistics.connections++;
+        }
+
+        {
+            std::lock_guard<std::mutex> locker(connectionMutex);
+            if (serverFd >= 0) {
+                connectionFds.push_back(serverFd);
+            }
+        }
+
+        while (bRunning && (serverFd >= 0)) {
+
+            int timeout { -1 };
+            if (config.faults.disconnectEvery.count() != 0) {
+                auto remaining { std::chrono::duration_cast<std::chrono::milliseconds>(
+                        opened + config.faults.disconnectEvery - std::chrono::steady_clock::now()) };
+                if (remaining.count() <= 0) {
+                    std::lock_guard<std::mutex> locker(statisticsMutex);
+                    recordFault(true);
+                    break;
+                }
+                timeout = static_cast<int>(remaining.count());
+            }
+
+            pollfd pollFds[2] { { clientFd, POLLIN, 0 }, { serverFd, POLLIN, 0 } };
+            if (::poll(pollFds, 2, timeout) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+
+            // Client to server (forwarded unchanged)
+
+            if (pollFds[0].revents != 0) {
+                ssize_t bytesRead { ::recv(clientFd, buffer, sizeof(buffer), 0) };
+                if ((bytesRead <= 0) || !sendAll(serverFd, buffer, static_cast<std::size_t>(bytesRead))) {
+                    break;
+                }
+                std::lock_guard<std::mutex> locker(statisticsMutex);
+                statistics.bytesToServer += static_cast<std::uint64_t>(bytesRead);
+            }
+
+            // Server to client (disconnect or stall at scheduled byte positions)
+
+            if (pollFds[1].revents != 0) {
+                ssize_t bytesRead { ::recv(serverFd, buffer, sizeof(buffer), 0) };
+                if (bytesRead <= 0) {
+                    break;
+                }
+                std::size_t offset { 0 }, length { static_cast<std::size_t>(bytesRead) };
+                bool bDisconnect { false };
+                while (offset < length) {
+                    std::size_t forward { length - offset };
+                    bool bStall { false };
+                    {
+                        std::lock_guard<std::mutex> locker(statisticsMutex);
+                        std::uint64_t position { statistics.bytesToClient };
+                        if (nextDisconnect <= position + forward) {
+                            forward = static_cast<std::size_t>(nextDisconnect - std::min(nextDisconnect, position));
+                            bDisconnect = true;
+                        } else if (nextStall <= position + forward) {
+                            forward = static_cast<std::size_t>(nextStall - std::min(nextStall, position));
+                            bStall = true;
+                        }
+                        statistics.bytesToClient += forward;
+                        if (bDisconnect) {
+                            recordFault(true);
+                            nextDisconnect = nextFaultPoint(config.faults.disconnectEveryBytes);
+                        } else if (bStall) {
+                            recordFault(false);
+                            nextStall = nextFaultPoint(config.faults.stallEveryBytes);
+                        }
+                    }
+                    if (!sendAll(clientFd, buffer + offset, forward)) {
+                        bDisconnect = true;
+                    }
+                    if (bDisconnect) {
+                        break;
+                    }
+                    if (bStall) {
+                        std::this_thread::sleep_for(config.faults.stallDuration);
+                    }
+                    offset += forward;
+                }
+                if (bDisconnect) {
+                    break;
+                }
+            }
+
+        }
+
+        std::lock_guard<std::mutex> locker(connectionMutex);
+        for (int socketFd : { clientFd, serverFd }) {
+            if (socketFd >= 0) {
+                connectionFds.erase(std::remove(connectionFds.begin(), connectionFds.end(), socketFd), connectionFds.end());
+                ::close(socketFd);
+            }
+        }
+
+    }
+
+    // ==============
+    // PUBLIC METHODS
+    // ==============
+
+    FaultProxy::FaultProxy(const ProxyConfig& config) : config(config) {
+    }
+
+    FaultProxy::~FaultProxy() {
+        stop();
+    }
+
+    void FaultProxy::start() {
+
+        randomState = (config.faults.seed != 0) ? config.faults.seed : 1;
+        nextDisconnect = nextFaultPoint(config.faults.disconnectEveryBytes);
+        nextStall = nextFaultPoint(config.faults.stallEveryBytes);
+
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("Could not create proxy listen socket.");
+        }
+
+        int reuseAddress { 1 };
+        ::setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+        sockaddr_in address {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<std::uint16_t>(config.port));
+
+        if ((::bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) || (::listen(listenFd, 64) != 0)) {
+            ::close(listenFd);
+            listenFd = -1;
+            throw std::runtime_error("Could not listen on proxy port " + std::to_string(config.port) + ": " + std::strerror(errno));
+        }
+
+        socklen_t addressLength { sizeof(address) };
+        ::getsockname(listenFd, reinterpret_cast<sockaddr *>(&address), &addressLength);
+        config.port = ntohs(address.sin_port);
+
+        bRunning = true;
+        acceptThread = std::thread(&FaultProxy::acceptConnections, this);
+
+    }
+
+    void FaultProxy::stop() {
+
+        if (!bRunning.exchange(false)) {
+            return;
+        }
+
+        ::shutdown(listenFd, SHUT_RDWR);
+        acceptThread.join();
+        ::close(listenFd);
+        listenFd = -1;
+
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> locker(connectionMutex);
+            for (auto socketFd : connectionFds) {
+                ::shutdown(socketFd, SHUT_RDWR);
+            }
+            threads.swap(connectionThreads);
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+    }
+
+    int FaultProxy::getPort() const {
+        return (config.port);
+    }
+
+    ProxyStatistics FaultProxy::getStatistics() const {
+        std::lock_guard<std::mutex> locker(statisticsMutex);
+        return (statistics);
+    }
+
+    std::vector<std::chrono::steady_clock::time_point> FaultProxy::getFaultTimes() const {
+        std::lock_guard<std::mutex> locker(statisticsMutex);
+        return (faultTimes);
+    }
+
+} // namespace FakeIMAP
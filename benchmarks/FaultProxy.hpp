@@ -0,0 +1,106 @@
+#ifndef FAULTPROXY_HPP
+#define FAULTPROXY_HPP
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// =========
+// NAMESPACE
+// =========
+
+namespace FakeIMAP {
+
+    //
+    // Byte level faults. Byte counts are of server to client traffic over the proxy
+    // lifetime (so faults recur across reconnects) and are jittered +/-50% from a
+    // fixed seed so runs are repeatable; 0 disables a fault.
+    //
+
+    struct ProxyFaults {
+        std::uint64_t disconnectEveryBytes { 0 };       // Drop connection (usually mid-literal)
+        std::chrono::milliseconds disconnectEvery { 0 }; // Drop connection after it has been open this long
+        std::uint64_t stallEveryBytes { 0 };            // Stop forwarding ...
+        std::chrono::milliseconds stallDuration { 0 };  // ... for this long
+        std::uint64_t seed { 1 };                       // Jitter seed
+    };
+
+    //
+    // Proxy configuration
+    //
+
+    struct ProxyConfig {
+        int port { 0 };                     // Listen port (0 = ephemeral)
+        int upstreamPort { 0 };             // Server port (localhost)
+        ProxyFaults faults;                 // Faults to inject
+    };
+
+    //
+    // Proxy statistics
+    //
+
+    struct ProxyStatistics {
+        std::uint64_t connections { 0 };
+        std::uint64_t bytesToServer { 0 };
+        std::uint64_t bytesToClient { 0 };
+        std::uint64_t disconnects { 0 };
+        std::uint64_t stalls { 0 };
+    };
+
+    //
+    // TCP proxy between Pendulum and the fake server that injects disconnects
+    // and stalls on a schedule. It works below TLS so it can only break or delay
+    // the stream, not rewrite IMAP responses (see FakeIMAPServer FaultSchedule).
+    //
+
+    class FaultProxy {
+    public:
+
+        explicit FaultProxy(const ProxyConfig& config);
+        ~FaultProxy();
+
+        FaultProxy(const FaultProxy&) = delete;
+        FaultProxy& operator=(const FaultProxy&) = delete;
+
+        void start();
+        void stop();
+
+        int getPort() const;
+
+        ProxyStatistics getStatistics() const;
+        std::vector<std::chrono::steady_clock::time_point> getFaultTimes() const;
+
+    private:
+
+        void acceptConnections();
+        void forwardConnection(int clientFd);
+        std::uint64_t nextFaultPoint(std::uint64_t every);
+        void recordFault(bool bDisconnect);
+
+        ProxyConfig config;
+        int listenFd { -1 };
+        std::atomic<bool> bRunning { false };
+        std::thread acceptThread;
+        std::vector<std::thread> connectionThreads;
+        std::vector<int> connectionFds;
+        std::mutex connectionMutex;
+
+        mutable std::mutex statisticsMutex;
+        ProxyStatistics statistics;
+        std::vector<std::chrono::steady_clock::time_point> faultTimes;
+        std::uint64_t randomState { 0 };
+        std::uint64_t nextDisconnect { 0 };
+        std::uint64_t nextStall { 0 };
+
+    };
+
+} // namespace FakeIMAP
+#endif /* FAULTPROXY_HPP */
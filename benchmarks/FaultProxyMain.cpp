@@ -0,0 +1,122 @@
+
+//
+// Program: FaultProxy
+//
+// Description: Run the fault injection proxy stand-alone in front of any localhost IMAP
+// server (the fake server or a real one tunnelled to localhost) to exercise Pendulum
+// reconnect handling by hand. Runs until interrupted then prints fault statistics.
+//
+// Usage: FaultProxy --upstream-port n [--port n] [--disconnect-bytes n] [--disconnect-ms ms]
+//                   [--stall-bytes n] [--stall-ms ms] [--seed n]
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+//
+// Linux
+//
+
+#include <signal.h>
+
+//
+// Fault proxy
+//
+
+#include "FaultProxy.hpp"
+
+// =======
+// IMPORTS
+// =======
+
+using namespace FakeIMAP;
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    try {
+
+        ProxyConfig config;
+
+        config.port = 1994;
+
+        for (int argumentNo = 1; argumentNo + 1 < argc; argumentNo += 2) {
+            std::string option { argv[argumentNo] };
+            std::uint64_t value { std::strtoull(argv[argumentNo + 1], nullptr, 10) };
+            if (option == "--port") {
+                config.port = static_cast<int>(value);
+            } else if (option == "--upstream-port") {
+                config.upstreamPort = static_cast<int>(value);
+            } else if (option == "--disconnect-bytes") {
+                config.faults.disconnectEveryBytes = value;
+            } else if (option == "--disconnect-ms") {
+                config.faults.disconnectEvery = std::chrono::milliseconds(value);
+            } else if (option == "--stall-bytes") {
+                config.faults.stallEveryBytes = value;
+            } else if (option == "--stall-ms") {
+                config.faults.stallDuration = std::chrono::milliseconds(value);
+            } else if (option == "--seed") {
+                config.faults.seed = value;
+            } else {
+                config.upstreamPort = 0;
+                break;
+            }
+        }
+
+        if ((config.upstreamPort == 0) || ((argc % 2) == 0)) {
+            std::cerr << "Usage: FaultProxy --upstream-port n [--port n] [--disconnect-bytes n] [--disconnect-ms ms]\n"
+                      << "                  [--stall-bytes n] [--stall-ms ms] [--seed n]" << std::endl;
+            return (EXIT_FAILURE);
+        }
+
+        // Block SIGINT/SIGTERM in all threads and wait for one here
+
+        sigset_t signalSet;
+        sigemptyset(&signalSet);
+        sigaddset(&signalSet, SIGINT);
+        sigaddset(&signalSet, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signalSet, nullptr);
+        ::signal(SIGPIPE, SIG_IGN);
+
+        FaultProxy proxy { config };
+
+        proxy.start();
+
+        std::cout << "Fault proxy listening on 127.0.0.1:" << proxy.getPort()
+                  << " forwarding to 127.0.0.1:" << config.upstreamPort << std::endl;
+
+        int signalNo { 0 };
+        sigwait(&signalSet, &signalNo);
+
+        proxy.stop();
+
+        ProxyStatistics statistics { proxy.getStatistics() };
+        std::cout << "Connections = " << statistics.connections << " Disconnects = " << statistics.disconnects
+                  << " Stalls = " << statistics.stalls << " Bytes to client = " << statistics.bytesToClient
+                  << " Bytes to server = " << statistics.bytesToServer << std::endl;
+
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return (EXIT_FAILURE);
+    }
+
+    return (EXIT_SUCCESS);
+
+}
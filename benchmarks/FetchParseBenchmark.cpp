@@ -0,0 +1,151 @@
+
+//
+// Program: FetchParseBenchmark
+//
+// Description: Compare the Antik CIMAPParse FETCH response parser (plus the body copy
+// made by fetchEmailContents) against the Pendulum zero-copy parser on large
+// synthetic FETCH responses. Throughput is reported in MB/s for each body size.
+//
+// Usage: FetchParseBenchmark [iterations]
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CIMAPParse.
+// Pendulum           : Pendulum_ResponseParse.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+
+//
+// Antik Classes
+//
+
+#include "CIMAPParse.hpp"
+
+//
+// Pendulum response parser
+//
+
+#include "Pendulum_ResponseParse.hpp"
+
+// =======
+// IMPORTS
+// =======
+
+using namespace Antik::IMAP;
+
+// ===============
+// LOCAL FUNCTIONS
+// ===============
+
+//
+// Create a synthetic "UID FETCH n (BODY[] BODY[HEADER.FIELDS (SUBJECT)])" response
+// with a body of bodySize bytes.
+//
+
+static std::string createFetchResponse(std::size_t bodySize) {
+
+    std::string body;
+    std::string subject { "Subject: Benchmark message\r\n\r\n" };
+    std::string line { "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod.\r\n" };
+
+    body.reserve(bodySize);
+    while (body.size() + line.size() < bodySize) {
+        body += line;
+    }
+    body.append(bodySize - body.size(), 'x');
+
+    return ("* 1 FETCH (UID 1 BODY[] {" + std::to_string(body.size()) + "}\r\n" + body +
+            " BODY[HEADER.FIELDS (SUBJECT)] {" + std::to_string(subject.size()) + "}\r\n" + subject +
+            ")\r\nA000001 OK UID FETCH completed\r\n");
+
+}
+
+//
+// Time iterations of a parse function and return MB/s.
+//
+
+template <typename ParseFn>
+static double benchmark(const std::string& response, int iterations, ParseFn parseFn) {
+
+    std::size_t checksum { 0 };
+    auto start = std::chrono::steady_clock::now();
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        checksum += parseFn(response);
+    }
+
+    std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+
+    if (checksum == 0) {
+        std::cerr << "Benchmark parse returned no body." << std::endl;
+    }
+
+    return ((static_cast<double>(response.size()) * iterations) / (1024.0 * 1024.0) / elapsed.count());
+
+}
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    int iterations { (argc > 1) ? std::atoi(argv[1]) : 20 };
+
+    std::cout << std::setw(12) << "Body (MB)" << std::setw(16) << "CIMAPParse MB/s" << std::setw(16) << "ZeroCopy MB/s" << std::endl;
+
+    for (std::size_t bodySize : { 1UL << 20, 8UL << 20, 32UL << 20 }) {
+
+        std::string response { createFetchResponse(bodySize) };
+
+        // Existing path: parse into response map then copy body out.
+
+        double existingRate = benchmark(response, iterations, [](const std::string& commandResponse) {
+            std::string emailBody;
+            CIMAPParse::COMMANDRESPONSE parsedResponse { CIMAPParse::parseResponse(commandResponse) };
+            for (auto& fetchEntry : parsedResponse->fetchList) {
+                for (auto& resp : fetchEntry.responseMap) {
+                    if (resp.first.find("BODY[]") == 0) {
+                        emailBody = resp.second;
+                    }
+                }
+            }
+            return (emailBody.size());
+        });
+
+        // Zero-copy path: the response is moved in (the copy here stands in for
+        // the string returned by CIMAP::sendCommand) and the body is a view.
+
+        double zeroCopyRate = benchmark(response, iterations, [](const std::string& commandResponse) {
+            Pendulum_ResponseParse::PARSEDRESPONSE parsedResponse {
+                Pendulum_ResponseParse::parseResponse(std::string(commandResponse))
+            };
+            std::size_t bodySize { 0 };
+            for (auto& fetchEntry : parsedResponse->fetchList) {
+                bodySize += Pendulum_ResponseParse::findFetchItem(fetchEntry, "BODY[]").size();
+            }
+            return (bodySize);
+        });
+
+        std::cout << std::setw(12) << (bodySize >> 20) << std::setw(16) << std::fixed << std::setprecision(1)
+                << existingRate << std::setw(16) << zeroCopyRate << std::endl;
+
+    }
+
+    exit(EXIT_SUCCESS);
+
+}
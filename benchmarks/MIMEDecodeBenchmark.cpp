@@ -0,0 +1,200 @@
+
+//
+// Program: MIMEDecodeBenchmark
+//
+// Description: Measure the throughput (GB/s) of the Pendulum MIME decoders at each
+// SIMD level supported by the CPU, and of subject line decoding against the
+// existing CMIME::convertMIMEStringToASCII plus isalnum() sanitise path.
+//
+// Usage: MIMEDecodeBenchmark [size MB]
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Antik Classes      : CMIME.
+// Pendulum           : Pendulum_MIMEDecode.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+
+//
+// Antik Classes
+//
+
+#include "CMIME.hpp"
+
+//
+// Pendulum MIME decode
+//
+
+#include "Pendulum_MIMEDecode.hpp"
+
+// =======
+// IMPORTS
+// =======
+
+using namespace Antik::File;
+using namespace Pendulum_MIMEDecode;
+
+// ===============
+// LOCAL FUNCTIONS
+// ===============
+
+//
+// Base64 encode data wrapped at 76 characters (as in a MIME body part).
+//
+
+static std::string encodeBase64(const std::string& data) {
+
+    static const char kAlphabet[] { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" };
+    std::string encoded;
+    std::size_t lineLength { 0 };
+
+    for (std::size_t index = 0; index + 3 <= data.size(); index += 3) {
+        std::uint32_t triple = (static_cast<std::uint8_t>(data[index]) << 16) |
+                (static_cast<std::uint8_t>(data[index + 1]) << 8) | static_cast<std::uint8_t>(data[index + 2]);
+        encoded += kAlphabet[(triple >> 18) & 0x3f];
+        encoded += kAlphabet[(triple >> 12) & 0x3f];
+        encoded += kAlphabet[(triple >> 6) & 0x3f];
+        encoded += kAlphabet[triple & 0x3f];
+        if ((lineLength += 4) == 76) {
+            encoded += "\r\n";
+            lineLength = 0;
+        }
+    }
+
+    return (encoded);
+
+}
+
+//
+// Time iterations of a function over size bytes of input and return GB/s.
+//
+
+template <typename BenchFn>
+static double benchmark(std::size_t size, int iterations, BenchFn benchFn) {
+
+    std::size_t checksum { 0 };
+    auto start = std::chrono::steady_clock::now();
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        checksum += benchFn();
+    }
+
+    std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+
+    if (checksum == 0) {
+        std::cerr << "Benchmark produced no output." << std::endl;
+    }
+
+    return ((static_cast<double>(size) * iterations) / 1e9 / elapsed.count());
+
+}
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    std::size_t dataSize { static_cast<std::size_t>((argc > 1) ? std::atoi(argv[1]) : 16) << 20 };
+    const int iterations { 10 };
+    std::mt19937 random { 42 };
+
+    // Test data: binary attachment, mostly ASCII quoted-printable text and subjects.
+
+    std::string binary(dataSize, '\0');
+    for (auto& ch : binary) ch = static_cast<char>(random());
+    std::string base64 { encodeBase64(binary) };
+
+    std::string quotedPrintable;
+    while (quotedPrintable.size() < dataSize) {
+        quotedPrintable += "Caf=C3=A9 society meeting notes, see the attached agenda for details =\r\n";
+        quotedPrintable += "and the minutes of the previous meeting which are plain text.\r\n";
+    }
+
+    std::vector<std::string> subjects;
+    std::size_t subjectBytes { 0 };
+    while (subjectBytes < (dataSize / 16)) {
+        subjects.push_back(" =?UTF-8?B?UmU6IFF1YXJ0ZXJseSByZXBvcnQgLSBGaW5hbmNl?= =?UTF-8?Q?_caf=C3=A9_(draft)?=\r\n");
+        subjectBytes += subjects.back().size();
+    }
+
+    std::cout << std::setw(10) << "SIMD" << std::setw(12) << "Base64" << std::setw(12) << "QP"
+            << std::setw(12) << "Sanitise" << std::setw(12) << "Subject" << "   (GB/s)" << std::endl;
+
+    for (SIMDLevel level : { SIMDLevel::Scalar, SIMDLevel::SSE42, SIMDLevel::AVX2 }) {
+
+        if (static_cast<int>(level) > static_cast<int>(getSupportedSIMDLevel())) {
+            break;
+        }
+
+        setSIMDLevel(level);
+
+        double base64Rate = benchmark(base64.size(), iterations, [&]() {
+            std::string decoded;
+            decodeBase64(base64, decoded);
+            return (decoded.size());
+        });
+
+        double qpRate = benchmark(quotedPrintable.size(), iterations, [&]() {
+            std::string decoded;
+            decodeQuotedPrintable(quotedPrintable, decoded);
+            return (decoded.size());
+        });
+
+        double sanitiseRate = benchmark(quotedPrintable.size(), iterations, [&]() {
+            std::string name { quotedPrintable };
+            sanitiseFileName(name);
+            return (name.size());
+        });
+
+        double subjectRate = benchmark(subjectBytes, iterations, [&]() {
+            std::size_t total { 0 };
+            for (auto& subject : subjects) {
+                std::string decoded { decodeEncodedWords(subject) };
+                sanitiseFileName(decoded);
+                total += decoded.size();
+            }
+            return (total);
+        });
+
+        std::cout << std::setw(10) << getSIMDLevelName(level) << std::fixed << std::setprecision(2)
+                << std::setw(12) << base64Rate << std::setw(12) << qpRate
+                << std::setw(12) << sanitiseRate << std::setw(12) << subjectRate << std::endl;
+
+    }
+
+    // Existing subject path
+
+    double cmimeRate = benchmark(subjectBytes, iterations, [&]() {
+        std::size_t total { 0 };
+        for (auto& subject : subjects) {
+            std::string decoded { CMIME::convertMIMEStringToASCII(subject) };
+            for (auto &ch : decoded) {
+                if (!isalnum(ch)) ch = ' ';
+            }
+            total += decoded.size();
+        }
+        return (total);
+    });
+
+    std::cout << std::setw(10) << "CMIME" << std::setw(48) << std::fixed << std::setprecision(2) << cmimeRate << std::endl;
+
+    exit(EXIT_SUCCESS);
+
+}
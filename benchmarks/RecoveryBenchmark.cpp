@@ -0,0 +1,462 @@
+
+//
+// Program: RecoveryBenchmark
+//
+// Description: Reconnect recovery benchmark. Pendulum is run against the fake IMAP server
+// through the fault proxy under a set of fault scenarios:
+//
+//   baseline          No faults.
+//   disconnect        Connection dropped every --fault-interval messages worth of bytes
+//                     (mid-literal, so the client sees a truncated response).
+//   timed-disconnect  Connection dropped every --fault-period ms.
+//   stall             Server traffic stalled for --stall-ms every --fault-interval messages.
+//   bye               Untagged BYE then close every --fault-interval mailbox commands.
+//   truncate          Connection closed half way through every --fault-interval-th message.
+//
+// For each scenario a single line JSON object is reported with the faults injected,
+// reconnects, time-to-recover (fault to the next message body fetched), bytes sent
+// again for messages already sent (duplicated bytes) and archive correctness: missing,
+// duplicate and wrongly sized .eml files against the messages served.
+//
+// Usage: RecoveryBenchmark [--scenario name,...] [--fault-interval n] [--fault-period ms]
+//                          [--stall-ms ms] [--retry n] [--pendulum path] [--output file]
+//                          [--label name] [--keep] [server options] [-- pendulum options]
+//
+// Dependencies:
+//
+// C11++              : Use of C11++ features.
+// Linux              : Target platform
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <cstdlib>
+
+//
+// Fake IMAP server, fault proxy and benchmark runner
+//
+
+#include "FakeIMAPServer.hpp"
+#include "FaultProxy.hpp"
+#include "BenchmarkRunner.hpp"
+
+// =======
+// IMPORTS
+// =======
+
+using namespace FakeIMAP;
+using namespace BenchmarkRunner;
+
+namespace fs = std::filesystem;
+
+// ===============
+// LOCAL CONSTANTS
+// ===============
+
+#ifndef PENDULUM_BINARY
+#define PENDULUM_BINARY "./Pendulum"
+#endif
+
+constexpr char const *kAllScenarios { "baseline,disconnect,timed-disconnect,stall,bye,truncate" };
+
+// ===============
+// LOCAL FUNCTIONS
+// ===============
+
+//
+// Scenario settings
+//
+
+struct ScenarioSettings {
+    std::uint64_t faultInterval { 100 };                    // Messages (or commands) between faults
+    std::chrono::milliseconds faultPeriod { 2000 };         // Timed disconnect period
+    std::chrono::milliseconds stallDuration { 2000 };       // Stall length
+    int retryCount { 5 };                                   // Pendulum --retry
+};
+
+//
+// Scenario result
+//
+
+struct ScenarioResult {
+    ProcessResult process;
+    std::uint64_t faults { 0 };
+    std::uint64_t reconnects { 0 };
+    std::vector<double> recoveryTimes;
+    std::uint64_t duplicatedBytes { 0 };
+    std::uint64_t duplicatedFetches { 0 };
+    std::uint64_t expectedMessages { 0 };
+    std::uint64_t archivedMessages { 0 };
+    std::uint64_t missingMessages { 0 };
+    std::uint64_t duplicateFiles { 0 };
+    std::uint64_t badSizeFiles { 0 };
+};
+
+//
+// Archive complete and correct ?
+//
+
+static bool isCorrect(const ScenarioResult& result) {
+    return ((result.process.exitStatus == 0) && (result.missingMessages == 0) &&
+            (result.duplicateFiles == 0) && (result.badSizeFiles == 0));
+}
+
+//
+// Configure server/proxy faults for a scenario.
+//
+
+static void configureScenario(const std::string& scenario, const ScenarioSettings& settings,
+                              ServerConfig& serverConfig, ProxyConfig& proxyConfig) {
+
+    serverConfig.faults = FaultSchedule();
+    proxyConfig.faults = ProxyFaults();
+
+    if (scenario == "disconnect") {
+        proxyConfig.faults.disconnectEveryBytes = settings.faultInterval * serverConfig.medianSize;
+    } else if (scenario == "timed-disconnect") {
+        proxyConfig.faults.disconnectEvery = settings.faultPeriod;
+    } else if (scenario == "stall") {
+        proxyConfig.faults.stallEveryBytes = settings.faultInterval * serverConfig.medianSize;
+        proxyConfig.faults.stallDuration = settings.stallDuration;
+    } else if (scenario == "bye") {
+        serverConfig.faults.byeEvery = settings.faultInterval;
+    } else if (scenario == "truncate") {
+        serverConfig.faults.truncateEvery = settings.faultInterval;
+    } else if (scenario != "baseline") {
+        throw std::invalid_argument("Unknown scenario [" + scenario + "].");
+    }
+
+}
+
+//
+// Time from each fault to the next message body fetch received (ms).
+//
+
+static std::vector<double> recoveryTimes(std::vector<std::chrono::steady_clock::time_point> faultTimes,
+                                         const std::vector<CommandRecord>& records) {
+
+    std::vector<std::chrono::steady_clock::time_point> fetchTimes;
+    std::vector<double> recovery;
+
+    for (auto& record : records) {
+        if (record.uid != 0) {
+            fetchTimes.push_back(record.received);
+        }
+    }
+    std::sort(fetchTimes.begin(), fetchTimes.end());
+    std::sort(faultTimes.begin(), faultTimes.end());
+
+    for (auto& faultTime : faultTimes) {
+        auto next { std::upper_bound(fetchTimes.begin(), fetchTimes.end(), faultTime) };
+        if (next != fetchTimes.end()) {
+            recovery.push_back(std::chrono::duration<double, std::milli>(*next - faultTime).count());
+        }
+    }
+
+    std::sort(recovery.begin(), recovery.end());
+
+    return (recovery);
+
+}
+
+//
+// Bytes (and fetches) of message bodies sent more than once; the largest response
+// for a message counts as its one necessary transfer.
+//
+
+static void duplicatedTransfers(const std::vector<CommandRecord>& records, ScenarioResult& result) {
+
+    std::map<std::pair<std::string, std::uint64_t>, std::pair<std::uint64_t, std::uint64_t>> transfers; // total, largest
+    std::uint64_t fetches { 0 };
+
+    for (auto& record : records) {
+        if (record.uid != 0) {
+            auto& transfer { transfers[{ record.mailBox, record.uid }] };
+            transfer.first += record.bytes;
+            transfer.second = std::max(transfer.second, record.bytes);
+            fetches++;
+        }
+    }
+
+    for (auto& transfer : transfers) {
+        result.duplicatedBytes += transfer.second.first - transfer.second.second;
+    }
+    result.duplicatedFetches = fetches - transfers.size();
+
+}
+
+//
+// Check archive against messages served: every UID present once and the right size.
+//
+
+static void checkArchive(const FakeIMAPServer& server, const ServerConfig& config, const ArchiveContents& archive,
+                         ScenarioResult& result) {
+
+    result.archivedMessages = archive.messages;
+
+    for (auto& mailBox : config.mailBoxes) {
+
+        result.expectedMessages += mailBox.messageCount;
+
+        auto folder { archive.files.find(mailBox.name) };
+        if (folder == archive.files.end()) {
+            result.missingMessages += mailBox.messageCount;
+            continue;
+        }
+
+        std::uint64_t previousUID { 0 }, present { 0 };
+        for (auto& file : folder->second) {
+            if (file.uid == previousUID) {
+                result.duplicateFiles++;
+                continue;
+            }
+            previousUID = file.uid;
+            if ((file.uid >= 1) && (file.uid <= mailBox.messageCount)) {
+                present++;
+                if (file.size != server.messageSize(mailBox.name, file.uid)) {
+                    result.badSizeFiles++;
+                }
+            }
+        }
+        result.missingMessages += mailBox.messageCount - present;
+
+    }
+
+}
+
+//
+// Run one scenario.
+//
+
+static ScenarioResult runScenario(const std::string& scenario, const ScenarioSettings& settings, ServerConfig serverConfig,
+                                  const std::string& pendulum, const std::vector<std::string>& extraArguments, bool bKeep) {
+
+    ScenarioResult result;
+    ProxyConfig proxyConfig;
+
+    configureScenario(scenario, settings, serverConfig, proxyConfig);
+
+    fs::path runFolder { createRunFolder() };
+    fs::path destination { runFolder / "archive" };
+    fs::create_directory(destination);
+
+    FakeIMAPServer server { serverConfig };
+    server.start();
+
+    proxyConfig.upstreamPort = server.getPort();
+    FaultProxy proxy { proxyConfig };
+    proxy.start();
+
+    std::string mailBoxList;
+    for (auto& mailBox : serverConfig.mailBoxes) {
+        mailBoxList += (mailBoxList.empty() ? "" : ",") + mailBox.name;
+    }
+
+    std::vector<std::string> arguments { "--server", "127.0.0.1:" + std::to_string(proxy.getPort()),
+                                         "--user", "benchmark", "--password", "benchmark",
+                                         "--mailbox", mailBoxList, "--destination", destination.string(),
+                                         "--retry", std::to_string(settings.retryCount) };
+    arguments.insert(arguments.end(), extraArguments.begin(), extraArguments.end());
+
+    result.process = runPendulum(pendulum, arguments, (runFolder / "pendulum.log").string());
+
+    proxy.stop();
+    server.stop();
+
+    std::vector<CommandRecord> records { server.getCommandRecords() };
+    std::vector<std::chrono::steady_clock::time_point> faultTimes { server.getFaultTimes() };
+    for (auto& faultTime : proxy.getFaultTimes()) {
+        faultTimes.push_back(faultTime);
+    }
+
+    result.faults = faultTimes.size();
+    result.reconnects = (server.getStatistics().connections > 0) ? server.getStatistics().connections - 1 : 0;
+    result.recoveryTimes = recoveryTimes(faultTimes, records);
+    duplicatedTransfers(records, result);
+    checkArchive(server, serverConfig, scanArchive(destination.string()), result);
+
+    if (!isCorrect(result)) {
+        std::cerr << "Scenario [" << scenario << "] incorrect; see " << (runFolder / "pendulum.log").string() << std::endl;
+    } else if (!bKeep) {
+        fs::remove_all(runFolder);
+    }
+
+    return (result);
+
+}
+
+//
+// Format a scenario result as a single line JSON object.
+//
+
+static std::string formatResult(const std::string& label, const std::string& scenario, const ServerConfig& config,
+                                const ScenarioSettings& settings, const ScenarioResult& result) {
+
+    std::ostringstream json;
+    double seconds { std::max(result.process.seconds, 1e-9) };
+    double meanRecovery { 0.0 };
+
+    for (auto recovery : result.recoveryTimes) {
+        meanRecovery += recovery / static_cast<double>(result.recoveryTimes.size());
+    }
+
+    json << std::fixed << std::setprecision(3);
+    json << "{\"benchmark\":\"recovery\",\"label\":" << jsonEscape(label) << ",\"timestamp\":" << jsonTimeStamp()
+         << ",\"scenario\":" << jsonEscape(scenario);
+
+    json << ",\"config\":{\"messages\":" << std::accumulate(config.mailBoxes.begin(), config.mailBoxes.end(), std::uint64_t { 0 },
+            [] (std::uint64_t total, const MailBox& mailBox) { return (total + mailBox.messageCount); })
+         << ",\"median_size\":" << config.medianSize << ",\"latency_ms\":" << (config.latency.count() / 1000.0)
+         << ",\"fault_interval\":" << settings.faultInterval << ",\"fault_period_ms\":" << settings.faultPeriod.count()
+         << ",\"stall_ms\":" << settings.stallDuration.count() << ",\"retry\":" << settings.retryCount << "}";
+
+    json << ",\"results\":{\"exit_status\":" << result.process.exitStatus
+         << ",\"seconds\":" << result.process.seconds
+         << ",\"messages_per_second\":" << (static_cast<double>(result.archivedMessages) / seconds)
+         << ",\"faults\":" << result.faults
+         << ",\"reconnects\":" << result.reconnects
+         << ",\"time_to_recover_ms\":{\"mean\":" << meanRecovery
+         << ",\"p50\":" << percentile(result.recoveryTimes, 50.0)
+         << ",\"max\":" << (result.recoveryTimes.empty() ? 0.0 : result.recoveryTimes.back()) << "}"
+         << ",\"duplicated_bytes\":" << result.duplicatedBytes
+         << ",\"duplicated_fetches\":" << result.duplicatedFetches
+         << ",\"expected_messages\":" << result.expectedMessages
+         << ",\"archived_messages\":" << result.archivedMessages
+         << ",\"missing\":" << result.missingMessages
+         << ",\"duplicates\":" << result.duplicateFiles
+         << ",\"bad_size\":" << result.badSizeFiles
+         << ",\"correct\":" << (isCorrect(result) ? "true" : "false")
+         << ",\"peak_rss_kb\":" << result.process.peakRSSKB << "}}";
+
+    return (json.str());
+
+}
+
+//
+// Print usage.
+//
+
+static void usage() {
+
+    std::cerr << "Usage: RecoveryBenchmark [options] [server options] [-- pendulum options]\n"
+              << "  --scenario name[,...]         Scenarios (default " << kAllScenarios << ")\n"
+              << "  --fault-interval n            Messages/commands between faults (default 100)\n"
+              << "  --fault-period ms             Timed disconnect period (default 2000)\n"
+              << "  --stall-ms ms                 Stall length (default 2000)\n"
+              << "  --retry n                     Pendulum reconnect retry count (default 5)\n"
+              << "  --pendulum path               Pendulum binary (default " << PENDULUM_BINARY << ")\n"
+              << "  --output file                 Append JSON results to file (default stdout)\n"
+              << "  --label name                  Label recorded with the results\n"
+              << "  --keep                        Keep archive/log folders\n"
+              << serverOptionsHelp();
+
+}
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    try {
+
+        ServerConfig config;
+        ScenarioSettings settings;
+        std::string pendulum { PENDULUM_BINARY };
+        std::string scenarioList { kAllScenarios };
+        std::string outputFile;
+        std::string label { "default" };
+        std::vector<std::string> extraArguments;
+        bool bKeep { false };
+
+        config.mailBoxes = { { "INBOX", 1000 } };
+
+        for (int argumentNo = 1; argumentNo < argc;) {
+            std::string option { argv[argumentNo] };
+            int consumed { parseServerOption(config, argc, argv, argumentNo) };
+            if (consumed != 0) {
+                argumentNo += consumed;
+                continue;
+            }
+            if (option == "--") {
+                extraArguments.assign(argv + argumentNo + 1, argv + argc);
+                break;
+            }
+            if (option == "--keep") {
+                bKeep = true;
+                argumentNo++;
+                continue;
+            }
+            if (argumentNo + 1 >= argc) {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            std::string value { argv[argumentNo + 1] };
+            if (option == "--scenario") {
+                scenarioList = value;
+            } else if (option == "--fault-interval") {
+                settings.faultInterval = std::max<std::uint64_t>(1, std::strtoull(value.c_str(), nullptr, 10));
+            } else if (option == "--fault-period") {
+                settings.faultPeriod = std::chrono::milliseconds(std::atol(value.c_str()));
+            } else if (option == "--stall-ms") {
+                settings.stallDuration = std::chrono::milliseconds(std::atol(value.c_str()));
+            } else if (option == "--retry") {
+                settings.retryCount = std::atoi(value.c_str());
+            } else if (option == "--pendulum") {
+                pendulum = value;
+            } else if (option == "--output") {
+                outputFile = value;
+            } else if (option == "--label") {
+                label = value;
+            } else {
+                usage();
+                return (EXIT_FAILURE);
+            }
+            argumentNo += 2;
+        }
+
+        int incorrectScenarios { 0 };
+
+        std::istringstream scenarioStream { scenarioList };
+        for (std::string scenario; std::getline(scenarioStream, scenario, ',');) {
+
+            ScenarioResult result { runScenario(scenario, settings, config, pendulum, extraArguments, bKeep) };
+
+            std::string json { formatResult(label, scenario, config, settings, result) };
+            if (outputFile.empty()) {
+                std::cout << json << std::endl;
+            } else {
+                std::ofstream output { outputFile, std::ios::app };
+                output << json << std::endl;
+                std::cerr << "Scenario [" << scenario << "]: " << result.faults << " faults, "
+                          << result.archivedMessages << "/" << result.expectedMessages << " messages." << std::endl;
+            }
+
+            if (!isCorrect(result)) {
+                incorrectScenarios++;
+            }
+
+        }
+
+        return ((incorrectScenarios == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return (EXIT_FAILURE);
+    }
+
+}